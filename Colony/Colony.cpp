@@ -23,6 +23,29 @@
 // Toggle rendering              - K
 // Toggle HUD display            - H
 // Toggle computing while render - M
+// Start/stop trace recording    - L
+// Toggle perf counters in HUD   - I
+// Start/stop frame time log     - G
+// Save snapshot                 - N
+// Restore snapshot              - B
+// Start/stop trajectory record  - V
+//
+// Command line:
+// -pinworkers   Pin each TaskMgr worker to its own core
+// -trace        Record a trace from startup, stopped by L
+// -framelog     Log frame times from startup, stopped by G
+// -framelogjson As -framelog, to JSON instead of CSV
+// -trajectory   Record unit trajectories from startup, stopped by V
+// -stats        Publish live stats to the ColonyStats shared memory segment
+//
+// Traces are written to Colony.trace.json and open in chrome://tracing or
+// the Perfetto UI.  Frame logs are written to Colony.frames.csv, or
+// Colony.frames.json, with one row of microsecond times per frame.
+// Snapshots of the world and units are saved to Colony.snapshot; restoring
+// one maps the file and copies it back over the game.  Unit trajectories
+// are written to Colony.trajectory, delta encoded on a background thread;
+// TrajectoryReader reads them back.  Live stats are copied to shared memory
+// once a frame, for ColonyStats or another tool to watch.
 //
 // Mouse:
 // Move camera              - Hold left button
@@ -37,6 +60,13 @@
 #include "Render.h"
 #include "Game.h"
 #include "TaskMgrTBB.h"
+#include "FrameArena.h"
+#include "TraceRecorder.h"
+#include "PerfCounters.h"
+#include "FrameStats.h"
+#include "TrajectoryRecorder.h"
+#include "StatsSegment.h"
+#include "CPUUsage.h"
 
 //--------------------------------------------------------------------------------------
 // Variable declarations
@@ -57,6 +87,18 @@ bool                        g_bComputeAcrossFrames = true;
 bool                        g_bStaticUnitCount = false;
 bool                        g_bRenderTrees = true;
 
+static const char*          g_szTraceFileName = "Colony.trace.json";
+static const char*          g_szFrameLogFileName = "Colony.frames.csv";
+static const char*          g_szFrameLogJsonFileName = "Colony.frames.json";
+static const char*          g_szSnapshotFileName = "Colony.snapshot";
+static const char*          g_szTrajectoryFileName = "Colony.trajectory";
+static const char*          g_szStatsSegmentName = "ColonyStats";
+
+StatsPublisher              g_StatsPublisher;
+StatsBlock                  g_Stats;
+CPUUsage*                   g_pCPUUsage = 0;
+std::vector<double>         g_CpuPercent;
+
 int                         g_nStaticUnitCount = false;
 
 typedef struct _PER_FRAME_CB
@@ -185,6 +227,42 @@ HRESULT CALLBACK OnD3D11ResizedSwapChain( ID3D11Device* pd3dDevice,
     return S_OK;
 }
 
+//--------------------------------------------------------------------------------------
+// Copy this frame's stats to the shared memory segment
+//--------------------------------------------------------------------------------------
+void PublishStats( float fElapsedTime )
+{
+    g_Stats.nFlags = ( g_bUseSIMD ? StatsBlock::FlagSIMD : 0 ) |
+                     ( g_bThreaded ? StatsBlock::FlagThreaded : 0 ) |
+                     ( g_bPaused ? StatsBlock::FlagPaused : 0 );
+    ++g_Stats.nFrame;
+    g_Stats.nTimeUs = FrameStats::GetTimeUs();
+    g_Stats.nUnits = g_Game.GetUnitManager()->GetNumUnits();
+    g_Stats.nResets = g_Game.GetResetCount();
+    g_Stats.fCoverage = g_Game.GetCoverage();
+    g_Stats.fFrameMs = fElapsedTime * 1000.0f;
+
+    // The series names never change, they were copied when publishing began
+    for( unsigned int nSeries = 0; nSeries < g_Stats.nSeries; ++nSeries )
+    {
+        FrameStats::Summary Summary = gFrameStats.GetSummary( nSeries );
+        g_Stats.fSeriesMs[ nSeries ] = gFrameStats.GetLastTime( nSeries ) / 1000.0f;
+        g_Stats.fSeriesP50Ms[ nSeries ] = Summary.nP50 / 1000.0f;
+        g_Stats.fSeriesP99Ms[ nSeries ] = Summary.nP99 / 1000.0f;
+        g_Stats.fSeriesMaxMs[ nSeries ] = Summary.nMax / 1000.0f;
+    }
+
+    // CPUUsage only queries the counters a few times a second
+    g_pCPUUsage->UpdatePeriodicData();
+    g_pCPUUsage->getCPUCounters( &g_CpuPercent[0] );
+    for( unsigned int nCpu = 0; nCpu < g_Stats.nCpus; ++nCpu )
+    {
+        g_Stats.fCpuPercent[ nCpu ] = ( float )g_CpuPercent[ nCpu ];
+    }
+
+    g_StatsPublisher.Publish( g_Stats );
+}
+
 //--------------------------------------------------------------------------------------
 // Handle updates to the scene.  This is called regardless of which D3D API is used
 //--------------------------------------------------------------------------------------
@@ -194,6 +272,29 @@ void CALLBACK OnFrameMove( double fTime,
 {
     g_Camera.FrameMove( fElapsedTime );
 
+    // Last frame's tasks have to finish before its scratch memory is reused
+    {
+        FrameStatsScope Stats( FrameSeriesWait );
+        g_Game.GetUnitManager()->StopWork();
+    }
+    gFrameArena.Reset();
+
+    // Record the frame the units just finished
+    if( gTrajectoryRecorder.IsRecording() )
+    {
+        g_Game.GetUnitManager()->RecordTrajectory( gTrajectoryRecorder );
+    }
+    gPerfCounters.EndFrame();
+
+    // The elapsed time is the length of the frame that just ended
+    gFrameStats.AddTime( FrameSeriesFrame, ( unsigned int )( fElapsedTime * 1000000.0f ) );
+    gFrameStats.EndFrame();
+
+    if( g_StatsPublisher.IsCreated() )
+    {
+        PublishStats( fElapsedTime );
+    }
+
     if( !g_bPaused )
     {
         if( !g_bStaticUnitCount )
@@ -218,6 +319,7 @@ void CALLBACK OnFrameMove( double fTime,
         }
 
         // Perform game updating
+        FrameStatsScope Stats( FrameSeriesUpdate );
         g_Game.Update( ( float )fTime, fElapsedTime );
 
     }
@@ -258,14 +360,14 @@ void CALLBACK OnD3D11FrameRender( ID3D11Device* pd3dDevice,
 
 
     // Update the renderer
-    Render::SetCamera( XMVectorSet( g_Camera.GetEyePt()->x, g_Camera.GetEyePt()->y, g_Camera.GetEyePt()->z, 1.0f ),
-                       XMVectorSet( g_Camera.GetWorldAhead()->x, g_Camera.GetWorldAhead()->y,
-                                    g_Camera.GetWorldAhead()->z, 1.0f ) );
+    Render::SetCamera( XMLoadFloat4x4( ( const XMFLOAT4X4* )&mViewProj ) );
 
     // Render the game
     if( g_bRender )
     {
         // Render the game
+        FrameStatsScope Stats( FrameSeriesRender );
+        Render::ResetStats();
         g_Game.Render();
     }
 
@@ -283,10 +385,49 @@ void CALLBACK OnD3D11FrameRender( ID3D11Device* pd3dDevice,
         g_pTextWriter->DrawFormattedTextLine( L"Frame time: %3.2f ms", fElapsedTime * 1000.0f );
         g_pTextWriter->DrawFormattedTextLine( L"Units: %d", g_Game.GetUnitManager()->GetNumUnits() );
         g_pTextWriter->DrawFormattedTextLine( L"Progress: %3.2f%%", g_Game.GetCoverage() * 100.0f );
+        g_pTextWriter->DrawFormattedTextLine( L"Frame arena: %u KB, %u heap allocs", 
+                                              ( unsigned int )( gFrameArena.GetFramePeakBytes() / 1024 ),
+                                              gFrameArena.GetFrameHeapAllocations() );
+        const RenderDevice::Stats& RenderStats = Render::GetStats();
+        g_pTextWriter->DrawFormattedTextLine( L"Draws: %u, %u state changes, %u shader changes, %u KB uploaded",
+                                              RenderStats.nDraws, RenderStats.nStateChanges,
+                                              RenderStats.nShaderChanges,
+                                              ( unsigned int )( RenderStats.nBytesUploaded / 1024 ) );
         g_pTextWriter->DrawFormattedTextLine( L"[C] SIMD: %d", g_bUseSIMD ? 1 : 0 );
         g_pTextWriter->DrawFormattedTextLine( L"[T] TBB: %d", g_bThreaded ? 1 : 0 );
         g_pTextWriter->DrawFormattedTextLine( L"[M] Compute across frames: %d", g_bComputeAcrossFrames ? 1 : 0 );
         g_pTextWriter->DrawFormattedTextLine( L"[U] Static unit count: %d", g_bStaticUnitCount ? 1 : 0 );
+        g_pTextWriter->DrawFormattedTextLine( L"[L] Trace: %d", gTraceRecorder.IsRecording() ? 1 : 0 );
+        g_pTextWriter->DrawFormattedTextLine( L"[I] Perf counters: %d", gPerfCounters.IsEnabled() ? 1 : 0 );
+        g_pTextWriter->DrawFormattedTextLine( L"[G] Frame log: %d", gFrameStats.IsLogging() ? 1 : 0 );
+
+        // Percentiles over the last few seconds; hitches show in p99 and max
+        for( unsigned int nSeries = 0; nSeries < gFrameStats.GetSeriesCount(); ++nSeries )
+        {
+            FrameStats::Summary Summary = gFrameStats.GetSummary( nSeries );
+            g_pTextWriter->DrawFormattedTextLine( L"  %S: p50 %.2f  p90 %.2f  p99 %.2f  max %.2f ms",
+                                                  gFrameStats.GetSeriesName( nSeries ),
+                                                  Summary.nP50 / 1000.0f,
+                                                  Summary.nP90 / 1000.0f,
+                                                  Summary.nP99 / 1000.0f,
+                                                  Summary.nMax / 1000.0f );
+        }
+
+        // Per unit costs of each simulation phase over the last frame; only
+        //   cycles are available on Windows
+        if( gPerfCounters.IsEnabled() )
+        {
+            for( unsigned int nPhase = 0; nPhase < gPerfCounters.GetPhaseCount(); ++nPhase )
+            {
+                const PerfCounters::Sample& Sample = gPerfCounters.GetFrameSample( nPhase );
+                g_pTextWriter->DrawFormattedTextLine( L"  %S: %.0f cycles/unit, IPC %.2f, LLC %.2f/unit, %.0f B/unit",
+                                                      gPerfCounters.GetPhaseName( nPhase ),
+                                                      Sample.GetPerUnit( PerfCounters::Cycles ),
+                                                      Sample.GetIPC(),
+                                                      Sample.GetPerUnit( PerfCounters::LLCMisses ),
+                                                      Sample.GetBytesPerUnit() );
+            }
+        }
         g_pTextWriter->End();
     }
 }
@@ -385,6 +526,58 @@ void CALLBACK OnKeyboard( UINT nChar,
                 g_bComputeAcrossFrames = !g_bComputeAcrossFrames;
                 break;
             }
+        case 'I':
+            {
+                gPerfCounters.SetEnabled( !gPerfCounters.IsEnabled() );
+                break;
+            }
+        case 'L':
+            {
+                if( gTraceRecorder.IsRecording() )
+                {
+                    gTraceRecorder.Stop();
+                }
+                else
+                {
+                    gTraceRecorder.Start( g_szTraceFileName );
+                }
+                break;
+            }
+        case 'G':
+            {
+                if( gFrameStats.IsLogging() )
+                {
+                    gFrameStats.StopLog();
+                }
+                else
+                {
+                    gFrameStats.StartLog( g_szFrameLogFileName );
+                }
+                break;
+            }
+        case 'N':
+            {
+                g_Game.SaveSnapshot( g_szSnapshotFileName );
+                break;
+            }
+        case 'V':
+            {
+                if( gTrajectoryRecorder.IsRecording() )
+                {
+                    gTrajectoryRecorder.Stop();
+                }
+                else
+                {
+                    gTrajectoryRecorder.Start( g_szTrajectoryFileName, gs_nMaxUnits, gs_fTrajectoryStep );
+                }
+                break;
+            }
+        case 'B':
+            {
+                // A missing or stale snapshot leaves the game running as it was
+                g_Game.LoadSnapshot( g_szSnapshotFileName );
+                break;
+            }
         }
     }
     else // if( !bKeyDown )
@@ -460,23 +653,74 @@ int WINAPI wWinMain( HINSTANCE hInstance,
     DXUTSetCursorSettings( true, true ); // Show the cursor and clip it when in full screen
     DXUTCreateWindow( L"Colony" );
 
+    // Start the task manager, the game uses it while the device is created
+    gTaskMgr.mbPinWorkerThreads = ( wcsstr( lpCmdLine, L"-pinworkers" ) != NULL );
+    gTaskMgr.Init();
+    gFrameArena.Init( gs_nMaxThreadCount, gs_nArenaContextSize );
+    gPerfCounters.Init( gs_nMaxThreadCount, UnitManager::s_szPhaseNames, UnitManager::PhaseCount );
+    gFrameStats.Init( g_szFrameSeriesNames, FrameSeriesCount, gs_nFrameStatsWindow );
+
+    if( wcsstr( lpCmdLine, L"-trace" ) != NULL )
+    {
+        gTraceRecorder.Start( g_szTraceFileName );
+    }
+
+    if( wcsstr( lpCmdLine, L"-trajectory" ) != NULL )
+    {
+        gTrajectoryRecorder.Start( g_szTrajectoryFileName, gs_nMaxUnits, gs_fTrajectoryStep );
+    }
+
+    if( wcsstr( lpCmdLine, L"-stats" ) != NULL && g_StatsPublisher.Create( g_szStatsSegmentName ) )
+    {
+        g_pCPUUsage = new CPUUsage();
+        g_CpuPercent.resize( g_pCPUUsage->getNumCounters() + 1 );
+
+        memset( &g_Stats, 0, sizeof( g_Stats ) );
+        g_Stats.nSeries = min( gFrameStats.GetSeriesCount(), StatsBlock::MaxSeries );
+        g_Stats.nCpus = min( g_pCPUUsage->getNumCounters(), StatsBlock::MaxCpus );
+        for( unsigned int nSeries = 0; nSeries < g_Stats.nSeries; ++nSeries )
+        {
+            strncpy_s( g_Stats.szSeriesNames[ nSeries ], StatsBlock::SeriesNameLength,
+                       gFrameStats.GetSeriesName( nSeries ), _TRUNCATE );
+        }
+    }
+
+    if( wcsstr( lpCmdLine, L"-framelogjson" ) != NULL )
+    {
+        gFrameStats.StartLog( g_szFrameLogJsonFileName );
+    }
+    else if( wcsstr( lpCmdLine, L"-framelog" ) != NULL )
+    {
+        gFrameStats.StartLog( g_szFrameLogFileName );
+    }
+
     // Only require 10-level hardware
     HRESULT hr = DXUTCreateDevice( D3D_FEATURE_LEVEL_10_0, true, 1024, 768 );
     if( FAILED( hr ) || DXUTGetDeviceSettings().ver == DXUT_D3D9_DEVICE )
     {
         MessageBox( 0, L"Colony requres at least Windows Vista with a Direct3D 10 capable GPU.", L"Failure", 0 );
         DXUTShutdown();
+        gTaskMgr.Shutdown();
+        gFrameArena.Shutdown();
+        gPerfCounters.Shutdown();
+        gFrameStats.Shutdown();
+        g_StatsPublisher.Destroy();
+        delete g_pCPUUsage;
         return 0;
     }
 
-    // Start the task manager
-    gTaskMgr.Init();
-
     DXUTMainLoop(); // Enter into the DXUT render loop
 
     // Stop the task manager
     g_Game.GetUnitManager()->StopWork();
+    gTraceRecorder.Stop();
+    gTrajectoryRecorder.Stop();
     gTaskMgr.Shutdown();
+    gFrameArena.Shutdown();
+    gPerfCounters.Shutdown();
+    gFrameStats.Shutdown();
+    g_StatsPublisher.Destroy();
+    delete g_pCPUUsage;
 
     // Clean up the renderer
     Render::Destroy();
@@ -49,7 +49,7 @@ __inline __m128 SSEDotProduct( const __m128& fX1,
                                const __m128& fX2,
                                const __m128& fY2 )
 {
-    return _mm_add_ps( _mm_mul_ps( fX1, fX2 ), _mm_mul_ps( fY2, fY2 ) );
+    return _mm_add_ps( _mm_mul_ps( fX1, fX2 ), _mm_mul_ps( fY1, fY2 ) );
 }
 __inline __m128 SSECircleRayCollision( const __m128& fRayVertexX,
                                        const __m128& fRayVertexY,
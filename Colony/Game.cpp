@@ -13,13 +13,32 @@
 // responsibility to update it.
 #include "Game.h"
 #include "Render.h"
+#include "FrameStats.h"
+#include "SnapshotFile.h"
 #include <intrin.h>
 
 extern bool g_bRenderTrees;
 
+// Colour of an active tile paved with a factory instead of concrete
+static const unsigned char gs_nNoPaving = 0xFF;
+
+const char* const g_szFrameSeriesNames[ FrameSeriesCount ] =
+{
+    "Frame",
+    "Update",
+    "Wait",
+    "Render",
+    "FillBins",
+    "CalculateDirection",
+    "UpdateUnits",
+};
+
 Game::Game( void ) : m_fCoverageThreshold( 0.0f ),
                      m_fCoverage( 0.0f ),
-                     m_nNumInactiveTiles( 0 ) {}
+                     m_nNumInactiveTiles( 0 ),
+                     m_nTileDeviceGeneration( 0 ),
+                     m_nTreeDeviceGeneration( 0 ),
+                     m_nResetCount( 0 ) {}
 
 Game::~Game( void ) {}
 
@@ -73,23 +92,22 @@ void Game::Update( float fTime,
 
 void Game::Reset( void )
 {
-    // Stop the unit manager
-    m_UnitManager.StopWork();
+    // Stop the unit manager, the in-flight update is discarded anyway
+    m_UnitManager.CancelWork();
+
+    // Resets rebuild the world and hitch; tag the frame in the frame log
+    gFrameStats.MarkFrame( "Reset" );
+    ++m_nResetCount;
 
     // Zero the inactive tiles array
     ZeroMemory( m_pInactiveTiles, sizeof( m_pInactiveTiles ) );
     m_nNumInactiveTiles = 0;
+    m_nNumActiveTiles = 0;
     m_nNumActiveFactories = 0;
     m_nNumActiveTrees = 0;
-    m_nNumActiveTilesRed = 0;
-	m_nNumActiveTilesBlue = 0;
-	m_nNumActiveTilesGreen = 0;
-	m_nNumActiveTilesPurple = 0;
-	m_nNumActiveTilesYellow = 0;
-	m_nNumActiveTilesCyan = 0;
-	m_nNumActiveTilesBlack = 0;
     m_nNumInactiveTrees = 0;
     m_fCoverage = 0.0f;
+    MarkAllTilesDirty();
 
     // Reset the tiles
     for( unsigned int x = 0; x < gs_nWorldSize; ++x )
@@ -101,6 +119,7 @@ void Game::Reset( void )
             m_pTiles[nIndex].fTimer = gs_fTileTime;
             m_pTiles[nIndex].bFactory = false;
             m_pTiles[nIndex].nTree = -1;
+            m_pTileColors[nIndex] = gs_nNoPaving;
             m_pInactiveTiles[m_nNumInactiveTiles++] = nIndex;
 
             if( !( rand() % gs_nTreeGranularity ) && m_nNumActiveTrees < gs_nTreeCount )
@@ -151,49 +170,43 @@ void Game::Reset( void )
         m_pFactories[i] = nIndex;
     }
 
+    // The trees stay put until paved over, so they are sorted into
+    //   hierarchies once here and uploaded once
+    BuildTreeHierarchies();
+
     // Reset the unit manager
     m_UnitManager.Reset();
 }
 
 void Game::Render( void )
 {
-    // Factories
-    Render::DrawInstanced( &m_pFactoryMatrices[0], FACTORY_MESH, 1, true, true, ColorFilter::WHITE);
-	Render::DrawInstanced( &m_pFactoryMatrices[1], FACTORY_MESH, 1, true, true, ColorFilter::RED);
-	Render::DrawInstanced( &m_pFactoryMatrices[2], FACTORY_MESH, 1, true, true, ColorFilter::BLUE);
-	Render::DrawInstanced( &m_pFactoryMatrices[3], FACTORY_MESH, 1, true, true, ColorFilter::GREEN);
-	Render::DrawInstanced( &m_pFactoryMatrices[4], FACTORY_MESH, 1, true, true, ColorFilter::PURPLE);
-	Render::DrawInstanced( &m_pFactoryMatrices[5], FACTORY_MESH, 1, true, true, ColorFilter::YELLOW);
-	Render::DrawInstanced( &m_pFactoryMatrices[6], FACTORY_MESH, 1, true, true, ColorFilter::CYAN);
-	Render::DrawInstanced( &m_pFactoryMatrices[7], FACTORY_MESH, 1, true, true, ColorFilter::BLACK);
-
-    // Trees
+    // Factories, each in its faction's colour
+    Render::DrawInstanced( m_pFactoryMatrices, FACTORY_MESH, gs_nMaxFactories, true, true );
+
+    // Trees, from the persistent instances; only leaves changed by paving
+    //   are uploaded
     if( g_bRenderTrees )
     {
-        Render::DrawInstanced( m_pActiveTreeMatrices, TREE_MESH, m_nNumActiveTrees, true, true);
-        Render::DrawInstanced( m_pInactiveTreeMatrices, TREE_MESH, m_nNumInactiveTrees, true, true);
+        if( m_nTreeDeviceGeneration != Render::GetDeviceGeneration() )
+        {
+            m_ActiveTrees.MarkAllDirty();
+            m_InactiveTrees.MarkAllDirty();
+            m_nTreeDeviceGeneration = Render::GetDeviceGeneration();
+        }
+        m_ActiveTrees.Upload( m_pActiveTreeMatrices );
+        m_InactiveTrees.Upload( m_pInactiveTreeMatrices );
+
+        m_ActiveTrees.Draw();
+        m_InactiveTrees.Draw();
     }
 
-    // Units
-	int numUnits =  m_UnitManager.GetNumUnits() * (1.0/8.0);
-	Render::DrawInstanced( &m_UnitManager.GetTransforms()[0], UNIT_MESH, numUnits, true, true, ColorFilter::WHITE);
-    Render::DrawInstanced( &m_UnitManager.GetTransforms()[numUnits * 1], UNIT_MESH, numUnits, true, true, ColorFilter::RED);
-	Render::DrawInstanced( &m_UnitManager.GetTransforms()[numUnits * 2], UNIT_MESH, numUnits, true, true, ColorFilter::BLUE);
-	Render::DrawInstanced( &m_UnitManager.GetTransforms()[numUnits * 3], UNIT_MESH, numUnits, true, true, ColorFilter::GREEN);
-	Render::DrawInstanced( &m_UnitManager.GetTransforms()[numUnits * 4], UNIT_MESH, numUnits, true, true, ColorFilter::PURPLE);
-	Render::DrawInstanced( &m_UnitManager.GetTransforms()[numUnits * 5], UNIT_MESH, numUnits, true, true, ColorFilter::YELLOW);
-	Render::DrawInstanced( &m_UnitManager.GetTransforms()[numUnits * 6], UNIT_MESH, numUnits, true, true, ColorFilter::CYAN);
-	Render::DrawInstanced( &m_UnitManager.GetTransforms()[numUnits * 7], UNIT_MESH, numUnits, true, true, ColorFilter::BLACK);
-
-    //Concrete
-    Render::DrawInstanced( m_pTileMatrices,       CONCRETE_MESH, m_nNumActiveTiles,       true, true);
-	Render::DrawInstanced( m_pTileMatricesRed,    CONCRETE_MESH, m_nNumActiveTiles,    true, true, ColorFilter::RED);
-	Render::DrawInstanced( m_pTileMatricesBlue,   CONCRETE_MESH, m_nNumActiveTiles,   true, true, ColorFilter::BLUE);
-	Render::DrawInstanced( m_pTileMatricesGreen,  CONCRETE_MESH, m_nNumActiveTiles,  true, true, ColorFilter::GREEN);
-	Render::DrawInstanced( m_pTileMatricesPurple, CONCRETE_MESH, m_nNumActiveTiles, true, true, ColorFilter::PURPLE);
-	Render::DrawInstanced( m_pTileMatricesYellow, CONCRETE_MESH, m_nNumActiveTiles, true, true, ColorFilter::YELLOW);
-	Render::DrawInstanced( m_pTileMatricesCyan,   CONCRETE_MESH, m_nNumActiveTiles,   true, true, ColorFilter::CYAN);
-	Render::DrawInstanced( m_pTileMatricesBlack,  CONCRETE_MESH, m_nNumActiveTiles,  true, true, ColorFilter::BLACK);
+    // Units, each in its faction's colour
+    Render::DrawInstanced( m_UnitManager.GetTransforms(), UNIT_MESH, m_UnitManager.GetNumUnits(), true, true );
+
+    // Concrete, from the persistent instances; only chunks paved since the
+    //   last frame are uploaded
+    UploadTileChunks();
+    DrawTileChunks();
 
     // Terrain
     Render::DrawTerrain( );
@@ -219,9 +232,12 @@ void Game::SetTileActive( unsigned int nTile, ColorFilter filter )
         return;
     }
 
-    // Activate the tile
+    // Activate the tile.  Its colour goes in first, so a chunk rebuilt from
+    //   another thread never sees the tile active with a stale colour.
+    m_pTileColors[ nTile ] = m_pTiles[ nTile ].bFactory ?
+        gs_nNoPaving : ( unsigned char )( filter - ColorFilter::WHITE );
     m_pTiles[ nTile ].bActive = true;
-    long nIndex = _InterlockedIncrement( &m_nNumActiveTiles );
+    _InterlockedIncrement( &m_nNumActiveTiles );
     // Increment our coverage
     m_fCoverage += gs_fCoveragePerTile;
 
@@ -240,49 +256,229 @@ void Game::SetTileActive( unsigned int nTile, ColorFilter filter )
     }
     LeaveCriticalSection( &m_CriticalSection );
 
-    // Render the tile
+    // Render the tile, with a factory or a slab of cement
     if( m_pTiles[ nTile ].bFactory )
-    { // With either a factory
-        m_pFactoryMatrices[ m_nNumActiveFactories++ ] = XMMatrixTranslation( m_pTiles[nTile].fX, 0.0f,
-                                                                             m_pTiles[nTile].fY );
-    }
-    else
-    { // ...or a slab of cement
-		switch(filter)
-		{
-		case WHITE:
-			m_pTileMatrices[ nIndex - 1 ] = XMMatrixTranslation( m_pTiles[nTile].fX, 0.0f, m_pTiles[nTile].fY );
-			break;
-		case RED:
-			m_pTileMatricesRed[ nIndex - 1 ] = XMMatrixTranslation( m_pTiles[nTile].fX, 0.0f, m_pTiles[nTile].fY );
-			break;
-		case BLUE:
-			m_pTileMatricesBlue[ nIndex - 1 ] = XMMatrixTranslation( m_pTiles[nTile].fX, 0.0f, m_pTiles[nTile].fY );
-			break;
-		case GREEN:
-			m_pTileMatricesGreen[ nIndex - 1 ] = XMMatrixTranslation( m_pTiles[nTile].fX, 0.0f, m_pTiles[nTile].fY );
-			break;
-		case YELLOW:
-			m_pTileMatricesYellow[ nIndex - 1 ] = XMMatrixTranslation( m_pTiles[nTile].fX, 0.0f, m_pTiles[nTile].fY );
-			break;
-		case PURPLE:
-			m_pTileMatricesPurple[ nIndex - 1 ] = XMMatrixTranslation( m_pTiles[nTile].fX, 0.0f, m_pTiles[nTile].fY );
-			break;
-		case CYAN:
-			m_pTileMatricesCyan[ nIndex - 1 ] = XMMatrixTranslation( m_pTiles[nTile].fX, 0.0f, m_pTiles[nTile].fY );
-			break;
-		case BLACK:
-			m_pTileMatricesBlack[ nIndex - 1 ] = XMMatrixTranslation( m_pTiles[nTile].fX, 0.0f, m_pTiles[nTile].fY );
-			break;
-		}
+    {
+        m_pFactoryMatrices[ m_nNumActiveFactories ] = XMMatrixTranslation( m_pTiles[nTile].fX, 0.0f,
+                                                                           m_pTiles[nTile].fY );
+        SetInstanceColor( m_pFactoryMatrices[ m_nNumActiveFactories ], gs_pFactionColors[ m_nNumActiveFactories ] );
+        ++m_nNumActiveFactories;
     }
 
+    // The slab is drawn once its chunk is rebuilt.  A factory marks the chunk
+    //   too, so a build that raced the activation is redone.
+    MarkTileDirty( nTile );
+
     // Stop rendering the tree
-    if( m_pTiles[nTile].nTree != -1 )
+    RemoveTree( nTile );
+}
+
+void Game::SetFactory( unsigned int nFactory,
+                       unsigned int nTile )
+{
+    assert( nFactory < gs_nMaxFactories && nTile < gs_nWorldSizeSq );
+
+    unsigned int nOldTile = m_pFactories[ nFactory ];
+    m_pFactories[ nFactory ] = nTile;
+
+    // The old tile stays a factory if another one is still there
+    m_pTiles[ nOldTile ].bFactory = false;
+    for( unsigned int i = 0; i < gs_nMaxFactories; ++i )
     {
-        m_pActiveTreeMatrices[ m_pTiles[nTile].nTree ] = m_pActiveTreeMatrices[ --m_nNumActiveTrees ];
-        m_pTiles[nTile].nTree = -1;
+        m_pTiles[ m_pFactories[i] ].bFactory = true;
+    }
+}
+
+void Game::PaveRandomTiles( float fCoverage )
+{
+    long nTargetTiles = ( long )( fCoverage * gs_nWorldSizeSq );
+    if( nTargetTiles > ( long )( gs_nWorldSizeSq - gs_nMaxFactories ) )
+    {
+        nTargetTiles = gs_nWorldSizeSq - gs_nMaxFactories;
+    }
+
+    // Paves like SetTileActive, but the inactive tiles array is rebuilt once
+    //   at the end instead of searched per tile
+    while( m_nNumActiveTiles < nTargetTiles )
+    {
+        // RAND_MAX can be as low as 32767
+        unsigned int nTile = ( ( unsigned int )rand() * ( RAND_MAX + 1u ) + rand() ) % gs_nWorldSizeSq;
+        if( m_pTiles[ nTile ].bActive || m_pTiles[ nTile ].bFactory )
+        {
+            continue;
+        }
+
+        m_pTileColors[ nTile ] = 0;
+        m_pTiles[ nTile ].bActive = true;
+        MarkTileDirty( nTile );
+        ++m_nNumActiveTiles;
+        m_fCoverage += gs_fCoveragePerTile;
+
+        RemoveTree( nTile );
+    }
+
+    m_nNumInactiveTiles = 0;
+    for( unsigned int nTile = 0; nTile < gs_nWorldSizeSq; ++nTile )
+    {
+        if( !m_pTiles[ nTile ].bActive )
+        {
+            m_pInactiveTiles[ m_nNumInactiveTiles++ ] = nTile;
+        }
+    }
+}
+
+// Snapshots of the game.  The version is bumped when any section's layout
+//   changes, Tile and the unit structs included.
+static const unsigned int gs_nSnapshotFormat = SNAPSHOT_TAG( 'C', 'O', 'L', 'Y' );
+static const unsigned int gs_nSnapshotVersion = 2;
+
+// The counters as a snapshot stores them
+struct GameSnapshotState
+{
+    long nNumActiveTiles;
+    long nNumInactiveTiles;
+    long nNumActiveTrees;
+    int nNumInactiveTrees;
+    unsigned int nNumActiveFactories;
+    unsigned int nResetCount;
+    float fTime;
+    float fCoverage;
+    float fCoverageThreshold;
+};
+
+static const unsigned int gs_nGameStateSection = SNAPSHOT_TAG( 'G', 'A', 'M', 'E' );
+static const unsigned int gs_nTilesSection = SNAPSHOT_TAG( 'T', 'I', 'L', 'E' );
+static const unsigned int gs_nInactiveTilesSection = SNAPSHOT_TAG( 'I', 'N', 'A', 'C' );
+static const unsigned int gs_nFactoriesSection = SNAPSHOT_TAG( 'F', 'A', 'C', 'T' );
+static const unsigned int gs_nFactoryMatricesSection = SNAPSHOT_TAG( 'F', 'M', 'A', 'T' );
+static const unsigned int gs_nActiveTreesSection = SNAPSHOT_TAG( 'T', 'R', 'E', 'A' );
+static const unsigned int gs_nInactiveTreesSection = SNAPSHOT_TAG( 'T', 'R', 'E', 'I' );
+static const unsigned int gs_nTileColorsSection = SNAPSHOT_TAG( 'T', 'C', 'O', 'L' );
+
+bool Game::SaveSnapshot( const char* szFileName )
+{
+    // In-flight unit tasks move units and pave tiles
+    m_UnitManager.StopWork();
+
+    GameSnapshotState State;
+    ZeroMemory( &State, sizeof( State ) );
+    State.nNumActiveTiles = m_nNumActiveTiles;
+    State.nNumInactiveTiles = m_nNumInactiveTiles;
+    State.nNumActiveTrees = m_nNumActiveTrees;
+    State.nNumInactiveTrees = m_nNumInactiveTrees;
+    State.nNumActiveFactories = m_nNumActiveFactories;
+    State.nResetCount = m_nResetCount;
+    State.fTime = m_fTime;
+    State.fCoverage = m_fCoverage;
+    State.fCoverageThreshold = m_fCoverageThreshold;
+
+    SnapshotWriter Writer( gs_nSnapshotFormat, gs_nSnapshotVersion );
+    Writer.AddSectionCopy( gs_nGameStateSection, &State, sizeof( State ) );
+    Writer.AddSection( gs_nTilesSection, m_pTiles, sizeof( m_pTiles ) );
+    Writer.AddSection( gs_nInactiveTilesSection, m_pInactiveTiles, sizeof( m_pInactiveTiles ) );
+    Writer.AddSection( gs_nFactoriesSection, m_pFactories, sizeof( m_pFactories ) );
+    Writer.AddSection( gs_nFactoryMatricesSection, m_pFactoryMatrices, sizeof( m_pFactoryMatrices ) );
+    Writer.AddSection( gs_nActiveTreesSection, m_pActiveTreeMatrices, sizeof( m_pActiveTreeMatrices ) );
+    Writer.AddSection( gs_nInactiveTreesSection, m_pInactiveTreeMatrices, sizeof( m_pInactiveTreeMatrices ) );
+    Writer.AddSection( gs_nTileColorsSection, m_pTileColors, sizeof( m_pTileColors ) );
+    m_UnitManager.WriteSnapshot( Writer );
+
+    return Writer.Write( szFileName );
+}
+
+bool Game::LoadSnapshot( const char* szFileName )
+{
+    // The file is mapped, not read, so the sections below are copied
+    //   straight from the file cache into the game's arrays
+    SnapshotReader Reader;
+    if( !Reader.Open( szFileName, gs_nSnapshotFormat, gs_nSnapshotVersion ) )
+    {
+        return false;
+    }
+
+    const GameSnapshotState* pState =
+        ( const GameSnapshotState* )Reader.GetSection( gs_nGameStateSection, sizeof( GameSnapshotState ) );
+    if( NULL == pState ||
+        pState->nNumActiveTiles < 0 || pState->nNumActiveTiles > ( long )gs_nWorldSizeSq ||
+        pState->nNumInactiveTiles < 0 || pState->nNumInactiveTiles > ( long )gs_nWorldSizeSq ||
+        pState->nNumActiveTrees < 0 || pState->nNumActiveTrees > ( long )gs_nTreeCount ||
+        pState->nNumInactiveTrees < 0 || pState->nNumInactiveTrees > ( int )gs_nTreeCount ||
+        pState->nNumActiveFactories > gs_nMaxFactories ||
+        NULL == Reader.GetSection( gs_nFactoryMatricesSection, sizeof( m_pFactoryMatrices ) ) ||
+        NULL == Reader.GetSection( gs_nActiveTreesSection, sizeof( m_pActiveTreeMatrices ) ) ||
+        NULL == Reader.GetSection( gs_nInactiveTreesSection, sizeof( m_pInactiveTreeMatrices ) ) )
+    {
+        return false;
+    }
+
+    // The game indexes its arrays with these without checking, so a file
+    //   with any out of range is refused
+    const Tile* pTiles = ( const Tile* )Reader.GetSection( gs_nTilesSection, sizeof( m_pTiles ) );
+    const unsigned int* pInactiveTiles =
+        ( const unsigned int* )Reader.GetSection( gs_nInactiveTilesSection, sizeof( m_pInactiveTiles ) );
+    const unsigned int* pFactories = ( const unsigned int* )Reader.GetSection( gs_nFactoriesSection, sizeof( m_pFactories ) );
+    const unsigned char* pTileColors =
+        ( const unsigned char* )Reader.GetSection( gs_nTileColorsSection, sizeof( m_pTileColors ) );
+    if( NULL == pTiles || NULL == pInactiveTiles || NULL == pFactories || NULL == pTileColors )
+    {
+        return false;
+    }
+
+    for( unsigned int nTile = 0; nTile < gs_nWorldSizeSq; ++nTile )
+    {
+        if( pTiles[ nTile ].nTree < -1 || pTiles[ nTile ].nTree >= ( int )gs_nTreeCount ||
+            ( gs_nNoPaving != pTileColors[ nTile ] && pTileColors[ nTile ] >= gs_nColorFilterCount ) )
+        {
+            return false;
+        }
     }
+
+    for( long i = 0; i < pState->nNumInactiveTiles; ++i )
+    {
+        if( pInactiveTiles[i] >= gs_nWorldSizeSq )
+        {
+            return false;
+        }
+    }
+
+    for( unsigned int i = 0; i < pState->nNumActiveFactories; ++i )
+    {
+        if( pFactories[i] >= gs_nWorldSizeSq )
+        {
+            return false;
+        }
+    }
+
+    // The units check their own sections; nothing has changed until they pass
+    m_UnitManager.CancelWork();
+    if( !m_UnitManager.ReadSnapshot( Reader ) )
+    {
+        return false;
+    }
+
+    gFrameStats.MarkFrame( "Snapshot" );
+
+    Reader.ReadSection( gs_nTilesSection, ( void* )m_pTiles, sizeof( m_pTiles ) );
+    Reader.ReadSection( gs_nInactiveTilesSection, m_pInactiveTiles, sizeof( m_pInactiveTiles ) );
+    Reader.ReadSection( gs_nFactoriesSection, m_pFactories, sizeof( m_pFactories ) );
+    Reader.ReadSection( gs_nFactoryMatricesSection, m_pFactoryMatrices, sizeof( m_pFactoryMatrices ) );
+    Reader.ReadSection( gs_nActiveTreesSection, m_pActiveTreeMatrices, sizeof( m_pActiveTreeMatrices ) );
+    Reader.ReadSection( gs_nInactiveTreesSection, m_pInactiveTreeMatrices, sizeof( m_pInactiveTreeMatrices ) );
+    Reader.ReadSection( gs_nTileColorsSection, m_pTileColors, sizeof( m_pTileColors ) );
+
+    m_nNumActiveTiles = pState->nNumActiveTiles;
+    m_nNumInactiveTiles = pState->nNumInactiveTiles;
+    m_nNumActiveTrees = pState->nNumActiveTrees;
+    m_nNumInactiveTrees = pState->nNumInactiveTrees;
+    m_nNumActiveFactories = pState->nNumActiveFactories;
+    m_nResetCount = pState->nResetCount;
+    m_fTime = pState->fTime;
+    m_fCoverage = pState->fCoverage;
+    m_fCoverageThreshold = pState->fCoverageThreshold;
+
+    BuildTreeHierarchies();
+    MarkAllTilesDirty();
+    return true;
 }
 
 // Returns true once the tile is paved
@@ -290,11 +486,21 @@ bool Game::PaveTile( unsigned int nTile, ColorFilter filter)
 {
     m_pTiles[nTile].fTimer -= m_fElapsedTime;
 
-    int nTree = m_pTiles[nTile].nTree;
-
-    if( nTree != -1 )
+    // RemoveTree on another task can move a tree into this tile's slot, so
+    //   the slot is read again, and the tree sunk, under its lock.  Tiles
+    //   without a tree skip the lock.
+    if( m_pTiles[nTile].nTree != -1 )
     {
-        m_pActiveTreeMatrices[nTree]._42 -= m_fElapsedTime;
+        EnterCriticalSection( &m_CriticalSection );
+
+        int nTree = m_pTiles[nTile].nTree;
+        if( nTree != -1 )
+        {
+            m_pActiveTreeMatrices[nTree]._42 -= m_fElapsedTime;
+            m_ActiveTrees.MarkDirty( nTree );
+        }
+
+        LeaveCriticalSection( &m_CriticalSection );
     }
 
     if( m_pTiles[nTile].fTimer <= 0.0f )
@@ -305,3 +511,193 @@ bool Game::PaveTile( unsigned int nTile, ColorFilter filter)
 
     return false;
 }
+
+// Tiles are numbered x * gs_nWorldSize + y, chunks the same way
+static unsigned int GetTileChunk( unsigned int nTile )
+{
+    unsigned int x = nTile / gs_nWorldSize;
+    unsigned int y = nTile % gs_nWorldSize;
+    return ( x / gs_nTileChunkSize ) * gs_nTileChunkCount + y / gs_nTileChunkSize;
+}
+
+void Game::MarkTileDirty( unsigned int nTile )
+{
+    m_pTileChunks[ GetTileChunk( nTile ) ].bDirty = 1;
+}
+
+void Game::MarkAllTilesDirty( void )
+{
+    for( unsigned int nChunk = 0; nChunk < gs_nTileChunkCountSq; ++nChunk )
+    {
+        m_pTileChunks[ nChunk ].bDirty = 1;
+    }
+}
+
+void Game::BuildTileChunk( unsigned int nChunk )
+{
+    TileChunk& Chunk = m_pTileChunks[ nChunk ];
+    unsigned int nFirstX = ( nChunk / gs_nTileChunkCount ) * gs_nTileChunkSize;
+    unsigned int nFirstY = ( nChunk % gs_nTileChunkCount ) * gs_nTileChunkSize;
+
+    // Pack the chunk's paving at the start of its range, each slab with its
+    //   colour.  Tiles paved while this runs leave the chunk dirty, so it is
+    //   built again next frame.
+    XMMATRIX* pMatrices = &m_pTileMatrices[ nChunk * gs_nTilesPerChunk ];
+    Chunk.nCount = 0;
+    for( unsigned int x = nFirstX; x < nFirstX + gs_nTileChunkSize; ++x )
+    {
+        for( unsigned int y = nFirstY; y < nFirstY + gs_nTileChunkSize; ++y )
+        {
+            // The flag is read before the colour, which SetTileActive writes
+            //   before it
+            unsigned int nTile = x * gs_nWorldSize + y;
+            if( !m_pTiles[ nTile ].bActive )
+            {
+                continue;
+            }
+
+            unsigned int nColor = m_pTileColors[ nTile ];
+            if( nColor < gs_nColorFilterCount )
+            {
+                XMMATRIX& mTransform = pMatrices[ Chunk.nCount++ ];
+                mTransform = XMMatrixTranslation( m_pTiles[nTile].fX, 0.0f, m_pTiles[nTile].fY );
+                SetInstanceColor( mTransform, ( ColorFilter )( WHITE + nColor ) );
+            }
+        }
+    }
+}
+
+void Game::UploadTileChunks( void )
+{
+    // A new render device has none of the paving
+    if( m_nTileDeviceGeneration != Render::GetDeviceGeneration() )
+    {
+        MarkAllTilesDirty();
+        m_nTileDeviceGeneration = Render::GetDeviceGeneration();
+    }
+
+    for( unsigned int nChunk = 0; nChunk < gs_nTileChunkCountSq; ++nChunk )
+    {
+        TileChunk& Chunk = m_pTileChunks[ nChunk ];
+        if( !Chunk.bDirty || !_InterlockedExchange( &Chunk.bDirty, 0 ) )
+        {
+            continue;
+        }
+
+        BuildTileChunk( nChunk );
+
+        unsigned int nFirst = nChunk * gs_nTilesPerChunk;
+        Render::UpdatePersistentInstances( CONCRETE_MESH, nFirst, &m_pTileMatrices[ nFirst ], Chunk.nCount );
+    }
+}
+
+void Game::DrawTileChunks( void )
+{
+    // A range per chunk that touches the frustum, merged with the one
+    //   before when that chunk is fully paved
+    unsigned int pFirst[ gs_nTileChunkCountSq ];
+    unsigned int pCounts[ gs_nTileChunkCountSq ];
+    unsigned int nRanges = 0;
+
+    static const float fChunkSize = gs_nTileChunkSize * gs_fTileSize;
+    XMVECTOR vExtents = XMVectorSet( fChunkSize / 2, gs_fBoxHeight / 2, fChunkSize / 2, 0.0f );
+    for( unsigned int nChunk = 0; nChunk < gs_nTileChunkCountSq; ++nChunk )
+    {
+        const TileChunk& Chunk = m_pTileChunks[ nChunk ];
+        if( Chunk.nCount == 0 )
+        {
+            continue;
+        }
+
+        float fX = ( nChunk / gs_nTileChunkCount + 0.5f ) * fChunkSize;
+        float fZ = ( nChunk % gs_nTileChunkCount + 0.5f ) * fChunkSize;
+        if( !Render::IsBoxVisible( XMVectorSet( fX, gs_fBoxHeight / 2, fZ, 1.0f ), vExtents ) )
+        {
+            continue;
+        }
+
+        unsigned int nFirst = nChunk * gs_nTilesPerChunk;
+        if( nRanges > 0 && pFirst[ nRanges - 1 ] + pCounts[ nRanges - 1 ] == nFirst )
+        {
+            pCounts[ nRanges - 1 ] += Chunk.nCount;
+        }
+        else
+        {
+            pFirst[ nRanges ] = nFirst;
+            pCounts[ nRanges ] = Chunk.nCount;
+            ++nRanges;
+        }
+    }
+
+    Render::DrawPersistentInstanced( CONCRETE_MESH, pFirst, pCounts, nRanges );
+}
+
+void Game::BuildTreeHierarchies( void )
+{
+    float fRadius = Render::GetBoundingRadius( TREE_MESH );
+    XMMATRIX* pScratch = ( XMMATRIX* )_aligned_malloc( gs_nTreeCount * sizeof( XMMATRIX ), 16 );
+    unsigned int* pTiles = new unsigned int[ gs_nTreeCount ];
+    unsigned int* pOrder = new unsigned int[ gs_nTreeCount ];
+
+    // The trees in the world are the ones tiles still point at
+    unsigned int nTrees = 0;
+    for( unsigned int nTile = 0; nTile < gs_nWorldSizeSq; ++nTile )
+    {
+        int nTree = m_pTiles[nTile].nTree;
+        if( nTree < 0 || nTree >= ( int )gs_nTreeCount || nTrees == gs_nTreeCount )
+        {
+            m_pTiles[nTile].nTree = -1;
+            continue;
+        }
+
+        pScratch[ nTrees ] = m_pActiveTreeMatrices[ nTree ];
+        pTiles[ nTrees++ ] = nTile;
+    }
+
+    m_ActiveTrees.Build( pScratch, nTrees, fRadius, TREE_MESH, 0, pOrder );
+    for( unsigned int i = 0; i < nTrees; ++i )
+    {
+        m_pActiveTreeMatrices[i] = pScratch[ pOrder[i] ];
+        m_pTreeTiles[i] = pTiles[ pOrder[i] ];
+        m_pTiles[ m_pTreeTiles[i] ].nTree = i;
+    }
+    m_nNumActiveTrees = nTrees;
+
+    memcpy( pScratch, m_pInactiveTreeMatrices, m_nNumInactiveTrees * sizeof( XMMATRIX ) );
+    m_InactiveTrees.Build( pScratch, m_nNumInactiveTrees, fRadius, TREE_MESH, gs_nTreeCount, pOrder );
+    for( int i = 0; i < m_nNumInactiveTrees; ++i )
+    {
+        m_pInactiveTreeMatrices[i] = pScratch[ pOrder[i] ];
+    }
+
+    delete[] pOrder;
+    delete[] pTiles;
+    _aligned_free( pScratch );
+}
+
+void Game::RemoveTree( unsigned int nTile )
+{
+    // Units pave from several tasks, and taking a tree out of its leaf moves
+    //   another tree of the leaf into its slot
+    EnterCriticalSection( &m_CriticalSection );
+
+    int nTree = m_pTiles[nTile].nTree;
+    if( nTree != -1 )
+    {
+        unsigned int nLast = m_ActiveTrees.Remove( nTree );
+        if( nLast != ( unsigned int )nTree )
+        {
+            m_pActiveTreeMatrices[nTree] = m_pActiveTreeMatrices[nLast];
+            m_pTreeTiles[nTree] = m_pTreeTiles[nLast];
+            m_pTiles[ m_pTreeTiles[nTree] ].nTree = nTree;
+        }
+
+        // After the move, so an upload in between cannot clear the flag
+        //   and leave the old slot drawn
+        m_ActiveTrees.MarkDirty( nTree );
+        m_pTiles[nTile].nTree = -1;
+        _InterlockedDecrement( &m_nNumActiveTrees );
+    }
+
+    LeaveCriticalSection( &m_CriticalSection );
+}
@@ -16,6 +16,7 @@
 #define _GAME_H_
 #include "Colony.h"
 #include "UnitManager.h"
+#include "InstanceBVH.h"
 
 enum ColorFilter
 {
@@ -29,6 +30,23 @@ enum ColorFilter
 	BLACK
 };
 
+static const unsigned int   gs_nColorFilterCount = BLACK - WHITE + 1;
+
+// Colour of each faction.  Factory n and the units in the nth part of the
+//   unit array belong to faction n.
+static const ColorFilter    gs_pFactionColors[ gs_nMaxFactories ] =
+{
+    WHITE, RED, BLUE, GREEN, PURPLE, YELLOW, CYAN, BLACK,
+};
+
+// Instances carry their colour, less WHITE, in the last column of their
+//   transform, which is otherwise 0 0 0 1.  The shader puts the column back.
+inline void SetInstanceColor( XMMATRIX& mTransform,
+                              ColorFilter filter )
+{
+    mTransform._14 = ( float )( filter - WHITE );
+}
+
 // Structure for each game "space"
 struct Tile
 {
@@ -40,6 +58,16 @@ struct Tile
     bool bFactory;
 };
 
+// The paving of one chunk of tiles.  Its instances are the first nCount of
+//   the chunk's range of the paving matrices.  Dirty is set whenever a tile
+//   in the chunk is paved, from any thread, and cleared by the render that
+//   rebuilds and uploads the range.
+struct TileChunk
+{
+    unsigned int nCount;
+    volatile long bDirty;
+};
+
 class __declspec( align( 16 ) ) Game
 {
 public:
@@ -74,44 +102,65 @@ public:
     // Get the factory indices
     unsigned int* GetFactories( void );
 
+    // Move a factory to another tile.  Factories may share a tile.  The
+    //   units keep their goals until the unit manager is reset.
+    void SetFactory( unsigned int nFactory,
+                     unsigned int nTile );
+
+    // Pave random tiles, other than factories, until the coverage is reached
+    void PaveRandomTiles( float fCoverage );
+
     // Coverage
     float GetCoverage( void ) const;
     void SetCoverageThreshold( float fThreshold );
 
+    // Number of resets since the game was created
+    unsigned int GetResetCount( void ) const;
+
+    // Save the world and the units to a snapshot file, or restore them from
+    //   one saved by the same build.  A failed restore leaves the game as it
+    //   was.
+    bool SaveSnapshot( const char* szFileName );
+    bool LoadSnapshot( const char* szFileName );
+
     // Lower the tree
     bool PaveTile( unsigned int nTile, ColorFilter filter = ColorFilter::WHITE );
 
 private:
+    // Paving, by chunk
+    void MarkTileDirty( unsigned int nTile );
+    void MarkAllTilesDirty( void );
+    void BuildTileChunk( unsigned int nChunk );
+    void UploadTileChunks( void );
+    void DrawTileChunks( void );
+
+    // Trees, in bounding volume hierarchies
+    void BuildTreeHierarchies( void );
+    void RemoveTree( unsigned int nTile );
+
     UnitManager m_UnitManager;                       // The unit manager
     Tile m_pTiles[ gs_nWorldSizeSq ];         // The world tiles
     unsigned int m_pInactiveTiles[ gs_nWorldSizeSq ]; // The inactive tiles
 
     // Rendering data
-    XMMATRIX m_pTileMatrices[ gs_nWorldSizeSq ];
-	XMMATRIX m_pTileMatricesRed[ gs_nWorldSizeSq ];
-	XMMATRIX m_pTileMatricesBlue[ gs_nWorldSizeSq ];
-	XMMATRIX m_pTileMatricesGreen[ gs_nWorldSizeSq ];
-	XMMATRIX m_pTileMatricesPurple[ gs_nWorldSizeSq ];
-	XMMATRIX m_pTileMatricesYellow[ gs_nWorldSizeSq ];
-	XMMATRIX m_pTileMatricesCyan[ gs_nWorldSizeSq ];
-	XMMATRIX m_pTileMatricesBlack[ gs_nWorldSizeSq ];
+    XMMATRIX m_pTileMatrices[ gs_nWorldSizeSq ];   // Paving, a range per chunk
+    unsigned char m_pTileColors[ gs_nWorldSizeSq ];   // Paving colour, less WHITE, of each active tile
+    TileChunk m_pTileChunks[ gs_nTileChunkCountSq ];
+    unsigned int m_nTileDeviceGeneration;   // Render device the chunks were uploaded to
 
     XMMATRIX m_pFactoryMatrices[ gs_nMaxFactories ];
-    XMMATRIX m_pActiveTreeMatrices[ gs_nTreeCount ];
-    XMMATRIX m_pInactiveTreeMatrices[ gs_nTreeCount ];
+    XMMATRIX m_pActiveTreeMatrices[ gs_nTreeCount ];     // In m_ActiveTrees order
+    XMMATRIX m_pInactiveTreeMatrices[ gs_nTreeCount ];   // In m_InactiveTrees order
+    unsigned int m_pTreeTiles[ gs_nTreeCount ];           // Tile of each active tree
+    InstanceBVH m_ActiveTrees;            // Trees in the world, persistent instances from 0
+    InstanceBVH m_InactiveTrees;          // Trees around it, from gs_nTreeCount
+    unsigned int m_nTreeDeviceGeneration; // Render device the trees were uploaded to
 
     unsigned int m_pFactories[ gs_nMaxFactories ];
     unsigned int m_nNumActiveFactories;
 
     CRITICAL_SECTION m_CriticalSection;// The critical section for safely activating a tile
-    volatile long m_nNumActiveTiles;      // The number of active tiles and matrices
-	volatile long m_nNumActiveTilesRed;      // The number of active tiles and matrices
-	volatile long m_nNumActiveTilesBlue;      // The number of active tiles and matrices
-	volatile long m_nNumActiveTilesGreen;      // The number of active tiles and matrices
-	volatile long m_nNumActiveTilesPurple;      // The number of active tiles and matrices
-	volatile long m_nNumActiveTilesCyan;      // The number of active tiles and matrices
-	volatile long m_nNumActiveTilesYellow;      // The number of active tiles and matrices
-	volatile long m_nNumActiveTilesBlack;      // The number of active tiles and matrices
+    volatile long m_nNumActiveTiles;      // The number of active tiles
     volatile long m_nNumInactiveTiles;    // The number of inactive tiles
     volatile long m_nNumActiveTrees;      // The number of rendered trees
     int m_nNumInactiveTrees;    // The number of out of bounds trees
@@ -119,6 +168,7 @@ private:
     float m_fTime;                // The running time of the simulation
     float m_fCoverage;            // The current coverage of the world
     float m_fCoverageThreshold;   // The threshold for reset
+    unsigned int m_nResetCount;   // The number of resets
 };
 
 _inline UnitManager* Game::GetUnitManager( void )
@@ -136,6 +186,11 @@ _inline void Game::SetCoverageThreshold( float fThreshold )
     m_fCoverageThreshold = fThreshold;
 }
 
+_inline unsigned int Game::GetResetCount( void ) const
+{
+    return m_nResetCount;
+}
+
 _inline Tile* Game::GetTiles( void )
 {
     return m_pTiles;
@@ -0,0 +1,218 @@
+// Copyright 2010 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+#include "InstanceBVH.h"
+#include "Render.h"
+#include "FrameArena.h"
+#include <algorithm>
+#include <float.h>
+#include <intrin.h>
+
+// Most instances in a leaf; leaves end up with between half this and this
+static const unsigned int   gs_nLeafSize = 64;
+
+// Deepest node stack Draw needs; median splits keep the tree balanced
+static const unsigned int   gs_nMaxDepth = 64;
+
+// Orders slots by the translation of their instance along one axis
+struct CompareAxis
+{
+    const XMMATRIX* pTransforms;
+    unsigned int nAxis;
+
+    bool operator()( unsigned int nA,
+                     unsigned int nB ) const
+    {
+        return ( &pTransforms[nA]._41 )[nAxis] < ( &pTransforms[nB]._41 )[nAxis];
+    }
+};
+
+
+// InstanceBVH class definitions //
+
+InstanceBVH::InstanceBVH( void ) : m_Type( TREE_MESH ),
+                                   m_nBase( 0 )
+{
+}
+
+void InstanceBVH::Build( const XMMATRIX* pTransforms,
+                         unsigned int nCount,
+                         float fRadius,
+                         MeshType Type,
+                         unsigned int nBase,
+                         unsigned int* pOrder )
+{
+    m_Type = Type;
+    m_nBase = nBase;
+    m_Nodes.clear();
+    m_SlotLeaves.resize( nCount );
+
+    for( unsigned int i = 0; i < nCount; ++i )
+    {
+        pOrder[i] = i;
+    }
+
+    if( nCount > 0 )
+    {
+        m_Nodes.reserve( 4 * nCount / gs_nLeafSize + 1 );
+        BuildNode( pTransforms, pOrder, 0, nCount, fRadius );
+    }
+
+    m_Dirty.assign( m_Nodes.size(), 1 );
+}
+
+unsigned int InstanceBVH::BuildNode( const XMMATRIX* pTransforms,
+                                     unsigned int* pOrder,
+                                     unsigned int nFirst,
+                                     unsigned int nCount,
+                                     float fRadius )
+{
+    unsigned int nNode = ( unsigned int )m_Nodes.size();
+    m_Nodes.push_back( Node() );
+
+    // Bounds of the spheres
+    XMVECTOR vMin = XMVectorReplicate( FLT_MAX );
+    XMVECTOR vMax = XMVectorReplicate( -FLT_MAX );
+    for( unsigned int i = nFirst; i < nFirst + nCount; ++i )
+    {
+        XMVECTOR vPosition = pTransforms[ pOrder[i] ].r[3];
+        vMin = XMVectorMin( vMin, vPosition );
+        vMax = XMVectorMax( vMax, vPosition );
+    }
+    XMVECTOR vRadius = XMVectorReplicate( fRadius );
+    XMStoreFloat3( &m_Nodes[nNode].vCenter, ( vMin + vMax ) * 0.5f );
+    XMStoreFloat3( &m_Nodes[nNode].vExtents, ( vMax - vMin ) * 0.5f + vRadius );
+
+    m_Nodes[nNode].nFirst = nFirst;
+    m_Nodes[nNode].nCount = nCount;
+    m_Nodes[nNode].nRight = 0;
+
+    if( nCount <= gs_nLeafSize )
+    {
+        for( unsigned int i = nFirst; i < nFirst + nCount; ++i )
+        {
+            m_SlotLeaves[i] = nNode;
+        }
+        return nNode;
+    }
+
+    // Split at the median of the longest axis
+    XMFLOAT3 vSize;
+    XMStoreFloat3( &vSize, vMax - vMin );
+    CompareAxis Compare = { pTransforms, 0 };
+    if( vSize.y > vSize.x && vSize.y > vSize.z )
+    {
+        Compare.nAxis = 1;
+    }
+    else if( vSize.z > vSize.x )
+    {
+        Compare.nAxis = 2;
+    }
+
+    unsigned int nHalf = nCount / 2;
+    std::nth_element( pOrder + nFirst, pOrder + nFirst + nHalf, pOrder + nFirst + nCount, Compare );
+
+    BuildNode( pTransforms, pOrder, nFirst, nHalf, fRadius );
+    unsigned int nRight = BuildNode( pTransforms, pOrder, nFirst + nHalf, nCount - nHalf, fRadius );
+    m_Nodes[nNode].nRight = nRight;
+
+    return nNode;
+}
+
+void InstanceBVH::MarkDirty( unsigned int nSlot )
+{
+    m_Dirty[ m_SlotLeaves[nSlot] ] = 1;
+}
+
+void InstanceBVH::MarkAllDirty( void )
+{
+    std::fill( m_Dirty.begin(), m_Dirty.end(), 1 );
+}
+
+unsigned int InstanceBVH::Remove( unsigned int nSlot )
+{
+    unsigned int nLeaf = m_SlotLeaves[nSlot];
+    Node& Leaf = m_Nodes[nLeaf];
+    assert( nSlot >= Leaf.nFirst && nSlot < Leaf.nFirst + Leaf.nCount );
+
+    return Leaf.nFirst + --Leaf.nCount;
+}
+
+void InstanceBVH::Upload( const XMMATRIX* pTransforms )
+{
+    for( unsigned int nNode = 0; nNode < m_Nodes.size(); ++nNode )
+    {
+        const Node& Leaf = m_Nodes[nNode];
+        if( Leaf.nRight || !m_Dirty[nNode] || !_InterlockedExchange( &m_Dirty[nNode], 0 ) )
+        {
+            continue;
+        }
+
+        Render::UpdatePersistentInstances( m_Type, m_nBase + Leaf.nFirst, &pTransforms[ Leaf.nFirst ], Leaf.nCount );
+    }
+}
+
+void InstanceBVH::Draw( void )
+{
+    if( m_Nodes.empty() )
+    {
+        return;
+    }
+
+    // Visible leaves in slot order, runs of whole leaves merged
+    FrameArenaScope Scratch( gFrameArena, FrameArena::MainContext );
+    unsigned int* pFirst = gFrameArena.AllocateArray<unsigned int>( FrameArena::MainContext, m_Nodes.size() );
+    unsigned int* pCounts = gFrameArena.AllocateArray<unsigned int>( FrameArena::MainContext, m_Nodes.size() );
+    unsigned int nRanges = 0;
+
+    unsigned int pStack[ gs_nMaxDepth ];
+    unsigned int nStack = 0;
+    pStack[ nStack++ ] = 0;
+
+    while( nStack > 0 )
+    {
+        unsigned int nNode = pStack[ --nStack ];
+        const Node& Current = m_Nodes[nNode];
+        if( !Render::IsBoxVisible( XMLoadFloat3( &Current.vCenter ), XMLoadFloat3( &Current.vExtents ) ) )
+        {
+            continue;
+        }
+
+        if( Current.nRight )
+        {
+            // Left is visited first so the ranges come out in slot order
+            pStack[ nStack++ ] = Current.nRight;
+            pStack[ nStack++ ] = nNode + 1;
+            continue;
+        }
+
+        if( Current.nCount == 0 )
+        {
+            continue;
+        }
+
+        unsigned int nFirst = m_nBase + Current.nFirst;
+        if( nRanges > 0 && pFirst[ nRanges - 1 ] + pCounts[ nRanges - 1 ] == nFirst )
+        {
+            pCounts[ nRanges - 1 ] += Current.nCount;
+        }
+        else
+        {
+            pFirst[ nRanges ] = nFirst;
+            pCounts[ nRanges ] = Current.nCount;
+            ++nRanges;
+        }
+    }
+
+    Render::DrawPersistentInstanced( m_Type, pFirst, pCounts, nRanges );
+}
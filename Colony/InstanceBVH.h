@@ -0,0 +1,86 @@
+// Copyright 2010 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+#pragma once
+#ifndef _INSTANCEBVH_H_
+#define _INSTANCEBVH_H_
+
+#include "Colony.h"
+#include "RenderDevice.h"
+#include <vector>
+
+// InstanceBVH class
+// A bounding volume hierarchy over instances that seldom move, kept in a
+// range of a mesh's persistent instance buffer.  Build orders the instances
+// so every node is a contiguous range of slots; the caller stores them in
+// that order, and from then on only leaves marked dirty are uploaded.
+// Culling walks the nodes, not the instances, and gives a draw range per
+// run of visible leaves.
+//
+// Instances can be taken out of a leaf but not added; the leaf's bounds are
+// left as built.
+class InstanceBVH
+{
+public:
+    InstanceBVH( void );
+
+    // Build over the nCount instances whose translations are those of
+    //   pTransforms, each in a sphere of fRadius.  pOrder gets the instance
+    //   that goes in each slot.  The instances are uploaded to Type's
+    //   persistent buffer from slot nBase.
+    void Build( const XMMATRIX* pTransforms,
+                unsigned int nCount,
+                float fRadius,
+                MeshType Type,
+                unsigned int nBase,
+                unsigned int* pOrder );
+
+    // Upload the leaf of nSlot at the next Upload.  Any thread may call it.
+    void MarkDirty( unsigned int nSlot );
+    void MarkAllDirty( void );
+
+    // Take nSlot out of its leaf.  Returns the leaf's last slot, whose
+    //   instance the caller moves into nSlot unless they are the same, and
+    //   then marks nSlot dirty.  Not threadsafe.
+    unsigned int Remove( unsigned int nSlot );
+
+    // Upload the dirty leaves from pTransforms, indexed by slot
+    void Upload( const XMMATRIX* pTransforms );
+
+    // Draw the leaves that touch the frustum
+    void Draw( void );
+
+private:
+    struct Node
+    {
+        XMFLOAT3 vCenter;
+        XMFLOAT3 vExtents;
+        unsigned int nFirst;
+        unsigned int nCount;        // Instances left, in a leaf
+        unsigned int nRight;        // Right child; the left one follows.  0 for a leaf
+    };
+
+    unsigned int BuildNode( const XMMATRIX* pTransforms,
+                            unsigned int* pOrder,
+                            unsigned int nFirst,
+                            unsigned int nCount,
+                            float fRadius );
+
+    std::vector<Node> m_Nodes;
+    std::vector<unsigned int> m_SlotLeaves;     // Leaf of each slot
+    std::vector<long> m_Dirty;                  // Per node, only leaves are uploaded
+    MeshType m_Type;
+    unsigned int m_nBase;
+};
+
+#endif // _INSTANCEBVH_H_
@@ -15,6 +15,8 @@
 #ifndef _GPA_INSTRUMENTATION_H_
 #define _GPA_INSTRUMENTATION_H_
 
+#include "TraceRecorder.h"
+
 /*! Intel Graphics Performance Analyizer (GPA) allows for CPU tracing of tasks
     in a frame.  Define PROFILEGPA to send task notifications to GPA.  
 */
@@ -66,7 +68,11 @@ public:
 #endif // PROFILEGPA
 
 
+/*! Scoped tasks are also recorded by gTraceRecorder whenever a trace is
+    running, with or without GPA.
+*/
 #define GPA_SCOPED_TASK( FunctionName, Domain ) \
+            TraceScope _trace_( FunctionName ); \
             GPAScopedTask _task_( FunctionName, (__itt_domain*)Domain )
 
 
@@ -44,17 +44,37 @@ struct PS_INPUT
 	float3 Normal   : NORMAL;
 	float2 TexCoord	: TEXCOORD0;
     float2 Coverage : TEXCOORD1;
+    nointerpolation float3 Tint : TEXCOORD2;
+};
+
+// Instance colours, in ColorFilter order from WHITE
+static const float3 Tints[8] =
+{
+    float3( 1.0, 1.0, 1.0 ),    // WHITE
+    float3( 1.0, 0.0, 0.0 ),    // RED
+    float3( 0.0, 1.0, 0.0 ),    // GREEN
+    float3( 0.0, 0.0, 1.0 ),    // BLUE
+    float3( 1.0, 0.0, 1.0 ),    // PURPLE
+    float3( 1.0, 1.0, 0.0 ),    // YELLOW
+    float3( 0.0, 1.0, 1.0 ),    // CYAN
+    float3( 0.0, 0.0, 0.0 ),    // BLACK
 };
 
 PS_INPUT VS_Instanced( VS_INPUT_INSTANCED Input )
 {
 	PS_INPUT Output;
+
+    // The colour index rides in the transform's last column
+    float4x4 Transform = Input.Transform;
+    uint nColor = min( ( uint )Transform._14, 7 );
+    Transform._14 = 0.0f;
 	
-	float4 PosWorld = mul(Input.Position, Input.Transform);
+	float4 PosWorld = mul(Input.Position, Transform);
 	Output.Position = mul(PosWorld, ViewProj);
-    Output.Normal   = normalize( mul( Input.Normal.xyz, Input.Transform ) );
+    Output.Normal   = normalize( mul( Input.Normal.xyz, ( float3x3 )Transform ) );
 	Output.TexCoord = Input.TexCoord;
     Output.Coverage = Params.xy;
+    Output.Tint     = Tints[ nColor ];
 	
 	return Output;
 }
@@ -75,149 +95,8 @@ float4 PS( PS_INPUT Input ) : SV_TARGET
     float3 lightDir = float3( -1.0f, -1.0f, 0.0f );
     float3 lightVec = -lightDir;
 
-    // texture
-    float4 texColor = DiffuseTexture.Sample(DiffuseTextureSampler, Input.TexCoord);
-
-    // increase color saturation
-    lightColor = increase_saturation( texColor.rgb );
-    
-    // diffuse
-    float ndotl = max( dot( lightVec, Input.Normal.xyz ), 0.05f ); 
-    float3 diffuse = ndotl * texColor.rgb * lightColor;
-
-    return float4( diffuse, texColor.a );
-}
-
-float4 PS_RED( PS_INPUT Input ) : SV_TARGET
-{
-    // light
-    float3 lightColor = float3( 1.0f, 1.0f, 1.0f );
-    float3 lightDir = float3( -1.0f, -1.0f, 0.0f );
-    float3 lightVec = -lightDir;
-
-    // texture
-    float4 texColor = DiffuseTexture.Sample(DiffuseTextureSampler, Input.TexCoord) * float4(1.0, 0.0, 0.0, 1.0);
-
-    // increase color saturation
-    lightColor = increase_saturation( texColor.rgb );
-    
-    // diffuse
-    float ndotl = max( dot( lightVec, Input.Normal.xyz ), 0.05f ); 
-    float3 diffuse = ndotl * texColor.rgb * lightColor;
-
-    return float4( diffuse, texColor.a );
-}
-
-float4 PS_GREEN( PS_INPUT Input ) : SV_TARGET
-{
-    // light
-    float3 lightColor = float3( 1.0f, 1.0f, 1.0f );
-    float3 lightDir = float3( -1.0f, -1.0f, 0.0f );
-    float3 lightVec = -lightDir;
-
-    // texture
-    float4 texColor = DiffuseTexture.Sample(DiffuseTextureSampler, Input.TexCoord) * float4(0.0, 1.0, 0.0, 1.0);
-
-    // increase color saturation
-    lightColor = increase_saturation( texColor.rgb );
-    
-    // diffuse
-    float ndotl = max( dot( lightVec, Input.Normal.xyz ), 0.05f ); 
-    float3 diffuse = ndotl * texColor.rgb * lightColor;
-
-    return float4( diffuse, texColor.a );
-}
-
-float4 PS_BLUE( PS_INPUT Input ) : SV_TARGET
-{
-    // light
-    float3 lightColor = float3( 1.0f, 1.0f, 1.0f );
-    float3 lightDir = float3( -1.0f, -1.0f, 0.0f );
-    float3 lightVec = -lightDir;
-
-    // texture
-    float4 texColor = DiffuseTexture.Sample(DiffuseTextureSampler, Input.TexCoord) * float4(0.0, 0.0, 1.0, 1.0);
-
-    // increase color saturation
-    lightColor = increase_saturation( texColor.rgb );
-    
-    // diffuse
-    float ndotl = max( dot( lightVec, Input.Normal.xyz ), 0.05f ); 
-    float3 diffuse = ndotl * texColor.rgb * lightColor;
-
-    return float4( diffuse, texColor.a );
-}
-
-float4 PS_PURPLE( PS_INPUT Input ) : SV_TARGET
-{
-    // light
-    float3 lightColor = float3( 1.0f, 1.0f, 1.0f );
-    float3 lightDir = float3( -1.0f, -1.0f, 0.0f );
-    float3 lightVec = -lightDir;
-
-    // texture
-    float4 texColor = DiffuseTexture.Sample(DiffuseTextureSampler, Input.TexCoord) * float4(1.0, 0.0, 1.0, 1.0);
-
-    // increase color saturation
-    lightColor = increase_saturation( texColor.rgb );
-    
-    // diffuse
-    float ndotl = max( dot( lightVec, Input.Normal.xyz ), 0.05f ); 
-    float3 diffuse = ndotl * texColor.rgb * lightColor;
-
-    return float4( diffuse, texColor.a );
-}
-
-float4 PS_YELLOW( PS_INPUT Input ) : SV_TARGET
-{
-    // light
-    float3 lightColor = float3( 1.0f, 1.0f, 1.0f );
-    float3 lightDir = float3( -1.0f, -1.0f, 0.0f );
-    float3 lightVec = -lightDir;
-
-    // texture
-    float4 texColor = DiffuseTexture.Sample(DiffuseTextureSampler, Input.TexCoord) * float4(1.0, 1.0, 0.0, 1.0);
-
-    // increase color saturation
-    lightColor = increase_saturation( texColor.rgb );
-    
-    // diffuse
-    float ndotl = max( dot( lightVec, Input.Normal.xyz ), 0.05f ); 
-    float3 diffuse = ndotl * texColor.rgb * lightColor;
-
-    return float4( diffuse, texColor.a );
-}
-
-float4 PS_CYAN( PS_INPUT Input ) : SV_TARGET
-{
-    // light
-    float3 lightColor = float3( 1.0f, 1.0f, 1.0f );
-    float3 lightDir = float3( -1.0f, -1.0f, 0.0f );
-    float3 lightVec = -lightDir;
-
-    // texture
-    float4 texColor = DiffuseTexture.Sample(DiffuseTextureSampler, Input.TexCoord) * float4(0.0, 1.0, 1.0, 1.0);
-
-    // increase color saturation
-    lightColor = increase_saturation( texColor.rgb );
-    
-    // diffuse
-    float ndotl = max( dot( lightVec, Input.Normal.xyz ), 0.05f ); 
-    float3 diffuse = ndotl * texColor.rgb * lightColor;
-
-    return float4( diffuse, texColor.a );
-}
-
-
-float4 PS_BLACK( PS_INPUT Input ) : SV_TARGET
-{
-    // light
-    float3 lightColor = float3( 1.0f, 1.0f, 1.0f );
-    float3 lightDir = float3( -1.0f, -1.0f, 0.0f );
-    float3 lightVec = -lightDir;
-
-    // texture
-    float4 texColor = DiffuseTexture.Sample(DiffuseTextureSampler, Input.TexCoord) * float4(0.0, 0.0, 0.0, 1.0);
+    // texture, tinted by the instance's colour
+    float4 texColor = DiffuseTexture.Sample(DiffuseTextureSampler, Input.TexCoord) * float4(Input.Tint, 1.0);
 
     // increase color saturation
     lightColor = increase_saturation( texColor.rgb );
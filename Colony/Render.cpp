@@ -13,6 +13,8 @@
 // responsibility to update it.
 #include "Render.h"
 #include "Instrumentation.h"
+#include "FrameArena.h"
+#include <intrin.h>
 
 // Intel GPA 4.0 defines
 static __itt_domain*        s_pRenderDomain = __itt_domain_createA( "Colony.Render" );
@@ -20,28 +22,55 @@ static __itt_domain*        s_pRenderDomain = __itt_domain_createA( "Colony.Rend
 // Render defines
 CDXUTSDKMesh                ColonyMesh::m_SDKMesh;
 
-ColonyMesh*                 Render::m_pMeshes[MESH_COUNT];
-ID3D11ShaderResourceView*   Render::m_pMeshTextures[TEXTURE_COUNT];
-ID3D11Buffer*               Render::m_pInstanceBuffers[MESH_COUNT];
-ID3D11SamplerState*         Render::m_pSamplerState = NULL;
-ID3D11Device*               Render::m_pDevice = NULL;
-ID3D11DeviceContext*        Render::m_pContext = NULL;
-ID3D11InputLayout*          Render::m_pInputLayout = NULL;
-ID3D11VertexShader*         Render::m_pVertexShader = NULL;
-ID3D11PixelShader*          Render::m_pPixelShader = NULL;
-ID3D11PixelShader*          Render::m_pPixelShaderRED = NULL;
-ID3D11PixelShader*          Render::m_pPixelShaderGREEN = NULL;
-ID3D11PixelShader*          Render::m_pPixelShaderBLUE = NULL;
-ID3D11PixelShader*          Render::m_pPixelShaderPURPLE = NULL;
-ID3D11PixelShader*          Render::m_pPixelShaderYELLOW = NULL;
-ID3D11PixelShader*          Render::m_pPixelShaderCYAN = NULL;
-ID3D11PixelShader*          Render::m_pPixelShaderBLACK = NULL;
-ID3D11PixelShader*          Render::m_pSkyPixelShader = NULL;
-XMVECTOR                    Render::m_vCamPos = XMVectorSet( 0.0f, 0.0f, 0.0f, 0.0f );
-XMVECTOR                    Render::m_vCamDir = XMVectorSet( 0.0f, 0.0f, 0.0f, 0.0f );
-float                       Render::m_fCamFOV = 0.0f;
+RenderDevice*               Render::m_pDevice = NULL;
+XMVECTOR                    Render::m_vFrustumPlanes[6];
 unsigned int                Render::m_nObjectsRendered = 0;
-XMMATRIX                    Render::m_pVisible[ gs_nMaxPerDraw ];
+unsigned int                Render::m_nCullTasks = 0;
+unsigned int                Render::m_nDeviceGeneration = 0;
+
+extern bool                 g_bThreaded;
+
+// The terrain and sky transforms never change; they are uploaded once a device
+static bool                 gs_bUpdateTerrainTransform = true;
+static bool                 gs_bUpdateSkyTransform = true;
+
+// Culling
+static const unsigned int   gs_nCullGrain = 1024;       // Fewest instances worth a cull task
+static const unsigned int   gs_nMaxCullTasks = gs_nTBBTaskCount;
+
+// Bounding sphere radius of each mesh around its origin, generous enough
+//   for the scales Game gives trees
+static const float gs_pCullRadii[] =
+{
+    gs_fUnitSize * 2.0f,        // UNIT_MESH
+    gs_fTileSize * 4.0f,        // FACTORY_MESH
+    gs_fTileSize * 4.0f,        // TREE_MESH
+    gs_fTileSize * 0.75f,       // CONCRETE_MESH
+    gs_fWorldSize,              // GRASS_MESH
+    gs_fWorldSize,              // SKY_MESH
+};
+
+// For each 4 bit mask of visible lanes, the visible lanes in order and how
+//   many there are
+static const unsigned int gs_pPackedLanes[16][4] =
+{
+    { 0, 0, 0, 0 }, { 0, 0, 0, 0 }, { 1, 0, 0, 0 }, { 0, 1, 0, 0 },
+    { 2, 0, 0, 0 }, { 0, 2, 0, 0 }, { 1, 2, 0, 0 }, { 0, 1, 2, 0 },
+    { 3, 0, 0, 0 }, { 0, 3, 0, 0 }, { 1, 3, 0, 0 }, { 0, 1, 3, 0 },
+    { 2, 3, 0, 0 }, { 0, 2, 3, 0 }, { 1, 2, 3, 0 }, { 0, 1, 2, 3 },
+};
+static const unsigned int gs_pLaneCounts[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+// One cull task's range and result
+struct CullArgs
+{
+    const XMMATRIX* pTransforms;
+    unsigned int nInstanceCount;
+    float fRadius;
+    unsigned int* pVisible;         // Each task writes from its range start
+    unsigned int pStart[ gs_nMaxCullTasks ];
+    unsigned int pVisibleCount[ gs_nMaxCullTasks ];
+};
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -231,9 +260,55 @@ ColonyMesh::~ColonyMesh( void )
 }
 
 
-// Render class definitions //
+// D3D11RenderDevice class definitions //
+
+// Pixel shader entry points in Colony.hlsl, in PixelShaderType order
+static const char*          gs_szPixelShaderNames[ PIXEL_SHADER_COUNT ] =
+{
+    "PS", "PS_Sky",
+};
+
+D3D11RenderDevice::D3D11RenderDevice( void ) : m_pSamplerState( NULL ),
+                                               m_pDevice( NULL ),
+                                               m_pContext( NULL ),
+                                               m_pInputLayout( NULL ),
+                                               m_pVertexShader( NULL )
+{
+    memset( m_pMeshTextures, 0, sizeof( m_pMeshTextures ) );
+    memset( m_pMeshes, 0, sizeof( m_pMeshes ) );
+    memset( m_pInstanceBuffers, 0, sizeof( m_pInstanceBuffers ) );
+    memset( m_pPersistentBuffers, 0, sizeof( m_pPersistentBuffers ) );
+    memset( m_pPixelShaders, 0, sizeof( m_pPixelShaders ) );
+}
+
+D3D11RenderDevice::~D3D11RenderDevice( void )
+{
+    for( unsigned int i = 0; i < MESH_COUNT; ++i )
+    {
+        SAFE_DELETE( m_pMeshes[i] );
+        SAFE_RELEASE( m_pInstanceBuffers[i] );
+        SAFE_RELEASE( m_pPersistentBuffers[i] );
+    }
+    for( unsigned int i = 0; i < TEXTURE_COUNT; ++i )
+    {
+        SAFE_RELEASE( m_pMeshTextures[i] );
+    }
+    for( unsigned int i = 0; i < PIXEL_SHADER_COUNT; ++i )
+    {
+        SAFE_RELEASE( m_pPixelShaders[i] );
+    }
+
+    SAFE_RELEASE( m_pSamplerState );
+    SAFE_RELEASE( m_pInputLayout );
+    SAFE_RELEASE( m_pVertexShader );
+}
 
-HRESULT Render::Init()
+bool D3D11RenderDevice::Init( void )
+{
+    return SUCCEEDED( CreateResources() );
+}
+
+HRESULT D3D11RenderDevice::CreateResources( void )
 {
     HRESULT hr = S_OK;
     ID3DBlob* pVSBlob;
@@ -297,56 +372,20 @@ HRESULT Render::Init()
     V_RETURN( m_pDevice->CreateVertexShader( pVSBlob->GetBufferPointer(), pVSBlob->GetBufferSize(),
                                              NULL, &m_pVertexShader ) );
 
-    // define pixel shaders
-    V_RETURN( D3DX11CompileFromFile( sFilename, NULL, NULL, "PS", "ps_4_0", D3DCOMPILE_ENABLE_STRICTNESS, NULL,
-                                     NULL, &pPSBlob, &pErrBlob, NULL ) );
-    V_RETURN( m_pDevice->CreatePixelShader( pPSBlob->GetBufferPointer(), pPSBlob->GetBufferSize(),
-                                            NULL, &m_pPixelShader ) );
-
-	V_RETURN( D3DX11CompileFromFile( sFilename, NULL, NULL, "PS_RED", "ps_4_0", D3DCOMPILE_ENABLE_STRICTNESS, NULL,
-                                     NULL, &pPSBlob, &pErrBlob, NULL ) );
-    V_RETURN( m_pDevice->CreatePixelShader( pPSBlob->GetBufferPointer(), pPSBlob->GetBufferSize(),
-                                            NULL, &m_pPixelShaderRED ) );
-
-	V_RETURN( D3DX11CompileFromFile( sFilename, NULL, NULL, "PS_GREEN", "ps_4_0", D3DCOMPILE_ENABLE_STRICTNESS, NULL,
-                                     NULL, &pPSBlob, &pErrBlob, NULL ) );
-    V_RETURN( m_pDevice->CreatePixelShader( pPSBlob->GetBufferPointer(), pPSBlob->GetBufferSize(),
-                                            NULL, &m_pPixelShaderGREEN ) );
-
-	V_RETURN( D3DX11CompileFromFile( sFilename, NULL, NULL, "PS_BLUE", "ps_4_0", D3DCOMPILE_ENABLE_STRICTNESS, NULL,
-                                     NULL, &pPSBlob, &pErrBlob, NULL ) );
-    V_RETURN( m_pDevice->CreatePixelShader( pPSBlob->GetBufferPointer(), pPSBlob->GetBufferSize(),
-                                            NULL, &m_pPixelShaderBLUE ) );
-
-	V_RETURN( D3DX11CompileFromFile( sFilename, NULL, NULL, "PS_YELLOW", "ps_4_0", D3DCOMPILE_ENABLE_STRICTNESS, NULL,
-                                     NULL, &pPSBlob, &pErrBlob, NULL ) );
-    V_RETURN( m_pDevice->CreatePixelShader( pPSBlob->GetBufferPointer(), pPSBlob->GetBufferSize(),
-                                            NULL, &m_pPixelShaderYELLOW ) );
-
-	V_RETURN( D3DX11CompileFromFile( sFilename, NULL, NULL, "PS_CYAN", "ps_4_0", D3DCOMPILE_ENABLE_STRICTNESS, NULL,
-                                     NULL, &pPSBlob, &pErrBlob, NULL ) );
-    V_RETURN( m_pDevice->CreatePixelShader( pPSBlob->GetBufferPointer(), pPSBlob->GetBufferSize(),
-                                            NULL, &m_pPixelShaderCYAN ) );
-
-	V_RETURN( D3DX11CompileFromFile( sFilename, NULL, NULL, "PS_PURPLE", "ps_4_0", D3DCOMPILE_ENABLE_STRICTNESS, NULL,
-                                     NULL, &pPSBlob, &pErrBlob, NULL ) );
-    V_RETURN( m_pDevice->CreatePixelShader( pPSBlob->GetBufferPointer(), pPSBlob->GetBufferSize(),
-                                            NULL, &m_pPixelShaderPURPLE ) );
-
-	V_RETURN( D3DX11CompileFromFile( sFilename, NULL, NULL, "PS_BLACK", "ps_4_0", D3DCOMPILE_ENABLE_STRICTNESS, NULL,
-                                     NULL, &pPSBlob, &pErrBlob, NULL ) );
-    V_RETURN( m_pDevice->CreatePixelShader( pPSBlob->GetBufferPointer(), pPSBlob->GetBufferSize(),
-                                            NULL, &m_pPixelShaderBLACK ) );
-
-    // define sky pixel shader
-    V_RETURN( D3DX11CompileFromFile( sFilename, NULL, NULL, "PS_Sky", "ps_4_0", D3DCOMPILE_ENABLE_STRICTNESS, NULL,
-                                     NULL, &pPSBlob, &pErrBlob, NULL ) );
-    V_RETURN( m_pDevice->CreatePixelShader( pPSBlob->GetBufferPointer(), pPSBlob->GetBufferSize(),
-                                            NULL, &m_pSkyPixelShader ) );
+    // define pixel shaders, the sky's included
+    for( unsigned int i = 0; i < PIXEL_SHADER_COUNT; ++i )
+    {
+        V_RETURN( D3DX11CompileFromFile( sFilename, NULL, NULL, gs_szPixelShaderNames[i], "ps_4_0",
+                                         D3DCOMPILE_ENABLE_STRICTNESS, NULL, NULL, &pPSBlob, &pErrBlob, NULL ) );
+        V_RETURN( m_pDevice->CreatePixelShader( pPSBlob->GetBufferPointer(), pPSBlob->GetBufferSize(),
+                                                NULL, &m_pPixelShaders[i] ) );
+        SAFE_RELEASE( pPSBlob );
+    }
 
     // define input layout
     V_RETURN( m_pDevice->CreateInputLayout( g_pStandardVertexElements, g_nElementCount, pVSBlob->GetBufferPointer(),
                                             pVSBlob->GetBufferSize(), &m_pInputLayout ) );
+    SAFE_RELEASE( pVSBlob );
 
 
     // init instance buffers
@@ -356,110 +395,192 @@ HRESULT Render::Init()
     bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
     bufferDesc.MiscFlags = 0;
     bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-    bufferDesc.ByteWidth = gs_nMaxUnits * sizeof( XMMATRIX );
-    V_RETURN( m_pDevice->CreateBuffer( &bufferDesc, 0, &( m_pInstanceBuffers[UNIT_MESH] ) ) );
-    bufferDesc.ByteWidth = gs_nMaxFactories * sizeof( XMMATRIX );
-    V_RETURN( m_pDevice->CreateBuffer( &bufferDesc, 0, &( m_pInstanceBuffers[FACTORY_MESH] ) ) );
-    bufferDesc.ByteWidth = gs_nWorldSizeSq * sizeof( XMMATRIX );
-    V_RETURN( m_pDevice->CreateBuffer( &bufferDesc, 0, &( m_pInstanceBuffers[TREE_MESH] ) ) );
-    V_RETURN( m_pDevice->CreateBuffer( &bufferDesc, 0, &( m_pInstanceBuffers[CONCRETE_MESH] ) ) );
-    bufferDesc.ByteWidth = sizeof( XMMATRIX );
-    V_RETURN( m_pDevice->CreateBuffer( &bufferDesc, 0, &( m_pInstanceBuffers[GRASS_MESH] ) ) );
-    V_RETURN( m_pDevice->CreateBuffer( &bufferDesc, 0, &( m_pInstanceBuffers[SKY_MESH] ) ) );
+    for( unsigned int i = 0; i < MESH_COUNT; ++i )
+    {
+        bufferDesc.ByteWidth = GetInstanceCapacity( ( MeshType )i );
+        V_RETURN( m_pDevice->CreateBuffer( &bufferDesc, 0, &( m_pInstanceBuffers[i] ) ) );
+    }
+
+    // Persistent ones are only written in ranges, with UpdateSubresource
+    bufferDesc.Usage = D3D11_USAGE_DEFAULT;
+    bufferDesc.CPUAccessFlags = 0;
+    for( unsigned int i = 0; i < MESH_COUNT; ++i )
+    {
+        bufferDesc.ByteWidth = GetPersistentCapacity( ( MeshType )i );
+        if( bufferDesc.ByteWidth > 0 )
+        {
+            V_RETURN( m_pDevice->CreateBuffer( &bufferDesc, 0, &( m_pPersistentBuffers[i] ) ) );
+        }
+    }
 
     return hr;
 }
 
-void Render::DrawInstanced( XMMATRIX* pTransforms,
-                            MeshType Type,
-                            unsigned int nInstanceCount,
-                            bool bUpdateTransforms,
-                            bool bCullObjects, 
-							ColorFilter filter)
+void D3D11RenderDevice::OnSetPipeline( PixelShaderType Shader )
 {
-    GPA_SCOPED_TASK( __FUNCTION__, s_pRenderDomain );
-
-    if( nInstanceCount == 0 )
-        return;
-
-    ColonyMesh* pInstancedMesh = m_pMeshes[Type];
-    unsigned int nVertexStride = pInstancedMesh->GetVertexStride();
-    ID3D11Buffer* pVertexBuffer = pInstancedMesh->GetVertexBuffer();
-    ID3D11Buffer* pIndexBuffer = pInstancedMesh->GetIndexBuffer();
-    DXGI_FORMAT IndexFormat = pInstancedMesh->GetIndexFormat();
-    unsigned int nIndexCount = pInstancedMesh->GetIndexCount();
-    ID3D11ShaderResourceView* pTextureResourceView = m_pMeshTextures[Type];
-    ID3D11Buffer* pInstanceBuffer = m_pInstanceBuffers[Type];
-
     m_pContext->IASetPrimitiveTopology( D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
     m_pContext->IASetInputLayout( m_pInputLayout );
     m_pContext->VSSetShader( m_pVertexShader, NULL, 0 );
-	switch(filter)
-	{
-	case ColorFilter::WHITE:
-		m_pContext->PSSetShader( m_pPixelShader, NULL, 0 );
-		break;
-	case ColorFilter::RED:
-		m_pContext->PSSetShader( m_pPixelShaderRED, NULL, 0 );
-		break;
-	case ColorFilter::GREEN:
-		m_pContext->PSSetShader( m_pPixelShaderGREEN, NULL, 0 );
-		break;
-	case ColorFilter::BLUE:
-		m_pContext->PSSetShader( m_pPixelShaderBLUE, NULL, 0 );
-		break;
-	case ColorFilter::PURPLE:
-		m_pContext->PSSetShader( m_pPixelShaderPURPLE, NULL, 0 );
-		break;
-	case ColorFilter::YELLOW:
-		m_pContext->PSSetShader( m_pPixelShaderYELLOW, NULL, 0 );
-		break;
-	case ColorFilter::CYAN:
-		m_pContext->PSSetShader( m_pPixelShaderCYAN, NULL, 0 );
-		break;
-	case ColorFilter::BLACK:
-		m_pContext->PSSetShader( m_pPixelShaderBLACK, NULL, 0 );
-		break;
-	}
-    
+    m_pContext->PSSetShader( m_pPixelShaders[Shader], NULL, 0 );
     m_pContext->PSSetSamplers( 0, 1, &m_pSamplerState );
+}
+
+void D3D11RenderDevice::OnSetMesh( MeshType Type,
+                                   bool bPersistent )
+{
+    ColonyMesh* pMesh = m_pMeshes[Type];
 
     UINT Strides[2] =
-    { nVertexStride, sizeof( XMMATRIX ) };
+    { pMesh->GetVertexStride(), sizeof( XMMATRIX ) };
     UINT Offsets[2] =
     { 0, 0 };
     ID3D11Buffer* pVB[2] =
-    { pVertexBuffer, pInstanceBuffer };
+    { pMesh->GetVertexBuffer(), bPersistent ? m_pPersistentBuffers[Type] : m_pInstanceBuffers[Type] };
+
+    m_pContext->IASetVertexBuffers( 0, 2, pVB, Strides, Offsets );
+    m_pContext->IASetIndexBuffer( pMesh->GetIndexBuffer(), pMesh->GetIndexFormat(), 0 );
+}
+
+void D3D11RenderDevice::OnSetTexture( unsigned int nSlot,
+                                      TextureType Texture )
+{
+    m_pContext->PSSetShaderResources( nSlot, 1, &m_pMeshTextures[Texture] );
+}
+
+void* D3D11RenderDevice::OnMapInstances( MeshType Type )
+{
+    D3D11_MAPPED_SUBRESOURCE MappedResource;
+    m_pContext->Map( m_pInstanceBuffers[Type], 0, D3D11_MAP_WRITE_DISCARD, 0, &MappedResource );
+    return MappedResource.pData;
+}
+
+void D3D11RenderDevice::OnUnmapInstances( MeshType Type )
+{
+    m_pContext->Unmap( m_pInstanceBuffers[Type], 0 );
+}
+
+void D3D11RenderDevice::OnUpdateInstances( MeshType Type,
+                                           unsigned int nFirst,
+                                           const void* pInstances,
+                                           unsigned int nInstances )
+{
+    D3D11_BOX Range = { nFirst * sizeof( XMMATRIX ), 0, 0, ( nFirst + nInstances ) * sizeof( XMMATRIX ), 1, 1 };
+    m_pContext->UpdateSubresource( m_pPersistentBuffers[Type], 0, &Range, pInstances, 0, 0 );
+}
+
+void D3D11RenderDevice::OnDrawInstanced( MeshType Type,
+                                         unsigned int nInstances,
+                                         unsigned int nFirstInstance )
+{
+    m_pContext->DrawIndexedInstanced( m_pMeshes[Type]->GetIndexCount(), nInstances, 0, 0, nFirstInstance );
+}
+
+void D3D11RenderDevice::OnDraw( MeshType Type )
+{
+    m_pContext->DrawIndexed( m_pMeshes[Type]->GetIndexCount(), 0, 0 );
+}
+
+
+// Render class definitions //
+
+HRESULT Render::Init( RenderBackend Backend )
+{
+    // A new device replaces the old one and everything it created
+    Destroy();
+
+    gs_bUpdateTerrainTransform = true;
+    gs_bUpdateSkyTransform = true;
+    ++m_nDeviceGeneration;
+
+    if( NULL_RENDER_BACKEND == Backend )
+    {
+        m_pDevice = new NullRenderDevice();
+    }
+    else
+    {
+        m_pDevice = new D3D11RenderDevice();
+    }
+
+    return m_pDevice->Init() ? S_OK : E_FAIL;
+}
+
+void Render::UploadInstances( MeshType Type,
+                              const XMMATRIX* pTransforms,
+                              unsigned int nInstanceCount )
+{
+    void* pMatrices = m_pDevice->MapInstances( Type );
+    memcpy_s( pMatrices, RenderDevice::GetInstanceCapacity( Type ), pTransforms, nInstanceCount * sizeof( XMMATRIX ) );
+    m_pDevice->UnmapInstances( Type, nInstanceCount * sizeof( XMMATRIX ) );
+}
+
+void Render::DrawInstanced( XMMATRIX* pTransforms,
+                            MeshType Type,
+                            unsigned int nInstanceCount,
+                            bool bUpdateTransforms,
+                            bool bCullObjects )
+{
+    GPA_SCOPED_TASK( __FUNCTION__, s_pRenderDomain );
+
+    if( nInstanceCount == 0 )
+        return;
+
+    m_pDevice->SetPipeline( MESH_PS );
 
     if( bCullObjects )
     {
-        unsigned int nVisibleCount = 0;
-        D3D11_MAPPED_SUBRESOURCE MappedResource;
-        for( unsigned int i = 0; i < nInstanceCount; i++ )
+        // Visible indices are gathered in frame scratch sized for this draw
+        FrameArenaScope Scratch( gFrameArena, FrameArena::MainContext );
+
+        CullArgs Args;
+        Args.pTransforms = pTransforms;
+        Args.nInstanceCount = nInstanceCount;
+        Args.fRadius = gs_pCullRadii[ Type ];
+        Args.pVisible = gFrameArena.AllocateArray<unsigned int>( FrameArena::MainContext, nInstanceCount );
+
+        unsigned int uTaskCount = g_bThreaded ? nInstanceCount / gs_nCullGrain : 1;
+        uTaskCount = max( 1u, min( uTaskCount, gs_nMaxCullTasks ) );
+        m_nCullTasks += uTaskCount;
+
+        if( 1 == uTaskCount )
         {
-            XMVECTOR vPosition = XMVectorSet( pTransforms[i]._41, pTransforms[i]._42, pTransforms[i]._43, 1.0f );
-            XMVECTOR vCamToObject = vPosition - m_vCamPos;
-            XMVECTOR vCamToObjectNormalized = XMVector4NormalizeEst( vCamToObject );
+            CullTask( &Args, FrameArena::MainContext, 0, 1 );
+        }
+        else
+        {
+            // The frame waits on the cull, so it goes ahead of the next
+            //   frame's simulation when that runs alongside as LOW
+            TASKSETHANDLE hCull;
+            gTaskMgr.CreateTaskSet( CullTask, &Args, uTaskCount, NULL, 0, "CullTask", &hCull,
+                                    TASKSETHANDLE_INVALID, TASKSETPRIORITY_HIGH );
+            gTaskMgr.WaitForSet( hCull );
+            gTaskMgr.ReleaseHandle( hCull );
+        }
 
-            if( XMVectorGetX( XMVector4Dot( vCamToObjectNormalized, m_vCamDir ) ) > m_fCamFOV )
-            {
-                m_pVisible[nVisibleCount++] = pTransforms[i];
-            }
+        unsigned int nVisibleCount = 0;
+        for( unsigned int uTask = 0; uTask < uTaskCount; ++uTask )
+        {
+            nVisibleCount += Args.pVisibleCount[ uTask ];
         }
 
         m_nObjectsRendered = nVisibleCount;
 
         if( nVisibleCount > 0 )
         {
-            m_pContext->Map( pInstanceBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &MappedResource );
-            XMMATRIX* pMatrices = ( XMMATRIX* )MappedResource.pData;
-            memcpy_s( pMatrices, gs_nMaxPerDraw * sizeof( XMMATRIX ), m_pVisible, nVisibleCount * sizeof( XMMATRIX ) );
-            m_pContext->Unmap( pInstanceBuffer, 0 );
-
-            m_pContext->IASetVertexBuffers( 0, 2, pVB, Strides, Offsets );
-            m_pContext->IASetIndexBuffer( pIndexBuffer, IndexFormat, 0 );
-            m_pContext->PSSetShaderResources( 0, 1, &pTextureResourceView );
-            m_pContext->DrawIndexedInstanced( nIndexCount, nVisibleCount, 0, 0, 0 );
+            // Gather the visible transforms straight into the instance buffer
+            XMMATRIX* pInstances = ( XMMATRIX* )m_pDevice->MapInstances( Type );
+            for( unsigned int uTask = 0; uTask < uTaskCount; ++uTask )
+            {
+                const unsigned int* pIndices = Args.pVisible + Args.pStart[ uTask ];
+                for( unsigned int i = 0; i < Args.pVisibleCount[ uTask ]; ++i )
+                {
+                    *pInstances++ = pTransforms[ pIndices[i] ];
+                }
+            }
+            m_pDevice->UnmapInstances( Type, nVisibleCount * sizeof( XMMATRIX ) );
+
+            m_pDevice->SetMesh( Type );
+            m_pDevice->SetTexture( 0, ( TextureType )Type );
+            m_pDevice->DrawInstanced( Type, nVisibleCount );
         }
     }
     else
@@ -467,157 +588,208 @@ void Render::DrawInstanced( XMMATRIX* pTransforms,
         m_nObjectsRendered = nInstanceCount;
         if( bUpdateTransforms )
         {
-            D3D11_MAPPED_SUBRESOURCE MappedResource;
-            m_pContext->Map( pInstanceBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &MappedResource );
-            XMMATRIX* pMatrices = ( XMMATRIX* )MappedResource.pData;
-            memcpy_s( pMatrices, gs_nMaxPerDraw * sizeof( XMMATRIX ), pTransforms,
-                      nInstanceCount * sizeof( XMMATRIX ) );
-            m_pContext->Unmap( pInstanceBuffer, 0 );
+            UploadInstances( Type, pTransforms, nInstanceCount );
         }
-        m_pContext->IASetVertexBuffers( 0, 2, pVB, Strides, Offsets );
-        m_pContext->IASetIndexBuffer( pIndexBuffer, IndexFormat, 0 );
-        m_pContext->PSSetShaderResources( 0, 1, &pTextureResourceView );
-        m_pContext->DrawIndexedInstanced( nIndexCount, nInstanceCount, 0, 0, 0 );
+        m_pDevice->SetMesh( Type );
+        m_pDevice->SetTexture( 0, ( TextureType )Type );
+        m_pDevice->DrawInstanced( Type, nInstanceCount );
     }
 }
 
-void Render::DrawTerrain( )
+void Render::UpdatePersistentInstances( MeshType Type,
+                                        unsigned int nFirst,
+                                        const XMMATRIX* pTransforms,
+                                        unsigned int nInstanceCount )
+{
+    assert( ( nFirst + nInstanceCount ) * sizeof( XMMATRIX ) <= RenderDevice::GetPersistentCapacity( Type ) );
+
+    if( nInstanceCount > 0 )
+    {
+        m_pDevice->UpdateInstances( Type, nFirst, pTransforms, nInstanceCount );
+    }
+}
+
+void Render::DrawPersistentInstanced( MeshType Type,
+                                      const unsigned int* pFirst,
+                                      const unsigned int* pCounts,
+                                      unsigned int nRanges )
 {
     GPA_SCOPED_TASK( __FUNCTION__, s_pRenderDomain );
 
+    if( nRanges == 0 )
+        return;
 
-    // Then draw
-    ColonyMesh* pInstancedMesh = m_pMeshes[GRASS_MESH];
-    unsigned int nVertexStride = pInstancedMesh->GetVertexStride();
-    ID3D11Buffer* pVertexBuffer = pInstancedMesh->GetVertexBuffer();
-    ID3D11Buffer* pIndexBuffer = pInstancedMesh->GetIndexBuffer();
-    DXGI_FORMAT nIndexFormat = pInstancedMesh->GetIndexFormat();
-    unsigned int nIndexCount = pInstancedMesh->GetIndexCount();
-    ID3D11ShaderResourceView* pTexture = m_pMeshTextures[GRASS_DIFFUSE];
+    m_pDevice->SetPipeline( MESH_PS );
+    m_pDevice->SetMesh( Type, true );
+    m_pDevice->SetTexture( 0, ( TextureType )Type );
 
-    m_pContext->IASetPrimitiveTopology( D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
-    m_pContext->IASetInputLayout( m_pInputLayout );
-    m_pContext->VSSetShader( m_pVertexShader, NULL, 0 );
-    m_pContext->PSSetShader( m_pPixelShader, NULL, 0 );
-    m_pContext->PSSetSamplers( 0, 1, &m_pSamplerState );
+    m_nObjectsRendered = 0;
+    for( unsigned int i = 0; i < nRanges; ++i )
+    {
+        m_pDevice->DrawInstanced( Type, pCounts[i], pFirst[i] );
+        m_nObjectsRendered += pCounts[i];
+    }
+}
 
-    // Quad to extend terrain past skydome
-    UINT Strides[2] =
-    { nVertexStride, sizeof( XMMATRIX ) };
-    UINT Offsets[2] =
-    { 0, 0 };
+float Render::GetBoundingRadius( MeshType Type )
+{
+    return gs_pCullRadii[ Type ];
+}
 
-    static bool bUpdateTransforms = true;
-    if( bUpdateTransforms )
+bool Render::IsBoxVisible( const XMVECTOR& vCenter,
+                           const XMVECTOR& vExtents )
+{
+    XMVECTOR vPoint = XMVectorSetW( vCenter, 1.0f );
+
+    // Outside if even the corner furthest along a plane's normal is behind it
+    for( unsigned int p = 0; p < 6; ++p )
+    {
+        float fDistance = XMVectorGetX( XMPlaneDot( m_vFrustumPlanes[p], vPoint ) );
+        float fReach = XMVectorGetX( XMVector3Dot( XMVectorAbs( m_vFrustumPlanes[p] ), vExtents ) );
+        if( fDistance < -fReach )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void Render::DrawTerrain( )
+{
+    GPA_SCOPED_TASK( __FUNCTION__, s_pRenderDomain );
+
+    m_pDevice->SetPipeline( MESH_PS );
+
+    // Quad to extend terrain past skydome
+    if( gs_bUpdateTerrainTransform )
     {
         static XMMATRIX mTransforms = XMMatrixTranslation( 0.0f, 0.0f, 0.0f );
-        D3D11_MAPPED_SUBRESOURCE MappedResource;
-        m_pContext->Map( m_pInstanceBuffers[GRASS_MESH], 0, D3D11_MAP_WRITE_DISCARD, 0, &MappedResource );
-        XMMATRIX* pMatrices = ( XMMATRIX* )MappedResource.pData;
-        memcpy_s( pMatrices, sizeof( XMMATRIX ), &mTransforms, sizeof( XMMATRIX ) );
-        m_pContext->Unmap( m_pInstanceBuffers[GRASS_MESH], 0 );
-        bUpdateTransforms = false;
+        UploadInstances( GRASS_MESH, &mTransforms, 1 );
+        gs_bUpdateTerrainTransform = false;
     }
-    ID3D11Buffer* pVB[2] =
-    { pVertexBuffer, m_pInstanceBuffers[GRASS_MESH] };
-    m_pContext->IASetVertexBuffers( 0, 2, pVB, Strides, Offsets );
-    m_pContext->IASetIndexBuffer( pIndexBuffer, nIndexFormat, 0 );
-    m_pContext->PSSetShaderResources( 0, 1, &pTexture );
-    m_pContext->DrawIndexed( nIndexCount, 0, 0 );
+    m_pDevice->SetMesh( GRASS_MESH );
+    m_pDevice->SetTexture( 0, GRASS_DIFFUSE );
+    m_pDevice->Draw( GRASS_MESH );
 
 }
 
 void Render::Destroy( void )
 {
-    SAFE_DELETE( m_pMeshes[ UNIT_MESH ] );
-    SAFE_DELETE( m_pMeshes[ FACTORY_MESH ] );
-    SAFE_DELETE( m_pMeshes[ TREE_MESH ] );
-    SAFE_DELETE( m_pMeshes[ CONCRETE_MESH ] );
-    SAFE_DELETE( m_pMeshes[ GRASS_MESH ] );
-    SAFE_DELETE( m_pMeshes[ SKY_MESH ] );
+    SAFE_DELETE( m_pDevice );
+}
 
-    SAFE_RELEASE( m_pSamplerState );
-    SAFE_RELEASE( m_pInputLayout );
-    SAFE_RELEASE( m_pVertexShader );
-    SAFE_RELEASE( m_pPixelShader );
-	SAFE_RELEASE( m_pPixelShaderRED );
-	SAFE_RELEASE( m_pPixelShaderGREEN );
-	SAFE_RELEASE( m_pPixelShaderBLUE );
-	SAFE_RELEASE( m_pPixelShaderYELLOW );
-	SAFE_RELEASE( m_pPixelShaderPURPLE );
-	SAFE_RELEASE( m_pPixelShaderCYAN );
-	SAFE_RELEASE( m_pPixelShaderBLACK );
-    SAFE_RELEASE( m_pSkyPixelShader );
-
-    SAFE_RELEASE( m_pMeshTextures[ UNIT_DIFFUSE ] );
-    SAFE_RELEASE( m_pMeshTextures[ FACTORY_DIFFUSE ] );
-    SAFE_RELEASE( m_pMeshTextures[ TREE_DIFFUSE ] );
-    SAFE_RELEASE( m_pMeshTextures[ CONCRETE_DIFFUSE ] );
-    SAFE_RELEASE( m_pMeshTextures[ GRASS_DIFFUSE ] );
-    SAFE_RELEASE( m_pMeshTextures[ SKY_DIFFUSE ] );
-    SAFE_RELEASE( m_pMeshTextures[ SKY_DARK_DIFFUSE ] );
-
-    SAFE_RELEASE( m_pInstanceBuffers[ UNIT_MESH ] );
-    SAFE_RELEASE( m_pInstanceBuffers[ FACTORY_MESH ] );
-    SAFE_RELEASE( m_pInstanceBuffers[ TREE_MESH ] );
-    SAFE_RELEASE( m_pInstanceBuffers[ CONCRETE_MESH ] );
-    SAFE_RELEASE( m_pInstanceBuffers[ GRASS_MESH ] );
-    SAFE_RELEASE( m_pInstanceBuffers[ SKY_MESH ] );
+void Render::SetCamera( const XMMATRIX& mViewProj )
+{
+    // With row vectors each plane is a sum of the matrix's columns
+    XMMATRIX mColumns = XMMatrixTranspose( mViewProj );
+
+    m_vFrustumPlanes[0] = XMPlaneNormalize( mColumns.r[3] + mColumns.r[0] );
+    m_vFrustumPlanes[1] = XMPlaneNormalize( mColumns.r[3] - mColumns.r[0] );
+    m_vFrustumPlanes[2] = XMPlaneNormalize( mColumns.r[3] + mColumns.r[1] );
+    m_vFrustumPlanes[3] = XMPlaneNormalize( mColumns.r[3] - mColumns.r[1] );
+    m_vFrustumPlanes[4] = XMPlaneNormalize( mColumns.r[2] );
+    m_vFrustumPlanes[5] = XMPlaneNormalize( mColumns.r[3] - mColumns.r[2] );
 }
 
-void Render::SetCamera( const XMVECTOR& vCamPos,
-                        const XMVECTOR& vCamDir,
-                        const float fCamFOV )
+unsigned int Render::CullRange( const XMMATRIX* pTransforms,
+                                unsigned int nStart,
+                                unsigned int nEnd,
+                                float fRadius,
+                                unsigned int* pVisible )
 {
-    m_vCamPos = vCamPos;
-    m_vCamDir = vCamDir;
-    m_fCamFOV = cos( fCamFOV );
+    __m128 PlaneX[6], PlaneY[6], PlaneZ[6], PlaneW[6];
+    for( unsigned int p = 0; p < 6; ++p )
+    {
+        PlaneX[p] = XMVectorSplatX( m_vFrustumPlanes[p] );
+        PlaneY[p] = XMVectorSplatY( m_vFrustumPlanes[p] );
+        PlaneZ[p] = XMVectorSplatZ( m_vFrustumPlanes[p] );
+        PlaneW[p] = XMVectorSplatW( m_vFrustumPlanes[p] );
+    }
+    __m128 NegRadius = _mm_set1_ps( -fRadius );
+
+    unsigned int nVisible = 0;
+    unsigned int i = nStart;
+    for( ; i + 4 <= nEnd; i += 4 )
+    {
+        // The translation rows of four transforms, turned into x, y and z
+        //   of four positions
+        __m128 X = _mm_loadu_ps( &pTransforms[i + 0]._41 );
+        __m128 Y = _mm_loadu_ps( &pTransforms[i + 1]._41 );
+        __m128 Z = _mm_loadu_ps( &pTransforms[i + 2]._41 );
+        __m128 W = _mm_loadu_ps( &pTransforms[i + 3]._41 );
+        _MM_TRANSPOSE4_PS( X, Y, Z, W );
+
+        __m128 Inside = _mm_cmpeq_ps( X, X );
+        for( unsigned int p = 0; p < 6; ++p )
+        {
+            __m128 Distance = _mm_add_ps( _mm_add_ps( _mm_mul_ps( X, PlaneX[p] ), _mm_mul_ps( Y, PlaneY[p] ) ),
+                                          _mm_add_ps( _mm_mul_ps( Z, PlaneZ[p] ), PlaneW[p] ) );
+            Inside = _mm_and_ps( Inside, _mm_cmpgt_ps( Distance, NegRadius ) );
+        }
+
+        // All four lanes are stored; the count only moves past the visible
+        //   ones.  The store stays inside the range as nVisible <= i - nStart.
+        int nMask = _mm_movemask_ps( Inside );
+        __m128i Lanes = _mm_loadu_si128( ( const __m128i* )gs_pPackedLanes[ nMask ] );
+        _mm_storeu_si128( ( __m128i* )( pVisible + nVisible ), _mm_add_epi32( Lanes, _mm_set1_epi32( i ) ) );
+        nVisible += gs_pLaneCounts[ nMask ];
+    }
+
+    for( ; i < nEnd; ++i )
+    {
+        XMVECTOR vPosition = XMVectorSet( pTransforms[i]._41, pTransforms[i]._42, pTransforms[i]._43, 1.0f );
+
+        bool bInside = true;
+        for( unsigned int p = 0; p < 6 && bInside; ++p )
+        {
+            bInside = XMVectorGetX( XMPlaneDot( m_vFrustumPlanes[p], vPosition ) ) > -fRadius;
+        }
+
+        if( bInside )
+        {
+            pVisible[nVisible++] = i;
+        }
+    }
+
+    return nVisible;
 }
 
-void Render::DrawSky( void )
+void Render::CullTask( void* pVoid,
+                       int nContext,
+                       unsigned int uTaskId,
+                       unsigned int uTaskCount )
 {
     GPA_SCOPED_TASK( __FUNCTION__, s_pRenderDomain );
 
-    ID3D11ShaderResourceView* pLightTexture = m_pMeshTextures[ SKY_DIFFUSE ];
-    ID3D11ShaderResourceView* pDarktTexture = m_pMeshTextures[ SKY_DARK_DIFFUSE ];
-    ColonyMesh* pInstancedMesh = m_pMeshes[ SKY_MESH ];
-    unsigned int nVertexStride = pInstancedMesh->GetVertexStride();
-    ID3D11Buffer* pVertexBuffer = pInstancedMesh->GetVertexBuffer();
-    ID3D11Buffer* pIndexBuffer = pInstancedMesh->GetIndexBuffer();
-    DXGI_FORMAT nIndexFormat = pInstancedMesh->GetIndexFormat();
-    unsigned int nIndexCount = pInstancedMesh->GetIndexCount();
+    CullArgs* pArgs = ( CullArgs* )pVoid;
 
-    m_pContext->IASetPrimitiveTopology( D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
-    m_pContext->IASetInputLayout( m_pInputLayout );
-    m_pContext->VSSetShader( m_pVertexShader, NULL, 0 );
-    m_pContext->PSSetShader( m_pSkyPixelShader, NULL, 0 );
-    m_pContext->PSSetSamplers( 0, 1, &m_pSamplerState );
+    // Ranges are whole groups of four, the last one takes the rest
+    unsigned int nChunk = ( ( pArgs->nInstanceCount + uTaskCount - 1 ) / uTaskCount + 3 ) & ~3u;
+    unsigned int nStart = min( nChunk * uTaskId, pArgs->nInstanceCount );
+    unsigned int nEnd = min( nStart + nChunk, pArgs->nInstanceCount );
 
-    UINT Strides[2] =
-    { nVertexStride, sizeof( XMMATRIX ) };
-    UINT Offsets[2] =
-    { 0, 0 };
+    pArgs->pStart[ uTaskId ] = nStart;
+    pArgs->pVisibleCount[ uTaskId ] = CullRange( pArgs->pTransforms, nStart, nEnd, pArgs->fRadius,
+                                                 pArgs->pVisible + nStart );
+}
+
+void Render::DrawSky( void )
+{
+    GPA_SCOPED_TASK( __FUNCTION__, s_pRenderDomain );
+
+    m_pDevice->SetPipeline( SKY_PS );
 
-    static bool bUpdateTransforms = true;
-    if( bUpdateTransforms )
+    if( gs_bUpdateSkyTransform )
     {
         static XMMATRIX mTransforms = XMMatrixScaling( gs_fTileSize * 3.6f, gs_fTileSize * 3.6f, gs_fTileSize * 3.6f ) 
                                      * XMMatrixTranslation( gs_fWorldSize / 2, 0.0f, gs_fWorldSize / 2 );
-
-        D3D11_MAPPED_SUBRESOURCE MappedResource;
-        m_pContext->Map( m_pInstanceBuffers[SKY_MESH], 0, D3D11_MAP_WRITE_DISCARD, 0, &MappedResource );
-        XMMATRIX* pMatrices = ( XMMATRIX* )MappedResource.pData;
-        memcpy_s( pMatrices, sizeof( XMMATRIX ), &mTransforms, sizeof( XMMATRIX ) );
-        m_pContext->Unmap( m_pInstanceBuffers[SKY_MESH], 0 );
-        bUpdateTransforms = false;
+        UploadInstances( SKY_MESH, &mTransforms, 1 );
+        gs_bUpdateSkyTransform = false;
     }
-    ID3D11Buffer* pVB[2] =
-    { pVertexBuffer, m_pInstanceBuffers[SKY_MESH] };
 
-    m_pContext->IASetVertexBuffers( 0, 2, pVB, Strides, Offsets );
-    m_pContext->IASetIndexBuffer( pIndexBuffer, nIndexFormat, 0 );
-    m_pContext->PSSetShaderResources( 1, 1, &pLightTexture );
-    m_pContext->PSSetShaderResources( 2, 1, &pDarktTexture );
-    m_pContext->DrawIndexed( nIndexCount, 0, 0 );
+    m_pDevice->SetMesh( SKY_MESH );
+    m_pDevice->SetTexture( 1, SKY_DIFFUSE );
+    m_pDevice->SetTexture( 2, SKY_DARK_DIFFUSE );
+    m_pDevice->Draw( SKY_MESH );
 }
-
@@ -16,35 +16,12 @@
 #include "SDKmesh.h"
 #include "SDKmisc.h"
 #include "Game.h"
+#include "RenderDevice.h"
 
 // The maximum objects rendered per draw call
 static const unsigned int   gs_nMaxPerDraw = max( gs_nWorldSizeSq, gs_nMaxUnits );
 
 
-
-enum MeshType
-{
-    UNIT_MESH = 0,
-    FACTORY_MESH,
-    TREE_MESH,
-    CONCRETE_MESH,
-    GRASS_MESH,
-    SKY_MESH,
-    MESH_COUNT,
-};
-
-enum TextureType
-{
-    UNIT_DIFFUSE = 0,
-    FACTORY_DIFFUSE,
-    TREE_DIFFUSE,
-    CONCRETE_DIFFUSE,
-    GRASS_DIFFUSE,
-    SKY_DIFFUSE,
-    SKY_DARK_DIFFUSE,
-    TEXTURE_COUNT,
-};
-
 typedef struct _STANDARD_VERTEX
 {
     XMFLOAT3 Position;
@@ -115,45 +92,141 @@ public:
     }
 };
 
+// D3D11RenderDevice class
+// Draws with the DXUT device.  Owns the meshes, textures, shaders, the
+// dynamic instance buffers and the default usage persistent ones.
+class D3D11RenderDevice : public RenderDevice
+{
+public:
+    D3D11RenderDevice( void );
+    virtual ~D3D11RenderDevice( void );
+
+    virtual bool Init( void );
+
+private:
+    HRESULT CreateResources( void );
+
+    virtual void OnSetPipeline( PixelShaderType Shader );
+    virtual void OnSetMesh( MeshType Type,
+                            bool bPersistent );
+    virtual void OnSetTexture( unsigned int nSlot,
+                               TextureType Texture );
+    virtual void* OnMapInstances( MeshType Type );
+    virtual void OnUnmapInstances( MeshType Type );
+    virtual void OnUpdateInstances( MeshType Type,
+                                    unsigned int nFirst,
+                                    const void* pInstances,
+                                    unsigned int nInstances );
+    virtual void OnDrawInstanced( MeshType Type,
+                                  unsigned int nInstances,
+                                  unsigned int nFirstInstance );
+    virtual void OnDraw( MeshType Type );
+
+    ID3D11ShaderResourceView* m_pMeshTextures[TEXTURE_COUNT];
+    ColonyMesh* m_pMeshes[MESH_COUNT];
+    ID3D11Buffer* m_pInstanceBuffers[MESH_COUNT];
+    ID3D11Buffer* m_pPersistentBuffers[MESH_COUNT];
+    ID3D11SamplerState* m_pSamplerState;
+    ID3D11Device* m_pDevice;
+    ID3D11DeviceContext* m_pContext;
+    ID3D11InputLayout* m_pInputLayout;
+    ID3D11VertexShader* m_pVertexShader;
+    ID3D11PixelShader* m_pPixelShaders[PIXEL_SHADER_COUNT];
+};
+
 // Render class
+// Culls and packs the instances of each draw and submits them to the
+// RenderDevice Init created.
+//
+// Culling tests a bounding sphere per instance, centred on its translation,
+// against the six planes of the view frustum.  Four instances are tested at
+// a time and the indices of the visible ones packed with a lookup on the
+// lane mask; large draws split the instances across TaskMgr tasks.
 class Render
 {
 private:
-    static XMMATRIX m_pVisible[ gs_nMaxPerDraw ];
-    static XMVECTOR m_vCamPos;
-    static XMVECTOR m_vCamDir;
-    static float m_fCamFOV;
+    // Frustum planes, left, right, bottom, top, near and far, normalized and
+    // facing in
+    static XMVECTOR m_vFrustumPlanes[6];
     static unsigned int m_nObjectsRendered;
-    static ID3D11ShaderResourceView* m_pMeshTextures[TEXTURE_COUNT];
-    static ColonyMesh* m_pMeshes[MESH_COUNT];
-    static ID3D11Buffer* m_pInstanceBuffers[MESH_COUNT];
-    static ID3D11SamplerState* m_pSamplerState;
-    static ID3D11Device* m_pDevice;
-    static ID3D11DeviceContext* m_pContext;
-    static ID3D11InputLayout* m_pInputLayout;
-    static ID3D11VertexShader* m_pVertexShader;
-    static ID3D11PixelShader* m_pPixelShader;
-	static ID3D11PixelShader* m_pPixelShaderRED;
-	static ID3D11PixelShader* m_pPixelShaderGREEN;
-	static ID3D11PixelShader* m_pPixelShaderBLUE;
-	static ID3D11PixelShader* m_pPixelShaderPURPLE;
-	static ID3D11PixelShader* m_pPixelShaderYELLOW;
-	static ID3D11PixelShader* m_pPixelShaderCYAN;
-	static ID3D11PixelShader* m_pPixelShaderBLACK;
-    static ID3D11PixelShader* m_pSkyPixelShader;
+    static unsigned int m_nCullTasks;
+    static unsigned int m_nDeviceGeneration;
+    static RenderDevice* m_pDevice;
+
+    static void UploadInstances( MeshType Type,
+                                 const XMMATRIX* pTransforms,
+                                 unsigned int nInstanceCount );
+
+    // Write the indices, from nStart, of the instances in [nStart, nEnd)
+    // whose spheres of fRadius touch the frustum to pVisible, in order.
+    // Returns how many were written.  pVisible needs room for nEnd - nStart.
+    static unsigned int CullRange( const XMMATRIX* pTransforms,
+                                   unsigned int nStart,
+                                   unsigned int nEnd,
+                                   float fRadius,
+                                   unsigned int* pVisible );
+
+    static void CullTask( void* pVoid,
+                          int nContext,
+                          unsigned int uTaskId,
+                          unsigned int uTaskCount );
 
 public:
-    static HRESULT Init( void );
-    static void SetCamera( const XMVECTOR& vCamPos,
-                           const XMVECTOR& vCamDir,
-                           const float fCamFOV = XM_PIDIV4 );
+    static HRESULT Init( RenderBackend Backend = D3D11_RENDER_BACKEND );
+
+    // The view projection the frame is drawn with, row vector, D3D clip space
+    static void SetCamera( const XMMATRIX& mViewProj );
     static void DrawInstanced( XMMATRIX* pTransforms,
                                MeshType Type,
                                unsigned int nInstanceCount,
                                bool bUpdateTransforms,
-                               bool bCullObjects, 
-							   ColorFilter filter = ColorFilter::WHITE);
+                               bool bCullObjects );
     static void DrawTerrain( void );
     static void DrawSky( void );
     static void Destroy( void );
+
+    // Persistent instances.  A new device starts with empty persistent
+    //   buffers, so a change of generation means everything in them has to
+    //   be written again.
+    static unsigned int GetDeviceGeneration( void )
+    {
+        return m_nDeviceGeneration;
+    }
+    static void UpdatePersistentInstances( MeshType Type,
+                                           unsigned int nFirst,
+                                           const XMMATRIX* pTransforms,
+                                           unsigned int nInstanceCount );
+
+    // Draw nRanges ranges of Type's persistent instances, range i being
+    //   pCounts[i] instances from pFirst[i].  Culling is up to the caller.
+    static void DrawPersistentInstanced( MeshType Type,
+                                         const unsigned int* pFirst,
+                                         const unsigned int* pCounts,
+                                         unsigned int nRanges );
+
+    // Radius around an instance's translation that holds Type's mesh
+    static float GetBoundingRadius( MeshType Type );
+
+    // Whether the box of half size vExtents around vCenter touches the
+    //   frustum
+    static bool IsBoxVisible( const XMVECTOR& vCenter,
+                              const XMVECTOR& vExtents );
+
+    // What was submitted since ResetStats
+    static const RenderDevice::Stats& GetStats( void )
+    {
+        return m_pDevice->GetStats();
+    }
+    static void ResetStats( void )
+    {
+        m_pDevice->ResetStats();
+        m_nCullTasks = 0;
+    }
+
+    // Cull tasks run since ResetStats; a draw culled on the main thread
+    //   counts as one
+    static unsigned int GetCullTasks( void )
+    {
+        return m_nCullTasks;
+    }
 };
@@ -0,0 +1,259 @@
+// Copyright 2010 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+#include "RenderDevice.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// Instance buffer writes are whole 4x4 float matrices
+static const unsigned int   gs_nInstanceSize = 16 * sizeof( float );
+
+// Draws kept by the null device before the vector has to grow
+static const unsigned int   gs_nNullDrawReserve = 64;
+
+// The null device's buffers are aligned like the D3D11 ones, for SSE stores
+static const size_t         gs_nInstanceAlignment = 16;
+
+static void* AllocateInstances( size_t nBytes )
+{
+#ifdef _WIN32
+    return _aligned_malloc( nBytes, gs_nInstanceAlignment );
+#else
+    void* p = NULL;
+    return posix_memalign( &p, gs_nInstanceAlignment, nBytes ) == 0 ? p : NULL;
+#endif
+}
+
+static void FreeInstances( void* p )
+{
+#ifdef _WIN32
+    _aligned_free( p );
+#else
+    free( p );
+#endif
+}
+
+
+// RenderDevice class definitions //
+
+RenderDevice::RenderDevice( void )
+{
+    memset( &m_Stats, 0, sizeof( m_Stats ) );
+    m_CurrentShader = PIXEL_SHADER_COUNT;
+}
+
+void RenderDevice::SetPipeline( PixelShaderType Shader )
+{
+    m_Stats.nStateChanges += 5;
+    if( Shader != m_CurrentShader )
+    {
+        ++m_Stats.nShaderChanges;
+        m_CurrentShader = Shader;
+    }
+    OnSetPipeline( Shader );
+}
+
+void RenderDevice::SetMesh( MeshType Type,
+                            bool bPersistent )
+{
+    m_Stats.nStateChanges += 2;
+    OnSetMesh( Type, bPersistent );
+}
+
+void RenderDevice::SetTexture( unsigned int nSlot,
+                               TextureType Texture )
+{
+    ++m_Stats.nStateChanges;
+    OnSetTexture( nSlot, Texture );
+}
+
+void* RenderDevice::MapInstances( MeshType Type )
+{
+    ++m_Stats.nMaps;
+    return OnMapInstances( Type );
+}
+
+void RenderDevice::UnmapInstances( MeshType Type,
+                                   unsigned int nBytes )
+{
+    m_Stats.nBytesUploaded += nBytes;
+    OnUnmapInstances( Type );
+}
+
+void RenderDevice::UpdateInstances( MeshType Type,
+                                    unsigned int nFirst,
+                                    const void* pInstances,
+                                    unsigned int nInstances )
+{
+    ++m_Stats.nUpdates;
+    m_Stats.nBytesUploaded += nInstances * gs_nInstanceSize;
+    OnUpdateInstances( Type, nFirst, pInstances, nInstances );
+}
+
+void RenderDevice::DrawInstanced( MeshType Type,
+                                  unsigned int nInstances,
+                                  unsigned int nFirstInstance )
+{
+    ++m_Stats.nDraws;
+    ++m_Stats.pMeshDraws[ Type ];
+    m_Stats.nInstances += nInstances;
+    OnDrawInstanced( Type, nInstances, nFirstInstance );
+}
+
+void RenderDevice::Draw( MeshType Type )
+{
+    ++m_Stats.nDraws;
+    ++m_Stats.pMeshDraws[ Type ];
+    ++m_Stats.nInstances;
+    OnDraw( Type );
+}
+
+void RenderDevice::ResetStats( void )
+{
+    memset( &m_Stats, 0, sizeof( m_Stats ) );
+}
+
+unsigned int RenderDevice::GetInstanceCapacity( MeshType Type )
+{
+    switch( Type )
+    {
+    case UNIT_MESH:
+        return gs_nMaxUnits * gs_nInstanceSize;
+    case FACTORY_MESH:
+        return gs_nMaxFactories * gs_nInstanceSize;
+    default:
+        // Trees and concrete draw from their persistent buffers, so theirs
+        //   only has to exist
+        return gs_nInstanceSize;
+    }
+}
+
+unsigned int RenderDevice::GetPersistentCapacity( MeshType Type )
+{
+    switch( Type )
+    {
+    case CONCRETE_MESH:
+        // Paved tiles, which only change as they are paved
+        return gs_nWorldSizeSq * gs_nInstanceSize;
+    case TREE_MESH:
+        // The trees in the world, then the ones around it
+        return 2 * gs_nTreeCount * gs_nInstanceSize;
+    default:
+        return 0;
+    }
+}
+
+
+// NullRenderDevice class definitions //
+
+NullRenderDevice::NullRenderDevice( void ) : m_Shader( PIXEL_SHADER_COUNT ),
+                                             m_bPersistent( false )
+{
+    memset( m_pInstances, 0, sizeof( m_pInstances ) );
+    memset( m_pPersistentInstances, 0, sizeof( m_pPersistentInstances ) );
+    m_Draws.reserve( gs_nNullDrawReserve );
+}
+
+NullRenderDevice::~NullRenderDevice( void )
+{
+    for( unsigned int i = 0; i < MESH_COUNT; ++i )
+    {
+        FreeInstances( m_pInstances[i] );
+        FreeInstances( m_pPersistentInstances[i] );
+    }
+}
+
+bool NullRenderDevice::Init( void )
+{
+    // The same sizes as the D3D11 buffers, written the same way
+    for( unsigned int i = 0; i < MESH_COUNT; ++i )
+    {
+        unsigned int nCapacity = GetInstanceCapacity( ( MeshType )i );
+        m_pInstances[i] = AllocateInstances( nCapacity );
+        if( NULL == m_pInstances[i] )
+        {
+            return false;
+        }
+        memset( m_pInstances[i], 0, nCapacity );
+
+        nCapacity = GetPersistentCapacity( ( MeshType )i );
+        if( nCapacity > 0 )
+        {
+            m_pPersistentInstances[i] = AllocateInstances( nCapacity );
+            if( NULL == m_pPersistentInstances[i] )
+            {
+                return false;
+            }
+            memset( m_pPersistentInstances[i], 0, nCapacity );
+        }
+    }
+
+    return true;
+}
+
+void NullRenderDevice::ResetStats( void )
+{
+    RenderDevice::ResetStats();
+    m_Draws.clear();
+}
+
+void NullRenderDevice::OnSetPipeline( PixelShaderType Shader )
+{
+    m_Shader = Shader;
+}
+
+void NullRenderDevice::OnSetMesh( MeshType Type,
+                                  bool bPersistent )
+{
+    m_bPersistent = bPersistent;
+}
+
+void NullRenderDevice::OnSetTexture( unsigned int nSlot,
+                                     TextureType Texture )
+{
+}
+
+void* NullRenderDevice::OnMapInstances( MeshType Type )
+{
+    return m_pInstances[ Type ];
+}
+
+void NullRenderDevice::OnUnmapInstances( MeshType Type )
+{
+}
+
+void NullRenderDevice::OnUpdateInstances( MeshType Type,
+                                          unsigned int nFirst,
+                                          const void* pInstances,
+                                          unsigned int nInstances )
+{
+    memcpy( ( char* )m_pPersistentInstances[ Type ] + nFirst * gs_nInstanceSize, pInstances,
+            nInstances * gs_nInstanceSize );
+}
+
+void NullRenderDevice::OnDrawInstanced( MeshType Type,
+                                        unsigned int nInstances,
+                                        unsigned int nFirstInstance )
+{
+    DrawRecord Record = { Type, m_Shader, m_bPersistent, nFirstInstance, nInstances };
+    m_Draws.push_back( Record );
+}
+
+void NullRenderDevice::OnDraw( MeshType Type )
+{
+    DrawRecord Record = { Type, m_Shader, m_bPersistent, 0, 1 };
+    m_Draws.push_back( Record );
+}
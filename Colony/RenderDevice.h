@@ -0,0 +1,227 @@
+// Copyright 2010 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+#pragma once
+#ifndef _RENDERDEVICE_H_
+#define _RENDERDEVICE_H_
+
+#include "ColonyDefines.h"
+#include <stddef.h>
+#include <vector>
+
+enum MeshType
+{
+    UNIT_MESH = 0,
+    FACTORY_MESH,
+    TREE_MESH,
+    CONCRETE_MESH,
+    GRASS_MESH,
+    SKY_MESH,
+    MESH_COUNT,
+};
+
+enum TextureType
+{
+    UNIT_DIFFUSE = 0,
+    FACTORY_DIFFUSE,
+    TREE_DIFFUSE,
+    CONCRETE_DIFFUSE,
+    GRASS_DIFFUSE,
+    SKY_DIFFUSE,
+    SKY_DARK_DIFFUSE,
+    TEXTURE_COUNT,
+};
+
+// Meshes share one pixel shader, which takes each instance's colour from
+//   its transform; the sky has its own
+enum PixelShaderType
+{
+    MESH_PS = 0,
+    SKY_PS,
+    PIXEL_SHADER_COUNT,
+};
+
+enum RenderBackend
+{
+    D3D11_RENDER_BACKEND = 0,       // Draws with the DXUT device
+    NULL_RENDER_BACKEND,            // Does the CPU work and counts it, draws nothing
+};
+
+// RenderDevice is everything Render submits for a draw: the pipeline, the
+// mesh and textures to bind, writes to the per mesh instance buffers and
+// the draw itself.  Render culls and packs instances the same way whatever
+// the device, so with the null device the CPU side of rendering can be
+// measured without a GPU.
+//
+// Meshes with a persistent capacity also have a persistent instance buffer,
+// kept across frames and written a range at a time with UpdateInstances,
+// for instances that rarely change.  Draws from it give the first instance.
+//
+// The device counts what is submitted.  A state change is one call the
+// D3D11 context would take: SetPipeline sets the topology, input layout,
+// vertex shader, pixel shader and sampler, SetMesh the vertex and index
+// buffers, SetTexture one texture.
+//
+// RenderDevice and NullRenderDevice need neither DXUT nor Windows, so the
+// CPU side of rendering builds wherever the simulation does.
+class RenderDevice
+{
+public:
+    struct Stats
+    {
+        unsigned int nDraws;
+        unsigned int nInstances;
+        unsigned int nStateChanges;
+        unsigned int nShaderChanges;        // Pixel shader switches
+        unsigned int nMaps;
+        unsigned int nUpdates;              // Persistent range writes
+        unsigned long long nBytesUploaded;
+        unsigned int pMeshDraws[ MESH_COUNT ];
+    };
+
+    RenderDevice( void );
+    virtual ~RenderDevice( void )
+    {
+    }
+
+    // Create the instance buffers and whatever else the device draws with.
+    //   False on failure.
+    virtual bool Init( void ) = 0;
+
+    // Bind the instanced vertex shader and input layout, Shader and the sampler
+    void SetPipeline( PixelShaderType Shader );
+
+    // Bind Type's vertex and index buffers and its instance buffer, or its
+    // persistent instance buffer
+    void SetMesh( MeshType Type,
+                  bool bPersistent = false );
+
+    void SetTexture( unsigned int nSlot,
+                     TextureType Texture );
+
+    // Write access to Type's instance buffer, whose old contents are
+    // discarded.  Unmap with the bytes written.
+    void* MapInstances( MeshType Type );
+    void UnmapInstances( MeshType Type,
+                         unsigned int nBytes );
+
+    // Write nInstances transforms to Type's persistent instance buffer from
+    // instance nFirst.  The rest of the buffer keeps its contents.
+    void UpdateInstances( MeshType Type,
+                          unsigned int nFirst,
+                          const void* pInstances,
+                          unsigned int nInstances );
+
+    // Draw nInstances instances of Type from nFirstInstance, or Type with
+    // its first instance
+    void DrawInstanced( MeshType Type,
+                        unsigned int nInstances,
+                        unsigned int nFirstInstance = 0 );
+    void Draw( MeshType Type );
+
+    const Stats& GetStats( void ) const
+    {
+        return m_Stats;
+    }
+    virtual void ResetStats( void );
+
+    // Bytes in Type's instance buffer, and in its persistent instance
+    // buffer, 0 for none
+    static unsigned int GetInstanceCapacity( MeshType Type );
+    static unsigned int GetPersistentCapacity( MeshType Type );
+
+private:
+    RenderDevice( const RenderDevice& );
+    RenderDevice& operator=( const RenderDevice& );
+
+    virtual void OnSetPipeline( PixelShaderType Shader ) = 0;
+    virtual void OnSetMesh( MeshType Type,
+                            bool bPersistent ) = 0;
+    virtual void OnSetTexture( unsigned int nSlot,
+                               TextureType Texture ) = 0;
+    virtual void* OnMapInstances( MeshType Type ) = 0;
+    virtual void OnUnmapInstances( MeshType Type ) = 0;
+    virtual void OnUpdateInstances( MeshType Type,
+                                    unsigned int nFirst,
+                                    const void* pInstances,
+                                    unsigned int nInstances ) = 0;
+    virtual void OnDrawInstanced( MeshType Type,
+                                  unsigned int nInstances,
+                                  unsigned int nFirstInstance ) = 0;
+    virtual void OnDraw( MeshType Type ) = 0;
+
+    Stats m_Stats;
+    PixelShaderType m_CurrentShader;
+};
+
+// Keeps the instance buffers in host memory and records the draws instead
+// of making them.
+class NullRenderDevice : public RenderDevice
+{
+public:
+    struct DrawRecord
+    {
+        MeshType Type;
+        PixelShaderType Shader;
+        bool bPersistent;
+        unsigned int nFirstInstance;
+        unsigned int nInstances;
+    };
+
+    NullRenderDevice( void );
+    virtual ~NullRenderDevice( void );
+
+    virtual bool Init( void );
+
+    // The draws since ResetStats
+    const std::vector<DrawRecord>& GetDraws( void ) const
+    {
+        return m_Draws;
+    }
+    virtual void ResetStats( void );
+
+    // The instance buffer as the last Unmap left it, and the persistent one
+    const void* GetInstances( MeshType Type ) const
+    {
+        return m_pInstances[ Type ];
+    }
+    const void* GetPersistentInstances( MeshType Type ) const
+    {
+        return m_pPersistentInstances[ Type ];
+    }
+
+private:
+    virtual void OnSetPipeline( PixelShaderType Shader );
+    virtual void OnSetMesh( MeshType Type,
+                            bool bPersistent );
+    virtual void OnSetTexture( unsigned int nSlot,
+                               TextureType Texture );
+    virtual void* OnMapInstances( MeshType Type );
+    virtual void OnUnmapInstances( MeshType Type );
+    virtual void OnUpdateInstances( MeshType Type,
+                                    unsigned int nFirst,
+                                    const void* pInstances,
+                                    unsigned int nInstances );
+    virtual void OnDrawInstanced( MeshType Type,
+                                  unsigned int nInstances,
+                                  unsigned int nFirstInstance );
+    virtual void OnDraw( MeshType Type );
+
+    void* m_pInstances[ MESH_COUNT ];
+    void* m_pPersistentInstances[ MESH_COUNT ];
+    PixelShaderType m_Shader;
+    bool m_bPersistent;
+    std::vector<DrawRecord> m_Draws;
+};
+
+#endif // _RENDERDEVICE_H_
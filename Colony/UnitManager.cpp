@@ -15,6 +15,11 @@
 #include "Game.h"
 #include "ColonyMath.h"
 #include "Instrumentation.h"
+#include "FrameArena.h"
+#include "PerfCounters.h"
+#include "FrameStats.h"
+#include "SnapshotFile.h"
+#include "TrajectoryRecorder.h"
 #include <intrin.h>
 
 // Intel GPA 4.0 defines
@@ -25,6 +30,13 @@ TASKSETHANDLE   UnitManager::m_hBin = TASKSETHANDLE_INVALID;
 TASKSETHANDLE   UnitManager::m_hDirection = TASKSETHANDLE_INVALID;
 TASKSETHANDLE   UnitManager::m_hUpdate = TASKSETHANDLE_INVALID;
 
+const char* const UnitManager::s_szPhaseNames[ PhaseCount ] =
+{
+    "FillBins",
+    "CalculateDirection",
+    "Update",
+};
+
 extern bool     g_bUseSIMD;
 extern bool     g_bThreaded;
 extern bool     g_bComputeAcrossFrames;
@@ -32,6 +44,7 @@ extern bool     g_bComputeAcrossFrames;
 UnitManager::UnitManager( void ) : m_nNumUnits( 0 ),
                                    m_nFluidNumUnits( 0 ),
                                    m_fElapsedTime( 0.0f ),
+                                   m_nBinOverflows( 0 ),
                                    m_bStarted( false ) {}
 
 UnitManager::~UnitManager( void ) {}
@@ -46,6 +59,14 @@ float GetRandValue( float fMin,
     return fRand;
 }
 
+// Colour of SIMD group nUnit of nNumUnits, the groups being split evenly
+//   between the factions in order
+static ColorFilter GetFactionColor( unsigned int nUnit,
+                                    unsigned int nNumUnits )
+{
+    return gs_pFactionColors[ gs_nMaxFactories * nUnit / nNumUnits ];
+}
+
 void UnitManager::StopWork( void )
 {
     if( m_bStarted )
@@ -56,26 +77,71 @@ void UnitManager::StopWork( void )
         gTaskMgr.ReleaseHandle( m_hDirection );
         gTaskMgr.ReleaseHandle( m_hBin );
 
+        m_hUpdate = TASKSETHANDLE_INVALID;
+        m_hDirection = TASKSETHANDLE_INVALID;
+        m_hBin = TASKSETHANDLE_INVALID;
+
         m_bStarted = false;
     }
 }
 
+void UnitManager::CancelWork( void )
+{
+    if( m_bStarted )
+    {
+        // Cancel the whole chain, tasks that haven't started are skipped
+        //   and CalculateDirectionTask bails out at its next chunk
+        gTaskMgr.CancelSet( m_hBin );
+        gTaskMgr.CancelSet( m_hDirection );
+        gTaskMgr.CancelSet( m_hUpdate );
+    }
+
+    StopWork();
+}
+
 void UnitManager::Initialize( Game* pGame )
 {
     m_pGame = pGame;
     m_nNumUnits = gs_nStartingUnits;
     m_nFluidNumUnits = m_nNumUnits;
     m_fElapsedTime = 0.0f;
+    m_nBinOverflows = 0;
     m_bStarted = false;
 
     // Zero out structures
     ZeroMemory( m_pBins, sizeof( m_pBins ) );
-    ZeroMemory( m_nUnitIndices, sizeof( m_nUnitIndices ) );
-    ZeroMemory( m_UnitPositionData, sizeof( m_UnitPositionData ) );
-    ZeroMemory( m_UnitSharedData, sizeof( m_UnitSharedData ) );
-    ZeroMemory( m_UnitCalculateDirection, sizeof( m_UnitCalculateDirection ) );
-    ZeroMemory( m_UnitUpdate, sizeof( m_UnitUpdate ) );
-    ZeroMemory( m_UnitRender, sizeof( m_UnitRender ) );
+
+    // The unit data is zeroed by the same task ranges and affinity key as
+    //   the per frame sets, so each range's pages are first touched by the
+    //   worker that keeps running it and land on that worker's NUMA node
+    if( g_bThreaded )
+    {
+        unsigned int uTasksToSpawn = gs_nTBBTaskCount;
+
+        if( 0 == uTasksToSpawn )
+        {
+            uTasksToSpawn = m_nNumUnits;
+        }
+
+        TASKSETHANDLE hFirstTouch;
+        gTaskMgr.CreateTaskSet( FirstTouchTask,
+                                this,
+                                uTasksToSpawn,
+                                NULL,
+                                0,
+                                "FirstTouchTask",
+                                &hFirstTouch,
+                                TASKSETHANDLE_INVALID,
+                                TASKSETPRIORITY_NORMAL,
+                                gs_nUnitAffinityKey );
+
+        gTaskMgr.WaitForSet( hFirstTouch );
+        gTaskMgr.ReleaseHandle( hFirstTouch );
+    }
+    else
+    {
+        FirstTouchTask( this, 0, 0, 1 );
+    }
 
     // Now initialize units with random positions
     for( unsigned int i = 0; i < gs_nUnitTaskCount; ++i )
@@ -163,6 +229,13 @@ void UnitManager::Update( float fElapsedTime )
 
         GPA_SCOPED_TASK( __FUNCTION__, s_pUnitMgrDomain );
 
+        // The three sets split the units into the same ranges, so they share
+        //   an affinity key to keep each range on the same worker from phase
+        //   to phase and frame to frame.
+        // When computing across frames the simulation overlaps the next
+        //   frame's render, so it yields to frame-critical task sets
+        TASKSETPRIORITY ePriority = g_bComputeAcrossFrames ? TASKSETPRIORITY_LOW : TASKSETPRIORITY_NORMAL;
+
         // Zero out the bins
         for( int i = 0; i < gs_nBinCountSq; ++i )
         {
@@ -176,7 +249,10 @@ void UnitManager::Update( float fElapsedTime )
                                 NULL,
                                 0,
                                 "FillBinsTask",
-                                &m_hBin );
+                                &m_hBin,
+                                TASKSETHANDLE_INVALID,
+                                ePriority,
+                                gs_nUnitAffinityKey );
 
         // First calculate their directions
         gTaskMgr.CreateTaskSet( pCalculateDirection,
@@ -185,7 +261,10 @@ void UnitManager::Update( float fElapsedTime )
                                 &m_hBin,
                                 1,
                                 "CalculateDirectionTask",
-                                &m_hDirection );
+                                &m_hDirection,
+                                TASKSETHANDLE_INVALID,
+                                ePriority,
+                                gs_nUnitAffinityKey );
 
         // Then update them
         gTaskMgr.CreateTaskSet( pUpdate,
@@ -194,7 +273,10 @@ void UnitManager::Update( float fElapsedTime )
                                 &m_hDirection,
                                 1,
                                 "UpdateUnitTask",
-                                &m_hUpdate );
+                                &m_hUpdate,
+                                TASKSETHANDLE_INVALID,
+                                ePriority,
+                                gs_nUnitAffinityKey );
 
         m_bStarted = true;
 
@@ -238,37 +320,7 @@ void UnitManager::UnitLogic( unsigned int nUnit )
             if( !pTiles[nTileIndex].bActive )
             {
                 // Stop and pave the tile
-				int type = (int)floor(gs_nMaxFactories * (nUnit / (float)m_nNumUnits));
-				ColorFilter filter = WHITE;
-				switch(type)
-				{
-				case 0:
-					filter = WHITE;
-					break;
-				case 1:
-					filter = RED;
-					break;
-				case 2:
-					filter = BLUE;
-					break;
-				case 3:
-					filter = GREEN;
-					break;
-				case 4:
-					filter = PURPLE;
-					break;
-				case 5:
-					filter = YELLOW;
-					break;
-				case 6:
-					filter = CYAN;
-					break;
-				case 7:
-					filter = BLACK;
-					break;
-				}
-
-
+                ColorFilter filter = GetFactionColor( nUnit, m_nNumUnits );
                 if( !m_pGame->PaveTile( nTileIndex, filter ) )
                 {
                     m_UnitUpdate[nUnit].fSpeed[nLane] = 0.0f;
@@ -400,6 +452,142 @@ void UnitManager::SetUnitCount( unsigned int nUnits )
     }
 }
 
+void UnitManager::SetUnitPosition( unsigned int nUnit,
+                                   float fX,
+                                   float fY )
+{
+    assert( nUnit < gs_nMaxUnits );
+
+    m_UnitPositionData[ nUnit / gs_nSIMDWidth ].fPositionX[ nUnit % gs_nSIMDWidth ] = fX;
+    m_UnitPositionData[ nUnit / gs_nSIMDWidth ].fPositionY[ nUnit % gs_nSIMDWidth ] = fY;
+}
+
+unsigned int UnitManager::GetBinOverflows( void ) const
+{
+    return ( unsigned int )m_nBinOverflows;
+}
+
+// The unit counts as a snapshot stores them
+struct UnitSnapshotCounts
+{
+    unsigned int nNumUnits;
+    unsigned int nFluidNumUnits;
+    unsigned int nBinOverflows;
+    unsigned int nPadding;
+};
+
+static const unsigned int gs_nUnitCountsSection = SNAPSHOT_TAG( 'U', 'N', 'I', 'T' );
+static const unsigned int gs_nUnitPositionSection = SNAPSHOT_TAG( 'U', 'P', 'O', 'S' );
+static const unsigned int gs_nUnitSharedSection = SNAPSHOT_TAG( 'U', 'S', 'H', 'R' );
+static const unsigned int gs_nUnitDirectionSection = SNAPSHOT_TAG( 'U', 'C', 'A', 'L' );
+static const unsigned int gs_nUnitUpdateSection = SNAPSHOT_TAG( 'U', 'U', 'P', 'D' );
+static const unsigned int gs_nUnitRenderSection = SNAPSHOT_TAG( 'U', 'R', 'E', 'N' );
+
+// Units can be pushed off the map in play, so restored positions may lie up
+//   to a world's width past its edges.  Written so NaN fails too.
+static bool IsSnapshotPosition( float fPosition )
+{
+    return fPosition >= -gs_fWorldSize && fPosition <= 2.0f * gs_fWorldSize;
+}
+
+void UnitManager::WriteSnapshot( SnapshotWriter& Writer ) const
+{
+    assert( !m_bStarted );
+
+    UnitSnapshotCounts Counts = { m_nNumUnits, m_nFluidNumUnits, ( unsigned int )m_nBinOverflows, 0 };
+    Writer.AddSectionCopy( gs_nUnitCountsSection, &Counts, sizeof( Counts ) );
+
+    // The SoA arrays go as they are, a SIMD group per struct
+    Writer.AddSection( gs_nUnitPositionSection, m_UnitPositionData, sizeof( m_UnitPositionData ) );
+    Writer.AddSection( gs_nUnitSharedSection, m_UnitSharedData, sizeof( m_UnitSharedData ) );
+    Writer.AddSection( gs_nUnitDirectionSection, m_UnitCalculateDirection, sizeof( m_UnitCalculateDirection ) );
+    Writer.AddSection( gs_nUnitUpdateSection, m_UnitUpdate, sizeof( m_UnitUpdate ) );
+    Writer.AddSection( gs_nUnitRenderSection, m_UnitRender, sizeof( m_UnitRender ) );
+}
+
+bool UnitManager::ReadSnapshot( const SnapshotReader& Reader )
+{
+    assert( !m_bStarted );
+
+    const UnitSnapshotCounts* pCounts =
+        ( const UnitSnapshotCounts* )Reader.GetSection( gs_nUnitCountsSection, sizeof( UnitSnapshotCounts ) );
+    if( NULL == pCounts ||
+        pCounts->nNumUnits > gs_nUnitTaskCount ||
+        pCounts->nFluidNumUnits > gs_nUnitTaskCount ||
+        NULL == Reader.GetSection( gs_nUnitPositionSection, sizeof( m_UnitPositionData ) ) ||
+        NULL == Reader.GetSection( gs_nUnitSharedSection, sizeof( m_UnitSharedData ) ) ||
+        NULL == Reader.GetSection( gs_nUnitDirectionSection, sizeof( m_UnitCalculateDirection ) ) ||
+        NULL == Reader.GetSection( gs_nUnitUpdateSection, sizeof( m_UnitUpdate ) ) ||
+        NULL == Reader.GetSection( gs_nUnitRenderSection, sizeof( m_UnitRender ) ) )
+    {
+        return false;
+    }
+
+    // Goals index the tiles and positions the bins and tiles, unchecked, so
+    //   a file with any out of range is refused
+    const UnitPositionData* pPositionData =
+        ( const UnitPositionData* )Reader.GetSection( gs_nUnitPositionSection, sizeof( m_UnitPositionData ) );
+    const UnitSharedData* pSharedData =
+        ( const UnitSharedData* )Reader.GetSection( gs_nUnitSharedSection, sizeof( m_UnitSharedData ) );
+    const UnitUpdate* pUpdate = ( const UnitUpdate* )Reader.GetSection( gs_nUnitUpdateSection, sizeof( m_UnitUpdate ) );
+
+    for( unsigned int nUnit = 0; nUnit < gs_nUnitTaskCount; ++nUnit )
+    {
+        for( unsigned int nLane = 0; nLane < gs_nSIMDWidth; ++nLane )
+        {
+            if( pUpdate[nUnit].nGoalIndex[nLane] >= gs_nWorldSizeSq ||
+                !IsSnapshotPosition( pPositionData[nUnit].fPositionX[nLane] ) ||
+                !IsSnapshotPosition( pPositionData[nUnit].fPositionY[nLane] ) ||
+                !IsSnapshotPosition( pSharedData[nUnit].fGoalPositionX[nLane] ) ||
+                !IsSnapshotPosition( pSharedData[nUnit].fGoalPositionY[nLane] ) )
+            {
+                return false;
+            }
+        }
+    }
+
+    Reader.ReadSection( gs_nUnitPositionSection, m_UnitPositionData, sizeof( m_UnitPositionData ) );
+    Reader.ReadSection( gs_nUnitSharedSection, m_UnitSharedData, sizeof( m_UnitSharedData ) );
+    Reader.ReadSection( gs_nUnitDirectionSection, m_UnitCalculateDirection, sizeof( m_UnitCalculateDirection ) );
+    Reader.ReadSection( gs_nUnitUpdateSection, m_UnitUpdate, sizeof( m_UnitUpdate ) );
+    Reader.ReadSection( gs_nUnitRenderSection, m_UnitRender, sizeof( m_UnitRender ) );
+
+    m_nNumUnits = pCounts->nNumUnits;
+    m_nFluidNumUnits = pCounts->nFluidNumUnits;
+    m_nBinOverflows = ( long )pCounts->nBinOverflows;
+    return true;
+}
+
+void UnitManager::RecordTrajectory( TrajectoryRecorder& Recorder,
+                                    bool bWait ) const
+{
+    assert( !m_bStarted );
+
+    TrajectoryRecorder::Frame* pFrame = Recorder.BeginFrame( m_nNumUnits * gs_nSIMDWidth, bWait );
+    if( NULL == pFrame )
+    {
+        return;
+    }
+
+    // The recorder keeps a plain array per field; the groups are split out
+    //   a SIMD width at a time
+    unsigned int nGroups = pFrame->nUnits / gs_nSIMDWidth;
+    for( unsigned int nGroup = 0; nGroup < nGroups; ++nGroup )
+    {
+        unsigned int nFirst = nGroup * gs_nSIMDWidth;
+        memcpy( &pFrame->pPositionX[ nFirst ], m_UnitPositionData[ nGroup ].fPositionX, sizeof( float ) * gs_nSIMDWidth );
+        memcpy( &pFrame->pPositionY[ nFirst ], m_UnitPositionData[ nGroup ].fPositionY, sizeof( float ) * gs_nSIMDWidth );
+        memcpy( &pFrame->pDirectionX[ nFirst ], m_UnitSharedData[ nGroup ].fDirectionX, sizeof( float ) * gs_nSIMDWidth );
+        memcpy( &pFrame->pDirectionY[ nFirst ], m_UnitSharedData[ nGroup ].fDirectionY, sizeof( float ) * gs_nSIMDWidth );
+        for( unsigned int nLane = 0; nLane < gs_nSIMDWidth; ++nLane )
+        {
+            pFrame->pState[ nFirst + nLane ] = m_UnitUpdate[ nGroup ].bCarrying[ nLane ] ? 1 : 0;
+        }
+    }
+
+    Recorder.EndFrame();
+}
+
 /************************************************************************\
   Bins are used so units don't have to check other units that are too far
     away. The map is divided up into 8 tile x 8 tile bins that the units
@@ -407,6 +595,45 @@ void UnitManager::SetUnitCount( unsigned int nUnits )
     units into bins very fast, and because the bins only store indices,
     it means getting all neighbor bins units is fast too.
 \************************************************************************/
+void UnitManager::FirstTouchTask( void* pVoid,
+                                  int nContext,
+                                  unsigned int uTaskId,
+                                  unsigned int uTaskCount )
+{
+    GPA_SCOPED_TASK( __FUNCTION__, s_pUnitMgrDomain );
+
+    UnitManager* pManager = ( UnitManager* )pVoid;
+
+    //  Convert task id to unit id, the same split as the per frame tasks.
+    unsigned int uUnits = pManager->m_nNumUnits / uTaskCount;
+    unsigned int uUnitStartId = uUnits * uTaskId;
+    if( uTaskId + 1 == uTaskCount )
+    {
+        uUnits = pManager->m_nNumUnits - uUnits * uTaskId;
+    }
+
+    //  Units past the current count are spread evenly over the tasks
+    unsigned int uSpare = gs_nUnitTaskCount - pManager->m_nNumUnits;
+    unsigned int uSpareUnits = uSpare / uTaskCount;
+    unsigned int uSpareStartId = pManager->m_nNumUnits + uSpareUnits * uTaskId;
+    if( uTaskId + 1 == uTaskCount )
+    {
+        uSpareUnits = uSpare - uSpareUnits * uTaskId;
+    }
+
+    unsigned int uStart[2] = { uUnitStartId, uSpareStartId };
+    unsigned int uCount[2] = { uUnits, uSpareUnits };
+
+    for( int i = 0; i < 2; ++i )
+    {
+        ZeroMemory( &pManager->m_UnitPositionData[ uStart[i] ], uCount[i] * sizeof( UnitPositionData ) );
+        ZeroMemory( &pManager->m_UnitSharedData[ uStart[i] ], uCount[i] * sizeof( UnitSharedData ) );
+        ZeroMemory( &pManager->m_UnitCalculateDirection[ uStart[i] ], uCount[i] * sizeof( UnitCalculateDirection ) );
+        ZeroMemory( &pManager->m_UnitUpdate[ uStart[i] ], uCount[i] * sizeof( UnitUpdate ) );
+        ZeroMemory( &pManager->m_UnitRender[ uStart[i] ], uCount[i] * sizeof( UnitRender ) );
+    }
+}
+
 void UnitManager::FillBinsTask( void* pVoid,
                                 int nContext,
                                 unsigned int uTaskId,
@@ -426,6 +653,9 @@ void UnitManager::FillBinsTask( void* pVoid,
         uUnits = pManager->m_nNumUnits - uUnits * uTaskId;
     }
 
+    PerfScope Perf( PhaseFillBins, nContext, uUnits * gs_nSIMDWidth );
+    FrameStatsScope Stats( FrameSeriesFillBins );
+
     for( unsigned int i = 0; i < uUnits; ++i )
     {
         unsigned int uIndex = uUnitStartId + i;
@@ -462,8 +692,18 @@ void UnitManager::FillBinsTask( void* pVoid,
                 if( !bAlreadyAdded )
                 {
                     long nUnit = _InterlockedIncrement( &pBins[nBinIndex].nUnits );
-                    assert( nUnit < gs_nBinCapacity );
-                    pBins[nBinIndex].pUnits[nUnit - 1] = uIndex;
+                    if( nUnit < gs_nBinCapacity )
+                    {
+                        pBins[nBinIndex].pUnits[nUnit - 1] = uIndex;
+                    }
+                    else
+                    {
+                        // The bin is full, when units crowd onto one
+                        //   factory.  Leave the unit out; once every
+                        //   task has backed out the count is the bin size.
+                        _InterlockedDecrement( &pBins[nBinIndex].nUnits );
+                        _InterlockedIncrement( &pManager->m_nBinOverflows );
+                    }
 
                     nBinsAddedTo[nNumBinsAddedTo++] = nBinIndex;
                 }
@@ -538,10 +778,27 @@ void UnitManager::CalculateDirectionTask( void* pVoid,
         uUnits = pManager->m_nNumUnits - uUnits * uTaskId;
     }
 
+    PerfScope Perf( PhaseCalculateDirection, nContext, uUnits * gs_nSIMDWidth );
+    FrameStatsScope Stats( FrameSeriesCalculateDirection );
+
+    // Only poll for cancellation when running as a task
+    TASKSETHANDLE hDirection = m_hDirection;
+
+    // Scratch for the indices gathered from the four bins checked per unit
+    FrameArenaScope Scratch( gFrameArena, nContext );
+    unsigned int* pUnitIndices = gFrameArena.AllocateArray<unsigned int>( nContext, gs_nNeighbourIndexCount );
+
     for( unsigned int i = 0; i < uUnits; ++i )
     {
         unsigned int uIndex = uUnitStartId + i;
 
+        // Check for a reset at chunk boundaries
+        if( ( i % gs_nCancelCheckInterval ) == 0 && 
+            hDirection != TASKSETHANDLE_INVALID && gTaskMgr.IsSetCancelled( hDirection ) )
+        {
+            return;
+        }
+
         for( int nLane = 0; nLane < gs_nSIMDWidth; ++nLane )
         {
             //////////////////////////////////////////////////////////////////////////////////////
@@ -597,7 +854,7 @@ void UnitManager::CalculateDirectionTask( void* pVoid,
 
             nUnitIndicesCount += pManager->m_pBins[nBinIndex].nUnits;
 
-            unsigned int* p = pManager->m_nUnitIndices[nContext];
+            unsigned int* p = pUnitIndices;
             memcpy( p, pManager->m_pBins[nBinIndex].pUnits, sizeof( unsigned int ) *
                     pManager->m_pBins[nBinIndex].nUnits );
             p += pManager->m_pBins[nBinIndex].nUnits;
@@ -644,7 +901,7 @@ void UnitManager::CalculateDirectionTask( void* pVoid,
                 //////////////////////////////////////////////////////////////////////////////////////
                 for( unsigned int k = 0; k < nUnitIndicesCount; ++k )
                 {
-                    unsigned int nCompUnit = pManager->m_nUnitIndices[nContext][k];
+                    unsigned int nCompUnit = pUnitIndices[k];
                     for( int nCompLane = 0; nCompLane < gs_nSIMDWidth; ++nCompLane )
                     {
                         // Skip self
@@ -701,7 +958,7 @@ void UnitManager::CalculateDirectionTask( void* pVoid,
 
                 for( unsigned int k = 0; k < nUnitIndicesCount; ++k )
                 {
-                    unsigned int nCompUnit = pManager->m_nUnitIndices[nContext][k];
+                    unsigned int nCompUnit = pUnitIndices[k];
                     // Skip self
                     if( nCompUnit == uIndex )
                         continue;
@@ -785,9 +1042,13 @@ void UnitManager::ScalarUpdateUnitTask( void* pVoid,
         uUnits = pManager->m_nNumUnits - uUnits * uTaskId;
     }
 
+    PerfScope Perf( PhaseUpdate, nContext, uUnits * gs_nSIMDWidth );
+    FrameStatsScope Stats( FrameSeriesUpdateUnits );
+
     for( unsigned int i = 0; i < uUnits; ++i )
     {
         unsigned int uIndex = uUnitStartId + i;
+        ColorFilter filter = GetFactionColor( uIndex, pManager->m_nNumUnits );
 
         for( int nLane = 0; nLane < gs_nSIMDWidth; ++nLane )
         {
@@ -804,6 +1065,7 @@ void UnitManager::ScalarUpdateUnitTask( void* pVoid,
                 XMMatrixTranslation( pManager->m_UnitPositionData[ uIndex ].fPositionX[nLane],
                                      gs_fBoxHeight,
                                      pManager->m_UnitPositionData[ uIndex ].fPositionY[nLane] );
+            SetInstanceColor( pManager->m_UnitRender[ uIndex ].Transform[nLane], filter );
 
         } //  for( int nLane = 0; nLane < SIMD_WIDTH; ++nLane )
 
@@ -832,6 +1094,9 @@ void UnitManager::SIMDUpdateUnitTask( void* pVoid,
         uUnits = pManager->m_nNumUnits - uUnits * uTaskId;
     }
 
+    PerfScope Perf( PhaseUpdate, nContext, uUnits * gs_nSIMDWidth );
+    FrameStatsScope Stats( FrameSeriesUpdateUnits );
+
     for( unsigned int i = 0; i < uUnits; ++i )
     {
         unsigned int uIndex = uUnitStartId + i;
@@ -889,6 +1154,12 @@ void UnitManager::SIMDUpdateUnitTask( void* pVoid,
                                  gs_fBoxHeight,
                                  pManager->m_UnitPositionData[ uIndex ].fPositionY[3] );
 
+        ColorFilter filter = GetFactionColor( uIndex, pManager->m_nNumUnits );
+        for( int nLane = 0; nLane < gs_nSIMDWidth; ++nLane )
+        {
+            SetInstanceColor( pManager->m_UnitRender[ uIndex ].Transform[nLane], filter );
+        }
+
         // Perform serial game update
         pManager->UnitLogic( uIndex );
     }
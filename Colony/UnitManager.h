@@ -18,6 +18,9 @@
 #include "TaskMgrTBB.h"
 
 class Game;
+class SnapshotWriter;
+class SnapshotReader;
+class TrajectoryRecorder;
 
 class __declspec( align( 16 ) ) UnitManager
 {
@@ -50,11 +53,50 @@ public:
     unsigned int GetNumUnits( void ) const;
     void SetUnitCount( unsigned int nUnits );
 
+    // Place a unit, counted in single units rather than SIMD groups
+    void SetUnitPosition( unsigned int nUnit,
+                          float fX,
+                          float fY );
+
+    // Units left out of a full bin, and so not avoided, since Initialize
+    unsigned int GetBinOverflows( void ) const;
+
+    // Add the units to a snapshot, or copy them back from one.  The work
+    //   must be stopped.  ReadSnapshot checks every section before it
+    //   changes anything; the bins are refilled by the next update.
+    void WriteSnapshot( SnapshotWriter& Writer ) const;
+    bool ReadSnapshot( const SnapshotReader& Reader );
+
+    // Copy every unit's position, direction and whether it carries
+    //   something into a frame of the recorder.  The work must be stopped.
+    //   bWait is passed on to TrajectoryRecorder::BeginFrame.
+    void RecordTrajectory( TrajectoryRecorder& Recorder,
+                           bool bWait = false ) const;
+
     // Stop the threaded work
     void StopWork( void );
 
+    // Cancel the threaded work and wait for it to drain
+    void CancelWork( void );
+
+    // Phases of Update as gPerfCounters reports them
+    enum Phase
+    {
+        PhaseFillBins = 0,
+        PhaseCalculateDirection,
+        PhaseUpdate,
+        PhaseCount
+    };
+
+    static const char* const s_szPhaseNames[ PhaseCount ];
+
 private:
     // TBB Task functions
+    static void FirstTouchTask( void* pVoid,
+                                int nContext,
+                                unsigned int uTaskId,
+                                unsigned int uTaskCount );
+
     static void FillBinsTask( void* pVoid,
                               int nContext,
                               unsigned int uTaskId,
@@ -140,12 +182,12 @@ private:
     UnitRender m_UnitRender[gs_nUnitTaskCount];
 
     Bin m_pBins[gs_nBinCountSq];
-    unsigned int m_nUnitIndices[gs_nMaxThreadCount][gs_nBinCapacity];   // We only check 4 bins at a time
 
     Game* m_pGame;
     unsigned int m_nNumUnits;
     unsigned int m_nFluidNumUnits;
     float m_fElapsedTime;
+    volatile long m_nBinOverflows;
 
     bool m_bStarted;
 
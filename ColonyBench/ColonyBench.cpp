@@ -0,0 +1,208 @@
+// Copyright 2010 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+//--------------------------------------------------------------------------------------
+// ColonyBench is a console harness for the parts of Colony that can run without
+// a window or a GPU.  It links the TaskMgr backend selected at build time, so
+// building it once with and once without TASKMGR_STDTHREAD compares them.
+//
+// Usage:
+// ColonyBench [suite ...] [-frames N] [-warmup N] [-threads N] [-pinworkers]
+//             [-trace file.json] [-json file.json]
+//
+// With no suite names every suite runs.  -trace records the run with
+// gTraceRecorder, for chrome://tracing or the Perfetto UI.  -json writes the
+// results of the suites that support it, currently taskmgr, as JSON.
+//
+// Windows: build ColonyBench.vcxproj.
+// Linux, std::thread backend, from this directory:
+//   g++ -std=c++11 -O2 -pthread -I../SampleComponents -I../Colony *.cpp
+//       ../SampleComponents/TaskMgrStd.cpp ../SampleComponents/CpuTopology.cpp
+//       ../SampleComponents/FrameArena.cpp ../SampleComponents/ParallelPrimitives.cpp
+//       ../SampleComponents/TraceRecorder.cpp ../SampleComponents/PerfCounters.cpp
+//       ../SampleComponents/TrajectoryRecorder.cpp ../SampleComponents/FrameStats.cpp
+//       -o ColonyBench
+// Add -std=c++20 to include the coroutine suite.
+//--------------------------------------------------------------------------------------
+
+#include "ColonyBench.h"
+#include "TraceRecorder.h"
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+struct BenchSuite
+{
+    const char* szName;
+    void ( *pRun )( const BenchOptions& Options );
+};
+
+static const BenchSuite gs_Suites[] =
+{
+    { "scheduler", RunSchedulerBench },
+    { "coroutine", RunCoroutineBench },
+    { "primitives", RunPrimitivesBench },
+    { "trace", RunTraceBench },
+    { "counters", RunCountersBench },
+    { "math", RunMathBench },
+    { "taskmgr", RunTaskMgrBench },
+    { "trajectory", RunTrajectoryBench },
+};
+
+static const unsigned int gs_nSuiteCount = sizeof( gs_Suites ) / sizeof( gs_Suites[0] );
+
+static const char* const gs_szBenchPhaseNames[ BenchPhaseCount ] =
+{
+    "FillBins",
+    "CalculateDirection",
+    "Update",
+};
+
+double BenchStats::GetMean( void ) const
+{
+    double fSum = 0.0;
+    for( size_t i = 0; i < m_Samples.size(); ++i )
+    {
+        fSum += m_Samples[i];
+    }
+    return m_Samples.empty() ? 0.0 : fSum / m_Samples.size();
+}
+
+double BenchStats::GetMin( void ) const
+{
+    return m_Samples.empty() ? 0.0 : *std::min_element( m_Samples.begin(), m_Samples.end() );
+}
+
+double BenchStats::GetPercentile( double fPercentile ) const
+{
+    if( m_Samples.empty() )
+    {
+        return 0.0;
+    }
+
+    std::vector<double> Sorted( m_Samples );
+    std::sort( Sorted.begin(), Sorted.end() );
+
+    size_t nIndex = ( size_t )( fPercentile * ( Sorted.size() - 1 ) + 0.5 );
+    return Sorted[ nIndex ];
+}
+
+void BenchStats::Print( const char* szSuite,
+                        const char* szCase ) const
+{
+    printf( "%-12s %-32s mean %9.4f ms  min %9.4f ms  p50 %9.4f ms  p99 %9.4f ms\n",
+            szSuite, szCase, GetMean(), GetMin(), GetPercentile( 0.5 ), GetPercentile( 0.99 ) );
+}
+
+const char* GetTaskMgrBackendName( void )
+{
+#ifdef TASKMGR_STDTHREAD
+    return "std::thread";
+#else
+    return "tbb";
+#endif
+}
+
+int main( int argc,
+          char* argv[] )
+{
+    BenchOptions Options;
+    Options.nFrames = 200;
+    Options.nWarmup = 20;
+    Options.nThreads = 0;
+    Options.szJsonFile = NULL;
+
+    bool bRunSuite[ gs_nSuiteCount ] = { false };
+    bool bAnySuite = false;
+    const char* szTraceFile = NULL;
+
+    for( int i = 1; i < argc; ++i )
+    {
+        if( !strcmp( argv[i], "-frames" ) && i + 1 < argc )
+        {
+            Options.nFrames = ( unsigned int )atoi( argv[++i] );
+        }
+        else if( !strcmp( argv[i], "-warmup" ) && i + 1 < argc )
+        {
+            Options.nWarmup = ( unsigned int )atoi( argv[++i] );
+        }
+        else if( !strcmp( argv[i], "-threads" ) && i + 1 < argc )
+        {
+            Options.nThreads = ( unsigned int )atoi( argv[++i] );
+            gTaskMgr.miDemoModeTBBThreadCountOverride = ( INT )Options.nThreads;
+        }
+        else if( !strcmp( argv[i], "-pinworkers" ) )
+        {
+            gTaskMgr.mbPinWorkerThreads = TRUE;
+        }
+        else if( !strcmp( argv[i], "-trace" ) && i + 1 < argc )
+        {
+            szTraceFile = argv[++i];
+        }
+        else if( !strcmp( argv[i], "-json" ) && i + 1 < argc )
+        {
+            Options.szJsonFile = argv[++i];
+        }
+        else
+        {
+            unsigned int nSuite = 0;
+            while( nSuite < gs_nSuiteCount && strcmp( argv[i], gs_Suites[nSuite].szName ) )
+            {
+                ++nSuite;
+            }
+
+            if( nSuite == gs_nSuiteCount )
+            {
+                printf( "Unknown suite or option: %s\n", argv[i] );
+                return 1;
+            }
+
+            bRunSuite[nSuite] = true;
+            bAnySuite = true;
+        }
+    }
+
+    printf( "ColonyBench: TaskMgr backend %s, %u frames, %u warmup\n",
+            GetTaskMgrBackendName(), Options.nFrames, Options.nWarmup );
+
+    gTaskMgr.Init();
+    gFrameArena.Init( gs_nBenchMaxContexts, 64 * 1024 );
+    gPerfCounters.Init( gs_nBenchMaxContexts, gs_szBenchPhaseNames, BenchPhaseCount );
+
+    if( szTraceFile && !gTraceRecorder.Start( szTraceFile ) )
+    {
+        printf( "Could not create trace file %s\n", szTraceFile );
+        return 1;
+    }
+
+    for( unsigned int nSuite = 0; nSuite < gs_nSuiteCount; ++nSuite )
+    {
+        if( !bAnySuite || bRunSuite[nSuite] )
+        {
+            gs_Suites[nSuite].pRun( Options );
+        }
+    }
+
+    if( szTraceFile )
+    {
+        gTraceRecorder.Stop();
+        printf( "Trace: %u events written to %s, %u dropped\n",
+                gTraceRecorder.GetWrittenEvents(), szTraceFile, gTraceRecorder.GetDroppedEvents() );
+    }
+
+    gTaskMgr.Shutdown();
+    gFrameArena.Shutdown();
+    gPerfCounters.Shutdown();
+
+    return 0;
+}
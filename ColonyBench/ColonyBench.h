@@ -0,0 +1,103 @@
+// Copyright 2010 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+#pragma once
+#ifndef _COLONYBENCH_H_
+#define _COLONYBENCH_H_
+
+#include "TaskMgrTBB.h"
+#include "FrameArena.h"
+#include "PerfCounters.h"
+#include <chrono>
+#include <vector>
+#include <stdio.h>
+
+// Task contexts the frame arena and counters are set up for
+static const unsigned int gs_nBenchMaxContexts = 64;
+
+// Phases of the scheduler suite's frame, for gPerfCounters
+enum BenchPhase
+{
+    BenchPhaseFillBins = 0,
+    BenchPhaseCalculateDirection,
+    BenchPhaseUpdate,
+    BenchPhaseCount
+};
+
+// Options shared by all suites
+struct BenchOptions
+{
+    unsigned int nFrames;       // Measured iterations per case
+    unsigned int nWarmup;       // Unmeasured iterations before each case
+    unsigned int nThreads;      // -threads, or 0 for every hardware thread
+    const char* szJsonFile;     // -json, or NULL.  Suites that support it write their results here
+};
+
+// Wall clock timer
+class BenchTimer
+{
+public:
+    BenchTimer( void )
+    {
+        Start();
+    }
+
+    void Start( void )
+    {
+        m_Start = std::chrono::steady_clock::now();
+    }
+
+    double ElapsedMs( void ) const
+    {
+        return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - m_Start ).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point m_Start;
+};
+
+// Collects one time per iteration and prints a summary line
+class BenchStats
+{
+public:
+    void Add( double fMs )
+    {
+        m_Samples.push_back( fMs );
+    }
+
+    double GetMean( void ) const;
+    double GetMin( void ) const;
+    double GetPercentile( double fPercentile ) const;
+
+    // Prints "<suite> <case> mean min p50 p99" in milliseconds
+    void Print( const char* szSuite,
+                const char* szCase ) const;
+
+private:
+    std::vector<double> m_Samples;
+};
+
+// Name of the TaskMgr backend the bench was built with
+const char* GetTaskMgrBackendName( void );
+
+// Suites
+void RunSchedulerBench( const BenchOptions& Options );
+void RunCoroutineBench( const BenchOptions& Options );
+void RunPrimitivesBench( const BenchOptions& Options );
+void RunTraceBench( const BenchOptions& Options );
+void RunCountersBench( const BenchOptions& Options );
+void RunMathBench( const BenchOptions& Options );
+void RunTaskMgrBench( const BenchOptions& Options );
+void RunTrajectoryBench( const BenchOptions& Options );
+
+#endif // #ifndef _COLONYBENCH_H_
@@ -0,0 +1,142 @@
+// Copyright 2010 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+//--------------------------------------------------------------------------------------
+// Coroutine suite.  Runs a multi-stage job, a chain of parallel tasksets where
+// each stage needs the previous one done, two ways:  from the main thread with
+// WaitForSet between stages, and as a TaskCoroutine that co_awaits each stage
+// on a worker while the main thread waits once.  Also checks that a cancelled
+// coroutine stops at its next co_await.  Only built with C++20 coroutines.
+//--------------------------------------------------------------------------------------
+
+#include "ColonyBench.h"
+#include "TaskMgrCoro.h"
+
+#ifdef TASKMGR_COROUTINES
+#include <atomic>
+
+static const unsigned int   gs_nStageCount = 8;
+static const unsigned int   gs_nStageTasks = 64;
+static const unsigned int   gs_nStageWork = 2048;
+
+static std::atomic<unsigned int>    gs_nStagesRun;
+static float                        gs_fStageData[gs_nStageTasks][gs_nStageWork];
+
+static void StageTask( void* pVoid,
+                       int nContext,
+                       unsigned int uTaskId,
+                       unsigned int uTaskCount )
+{
+    float* pData = gs_fStageData[uTaskId];
+    for( unsigned int i = 0; i < gs_nStageWork; ++i )
+    {
+        pData[i] = pData[i] * 0.5f + ( float )i;
+    }
+
+    if( uTaskId == 0 )
+    {
+        gs_nStagesRun.fetch_add( 1 );
+    }
+}
+
+static TASKSETHANDLE CreateStage( void )
+{
+    TASKSETHANDLE hStage;
+    gTaskMgr.CreateTaskSet( StageTask, NULL, gs_nStageTasks, NULL, 0, "StageTask", &hStage );
+    return hStage;
+}
+
+static void RunStagesBlocking( void )
+{
+    for( unsigned int i = 0; i < gs_nStageCount; ++i )
+    {
+        TASKSETHANDLE hStage = CreateStage();
+        gTaskMgr.WaitForSet( hStage );
+        gTaskMgr.ReleaseHandle( hStage );
+    }
+}
+
+// Releases the stage even when a cancelled coroutine is destroyed while
+//   suspended on it
+struct StageHandle
+{
+    TASKSETHANDLE hSet;
+
+    StageHandle( void ) : hSet( CreateStage() ) {}
+    ~StageHandle( void ) { gTaskMgr.ReleaseHandle( hSet ); }
+};
+
+static TaskCoroutine RunStagesCoroutine( void )
+{
+    for( unsigned int i = 0; i < gs_nStageCount; ++i )
+    {
+        StageHandle Stage;
+        co_await AwaitTaskSet( Stage.hSet );
+    }
+}
+
+void RunCoroutineBench( const BenchOptions& Options )
+{
+    BenchStats Blocking;
+    BenchStats Coroutine;
+
+    for( unsigned int i = 0; i < Options.nWarmup + Options.nFrames; ++i )
+    {
+        BenchTimer Timer;
+        RunStagesBlocking();
+        if( i >= Options.nWarmup )
+        {
+            Blocking.Add( Timer.ElapsedMs() );
+        }
+    }
+
+    gs_nStagesRun = 0;
+    for( unsigned int i = 0; i < Options.nWarmup + Options.nFrames; ++i )
+    {
+        BenchTimer Timer;
+        TaskCoroutine Job = RunStagesCoroutine();
+        gTaskMgr.WaitForSet( Job.GetHandle() );
+        if( i >= Options.nWarmup )
+        {
+            Coroutine.Add( Timer.ElapsedMs() );
+        }
+    }
+
+    if( gs_nStagesRun != ( Options.nWarmup + Options.nFrames ) * gs_nStageCount )
+    {
+        printf( "coroutine: ran %u stages, expected %u\n",
+                gs_nStagesRun.load(), ( Options.nWarmup + Options.nFrames ) * gs_nStageCount );
+    }
+
+    Blocking.Print( "coroutine", "8 stages WaitForSet" );
+    Coroutine.Print( "coroutine", "8 stages co_await" );
+
+    // A cancelled coroutine completes its set without running more stages
+    gs_nStagesRun = 0;
+    {
+        TaskCoroutine Job = RunStagesCoroutine();
+        gTaskMgr.CancelSet( Job.GetHandle() );
+        gTaskMgr.WaitForSet( Job.GetHandle() );
+    }
+
+    printf( "%-12s %-32s ran %u of %u stages\n", "coroutine", "cancelled job", gs_nStagesRun.load(), gs_nStageCount );
+}
+
+#else
+
+void RunCoroutineBench( const BenchOptions& Options )
+{
+    printf( "%-12s built without C++20 coroutines, skipped\n", "coroutine" );
+}
+
+#endif // TASKMGR_COROUTINES
@@ -0,0 +1,375 @@
+// Copyright 2010 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+//--------------------------------------------------------------------------------------
+// Math suite.  Checks each SSE kernel in ColonyMath.h against its scalar
+// version on random inputs, lane by lane, and times both.  Results are
+// compared in ULPs, units in the last place, so the bounds hold at any
+// magnitude.
+//
+// SSECircleRayCollision does not return what CircleRayCollision does: it
+// reports the distance along the ray to the circle's closest point without
+// subtracting the radius, and counts circles behind the ray vertex as
+// misses.  The check holds it to that contract, against the scalar result.
+//--------------------------------------------------------------------------------------
+
+#include "ColonyBench.h"
+#include <math.h>
+#include <string.h>
+#include <xmmintrin.h>
+
+#ifndef _MSC_VER
+#define __forceinline inline __attribute__( ( always_inline ) )
+#define __inline inline
+#endif
+
+// ColonyMath.h takes the miss distance from Colony.h, which needs DXUT
+static const float          gs_fGreatRange = 0.5f;
+
+#include "ColonyMath.h"
+
+static const unsigned int   gs_nMathCount = 64 * 1024;  // Lanes per pass, a multiple of 4
+static const float          gs_fMathWorldSize = 32.0f;
+static const float          gs_fMathUnitRadius = 0.015f;
+
+// Largest ULP difference each kernel may show against its scalar version.
+//   The scalar code may be compiled to fused multiply-adds, which round once
+//   less than the SSE kernels.
+static const unsigned int   gs_nNormalizeUlps = 2;
+static const unsigned int   gs_nLengthSqUlps = 1;
+static const unsigned int   gs_nDotProductUlps = 2;
+static const unsigned int   gs_nCollisionUlps = 4;
+
+struct MathData
+{
+    std::vector<float> X1, Y1, X2, Y2;
+    std::vector<float> RayX, RayY, DirX, DirY, SphereX, SphereY, Radius;
+    std::vector<float> OutX, OutY, OutScalarX, OutScalarY;
+};
+
+static MathData gs_Math;
+
+static float BenchRandFloat( unsigned int& nSeed )
+{
+    nSeed = nSeed * 1664525u + 1013904223u;
+    return ( nSeed >> 8 ) * ( 1.0f / 16777216.0f );
+}
+
+static void InitData( void )
+{
+    const unsigned int n = gs_nMathCount;
+    unsigned int nSeed = 4242;
+
+    std::vector<float>* pArrays[] =
+    {
+        &gs_Math.X1, &gs_Math.Y1, &gs_Math.X2, &gs_Math.Y2,
+        &gs_Math.RayX, &gs_Math.RayY, &gs_Math.DirX, &gs_Math.DirY,
+        &gs_Math.SphereX, &gs_Math.SphereY, &gs_Math.Radius,
+        &gs_Math.OutX, &gs_Math.OutY, &gs_Math.OutScalarX, &gs_Math.OutScalarY,
+    };
+    for( unsigned int a = 0; a < sizeof( pArrays ) / sizeof( pArrays[0] ); ++a )
+    {
+        pArrays[a]->resize( n );
+    }
+
+    for( unsigned int i = 0; i < n; ++i )
+    {
+        // Vectors of any direction, kept away from zero length
+        float fX, fY;
+        do
+        {
+            fX = BenchRandFloat( nSeed ) * 2.0f - 1.0f;
+            fY = BenchRandFloat( nSeed ) * 2.0f - 1.0f;
+        } while( fX * fX + fY * fY < 1e-4f );
+
+        gs_Math.X1[i] = fX;
+        gs_Math.Y1[i] = fY;
+        gs_Math.X2[i] = BenchRandFloat( nSeed ) * 2.0f - 1.0f;
+        gs_Math.Y2[i] = BenchRandFloat( nSeed ) * 2.0f - 1.0f;
+
+        // Rays from a unit's feelers past neighbours within avoidance
+        //   range, as CalculateDirectionTask casts them
+        float fLength = sqrtf( fX * fX + fY * fY );
+        gs_Math.RayX[i] = BenchRandFloat( nSeed ) * gs_fMathWorldSize;
+        gs_Math.RayY[i] = BenchRandFloat( nSeed ) * gs_fMathWorldSize;
+        gs_Math.DirX[i] = fX / fLength;
+        gs_Math.DirY[i] = fY / fLength;
+        gs_Math.SphereX[i] = gs_Math.RayX[i] + ( BenchRandFloat( nSeed ) * 2.0f - 1.0f ) * gs_fGreatRange;
+        gs_Math.SphereY[i] = gs_Math.RayY[i] + ( BenchRandFloat( nSeed ) * 2.0f - 1.0f ) * gs_fGreatRange;
+        gs_Math.Radius[i] = gs_fMathUnitRadius * ( 0.5f + BenchRandFloat( nSeed ) * 4.0f );
+    }
+}
+
+// Distance between two floats in representable values
+static unsigned int UlpDistance( float fA,
+                                 float fB )
+{
+    int nA, nB;
+    memcpy( &nA, &fA, sizeof( nA ) );
+    memcpy( &nB, &fB, sizeof( nB ) );
+
+    // Map the sign-magnitude bits onto a monotonic integer line
+    long long nOrderedA = nA < 0 ? ( long long )( int )0x80000000 - nA : nA;
+    long long nOrderedB = nB < 0 ? ( long long )( int )0x80000000 - nB : nB;
+    long long nDiff = nOrderedA - nOrderedB;
+    return ( unsigned int )( nDiff < 0 ? -nDiff : nDiff );
+}
+
+// Distance in ULPs of fScale, for results that come out of a subtraction
+//   and so are only as exact as its larger operand
+static unsigned int ScaledUlpDistance( float fA,
+                                       float fB,
+                                       float fScale )
+{
+    // A float has 24 significant bits
+    int nExponent;
+    frexp( fScale, &nExponent );
+    double fUlp = ldexp( 1.0, nExponent - 24 );
+    return ( unsigned int )( fabs( ( double )fA - fB ) / fUlp + 0.5 );
+}
+
+//--------------------------------------------------------------------------------------
+// Kernels over the arrays, SSE four lanes at a time and scalar one at a time
+//--------------------------------------------------------------------------------------
+static void NormalizeSSE( void )
+{
+    for( unsigned int i = 0; i < gs_nMathCount; i += 4 )
+    {
+        __m128 fX = _mm_loadu_ps( &gs_Math.X1[i] );
+        __m128 fY = _mm_loadu_ps( &gs_Math.Y1[i] );
+        SSENormalize( fX, fY );
+        _mm_storeu_ps( &gs_Math.OutX[i], fX );
+        _mm_storeu_ps( &gs_Math.OutY[i], fY );
+    }
+}
+
+static void NormalizeScalar( void )
+{
+    for( unsigned int i = 0; i < gs_nMathCount; ++i )
+    {
+        float fX = gs_Math.X1[i];
+        float fY = gs_Math.Y1[i];
+        Normalize( fX, fY );
+        gs_Math.OutScalarX[i] = fX;
+        gs_Math.OutScalarY[i] = fY;
+    }
+}
+
+static void LengthSqSSE( void )
+{
+    for( unsigned int i = 0; i < gs_nMathCount; i += 4 )
+    {
+        _mm_storeu_ps( &gs_Math.OutX[i], SSELengthSq( _mm_loadu_ps( &gs_Math.X1[i] ),
+                                                      _mm_loadu_ps( &gs_Math.Y1[i] ) ) );
+    }
+}
+
+static void LengthSqScalar( void )
+{
+    for( unsigned int i = 0; i < gs_nMathCount; ++i )
+    {
+        gs_Math.OutScalarX[i] = LengthSq( gs_Math.X1[i], gs_Math.Y1[i] );
+    }
+}
+
+static void DotProductSSE( void )
+{
+    for( unsigned int i = 0; i < gs_nMathCount; i += 4 )
+    {
+        _mm_storeu_ps( &gs_Math.OutX[i], SSEDotProduct( _mm_loadu_ps( &gs_Math.X1[i] ),
+                                                        _mm_loadu_ps( &gs_Math.Y1[i] ),
+                                                        _mm_loadu_ps( &gs_Math.X2[i] ),
+                                                        _mm_loadu_ps( &gs_Math.Y2[i] ) ) );
+    }
+}
+
+static void DotProductScalar( void )
+{
+    for( unsigned int i = 0; i < gs_nMathCount; ++i )
+    {
+        gs_Math.OutScalarX[i] = DotProduct( gs_Math.X1[i], gs_Math.Y1[i], gs_Math.X2[i], gs_Math.Y2[i] );
+    }
+}
+
+static void CollisionSSE( void )
+{
+    for( unsigned int i = 0; i < gs_nMathCount; i += 4 )
+    {
+        _mm_storeu_ps( &gs_Math.OutX[i], SSECircleRayCollision( _mm_loadu_ps( &gs_Math.RayX[i] ),
+                                                                _mm_loadu_ps( &gs_Math.RayY[i] ),
+                                                                _mm_loadu_ps( &gs_Math.DirX[i] ),
+                                                                _mm_loadu_ps( &gs_Math.DirY[i] ),
+                                                                _mm_loadu_ps( &gs_Math.SphereX[i] ),
+                                                                _mm_loadu_ps( &gs_Math.SphereY[i] ),
+                                                                _mm_loadu_ps( &gs_Math.Radius[i] ) ) );
+    }
+}
+
+static void CollisionScalar( void )
+{
+    for( unsigned int i = 0; i < gs_nMathCount; ++i )
+    {
+        gs_Math.OutScalarX[i] = CircleRayCollision( gs_Math.RayX[i], gs_Math.RayY[i],
+                                                    gs_Math.DirX[i], gs_Math.DirY[i],
+                                                    gs_Math.SphereX[i], gs_Math.SphereY[i],
+                                                    gs_Math.Radius[i] );
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Differential checks, run after both versions of a kernel
+//--------------------------------------------------------------------------------------
+static void PrintCheck( const char* szCase,
+                        unsigned int nMaxUlps,
+                        unsigned int nBound,
+                        unsigned int nFailures )
+{
+    printf( "%-12s %-32s max %u ulp (bound %u), %u of %u lanes out of bound, %s\n", "math", szCase,
+            nMaxUlps, nBound, nFailures, gs_nMathCount, nFailures ? "FAILED" : "ok" );
+}
+
+static void CheckLanes( const char* szCase,
+                        const std::vector<float>& Actual,
+                        const std::vector<float>& Expected,
+                        unsigned int nBound )
+{
+    unsigned int nMaxUlps = 0;
+    unsigned int nFailures = 0;
+    for( unsigned int i = 0; i < gs_nMathCount; ++i )
+    {
+        unsigned int nUlps = UlpDistance( Actual[i], Expected[i] );
+        nMaxUlps = nUlps > nMaxUlps ? nUlps : nMaxUlps;
+        nFailures += nUlps > nBound ? 1 : 0;
+    }
+    PrintCheck( szCase, nMaxUlps, nBound, nFailures );
+}
+
+// A dot product can cancel to near zero, where the ULPs of the result say
+//   nothing; compare in ULPs of the larger product instead
+static void CheckDotProduct( void )
+{
+    unsigned int nMaxUlps = 0;
+    unsigned int nFailures = 0;
+    for( unsigned int i = 0; i < gs_nMathCount; ++i )
+    {
+        float fProductX = fabsf( gs_Math.X1[i] * gs_Math.X2[i] );
+        float fProductY = fabsf( gs_Math.Y1[i] * gs_Math.Y2[i] );
+        unsigned int nUlps = ScaledUlpDistance( gs_Math.OutX[i], gs_Math.OutScalarX[i],
+                                                fProductX > fProductY ? fProductX : fProductY );
+        nMaxUlps = nUlps > nMaxUlps ? nUlps : nMaxUlps;
+        nFailures += nUlps > gs_nDotProductUlps ? 1 : 0;
+    }
+    PrintCheck( "dot check", nMaxUlps, gs_nDotProductUlps, nFailures );
+}
+
+static void CheckCollision( void )
+{
+    unsigned int nMaxUlps = 0;
+    unsigned int nFailures = 0;
+    unsigned int nHits = 0;
+    unsigned int nBorderline = 0;
+
+    for( unsigned int i = 0; i < gs_nMathCount; ++i )
+    {
+        float fSSE = gs_Math.OutX[i];
+        float fScalar = gs_Math.OutScalarX[i];
+        float fRadius = gs_Math.Radius[i];
+
+        // The same test in double precision tells which lanes sit so close
+        //   to the circle's edge, or to the ray vertex, that float rounding
+        //   may decide either way
+        double fToX = ( double )gs_Math.SphereX[i] - gs_Math.RayX[i];
+        double fToY = ( double )gs_Math.SphereY[i] - gs_Math.RayY[i];
+        double fDistance = fToX * gs_Math.DirX[i] + fToY * gs_Math.DirY[i];
+        double fOffX = fToX - gs_Math.DirX[i] * fDistance;
+        double fOffY = fToY - gs_Math.DirY[i] * fDistance;
+        double fEdge = fOffX * fOffX + fOffY * fOffY - ( double )fRadius * fRadius;
+        if( fabs( fEdge ) < 1e-5 * fRadius * fRadius || fabs( fDistance ) < 1e-5 )
+        {
+            ++nBorderline;
+            continue;
+        }
+
+        bool bScalarHit = ( fScalar != gs_fGreatRange );
+        bool bInFront = fDistance > 0.0;
+        float fExpected = ( bScalarHit && bInFront ) ? fScalar + fRadius : gs_fGreatRange;
+
+        unsigned int nUlps = ScaledUlpDistance( fSSE, fExpected, fabsf( fExpected ) > fRadius ? fExpected : fRadius );
+        nMaxUlps = nUlps > nMaxUlps ? nUlps : nMaxUlps;
+        nFailures += nUlps > gs_nCollisionUlps ? 1 : 0;
+        nHits += ( bScalarHit && bInFront ) ? 1 : 0;
+    }
+
+    PrintCheck( "circle ray check", nMaxUlps, gs_nCollisionUlps, nFailures );
+    printf( "%-12s %-32s %u hits, %u borderline lanes skipped\n", "math", "circle ray coverage", nHits, nBorderline );
+}
+
+//--------------------------------------------------------------------------------------
+// Timing
+//--------------------------------------------------------------------------------------
+static void TimeKernel( const BenchOptions& Options,
+                        BenchStats& Stats,
+                        void ( *pKernel )( void ) )
+{
+    for( unsigned int i = 0; i < Options.nWarmup + Options.nFrames; ++i )
+    {
+        BenchTimer Timer;
+        pKernel();
+        if( i >= Options.nWarmup )
+        {
+            Stats.Add( Timer.ElapsedMs() );
+        }
+    }
+}
+
+static void RunKernel( const BenchOptions& Options,
+                       const char* szName,
+                       void ( *pScalar )( void ),
+                       void ( *pSSE )( void ) )
+{
+    char szCase[64];
+    BenchStats Scalar;
+    BenchStats SSE;
+
+    TimeKernel( Options, Scalar, pScalar );
+    TimeKernel( Options, SSE, pSSE );
+
+    sprintf( szCase, "%s scalar", szName );
+    Scalar.Print( "math", szCase );
+    sprintf( szCase, "%s sse", szName );
+    SSE.Print( "math", szCase );
+
+    // Millions of lanes per second
+    sprintf( szCase, "%s throughput", szName );
+    printf( "%-12s %-32s scalar %.0f M/s, sse %.0f M/s, speedup %.2fx\n", "math", szCase,
+            gs_nMathCount / ( Scalar.GetMean() * 1000.0 ), gs_nMathCount / ( SSE.GetMean() * 1000.0 ),
+            Scalar.GetMean() / SSE.GetMean() );
+}
+
+void RunMathBench( const BenchOptions& Options )
+{
+    InitData();
+
+    RunKernel( Options, "normalize", NormalizeScalar, NormalizeSSE );
+    CheckLanes( "normalize x check", gs_Math.OutX, gs_Math.OutScalarX, gs_nNormalizeUlps );
+    CheckLanes( "normalize y check", gs_Math.OutY, gs_Math.OutScalarY, gs_nNormalizeUlps );
+
+    RunKernel( Options, "lengthsq", LengthSqScalar, LengthSqSSE );
+    CheckLanes( "lengthsq check", gs_Math.OutX, gs_Math.OutScalarX, gs_nLengthSqUlps );
+
+    RunKernel( Options, "dot", DotProductScalar, DotProductSSE );
+    CheckDotProduct();
+
+    RunKernel( Options, "circle ray", CollisionScalar, CollisionSSE );
+    CheckCollision();
+}
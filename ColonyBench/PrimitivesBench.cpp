@@ -0,0 +1,320 @@
+// Copyright 2010 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+//--------------------------------------------------------------------------------------
+// Primitives suite.  Times each of the ParallelPrimitives.h calls against a
+// plain serial loop doing the same work, and checks the two agree.  Compaction
+// moves 64 byte elements, the size of the instance matrices Render draws.
+//--------------------------------------------------------------------------------------
+
+#include "ColonyBench.h"
+#include "ParallelPrimitives.h"
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+static const unsigned int   gs_nPrimitiveCount = 1024 * 1024;
+
+struct BenchElement
+{
+    float fValues[16];
+};
+
+struct PrimitiveData
+{
+    std::vector<unsigned int>   Counts;
+    std::vector<unsigned int>   Offsets;
+    std::vector<float>          Floats;
+    std::vector<BenchElement>   Elements;
+    std::vector<BenchElement>   Compacted;
+    std::vector<unsigned char>  Keep;
+    std::vector<unsigned int>   SourceKeys;
+    std::vector<unsigned int>   Keys;
+    std::vector<unsigned int>   Values;
+    std::vector<unsigned int>   TempKeys;
+    std::vector<unsigned int>   TempValues;
+    std::vector<unsigned long long> Pairs;
+};
+
+static PrimitiveData    gs_Data;
+
+static unsigned int BenchRandInt( unsigned int& nSeed )
+{
+    nSeed = nSeed * 1664525u + 1013904223u;
+    return nSeed;
+}
+
+static void InitData( void )
+{
+    const unsigned int n = gs_nPrimitiveCount;
+    unsigned int nSeed = 12345;
+
+    gs_Data.Counts.resize( n );
+    gs_Data.Offsets.resize( n );
+    gs_Data.Floats.resize( n );
+    gs_Data.Elements.resize( n );
+    gs_Data.Compacted.resize( n );
+    gs_Data.Keep.resize( n );
+    gs_Data.SourceKeys.resize( n );
+    gs_Data.Keys.resize( n );
+    gs_Data.Values.resize( n );
+    gs_Data.TempKeys.resize( n );
+    gs_Data.TempValues.resize( n );
+    gs_Data.Pairs.resize( n );
+
+    for( unsigned int i = 0; i < n; ++i )
+    {
+        gs_Data.Counts[i] = BenchRandInt( nSeed ) >> 28;
+        gs_Data.Floats[i] = ( BenchRandInt( nSeed ) >> 8 ) * ( 1.0f / 16777216.0f );
+        for( unsigned int j = 0; j < 16; ++j )
+        {
+            gs_Data.Elements[i].fValues[j] = ( float )( i * 16 + j );
+        }
+
+        // About half kept, in runs like a culling pass produces
+        gs_Data.Keep[i] = ( ( i >> 5 ) + ( BenchRandInt( nSeed ) >> 31 ) ) & 1;
+
+        gs_Data.SourceKeys[i] = BenchRandInt( nSeed );
+    }
+}
+
+// Times Options.nFrames calls of pCase after Options.nWarmup unmeasured ones.
+//   pPrepare, when given, runs untimed before every call.
+static void TimeCase( const BenchOptions& Options,
+                      BenchStats& Stats,
+                      void ( *pCase )( void ),
+                      void ( *pPrepare )( void ) = NULL )
+{
+    for( unsigned int i = 0; i < Options.nWarmup + Options.nFrames; ++i )
+    {
+        if( pPrepare )
+        {
+            pPrepare();
+        }
+
+        BenchTimer Timer;
+        pCase();
+        if( i >= Options.nWarmup )
+        {
+            Stats.Add( Timer.ElapsedMs() );
+        }
+    }
+}
+
+static void PrintSpeedup( const char* szCase,
+                          const BenchStats& Serial,
+                          const BenchStats& Parallel,
+                          bool bMatch )
+{
+    printf( "%-12s %-32s speedup %.2fx, %s\n", "primitives", szCase,
+            Serial.GetMean() / Parallel.GetMean(), bMatch ? "results match" : "RESULTS DIFFER" );
+}
+
+//--------------------------------------------------------------------------------------
+// Scan
+//--------------------------------------------------------------------------------------
+
+static unsigned int gs_nScanTotal;
+
+static void SerialScan( void )
+{
+    unsigned int nTotal = 0;
+    for( unsigned int i = 0; i < gs_nPrimitiveCount; ++i )
+    {
+        gs_Data.Offsets[i] = nTotal;
+        nTotal += gs_Data.Counts[i];
+    }
+    gs_nScanTotal = nTotal;
+}
+
+static void ParallelScanCase( void )
+{
+    gs_nScanTotal = ParallelScan( &gs_Data.Counts[0], &gs_Data.Offsets[0], gs_nPrimitiveCount );
+}
+
+static void RunScan( const BenchOptions& Options )
+{
+    BenchStats Serial;
+    BenchStats Parallel;
+
+    TimeCase( Options, Serial, SerialScan );
+    std::vector<unsigned int> Expected( gs_Data.Offsets );
+    unsigned int nExpectedTotal = gs_nScanTotal;
+
+    TimeCase( Options, Parallel, ParallelScanCase );
+    bool bMatch = gs_nScanTotal == nExpectedTotal && Expected == gs_Data.Offsets;
+
+    Serial.Print( "primitives", "scan serial" );
+    Parallel.Print( "primitives", "scan parallel" );
+    PrintSpeedup( "scan", Serial, Parallel, bMatch );
+}
+
+//--------------------------------------------------------------------------------------
+// Reduce
+//--------------------------------------------------------------------------------------
+
+static float gs_fReduceSum;
+
+static void SerialReduce( void )
+{
+    float fSum = 0.0f;
+    for( unsigned int i = 0; i < gs_nPrimitiveCount; ++i )
+    {
+        fSum += gs_Data.Floats[i];
+    }
+    gs_fReduceSum = fSum;
+}
+
+static void ParallelReduceCase( void )
+{
+    gs_fReduceSum = ParallelReduce( &gs_Data.Floats[0], gs_nPrimitiveCount, PARALLELREDUCE_SUM );
+}
+
+static void RunReduce( const BenchOptions& Options )
+{
+    BenchStats Serial;
+    BenchStats Parallel;
+
+    TimeCase( Options, Serial, SerialReduce );
+    float fExpected = gs_fReduceSum;
+
+    TimeCase( Options, Parallel, ParallelReduceCase );
+
+    // The serial float sum is itself off by rounding, so compare against a
+    //   double sum and allow the serial loop's error
+    double fExact = 0.0;
+    for( unsigned int i = 0; i < gs_nPrimitiveCount; ++i )
+    {
+        fExact += gs_Data.Floats[i];
+    }
+    double fTolerance = fabs( fExpected - fExact ) + fExact * 1e-5;
+    bool bMatch = fabs( gs_fReduceSum - fExact ) <= fTolerance;
+
+    bMatch = bMatch &&
+             ParallelReduce( &gs_Data.Floats[0], gs_nPrimitiveCount, PARALLELREDUCE_MIN ) ==
+                 *std::min_element( gs_Data.Floats.begin(), gs_Data.Floats.end() ) &&
+             ParallelReduce( &gs_Data.Floats[0], gs_nPrimitiveCount, PARALLELREDUCE_MAX ) ==
+                 *std::max_element( gs_Data.Floats.begin(), gs_Data.Floats.end() );
+
+    Serial.Print( "primitives", "reduce sum serial" );
+    Parallel.Print( "primitives", "reduce sum parallel" );
+    PrintSpeedup( "reduce sum", Serial, Parallel, bMatch );
+}
+
+//--------------------------------------------------------------------------------------
+// Compact
+//--------------------------------------------------------------------------------------
+
+static unsigned int gs_nCompacted;
+
+static void SerialCompact( void )
+{
+    unsigned int nKept = 0;
+    for( unsigned int i = 0; i < gs_nPrimitiveCount; ++i )
+    {
+        if( gs_Data.Keep[i] )
+        {
+            gs_Data.Compacted[nKept++] = gs_Data.Elements[i];
+        }
+    }
+    gs_nCompacted = nKept;
+}
+
+static void ParallelCompactCase( void )
+{
+    gs_nCompacted = ParallelCompact( &gs_Data.Elements[0], &gs_Data.Compacted[0], sizeof( BenchElement ),
+                                     &gs_Data.Keep[0], gs_nPrimitiveCount );
+}
+
+static void RunCompact( const BenchOptions& Options )
+{
+    BenchStats Serial;
+    BenchStats Parallel;
+
+    TimeCase( Options, Serial, SerialCompact );
+    std::vector<BenchElement> Expected( gs_Data.Compacted.begin(), gs_Data.Compacted.begin() + gs_nCompacted );
+
+    memset( &gs_Data.Compacted[0], 0, gs_Data.Compacted.size() * sizeof( BenchElement ) );
+    TimeCase( Options, Parallel, ParallelCompactCase );
+    bool bMatch = gs_nCompacted == Expected.size() &&
+                  0 == memcmp( &Expected[0], &gs_Data.Compacted[0], Expected.size() * sizeof( BenchElement ) );
+
+    Serial.Print( "primitives", "compact 64B serial" );
+    Parallel.Print( "primitives", "compact 64B parallel" );
+    PrintSpeedup( "compact 64B", Serial, Parallel, bMatch );
+}
+
+//--------------------------------------------------------------------------------------
+// Radix sort
+//--------------------------------------------------------------------------------------
+
+// Keys with their index as the value, so the sort's stability shows in the values
+static void PrepareKeys( void )
+{
+    for( unsigned int i = 0; i < gs_nPrimitiveCount; ++i )
+    {
+        gs_Data.Keys[i] = gs_Data.SourceKeys[i];
+        gs_Data.Values[i] = i;
+    }
+}
+
+// The serial baseline packs key and index into one 64 bit value, which
+//   std::sort then orders the same way a stable key sort would
+static void PreparePairs( void )
+{
+    for( unsigned int i = 0; i < gs_nPrimitiveCount; ++i )
+    {
+        gs_Data.Pairs[i] = ( ( unsigned long long )gs_Data.SourceKeys[i] << 32 ) | i;
+    }
+}
+
+static void SerialSort( void )
+{
+    std::sort( gs_Data.Pairs.begin(), gs_Data.Pairs.end() );
+}
+
+static void ParallelSortCase( void )
+{
+    ParallelRadixSort( &gs_Data.Keys[0], &gs_Data.Values[0], &gs_Data.TempKeys[0], &gs_Data.TempValues[0],
+                       gs_nPrimitiveCount );
+}
+
+static void RunSort( const BenchOptions& Options )
+{
+    BenchStats Serial;
+    BenchStats Parallel;
+
+    TimeCase( Options, Serial, SerialSort, PreparePairs );
+    TimeCase( Options, Parallel, ParallelSortCase, PrepareKeys );
+
+    bool bMatch = true;
+    for( unsigned int i = 0; i < gs_nPrimitiveCount && bMatch; ++i )
+    {
+        bMatch = gs_Data.Keys[i] == ( unsigned int )( gs_Data.Pairs[i] >> 32 ) &&
+                 gs_Data.Values[i] == ( unsigned int )gs_Data.Pairs[i];
+    }
+
+    Serial.Print( "primitives", "sort std::sort" );
+    Parallel.Print( "primitives", "sort parallel radix" );
+    PrintSpeedup( "sort", Serial, Parallel, bMatch );
+}
+
+void RunPrimitivesBench( const BenchOptions& Options )
+{
+    InitData();
+
+    RunScan( Options );
+    RunReduce( Options );
+    RunCompact( Options );
+    RunSort( Options );
+}
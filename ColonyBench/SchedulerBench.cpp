@@ -0,0 +1,760 @@
+// Copyright 2010 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+//--------------------------------------------------------------------------------------
+// Scheduler suite.  Runs a frame shaped like UnitManager::Update, three chained
+// task sets that fill spatial bins, steer each unit away from its neighbours
+// and move it, serially and through gTaskMgr at several task counts.  The data
+// layout and sizes follow Colony.h, but the code only depends on TaskMgr so it
+// runs on any backend.
+//
+// At 64 tasks the frame also runs with and without pinned workers, each with
+// and without an affinity key on the three sets, on a fresh TaskMgr per case.
+// They report how many tasks ran on the same thread as their index did the
+// frame before and, where the hardware counters are available, each phase's
+// cycles and L1D, L2 and LLC misses per unit.
+//
+// The wake cases time how long a set takes to reach a worker, right after
+// another set while workers still spin, and after a pause long enough for
+// them to park.
+//
+// The idle cases run a set while the main thread has 1.6 ms of its own work,
+// and time the frame and the time the main thread spends waiting without
+// running a task.  idle wait blocks in WaitForSet before doing that work, as
+// the frame loop did before TryWaitForSet; idle budget does it between
+// 100 us TryWaitForSet calls.
+//
+// The counters suite runs the same frame with gPerfCounters collecting, and
+// reports each phase's IPC, cache and branch misses per unit and estimated
+// memory traffic per unit, in total and per worker.
+//--------------------------------------------------------------------------------------
+
+#include "ColonyBench.h"
+#include <atomic>
+#include <math.h>
+#include <string.h>
+#include <thread>
+
+// Sizes from Colony.h
+static const unsigned int   gs_nBenchUnits = 1024 * 8;
+static const unsigned int   gs_nBenchWorldSize = 512;
+static const unsigned int   gs_nBenchBinSize = 8;
+static const unsigned int   gs_nBenchBinCount = gs_nBenchWorldSize / gs_nBenchBinSize;
+static const unsigned int   gs_nBenchBinCountSq = gs_nBenchBinCount * gs_nBenchBinCount;
+static const unsigned int   gs_nBenchBinCapacity = 2048;
+static const unsigned int   gs_nBenchNeighbourCount = 4 * gs_nBenchBinCapacity;
+static const float          gs_fBenchTileSize = 1.0f / 16.0f;
+static const float          gs_fBenchWorldSize = gs_nBenchWorldSize * gs_fBenchTileSize;
+static const float          gs_fBenchRecipBinSize = 1.0f / ( gs_fBenchTileSize * gs_nBenchBinSize );
+static const float          gs_fBenchUnitRadius = 0.015f;
+static const float          gs_fBenchSpeed = ( gs_fBenchTileSize / 2.0f ) * 25.0f;
+static const float          gs_fBenchElapsed = 1.0f / 30.0f;
+
+struct BenchBin
+{
+    unsigned int pUnits[gs_nBenchBinCapacity];
+    std::atomic<unsigned int> nUnits;
+};
+
+struct BenchWorld
+{
+    float fPositionX[gs_nBenchUnits];
+    float fPositionY[gs_nBenchUnits];
+    float fGoalX[gs_nBenchUnits];
+    float fGoalY[gs_nBenchUnits];
+    float fDirectionX[gs_nBenchUnits];
+    float fDirectionY[gs_nBenchUnits];
+
+    BenchBin Bins[gs_nBenchBinCountSq];
+};
+
+static BenchWorld   gs_World;
+
+// Thread each task index of each phase last ran on, and how many tasks ran
+//   on the same thread as the frame before, while s_bTrackTasks is set
+static const unsigned int   gs_nTrackedTasks = 256;
+static int                  s_nTaskContext[ BenchPhaseCount ][ gs_nTrackedTasks ];
+static std::atomic<unsigned int> s_nTasksRun;
+static std::atomic<unsigned int> s_nTasksSameThread;
+static bool                 s_bTrackTasks;
+
+static void TrackTask( unsigned int nPhase,
+                       unsigned int uTaskId,
+                       int nContext )
+{
+    if( !s_bTrackTasks || uTaskId >= gs_nTrackedTasks )
+    {
+        return;
+    }
+
+    // Each index runs once per phase and frame, so only one thread writes
+    //   its slot at a time
+    s_nTasksRun.fetch_add( 1, std::memory_order_relaxed );
+    if( s_nTaskContext[nPhase][uTaskId] == nContext )
+    {
+        s_nTasksSameThread.fetch_add( 1, std::memory_order_relaxed );
+    }
+    s_nTaskContext[nPhase][uTaskId] = nContext;
+}
+
+// Deterministic so every backend simulates the same frames
+static float BenchRand( unsigned int& nSeed )
+{
+    nSeed = nSeed * 1664525u + 1013904223u;
+    return ( nSeed >> 8 ) * ( 1.0f / 16777216.0f );
+}
+
+static void ResetWorld( void )
+{
+    unsigned int nSeed = 12345;
+    for( unsigned int i = 0; i < gs_nBenchUnits; ++i )
+    {
+        gs_World.fPositionX[i] = BenchRand( nSeed ) * gs_fBenchWorldSize;
+        gs_World.fPositionY[i] = BenchRand( nSeed ) * gs_fBenchWorldSize;
+        gs_World.fGoalX[i] = BenchRand( nSeed ) * gs_fBenchWorldSize;
+        gs_World.fGoalY[i] = BenchRand( nSeed ) * gs_fBenchWorldSize;
+        gs_World.fDirectionX[i] = 0.0f;
+        gs_World.fDirectionY[i] = 0.0f;
+    }
+}
+
+static void GetTaskRange( unsigned int uTaskId,
+                          unsigned int uTaskCount,
+                          unsigned int& uStart,
+                          unsigned int& uEnd )
+{
+    unsigned int uUnits = gs_nBenchUnits / uTaskCount;
+    uStart = uUnits * uTaskId;
+    uEnd = ( uTaskId + 1 == uTaskCount ) ? gs_nBenchUnits : uStart + uUnits;
+}
+
+static int GetBin( float fX,
+                   float fY )
+{
+    int nBinX = ( int )( fX * gs_fBenchRecipBinSize );
+    int nBinY = ( int )( fY * gs_fBenchRecipBinSize );
+    if( nBinX < 0 || nBinY < 0 || nBinX >= ( int )gs_nBenchBinCount || nBinY >= ( int )gs_nBenchBinCount )
+    {
+        return -1;
+    }
+    return nBinX * gs_nBenchBinCount + nBinY;
+}
+
+// Shaped like UnitManager::FillBinsTask, every task appends to shared bins
+static void FillBinsTask( void* pVoid,
+                          int nContext,
+                          unsigned int uTaskId,
+                          unsigned int uTaskCount )
+{
+    unsigned int uStart, uEnd;
+    GetTaskRange( uTaskId, uTaskCount, uStart, uEnd );
+
+    PerfScope Perf( BenchPhaseFillBins, nContext, uEnd - uStart );
+    TrackTask( BenchPhaseFillBins, uTaskId, nContext );
+
+    for( unsigned int i = uStart; i < uEnd; ++i )
+    {
+        int nBin = GetBin( gs_World.fPositionX[i], gs_World.fPositionY[i] );
+        if( nBin < 0 )
+        {
+            continue;
+        }
+
+        unsigned int nSlot = gs_World.Bins[nBin].nUnits.fetch_add( 1 );
+        if( nSlot < gs_nBenchBinCapacity )
+        {
+            gs_World.Bins[nBin].pUnits[nSlot] = i;
+        }
+    }
+}
+
+// Shaped like UnitManager::CalculateDirectionTask, gathers the units of four
+//   bins and steers away from the close ones
+static void CalculateDirectionTask( void* pVoid,
+                                    int nContext,
+                                    unsigned int uTaskId,
+                                    unsigned int uTaskCount )
+{
+    unsigned int uStart, uEnd;
+    GetTaskRange( uTaskId, uTaskCount, uStart, uEnd );
+
+    PerfScope Perf( BenchPhaseCalculateDirection, nContext, uEnd - uStart );
+    TrackTask( BenchPhaseCalculateDirection, uTaskId, nContext );
+
+    // Scratch from the frame arena, like UnitManager::CalculateDirectionTask
+    FrameArenaScope Scratch( gFrameArena, nContext );
+    unsigned int* pNeighbours = gFrameArena.AllocateArray<unsigned int>( nContext, gs_nBenchNeighbourCount );
+
+    for( unsigned int i = uStart; i < uEnd; ++i )
+    {
+        float fX = gs_World.fPositionX[i];
+        float fY = gs_World.fPositionY[i];
+
+        float fDirX = gs_World.fGoalX[i] - fX;
+        float fDirY = gs_World.fGoalY[i] - fY;
+        float fLength = sqrtf( fDirX * fDirX + fDirY * fDirY ) + 1e-6f;
+        fDirX /= fLength;
+        fDirY /= fLength;
+
+        int nBinX = ( int )( fX * gs_fBenchRecipBinSize );
+        int nBinY = ( int )( fY * gs_fBenchRecipBinSize );
+        int nDeltaX = fDirX > 0.0f ? 1 : -1;
+        int nDeltaY = fDirY > 0.0f ? 1 : -1;
+        int nBinsX[4] = { nBinX, nBinX + nDeltaX, nBinX, nBinX + nDeltaX };
+        int nBinsY[4] = { nBinY, nBinY, nBinY + nDeltaY, nBinY + nDeltaY };
+
+        unsigned int nCount = 0;
+        for( int b = 0; b < 4; ++b )
+        {
+            if( nBinsX[b] < 0 || nBinsY[b] < 0 ||
+                nBinsX[b] >= ( int )gs_nBenchBinCount || nBinsY[b] >= ( int )gs_nBenchBinCount )
+            {
+                continue;
+            }
+
+            const BenchBin& Bin = gs_World.Bins[nBinsX[b] * gs_nBenchBinCount + nBinsY[b]];
+            unsigned int nUnits = Bin.nUnits.load( std::memory_order_relaxed );
+            if( nUnits > gs_nBenchBinCapacity )
+            {
+                nUnits = gs_nBenchBinCapacity;
+            }
+
+            memcpy( pNeighbours + nCount, Bin.pUnits, nUnits * sizeof( unsigned int ) );
+            nCount += nUnits;
+        }
+
+        float fAvoidX = 0.0f;
+        float fAvoidY = 0.0f;
+        for( unsigned int n = 0; n < nCount; ++n )
+        {
+            unsigned int nOther = pNeighbours[n];
+            float fDX = fX - gs_World.fPositionX[nOther];
+            float fDY = fY - gs_World.fPositionY[nOther];
+            float fDistSq = fDX * fDX + fDY * fDY;
+            if( nOther != i && fDistSq < 16.0f * gs_fBenchUnitRadius * gs_fBenchUnitRadius )
+            {
+                float fScale = 1.0f / ( fDistSq + 1e-4f );
+                fAvoidX += fDX * fScale;
+                fAvoidY += fDY * fScale;
+            }
+        }
+
+        gs_World.fDirectionX[i] = fDirX + fAvoidX * 1e-4f;
+        gs_World.fDirectionY[i] = fDirY + fAvoidY * 1e-4f;
+    }
+}
+
+// Shaped like UnitManager::ScalarUpdateUnitTask
+static void UpdateUnitTask( void* pVoid,
+                            int nContext,
+                            unsigned int uTaskId,
+                            unsigned int uTaskCount )
+{
+    unsigned int uStart, uEnd;
+    GetTaskRange( uTaskId, uTaskCount, uStart, uEnd );
+
+    PerfScope Perf( BenchPhaseUpdate, nContext, uEnd - uStart );
+    TrackTask( BenchPhaseUpdate, uTaskId, nContext );
+
+    for( unsigned int i = uStart; i < uEnd; ++i )
+    {
+        float fDirX = gs_World.fDirectionX[i];
+        float fDirY = gs_World.fDirectionY[i];
+        float fLength = sqrtf( fDirX * fDirX + fDirY * fDirY ) + 1e-6f;
+
+        float fStep = gs_fBenchSpeed * gs_fBenchElapsed / fLength;
+        gs_World.fPositionX[i] += fDirX * fStep;
+        gs_World.fPositionY[i] += fDirY * fStep;
+
+        // Pick a new goal once this one is reached
+        float fGoalDX = gs_World.fGoalX[i] - gs_World.fPositionX[i];
+        float fGoalDY = gs_World.fGoalY[i] - gs_World.fPositionY[i];
+        if( fGoalDX * fGoalDX + fGoalDY * fGoalDY < gs_fBenchTileSize * gs_fBenchTileSize )
+        {
+            gs_World.fGoalX[i] = gs_fBenchWorldSize - gs_World.fGoalX[i];
+            gs_World.fGoalY[i] = gs_fBenchWorldSize - gs_World.fGoalY[i];
+        }
+    }
+}
+
+static void ClearBins( void )
+{
+    for( unsigned int i = 0; i < gs_nBenchBinCountSq; ++i )
+    {
+        gs_World.Bins[i].nUnits.store( 0, std::memory_order_relaxed );
+    }
+}
+
+static void SerialFrame( void )
+{
+    gFrameArena.Reset();
+    ClearBins();
+    FillBinsTask( NULL, 0, 0, 1 );
+    CalculateDirectionTask( NULL, 0, 0, 1 );
+    UpdateUnitTask( NULL, 0, 0, 1 );
+}
+
+static void TaskFrame( unsigned int uTaskCount,
+                       UINT uAffinityKey = TASKSETAFFINITY_NONE )
+{
+    TASKSETHANDLE hBin;
+    TASKSETHANDLE hDirection;
+    TASKSETHANDLE hUpdate;
+
+    gFrameArena.Reset();
+    ClearBins();
+
+    // The three sets cover the same unit ranges, so they share a key
+    gTaskMgr.CreateTaskSet( FillBinsTask, NULL, uTaskCount, NULL, 0, "FillBinsTask", &hBin,
+                            TASKSETHANDLE_INVALID, TASKSETPRIORITY_NORMAL, uAffinityKey );
+    gTaskMgr.CreateTaskSet( CalculateDirectionTask, NULL, uTaskCount, &hBin, 1, "CalculateDirectionTask", &hDirection,
+                            TASKSETHANDLE_INVALID, TASKSETPRIORITY_NORMAL, uAffinityKey );
+    gTaskMgr.CreateTaskSet( UpdateUnitTask, NULL, uTaskCount, &hDirection, 1, "UpdateUnitTask", &hUpdate,
+                            TASKSETHANDLE_INVALID, TASKSETPRIORITY_NORMAL, uAffinityKey );
+
+    gTaskMgr.WaitForSet( hUpdate );
+
+    gTaskMgr.ReleaseHandle( hUpdate );
+    gTaskMgr.ReleaseHandle( hDirection );
+    gTaskMgr.ReleaseHandle( hBin );
+}
+
+// Wake cases
+static const unsigned int   gs_nWakeTasks = 64;
+static const double         gs_fWakeTaskMs = 0.02;
+static const unsigned int   gs_nWakeParkMs = 10;
+
+static std::thread::id                  s_WakeMainThread;
+static std::chrono::steady_clock::time_point s_WakeStart;
+static std::atomic<long long>           s_nWakeNs;
+
+static void WakeTask( void* pVoid, int nContext, unsigned int uTaskId, unsigned int uTaskCount )
+{
+    // Only the first task to start on a worker records
+    if( std::this_thread::get_id() != s_WakeMainThread && 0 == s_nWakeNs.load( std::memory_order_relaxed ) )
+    {
+        long long nExpected = 0;
+        long long nWakeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - s_WakeStart ).count();
+        s_nWakeNs.compare_exchange_strong( nExpected, nWakeNs > 0 ? nWakeNs : 1 );
+    }
+
+    BenchTimer Timer;
+    while( Timer.ElapsedMs() < gs_fWakeTaskMs )
+    {
+    }
+}
+
+// Returns the time in ms from creating a set to its first task starting on a
+// worker, or a negative value if the main thread ran every task
+static double WakeSet( void )
+{
+    TASKSETHANDLE hWake;
+
+    s_nWakeNs.store( 0 );
+    s_WakeStart = std::chrono::steady_clock::now();
+    gTaskMgr.CreateTaskSet( WakeTask, NULL, gs_nWakeTasks, NULL, 0, "WakeTask", &hWake );
+    gTaskMgr.WaitForSet( hWake );
+    gTaskMgr.ReleaseHandle( hWake );
+
+    long long nWakeNs = s_nWakeNs.load();
+    return nWakeNs > 0 ? nWakeNs / 1000000.0 : -1.0;
+}
+
+static void BenchWake( const BenchOptions& Options,
+                       bool bParked )
+{
+    BenchStats Wake;
+    unsigned int nMissed = 0;
+    const char* szCase = bParked ? "wake parked" : "wake spinning";
+
+    s_WakeMainThread = std::this_thread::get_id();
+
+    for( unsigned int i = 0; i < Options.nWarmup + Options.nFrames; ++i )
+    {
+        if( bParked )
+        {
+            std::this_thread::sleep_for( std::chrono::milliseconds( gs_nWakeParkMs ) );
+        }
+        else
+        {
+            // Leaves the workers looking for work
+            WakeSet();
+        }
+
+        double fWakeMs = WakeSet();
+        if( i < Options.nWarmup )
+        {
+            continue;
+        }
+
+        if( fWakeMs < 0.0 )
+        {
+            ++nMissed;
+        }
+        else
+        {
+            Wake.Add( fWakeMs );
+        }
+    }
+
+    if( nMissed == Options.nFrames )
+    {
+        printf( "%-12s %-32s no worker woke, skipped\n", "scheduler", szCase );
+        return;
+    }
+
+    Wake.Print( "scheduler", szCase );
+    if( nMissed > 0 )
+    {
+        printf( "%-12s %-32s %u of %u sets ran only on the main thread\n", "scheduler", szCase, nMissed, Options.nFrames );
+    }
+}
+
+// Idle cases.  A set of short tasks runs while the main thread has work of
+//   its own to get through, as the frame loop has with the next frame to
+//   prepare.
+static const unsigned int   gs_nIdleTasks = 64;
+static const double         gs_fIdleTaskMs = 0.05;
+static const unsigned int   gs_nIdleMainChunks = 16;
+static const double         gs_fIdleMainChunkMs = 0.1;
+static const DWORD          gs_dwIdleBudgetUs = 100;
+
+static double               s_fIdleMainTaskMs;
+
+static void IdleTask( void* pVoid, int nContext, unsigned int uTaskId, unsigned int uTaskCount )
+{
+    BenchTimer Timer;
+    while( Timer.ElapsedMs() < gs_fIdleTaskMs )
+    {
+    }
+
+    // Time the main thread spends running tasks while it waits is not idle
+    if( std::this_thread::get_id() == s_WakeMainThread )
+    {
+        s_fIdleMainTaskMs += Timer.ElapsedMs();
+    }
+}
+
+static void IdleMainChunk( void )
+{
+    BenchTimer Timer;
+    while( Timer.ElapsedMs() < gs_fIdleMainChunkMs )
+    {
+    }
+}
+
+// Runs one frame and returns the time in ms the main thread spent in
+//   WaitForSet or TryWaitForSet without running a task.  bBudget waits
+//   with TryWaitForSet between chunks of the main thread's own work;
+//   otherwise the main thread waits for the set first and does its work
+//   after, as it did before TryWaitForSet.
+static double IdleFrame( bool bBudget )
+{
+    TASKSETHANDLE hIdle;
+    unsigned int nChunk = 0;
+    double fWaitMs = 0.0;
+
+    s_fIdleMainTaskMs = 0.0;
+    gTaskMgr.CreateTaskSet( IdleTask, NULL, gs_nIdleTasks, NULL, 0, "IdleTask", &hIdle );
+
+    if( bBudget )
+    {
+        BOOL bComplete = FALSE;
+        while( !bComplete && nChunk < gs_nIdleMainChunks )
+        {
+            BenchTimer Wait;
+            bComplete = gTaskMgr.TryWaitForSet( hIdle, gs_dwIdleBudgetUs );
+            fWaitMs += Wait.ElapsedMs();
+
+            if( !bComplete )
+            {
+                IdleMainChunk();
+                ++nChunk;
+            }
+        }
+    }
+
+    // The main thread's work is done, or there was no budget; block
+    BenchTimer Wait;
+    gTaskMgr.WaitForSet( hIdle );
+    fWaitMs += Wait.ElapsedMs();
+    gTaskMgr.ReleaseHandle( hIdle );
+
+    for( ; nChunk < gs_nIdleMainChunks; ++nChunk )
+    {
+        IdleMainChunk();
+    }
+
+    return fWaitMs - s_fIdleMainTaskMs;
+}
+
+static void BenchIdle( const BenchOptions& Options,
+                       bool bBudget )
+{
+    BenchStats Frame;
+    BenchStats Idle;
+    const char* szCase = bBudget ? "idle budget" : "idle wait";
+
+    s_WakeMainThread = std::this_thread::get_id();
+
+    for( unsigned int i = 0; i < Options.nWarmup + Options.nFrames; ++i )
+    {
+        BenchTimer Timer;
+        double fIdleMs = IdleFrame( bBudget );
+        if( i >= Options.nWarmup )
+        {
+            Frame.Add( Timer.ElapsedMs() );
+            Idle.Add( fIdleMs );
+        }
+    }
+
+    char szIdleCase[64];
+    sprintf( szIdleCase, "%s, main thread idle", szCase );
+    Frame.Print( "scheduler", szCase );
+    Idle.Print( "scheduler", szIdleCase );
+}
+
+// Sums a phase's samples over frames
+static void AddSample( PerfCounters::Sample& Total,
+                       const PerfCounters::Sample& Frame )
+{
+    for( unsigned int c = 0; c < PerfCounters::CounterCount; ++c )
+    {
+        Total.nCounts[c] += Frame.nCounts[c];
+    }
+    Total.nUnits += Frame.nUnits;
+    Total.nScopes += Frame.nScopes;
+}
+
+static void PrintSample( const char* szSuite,
+                         const char* szCase,
+                         const PerfCounters::Sample& Sample )
+{
+    char szLine[256];
+    int nLength = sprintf( szLine, "%-12s %-32s IPC %5.2f  cycles/unit %7.1f", szSuite, szCase,
+                           Sample.GetIPC(), Sample.GetPerUnit( PerfCounters::Cycles ) );
+
+    if( gPerfCounters.HasCounter( PerfCounters::L1DMisses ) )
+    {
+        nLength += sprintf( szLine + nLength, "  L1D miss/unit %6.2f", Sample.GetPerUnit( PerfCounters::L1DMisses ) );
+    }
+    if( gPerfCounters.HasCounter( PerfCounters::LLCReferences ) )
+    {
+        nLength += sprintf( szLine + nLength, "  L2 miss/unit %6.3f", Sample.GetPerUnit( PerfCounters::LLCReferences ) );
+    }
+    if( gPerfCounters.HasCounter( PerfCounters::LLCMisses ) )
+    {
+        nLength += sprintf( szLine + nLength, "  LLC miss/unit %6.3f  B/unit %6.1f",
+                            Sample.GetPerUnit( PerfCounters::LLCMisses ), Sample.GetBytesPerUnit() );
+    }
+    if( gPerfCounters.HasCounter( PerfCounters::BranchMisses ) )
+    {
+        nLength += sprintf( szLine + nLength, "  br miss/unit %5.2f", Sample.GetPerUnit( PerfCounters::BranchMisses ) );
+    }
+
+    puts( szLine );
+}
+
+// Restarts gTaskMgr with the bench's thread count; Init resets the override
+static void RestartTaskMgr( const BenchOptions& Options,
+                            BOOL bPinWorkers )
+{
+    gTaskMgr.Shutdown();
+    gTaskMgr.mbPinWorkerThreads = bPinWorkers;
+    if( Options.nThreads )
+    {
+        gTaskMgr.miDemoModeTBBThreadCountOverride = ( INT )Options.nThreads;
+    }
+    gTaskMgr.Init();
+}
+
+void RunSchedulerBench( const BenchOptions& Options )
+{
+    BenchStats Serial;
+
+    ResetWorld();
+    for( unsigned int i = 0; i < Options.nWarmup; ++i )
+    {
+        SerialFrame();
+    }
+
+    for( unsigned int i = 0; i < Options.nFrames; ++i )
+    {
+        BenchTimer Timer;
+        SerialFrame();
+        Serial.Add( Timer.ElapsedMs() );
+    }
+
+    Serial.Print( "scheduler", "frame serial" );
+
+    static const unsigned int s_nTaskCounts[] = { 16, 64, 256 };
+
+    for( unsigned int c = 0; c < sizeof( s_nTaskCounts ) / sizeof( s_nTaskCounts[0] ); ++c )
+    {
+        BenchStats Tasks;
+        unsigned int nHeapAllocations = 0;
+        char szCase[64];
+
+        ResetWorld();
+        for( unsigned int i = 0; i < Options.nWarmup; ++i )
+        {
+            TaskFrame( s_nTaskCounts[c] );
+        }
+
+        for( unsigned int i = 0; i < Options.nFrames; ++i )
+        {
+            BenchTimer Timer;
+            TaskFrame( s_nTaskCounts[c] );
+            Tasks.Add( Timer.ElapsedMs() );
+            nHeapAllocations += gFrameArena.GetFrameHeapAllocations();
+        }
+
+        sprintf( szCase, "frame %s %u tasks", GetTaskMgrBackendName(), s_nTaskCounts[c] );
+        Tasks.Print( "scheduler", szCase );
+        printf( "%-12s %-32s speedup %.2fx, %u arena heap allocations\n",
+                "scheduler", szCase, Serial.GetMean() / Tasks.GetMean(), nHeapAllocations );
+    }
+
+    // Pinned against unpinned workers, with and without affinity.  Where
+    //   there are hardware counters each phase's cycles and cache misses
+    //   per unit are collected too, from the same frames.
+    static const unsigned int s_nAffinityTasks = 64;
+    BOOL bPinWorkers = gTaskMgr.mbPinWorkerThreads;
+
+    for( unsigned int nCase = 0; nCase < 4; ++nCase )
+    {
+        BOOL bPinned = ( nCase & 2 ) ? TRUE : FALSE;
+        UINT uAffinityKey = ( nCase & 1 ) ? 0 : TASKSETAFFINITY_NONE;
+        BenchStats Tasks;
+        PerfCounters::Sample Phases[ BenchPhaseCount ];
+        char szCase[64];
+
+        memset( Phases, 0, sizeof( Phases ) );
+        RestartTaskMgr( Options, bPinned );
+
+        ResetWorld();
+        for( unsigned int i = 0; i < Options.nWarmup; ++i )
+        {
+            TaskFrame( s_nAffinityTasks, uAffinityKey );
+        }
+
+        gPerfCounters.SetEnabled( true );
+        gPerfCounters.EndFrame();
+        s_nTasksRun.store( 0 );
+        s_nTasksSameThread.store( 0 );
+        s_bTrackTasks = true;
+
+        for( unsigned int i = 0; i < Options.nFrames; ++i )
+        {
+            BenchTimer Timer;
+            TaskFrame( s_nAffinityTasks, uAffinityKey );
+            Tasks.Add( Timer.ElapsedMs() );
+
+            gPerfCounters.EndFrame();
+            for( unsigned int nPhase = 0; nPhase < BenchPhaseCount; ++nPhase )
+            {
+                AddSample( Phases[nPhase], gPerfCounters.GetFrameSample( nPhase ) );
+            }
+        }
+
+        gPerfCounters.SetEnabled( false );
+        s_bTrackTasks = false;
+
+        sprintf( szCase, "frame %s%s", bPinned ? "pinned" : "unpinned",
+                 TASKSETAFFINITY_NONE != uAffinityKey ? " affinity" : "" );
+        Tasks.Print( "scheduler", szCase );
+        printf( "%-12s %-32s speedup %.2fx, %.1f%% of tasks on last frame's thread\n", "scheduler", szCase,
+                Serial.GetMean() / Tasks.GetMean(),
+                s_nTasksRun.load() ? s_nTasksSameThread.load() * 100.0 / s_nTasksRun.load() : 0.0 );
+
+        if( gPerfCounters.HasCounter( PerfCounters::Cycles ) )
+        {
+            for( unsigned int nPhase = 0; nPhase < BenchPhaseCount; ++nPhase )
+            {
+                sprintf( szCase, "  %s", gPerfCounters.GetPhaseName( nPhase ) );
+                PrintSample( "scheduler", szCase, Phases[nPhase] );
+            }
+        }
+    }
+
+    // Back to the workers the other suites run with
+    RestartTaskMgr( Options, bPinWorkers );
+
+    // Cost of parking idle workers
+    BenchWake( Options, false );
+    BenchWake( Options, true );
+
+    // Main thread idle time, blocking in WaitForSet against TryWaitForSet
+    BenchIdle( Options, false );
+    BenchIdle( Options, true );
+}
+
+void RunCountersBench( const BenchOptions& Options )
+{
+    static const unsigned int s_nTaskCount = 64;
+
+    if( !gPerfCounters.HasCounter( PerfCounters::Cycles ) )
+    {
+        printf( "%-12s no hardware counters available, skipped\n", "counters" );
+        return;
+    }
+
+    PerfCounters::Sample Totals[ BenchPhaseCount ];
+    PerfCounters::Sample Workers[ gs_nBenchMaxContexts ][ BenchPhaseCount ];
+    memset( Totals, 0, sizeof( Totals ) );
+    memset( Workers, 0, sizeof( Workers ) );
+
+    ResetWorld();
+    for( unsigned int i = 0; i < Options.nWarmup; ++i )
+    {
+        TaskFrame( s_nTaskCount );
+    }
+
+    gPerfCounters.SetEnabled( true );
+    gPerfCounters.EndFrame();
+
+    for( unsigned int i = 0; i < Options.nFrames; ++i )
+    {
+        TaskFrame( s_nTaskCount );
+        gPerfCounters.EndFrame();
+
+        for( unsigned int nPhase = 0; nPhase < BenchPhaseCount; ++nPhase )
+        {
+            AddSample( Totals[nPhase], gPerfCounters.GetFrameSample( nPhase ) );
+            for( unsigned int nContext = 0; nContext < gs_nBenchMaxContexts; ++nContext )
+            {
+                AddSample( Workers[nContext][nPhase], gPerfCounters.GetFrameSample( nPhase, nContext ) );
+            }
+        }
+    }
+
+    gPerfCounters.SetEnabled( false );
+
+    for( unsigned int nPhase = 0; nPhase < BenchPhaseCount; ++nPhase )
+    {
+        char szCase[64];
+        sprintf( szCase, "%s", gPerfCounters.GetPhaseName( nPhase ) );
+        PrintSample( "counters", szCase, Totals[nPhase] );
+
+        for( unsigned int nContext = 0; nContext < gs_nBenchMaxContexts; ++nContext )
+        {
+            if( Workers[nContext][nPhase].nScopes > 0 )
+            {
+                sprintf( szCase, "  context %u, %u%% of units", nContext,
+                         ( unsigned int )( Workers[nContext][nPhase].nUnits * 100 / Totals[nPhase].nUnits ) );
+                PrintSample( "counters", szCase, Workers[nContext][nPhase] );
+            }
+        }
+    }
+}
@@ -0,0 +1,489 @@
+// Copyright 2010 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+//--------------------------------------------------------------------------------------
+// TaskMgr suite.  Measures the tasking layer itself with tasks that do no
+// work, at 1, 2, 4 ... threads up to -threads or the machine's thread count:
+//
+//   create N deps      CreateTaskSet of one task depending on 0, 1 or 5
+//                      completed sets.  0 deps allocates a fake parent.
+//   create ring N%     CreateTaskSet while N% of the MAX_TASKSETS slots are
+//                      held, so AllocateTaskSet probes past them.
+//   empty task         Per task cost of one large set of empty tasks.
+//   chain link         Latency of one link of a dependency chain, from a
+//                      set's last task through CompleteTaskSet to its
+//                      successor running.
+//   successor shared   CreateTaskSet called from MAX_SUCCESSORS tasks at
+//                      once, all depending on one set, so they contend for
+//                      its successor lock and completion count.
+//   successor own      The same with a parent per task, for comparison.
+//   latency idle       Time from creating a set of one short task per thread
+//                      to the workers completing it, with nothing else
+//                      queued.  The main thread only polls, so the tasks
+//                      wait their turn in the workers' queues.  Run at 2
+//                      threads and up.
+//   latency normal     The same under a NORMAL background set that keeps
+//                      every thread busy.
+//   latency high       The set as HIGH under a LOW background set, as the
+//                      render cull runs against the next frame's simulation.
+//
+// All times are ns per operation.  -json writes them to a file.
+//--------------------------------------------------------------------------------------
+
+#include "ColonyBench.h"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <string.h>
+
+static const unsigned int   gs_nCreateBatch = 64;
+static const unsigned int   gs_nRingBatch = 4;
+static const unsigned int   gs_nEmptyTasks = 16 * 1024;
+static const unsigned int   gs_nChainLength = 32;
+static const unsigned int   gs_nSuccessorCreates = 16;
+static const unsigned int   gs_nBackgroundTasks = 64;          // Per thread
+static const double         gs_fBackgroundTaskMs = 0.05;
+static const double         gs_fForegroundTaskMs = 0.005;
+static const double         gs_fBackgroundSettleMs = 0.2;
+
+// More tasks adding successors to one set at a time than MAX_SUCCESSORS
+//   can overflow its successor list
+static const unsigned int   gs_nSuccessorTasks = MAX_SUCCESSORS;
+
+struct TaskMgrResult
+{
+    unsigned int nThreads;
+    std::string Case;
+    double fMean;
+    double fMin;
+    double fP50;
+    double fP99;
+};
+
+static std::vector<TaskMgrResult>   gs_Results;
+
+static std::atomic<bool>    gs_bGateOpen;
+
+struct SuccessorArgs
+{
+    TASKSETHANDLE* phParents;       // One parent, or one per task
+    unsigned int nParentStride;     // 0 when the parent is shared
+    TASKSETHANDLE* phChildren;
+    double* pfNsPerCreate;
+};
+
+static void EmptyTask( void* pVoid,
+                       int nContext,
+                       unsigned int uTaskId,
+                       unsigned int uTaskCount )
+{
+}
+
+// Holds its set open until the main thread opens the gate
+static void GateTask( void* pVoid,
+                      int nContext,
+                      unsigned int uTaskId,
+                      unsigned int uTaskCount )
+{
+    while( !gs_bGateOpen.load( std::memory_order_acquire ) )
+    {
+        std::this_thread::yield();
+    }
+}
+
+// Busy for the milliseconds pVoid points at
+static void SpinTask( void* pVoid,
+                      int nContext,
+                      unsigned int uTaskId,
+                      unsigned int uTaskCount )
+{
+    double fMs = *( const double* )pVoid;
+    BenchTimer Timer;
+    while( Timer.ElapsedMs() < fMs )
+    {
+    }
+}
+
+static void SuccessorTask( void* pVoid,
+                           int nContext,
+                           unsigned int uTaskId,
+                           unsigned int uTaskCount )
+{
+    SuccessorArgs* pArgs = ( SuccessorArgs* )pVoid;
+    TASKSETHANDLE* phParent = pArgs->phParents + uTaskId * pArgs->nParentStride;
+    TASKSETHANDLE* phChildren = pArgs->phChildren + uTaskId * gs_nSuccessorCreates;
+
+    BenchTimer Timer;
+    for( unsigned int i = 0; i < gs_nSuccessorCreates; ++i )
+    {
+        gTaskMgr.CreateTaskSet( EmptyTask, NULL, 1, phParent, 1, "SuccessorChild", &phChildren[i] );
+    }
+    pArgs->pfNsPerCreate[uTaskId] = Timer.ElapsedMs() * 1e6 / gs_nSuccessorCreates;
+}
+
+static void WaitAndRelease( TASKSETHANDLE* phSets,
+                            unsigned int nSets )
+{
+    for( unsigned int i = 0; i < nSets; ++i )
+    {
+        gTaskMgr.WaitForSet( phSets[i] );
+    }
+    gTaskMgr.ReleaseHandles( phSets, nSets );
+}
+
+// Completed sets whose handles are held, to depend on or to fill the ring
+static void CreateCompletedSets( TASKSETHANDLE* phSets,
+                                 unsigned int nSets )
+{
+    for( unsigned int i = 0; i < nSets; ++i )
+    {
+        gTaskMgr.CreateTaskSet( EmptyTask, NULL, 1, NULL, 0, "Held", &phSets[i] );
+    }
+    for( unsigned int i = 0; i < nSets; ++i )
+    {
+        gTaskMgr.WaitForSet( phSets[i] );
+    }
+}
+
+static void AddResult( unsigned int nThreads,
+                       const char* szCase,
+                       const BenchStats& Stats )
+{
+    char szLine[64];
+    sprintf( szLine, "%s, %u threads", szCase, nThreads );
+    printf( "%-12s %-32s mean %8.1f ns  min %8.1f ns  p50 %8.1f ns  p99 %8.1f ns\n", "taskmgr", szLine,
+            Stats.GetMean(), Stats.GetMin(), Stats.GetPercentile( 0.5 ), Stats.GetPercentile( 0.99 ) );
+
+    TaskMgrResult Result;
+    Result.nThreads = nThreads;
+    Result.Case = szCase;
+    Result.fMean = Stats.GetMean();
+    Result.fMin = Stats.GetMin();
+    Result.fP50 = Stats.GetPercentile( 0.5 );
+    Result.fP99 = Stats.GetPercentile( 0.99 );
+    gs_Results.push_back( Result );
+}
+
+static void BenchCreate( const BenchOptions& Options,
+                         unsigned int nThreads,
+                         unsigned int nDepends )
+{
+    TASKSETHANDLE hParents[5];
+    TASKSETHANDLE hSets[ gs_nCreateBatch ];
+    BenchStats Stats;
+
+    CreateCompletedSets( hParents, nDepends );
+
+    for( unsigned int i = 0; i < Options.nWarmup + Options.nFrames; ++i )
+    {
+        BenchTimer Timer;
+        for( unsigned int j = 0; j < gs_nCreateBatch; ++j )
+        {
+            gTaskMgr.CreateTaskSet( EmptyTask, NULL, 1, nDepends ? hParents : NULL, nDepends, "Create", &hSets[j] );
+        }
+        if( i >= Options.nWarmup )
+        {
+            Stats.Add( Timer.ElapsedMs() * 1e6 / gs_nCreateBatch );
+        }
+
+        WaitAndRelease( hSets, gs_nCreateBatch );
+    }
+
+    gTaskMgr.ReleaseHandles( hParents, nDepends );
+
+    char szCase[32];
+    sprintf( szCase, "create %u deps", nDepends );
+    AddResult( nThreads, szCase, Stats );
+}
+
+static void BenchRing( const BenchOptions& Options,
+                       unsigned int nThreads,
+                       unsigned int nHeld )
+{
+    TASKSETHANDLE hHeld[ MAX_TASKSETS ];
+    TASKSETHANDLE hSets[ gs_nRingBatch ];
+    BenchStats Stats;
+
+    CreateCompletedSets( hHeld, nHeld );
+
+    for( unsigned int i = 0; i < Options.nWarmup + Options.nFrames; ++i )
+    {
+        BenchTimer Timer;
+        for( unsigned int j = 0; j < gs_nRingBatch; ++j )
+        {
+            gTaskMgr.CreateTaskSet( EmptyTask, NULL, 1, NULL, 0, "Ring", &hSets[j] );
+        }
+        if( i >= Options.nWarmup )
+        {
+            Stats.Add( Timer.ElapsedMs() * 1e6 / gs_nRingBatch );
+        }
+
+        WaitAndRelease( hSets, gs_nRingBatch );
+    }
+
+    gTaskMgr.ReleaseHandles( hHeld, nHeld );
+
+    char szCase[32];
+    sprintf( szCase, "create ring %u%%", nHeld * 100 / MAX_TASKSETS );
+    AddResult( nThreads, szCase, Stats );
+}
+
+static void BenchEmptyTasks( const BenchOptions& Options,
+                             unsigned int nThreads )
+{
+    BenchStats Stats;
+
+    for( unsigned int i = 0; i < Options.nWarmup + Options.nFrames; ++i )
+    {
+        TASKSETHANDLE hSet;
+
+        BenchTimer Timer;
+        gTaskMgr.CreateTaskSet( EmptyTask, NULL, gs_nEmptyTasks, NULL, 0, "Empty", &hSet );
+        gTaskMgr.WaitForSet( hSet );
+        if( i >= Options.nWarmup )
+        {
+            Stats.Add( Timer.ElapsedMs() * 1e6 / gs_nEmptyTasks );
+        }
+
+        gTaskMgr.ReleaseHandle( hSet );
+    }
+
+    AddResult( nThreads, "empty task", Stats );
+}
+
+static void BenchChain( const BenchOptions& Options,
+                        unsigned int nThreads )
+{
+    BenchStats Stats;
+
+    for( unsigned int i = 0; i < Options.nWarmup + Options.nFrames; ++i )
+    {
+        TASKSETHANDLE hSets[ 1 + gs_nChainLength ];
+
+        // The whole chain is wired behind the gate before it is opened, so
+        //   only completion and successor scheduling are timed
+        gs_bGateOpen.store( false );
+        gTaskMgr.CreateTaskSet( GateTask, NULL, 1, NULL, 0, "Gate", &hSets[0] );
+        for( unsigned int j = 1; j <= gs_nChainLength; ++j )
+        {
+            gTaskMgr.CreateTaskSet( EmptyTask, NULL, 1, &hSets[j - 1], 1, "Chain", &hSets[j] );
+        }
+
+        BenchTimer Timer;
+        gs_bGateOpen.store( true, std::memory_order_release );
+        gTaskMgr.WaitForSet( hSets[ gs_nChainLength ] );
+        if( i >= Options.nWarmup )
+        {
+            Stats.Add( Timer.ElapsedMs() * 1e6 / gs_nChainLength );
+        }
+
+        WaitAndRelease( hSets, 1 + gs_nChainLength );
+    }
+
+    AddResult( nThreads, "chain link", Stats );
+}
+
+static void BenchSuccessors( const BenchOptions& Options,
+                             unsigned int nThreads,
+                             bool bShared )
+{
+    TASKSETHANDLE hParents[ gs_nSuccessorTasks ];
+    TASKSETHANDLE hChildren[ gs_nSuccessorTasks * gs_nSuccessorCreates ];
+    double fNsPerCreate[ gs_nSuccessorTasks ];
+    BenchStats Stats;
+
+    unsigned int nParents = bShared ? 1 : gs_nSuccessorTasks;
+    CreateCompletedSets( hParents, nParents );
+
+    SuccessorArgs Args;
+    Args.phParents = hParents;
+    Args.nParentStride = bShared ? 0 : 1;
+    Args.phChildren = hChildren;
+    Args.pfNsPerCreate = fNsPerCreate;
+
+    for( unsigned int i = 0; i < Options.nWarmup + Options.nFrames; ++i )
+    {
+        TASKSETHANDLE hSet;
+
+        gTaskMgr.CreateTaskSet( SuccessorTask, &Args, gs_nSuccessorTasks, NULL, 0, "Successors", &hSet );
+        gTaskMgr.WaitForSet( hSet );
+        gTaskMgr.ReleaseHandle( hSet );
+
+        WaitAndRelease( hChildren, gs_nSuccessorTasks * gs_nSuccessorCreates );
+
+        if( i >= Options.nWarmup )
+        {
+            for( unsigned int j = 0; j < gs_nSuccessorTasks; ++j )
+            {
+                Stats.Add( fNsPerCreate[j] );
+            }
+        }
+    }
+
+    gTaskMgr.ReleaseHandles( hParents, nParents );
+
+    AddResult( nThreads, bShared ? "successor shared" : "successor own", Stats );
+}
+
+static void BenchLatency( const BenchOptions& Options,
+                          unsigned int nThreads,
+                          const char* szCase,
+                          bool bLoaded,
+                          TASKSETPRIORITY eBackground,
+                          TASKSETPRIORITY eForeground )
+{
+    BenchStats Stats;
+
+    for( unsigned int i = 0; i < Options.nWarmup + Options.nFrames; ++i )
+    {
+        TASKSETHANDLE hBackground = TASKSETHANDLE_INVALID;
+        TASKSETHANDLE hForeground;
+
+        // Give the workers time to take up the background work
+        if( bLoaded )
+        {
+            gTaskMgr.CreateTaskSet( SpinTask, ( void* )&gs_fBackgroundTaskMs, nThreads * gs_nBackgroundTasks,
+                                    NULL, 0, "Background", &hBackground, TASKSETHANDLE_INVALID, eBackground );
+            SpinTask( ( void* )&gs_fBackgroundSettleMs, 0, 0, 1 );
+        }
+
+        BenchTimer Timer;
+        gTaskMgr.CreateTaskSet( SpinTask, ( void* )&gs_fForegroundTaskMs, nThreads, NULL, 0, "Foreground",
+                                &hForeground, TASKSETHANDLE_INVALID, eForeground );
+
+        // WaitForSet would run the set's tasks on this thread, ahead of
+        //   anything the workers have queued, whatever its priority.  Poll
+        //   instead so the time is how soon the workers get to it.
+        while( !gTaskMgr.IsSetComplete( hForeground ) )
+        {
+            std::this_thread::yield();
+        }
+        gTaskMgr.WaitForSet( hForeground );
+        if( i >= Options.nWarmup )
+        {
+            Stats.Add( Timer.ElapsedMs() * 1e6 );
+        }
+        gTaskMgr.ReleaseHandle( hForeground );
+
+        // The rest of the background is not measured
+        if( bLoaded )
+        {
+            gTaskMgr.CancelSet( hBackground );
+            gTaskMgr.WaitForSet( hBackground );
+            gTaskMgr.ReleaseHandle( hBackground );
+        }
+    }
+
+    AddResult( nThreads, szCase, Stats );
+}
+
+static bool WriteJson( const char* szFileName )
+{
+    FILE* pFile = fopen( szFileName, "w" );
+    if( NULL == pFile )
+    {
+        return false;
+    }
+
+    fprintf( pFile, "{\n  \"suite\": \"taskmgr\",\n  \"backend\": \"%s\",\n", GetTaskMgrBackendName() );
+    fprintf( pFile, "  \"max_tasksets\": %u,\n  \"max_successors\": %u,\n  \"unit\": \"ns\",\n  \"results\": [\n",
+             MAX_TASKSETS, MAX_SUCCESSORS );
+
+    for( size_t i = 0; i < gs_Results.size(); ++i )
+    {
+        const TaskMgrResult& Result = gs_Results[i];
+        fprintf( pFile, "    { \"threads\": %u, \"case\": \"%s\", \"mean\": %.2f, \"min\": %.2f, \"p50\": %.2f, \"p99\": %.2f }%s\n",
+                 Result.nThreads, Result.Case.c_str(), Result.fMean, Result.fMin, Result.fP50, Result.fP99,
+                 i + 1 < gs_Results.size() ? "," : "" );
+    }
+
+    fputs( "  ]\n}\n", pFile );
+    fclose( pFile );
+    return true;
+}
+
+void RunTaskMgrBench( const BenchOptions& Options )
+{
+    unsigned int nMaxThreads = Options.nThreads ? Options.nThreads : std::thread::hardware_concurrency();
+    if( 0 == nMaxThreads )
+    {
+        nMaxThreads = 1;
+    }
+
+    // Held slots for the ring cases.  The fullest leaves room for one batch
+    //   of sets and their fake parents, with some slack for slots that are
+    //   released just after WaitForSet returns.
+    const unsigned int nRingHeld[] = { 0, MAX_TASKSETS / 2, MAX_TASKSETS - 4 * gs_nRingBatch };
+
+    gs_Results.clear();
+
+    // Every thread count runs on a fresh TaskMgr
+    gTaskMgr.Shutdown();
+
+    for( unsigned int nThreads = 1; ; nThreads *= 2 )
+    {
+        if( nThreads > nMaxThreads )
+        {
+            nThreads = nMaxThreads;
+        }
+
+        gTaskMgr.miDemoModeTBBThreadCountOverride = ( INT )nThreads;
+        gTaskMgr.Init();
+
+        BenchCreate( Options, nThreads, 0 );
+        BenchCreate( Options, nThreads, 1 );
+        BenchCreate( Options, nThreads, 5 );
+        for( unsigned int r = 0; r < sizeof( nRingHeld ) / sizeof( nRingHeld[0] ); ++r )
+        {
+            BenchRing( Options, nThreads, nRingHeld[r] );
+        }
+        BenchEmptyTasks( Options, nThreads );
+        BenchChain( Options, nThreads );
+        BenchSuccessors( Options, nThreads, true );
+        BenchSuccessors( Options, nThreads, false );
+
+        // The latency cases need a worker besides the main thread
+        if( nThreads > 1 )
+        {
+            BenchLatency( Options, nThreads, "latency idle", false, TASKSETPRIORITY_NORMAL, TASKSETPRIORITY_NORMAL );
+            BenchLatency( Options, nThreads, "latency normal", true, TASKSETPRIORITY_NORMAL, TASKSETPRIORITY_NORMAL );
+            BenchLatency( Options, nThreads, "latency high", true, TASKSETPRIORITY_LOW, TASKSETPRIORITY_HIGH );
+        }
+
+        gTaskMgr.Shutdown();
+
+        if( nThreads == nMaxThreads )
+        {
+            break;
+        }
+    }
+
+    // Back to the thread count the other suites run with
+    if( Options.nThreads )
+    {
+        gTaskMgr.miDemoModeTBBThreadCountOverride = ( INT )Options.nThreads;
+    }
+    gTaskMgr.Init();
+
+    if( Options.szJsonFile )
+    {
+        if( WriteJson( Options.szJsonFile ) )
+        {
+            printf( "%-12s results written to %s\n", "taskmgr", Options.szJsonFile );
+        }
+        else
+        {
+            printf( "%-12s could not create %s\n", "taskmgr", Options.szJsonFile );
+        }
+    }
+}
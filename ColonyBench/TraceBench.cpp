@@ -0,0 +1,134 @@
+// Copyright 2010 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+//--------------------------------------------------------------------------------------
+// Trace suite.  Measures what a TraceScope costs on the thread that opens it,
+// with no trace running and while recording.  A recorded scope reads the
+// timestamp twice, so the cost of one read is shown too; it dominates where
+// the timestamp counter is slow to read, as under some hypervisors.  Record
+// is also timed on its own, given timestamps, which is the cost the recorder
+// adds on top of the two reads.  Scopes are opened in batches that
+// fit a thread's ring, and the flush thread is given time to drain between
+// batches, so no event is dropped and only the recording path is timed.
+//--------------------------------------------------------------------------------------
+
+#include "ColonyBench.h"
+#include "TraceRecorder.h"
+#include <thread>
+
+static const unsigned int   gs_nScopesPerBatch = TraceRecorder::RingSize / 4;
+static const char*          gs_szTraceBenchFile = "ColonyBench_tracebench.json";
+
+// Keeps the timestamp reads from being optimised away
+static volatile unsigned long long gs_nTimestampSink;
+
+static void RunScopes( void )
+{
+    for( unsigned int i = 0; i < gs_nScopesPerBatch; ++i )
+    {
+        TraceScope Trace( "TraceBenchScope" );
+    }
+}
+
+// Records with timestamps already taken, so only the ring write is timed
+static void RunRecords( void )
+{
+    for( unsigned int i = 0; i < gs_nScopesPerBatch; ++i )
+    {
+        gTraceRecorder.Record( "TraceBenchRecord", -1, i + 1, i + 2 );
+    }
+}
+
+static void TimeBatches( const BenchOptions& Options,
+                         BenchStats& Stats,
+                         void ( *pRun )( void ) = RunScopes )
+{
+    for( unsigned int i = 0; i < Options.nWarmup + Options.nFrames; ++i )
+    {
+        BenchTimer Timer;
+        pRun();
+        if( i >= Options.nWarmup )
+        {
+            // Stored as ns per scope
+            Stats.Add( Timer.ElapsedMs() * 1e6 / gs_nScopesPerBatch );
+        }
+
+        if( gTraceRecorder.IsRecording() )
+        {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+        }
+    }
+}
+
+static void TimeTimestamps( const BenchOptions& Options,
+                            BenchStats& Stats )
+{
+    for( unsigned int i = 0; i < Options.nWarmup + Options.nFrames; ++i )
+    {
+        BenchTimer Timer;
+        for( unsigned int j = 0; j < gs_nScopesPerBatch; ++j )
+        {
+            gs_nTimestampSink = TraceRecorder::GetTimestamp();
+        }
+        if( i >= Options.nWarmup )
+        {
+            Stats.Add( Timer.ElapsedMs() * 1e6 / gs_nScopesPerBatch );
+        }
+    }
+}
+
+void RunTraceBench( const BenchOptions& Options )
+{
+    BenchStats Timestamp;
+    TimeTimestamps( Options, Timestamp );
+    printf( "%-12s %-32s mean %6.1f ns  min %6.1f ns  p99 %6.1f ns\n", "trace", "timestamp read",
+            Timestamp.GetMean(), Timestamp.GetMin(), Timestamp.GetPercentile( 0.99 ) );
+
+    // With -trace the whole run is already being recorded
+    bool bOwnTrace = !gTraceRecorder.IsRecording();
+
+    BenchStats Idle;
+    if( bOwnTrace )
+    {
+        TimeBatches( Options, Idle );
+        if( !gTraceRecorder.Start( gs_szTraceBenchFile ) )
+        {
+            printf( "%-12s could not create %s, skipped\n", "trace", gs_szTraceBenchFile );
+            return;
+        }
+    }
+
+    unsigned int nDroppedBefore = gTraceRecorder.GetDroppedEvents();
+
+    BenchStats Recording;
+    TimeBatches( Options, Recording );
+
+    BenchStats Record;
+    TimeBatches( Options, Record, RunRecords );
+
+    unsigned int nDropped = gTraceRecorder.GetDroppedEvents() - nDroppedBefore;
+
+    if( bOwnTrace )
+    {
+        gTraceRecorder.Stop();
+        remove( gs_szTraceBenchFile );
+
+        printf( "%-12s %-32s mean %6.1f ns  min %6.1f ns  p99 %6.1f ns\n", "trace", "scope, not recording",
+                Idle.GetMean(), Idle.GetMin(), Idle.GetPercentile( 0.99 ) );
+    }
+
+    printf( "%-12s %-32s mean %6.1f ns  min %6.1f ns  p99 %6.1f ns, %u dropped\n", "trace", "scope, recording",
+            Recording.GetMean(), Recording.GetMin(), Recording.GetPercentile( 0.99 ), nDropped );
+    printf( "%-12s %-32s mean %6.1f ns  min %6.1f ns  p99 %6.1f ns\n", "trace", "record, no timestamps",
+            Record.GetMean(), Record.GetMin(), Record.GetPercentile( 0.99 ) );
+}
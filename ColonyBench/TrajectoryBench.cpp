@@ -0,0 +1,265 @@
+// Copyright 2010 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+//--------------------------------------------------------------------------------------
+// Trajectory suite.  Records units that wander the world like Colony's, at
+// Colony's unit count and at eight times that, and reads the file back.
+// Recording times the main thread's copy into the frame, and the whole run
+// to Stop; BeginFrame waits for the encoder, so the second is the encoder's
+// cost per frame.  Reading times TrajectoryReader decoding each frame, and
+// checks every field against the frames recorded, from the start and after a
+// Seek into the middle of the file.
+//--------------------------------------------------------------------------------------
+
+#include "ColonyBench.h"
+#include "TrajectoryRecorder.h"
+#include <math.h>
+#include <string.h>
+
+// Sizes from Colony.h
+static const unsigned int   gs_nTrajectoryUnits = 1024 * 8;
+static const float          gs_fTrajectoryTileSize = 1.0f / 16.0f;
+static const float          gs_fTrajectoryWorldSize = 512 * gs_fTrajectoryTileSize;
+static const float          gs_fTrajectoryBenchStep = gs_fTrajectoryTileSize / 64.0f;
+static const float          gs_fTrajectorySpeed = ( gs_fTrajectoryTileSize / 2.0f ) * 25.0f;
+static const float          gs_fTrajectoryElapsed = 1.0f / 30.0f;
+
+static const char*          gs_szTrajectoryBenchFile = "ColonyBench_trajectory.bin";
+
+// Units that walk straight ahead, turn now and then, and change state
+// when they do.  Seeded the same way, it replays the same frames, so the
+// reader can be checked without keeping every frame in memory.
+class TrajectoryWorld
+{
+public:
+    TrajectoryWorld( unsigned int nUnits )
+        : m_PositionX( nUnits )
+        , m_PositionY( nUnits )
+        , m_DirectionX( nUnits )
+        , m_DirectionY( nUnits )
+        , m_State( nUnits )
+        , m_nSeed( 1 )
+    {
+        for( unsigned int i = 0; i < nUnits; ++i )
+        {
+            m_PositionX[i] = Random() * gs_fTrajectoryWorldSize;
+            m_PositionY[i] = Random() * gs_fTrajectoryWorldSize;
+            Turn( i );
+            m_State[i] = 0;
+        }
+    }
+
+    void Step( void )
+    {
+        for( unsigned int i = 0; i < m_State.size(); ++i )
+        {
+            m_PositionX[i] += m_DirectionX[i] * gs_fTrajectorySpeed * gs_fTrajectoryElapsed;
+            m_PositionY[i] += m_DirectionY[i] * gs_fTrajectorySpeed * gs_fTrajectoryElapsed;
+
+            bool bOutside = m_PositionX[i] < 0.0f || m_PositionX[i] > gs_fTrajectoryWorldSize ||
+                            m_PositionY[i] < 0.0f || m_PositionY[i] > gs_fTrajectoryWorldSize;
+            if( bOutside || Random() < 0.02f )
+            {
+                if( bOutside )
+                {
+                    m_PositionX[i] = gs_fTrajectoryWorldSize * 0.5f;
+                    m_PositionY[i] = gs_fTrajectoryWorldSize * 0.5f;
+                }
+                Turn( i );
+                m_State[i] = ( unsigned char )( ( m_State[i] + 1 ) & 3 );
+            }
+        }
+    }
+
+    void Copy( TrajectoryRecorder::Frame& Data ) const
+    {
+        size_t nBytes = m_State.size() * sizeof( float );
+        memcpy( Data.pPositionX, &m_PositionX[0], nBytes );
+        memcpy( Data.pPositionY, &m_PositionY[0], nBytes );
+        memcpy( Data.pDirectionX, &m_DirectionX[0], nBytes );
+        memcpy( Data.pDirectionY, &m_DirectionY[0], nBytes );
+        memcpy( Data.pState, &m_State[0], m_State.size() );
+    }
+
+    // True if every field of Data is within the recorder's precision
+    bool Matches( const TrajectoryRecorder::Frame& Data ) const
+    {
+        const float fPositionError = gs_fTrajectoryBenchStep * 0.51f;
+        const float fDirectionError = 1.0f / 16384.0f;
+        if( Data.nUnits != m_State.size() )
+        {
+            return false;
+        }
+        for( unsigned int i = 0; i < Data.nUnits; ++i )
+        {
+            if( fabsf( Data.pPositionX[i] - m_PositionX[i] ) > fPositionError ||
+                fabsf( Data.pPositionY[i] - m_PositionY[i] ) > fPositionError ||
+                fabsf( Data.pDirectionX[i] - m_DirectionX[i] ) > fDirectionError ||
+                fabsf( Data.pDirectionY[i] - m_DirectionY[i] ) > fDirectionError ||
+                Data.pState[i] != m_State[i] )
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    float Random( void )
+    {
+        m_nSeed = m_nSeed * 1664525u + 1013904223u;
+        return ( m_nSeed >> 8 ) * ( 1.0f / 16777216.0f );
+    }
+
+    void Turn( unsigned int i )
+    {
+        float fAngle = Random() * 6.2831853f;
+        m_DirectionX[i] = cosf( fAngle );
+        m_DirectionY[i] = sinf( fAngle );
+    }
+
+    std::vector<float> m_PositionX;
+    std::vector<float> m_PositionY;
+    std::vector<float> m_DirectionX;
+    std::vector<float> m_DirectionY;
+    std::vector<unsigned char> m_State;
+    unsigned int m_nSeed;
+};
+
+// Records nFrames frames of nUnits units, timing those after nWarmup.
+// False if the file could not be written.
+static bool Record( unsigned int nUnits,
+                    unsigned int nFrames,
+                    unsigned int nWarmup,
+                    BenchStats& Capture,
+                    double& fTotalMs,
+                    unsigned long long& nBytes )
+{
+    TrajectoryRecorder Recorder;
+    if( !Recorder.Start( gs_szTrajectoryBenchFile, nUnits, gs_fTrajectoryBenchStep ) )
+    {
+        return false;
+    }
+
+    TrajectoryWorld World( nUnits );
+    double fStepMs = 0.0;
+    BenchTimer Total;
+    for( unsigned int i = 0; i < nFrames; ++i )
+    {
+        BenchTimer Step;
+        World.Step();
+        fStepMs += Step.ElapsedMs();
+
+        // Timed from when the buffer is free, the copy the main thread
+        // pays while the encoder keeps up
+        TrajectoryRecorder::Frame* pFrame = Recorder.BeginFrame( nUnits, true );
+        BenchTimer Timer;
+        World.Copy( *pFrame );
+        Recorder.EndFrame();
+        if( i >= nWarmup )
+        {
+            Capture.Add( Timer.ElapsedMs() );
+        }
+    }
+    bool bWritten = Recorder.Stop();
+
+    // Less the time spent moving the units
+    fTotalMs = Total.ElapsedMs() - fStepMs;
+    nBytes = Recorder.GetBytesWritten();
+    return bWritten && 0 == Recorder.GetDroppedFrames();
+}
+
+// Reads the file back from nFirstFrame, checking each frame and timing
+// those after nWarmup.  False on the first frame that is missing, out of
+// order or does not match.
+static bool Replay( unsigned int nUnits,
+                    unsigned int nFrames,
+                    unsigned int nFirstFrame,
+                    unsigned int nWarmup,
+                    BenchStats* pDecode )
+{
+    TrajectoryReader Reader;
+    if( !Reader.Open( gs_szTrajectoryBenchFile ) ||
+        Reader.GetMaxUnits() != nUnits ||
+        Reader.GetFrameCount() != nFrames ||
+        !Reader.Seek( nFirstFrame ) )
+    {
+        return false;
+    }
+
+    TrajectoryWorld World( nUnits );
+    for( unsigned int i = 0; i < nFirstFrame; ++i )
+    {
+        World.Step();
+    }
+
+    for( unsigned int i = nFirstFrame; i < nFrames; ++i )
+    {
+        World.Step();
+
+        TrajectoryRecorder::Frame Data;
+        unsigned int nFrame;
+        BenchTimer Timer;
+        bool bRead = Reader.ReadFrame( Data, nFrame );
+        if( NULL != pDecode && i >= nWarmup )
+        {
+            pDecode->Add( Timer.ElapsedMs() );
+        }
+        if( !bRead || nFrame != i || !World.Matches( Data ) )
+        {
+            return false;
+        }
+    }
+
+    TrajectoryRecorder::Frame Data;
+    unsigned int nFrame;
+    return !Reader.ReadFrame( Data, nFrame );
+}
+
+static void RunCase( const BenchOptions& Options,
+                     unsigned int nUnits )
+{
+    char szCase[ 64 ];
+    unsigned int nFrames = Options.nWarmup + Options.nFrames;
+
+    BenchStats Capture;
+    double fTotalMs;
+    unsigned long long nBytes;
+    if( !Record( nUnits, nFrames, Options.nWarmup, Capture, fTotalMs, nBytes ) )
+    {
+        printf( "%-12s could not record %s, skipped\n", "trajectory", gs_szTrajectoryBenchFile );
+        remove( gs_szTrajectoryBenchFile );
+        return;
+    }
+
+    sprintf( szCase, "capture, %u units", nUnits );
+    Capture.Print( "trajectory", szCase );
+    printf( "%-12s %-32s %.3f ms per frame, %.2f bytes per unit\n", "trajectory", "encode",
+            fTotalMs / nFrames, ( double )nBytes / ( ( double )nFrames * nUnits ) );
+
+    BenchStats Decode;
+    bool bMatched = Replay( nUnits, nFrames, 0, Options.nWarmup, &Decode );
+    bool bSeeked = bMatched && Replay( nUnits, nFrames, nFrames / 2 + 1, 0, NULL );
+    remove( gs_szTrajectoryBenchFile );
+
+    sprintf( szCase, "decode, %u units", nUnits );
+    Decode.Print( "trajectory", szCase );
+    printf( "%-12s %-32s %s\n", "trajectory", "round trip",
+            !bMatched ? "FAILED" : ( bSeeked ? "ok" : "FAILED after Seek" ) );
+}
+
+void RunTrajectoryBench( const BenchOptions& Options )
+{
+    RunCase( Options, gs_nTrajectoryUnits );
+    RunCase( Options, gs_nTrajectoryUnits * 8 );
+}
@@ -0,0 +1,707 @@
+// Copyright 2010 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+//--------------------------------------------------------------------------------------
+// ColonyHeadless runs the Colony simulation without a window or a device, for
+// numbers that can be compared from run to run.  Colony itself adds and
+// removes units to hold its frame rate; here the unit count is pinned and
+// every frame advances the same fixed time step.
+//
+// Each configuration restarts the game from the same scenario and runs
+// Update for the scenario's frames.  A scenario fixes the seed, factory
+// positions, unit count schedule, where the units start and how much of the
+// world is paved; see Scenario.h.  Without -scenario the world is random
+// from -seed with the units spread over it.  The simulation runs once single threaded
+// with g_bThreaded off, then threaded at each thread count, each with SIMD
+// and scalar unit updates.  Speedup and scaling efficiency are relative to
+// the single threaded run of the same update.
+//
+// Usage:
+// ColonyHeadless [-scenario file] [-units N] [-frames N] [-warmup N] [-dt ms]
+//                [-seed N] [-threads 1,2,4,...] [-modes simd,scalar]
+//                [-snapshot file] [-savesnapshot file] [-trajectory file]
+//                [-stats name] [-render] [-pinworkers] [-out file.json]
+//
+// Options apply in order, so -units, -frames and -seed after -scenario
+// override the scenario's settings.  The stress cases are in Scenarios:
+//   uniform    units spread evenly over a random world
+//   converge   every factory on one tile; the bins around it overflow
+//   coverage   85% of the world paved, units search for the rest
+//   maxunits   gs_nMaxUnits units in a cluster
+//   ramp       the unit count stepping up to gs_nMaxUnits
+//
+// -snapshot starts every configuration from a snapshot saved by Colony (key
+// N) or by -savesnapshot, in place of the scenario's world and units; the
+// unit count is the snapshot's and the scenario's schedule is not applied.
+// -savesnapshot saves the game as the first configuration leaves it, so a
+// long run can be restored and measured from where it got to.
+//
+// -trajectory records the units of the first configuration's measured
+// frames with TrajectoryRecorder, and reports the main thread time the
+// capture took per frame.
+//
+// -render draws every frame with the null render device after its update:
+// the culling, instance packing and instance buffer writes all run, into
+// host memory, and nothing reaches a GPU.  Trees are drawn, as Colony draws
+// them by default.  Each run reports the render phase time and the draws,
+// in all and per mesh, state changes, bytes and cull tasks it submitted a
+// frame; threaded, a full unit draw splits its cull across tasks.  Render
+// time is not part of the frame time.
+//
+// -stats publishes every frame of every configuration to the shared memory
+// segment name, as Colony -stats does, so ColonyStats -name name can watch
+// a long run.  There are no CPU counters in it.
+//
+// The results are written as JSON to the -out file, or to stdout.  Times are
+// in milliseconds; phase times add up the busy time of all of a phase's
+// tasks, so they can exceed the frame time when threaded.
+//
+// Build ColonyHeadless.vcxproj from Colony_2010.sln.
+//--------------------------------------------------------------------------------------
+
+#include "Colony.h"
+#include "Game.h"
+#include "Render.h"
+#include "FrameArena.h"
+#include "FrameStats.h"
+#include "Scenario.h"
+#include "TrajectoryRecorder.h"
+#include "StatsSegment.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+//--------------------------------------------------------------------------------------
+// The switches Colony.cpp owns and the simulation reads
+//--------------------------------------------------------------------------------------
+bool                        g_bUseSIMD = true;
+bool                        g_bThreaded = true;
+bool                        g_bComputeAcrossFrames = false;
+bool                        g_bRenderTrees = false;
+
+Game                        g_Game;
+
+static StatsPublisher       gs_StatsPublisher;
+
+// -render's per mesh draw counts, by MeshType
+static const char* const    gs_szMeshNames[ MESH_COUNT ] =
+{
+    "unit",
+    "factory",
+    "tree",
+    "concrete",
+    "grass",
+    "sky",
+};
+static StatsBlock           gs_Stats;
+
+struct HeadlessOptions
+{
+    Scenario TheScenario;
+    unsigned int nWarmup;
+    float fTimeStep;
+    std::vector<unsigned int> ThreadCounts;
+    bool bSIMD;
+    bool bScalar;
+    const char* szSnapshotFile;
+    const char* szSaveSnapshotFile;
+    const char* szTrajectoryFile;
+    const char* szStatsName;
+    bool bRender;
+};
+
+struct HeadlessResult
+{
+    const char* szMode;
+    bool bThreaded;
+    unsigned int nThreads;
+
+    double fFrameMean;
+    FrameStats::Summary Frame;
+    double fPhaseMean[ FrameSeriesCount ];
+    FrameStats::Summary Phases[ FrameSeriesCount ];
+
+    unsigned int nResets;
+    unsigned int nBinOverflows;
+
+    // Submitted a frame, with -render
+    double fDraws;
+    double fMeshDraws[ MESH_COUNT ];
+    double fInstances;
+    double fStateChanges;
+    double fShaderChanges;
+    double fUploadKB;
+    double fCullTasks;
+
+    double fUnitsPerSecond;
+    double fSpeedup;
+    double fEfficiency;
+};
+
+static unsigned int GetHardwareThreadCount( void )
+{
+    SYSTEM_INFO Info;
+    GetSystemInfo( &Info );
+    return Info.dwNumberOfProcessors;
+}
+
+static void ParseThreadCounts( const char* szList,
+                               std::vector<unsigned int>& ThreadCounts )
+{
+    ThreadCounts.clear();
+    for( const char* p = szList; *p; )
+    {
+        unsigned int nThreads = ( unsigned int )atoi( p );
+        if( nThreads > 0 )
+        {
+            ThreadCounts.push_back( nThreads );
+        }
+
+        p = strchr( p, ',' );
+        if( NULL == p )
+        {
+            break;
+        }
+        ++p;
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Copy the frame just ended to the stats segment
+//--------------------------------------------------------------------------------------
+static void PublishStats( float fFrameMs )
+{
+    gs_Stats.nFlags = ( g_bUseSIMD ? StatsBlock::FlagSIMD : 0 ) | ( g_bThreaded ? StatsBlock::FlagThreaded : 0 );
+    ++gs_Stats.nFrame;
+    gs_Stats.nTimeUs = FrameStats::GetTimeUs();
+    gs_Stats.nUnits = g_Game.GetUnitManager()->GetNumUnits();
+    gs_Stats.nResets = g_Game.GetResetCount();
+    gs_Stats.fCoverage = g_Game.GetCoverage();
+    gs_Stats.fFrameMs = fFrameMs;
+
+    for( unsigned int nSeries = 0; nSeries < gs_Stats.nSeries; ++nSeries )
+    {
+        FrameStats::Summary Summary = gFrameStats.GetSummary( nSeries );
+        gs_Stats.fSeriesMs[ nSeries ] = gFrameStats.GetLastTime( nSeries ) / 1000.0f;
+        gs_Stats.fSeriesP50Ms[ nSeries ] = Summary.nP50 / 1000.0f;
+        gs_Stats.fSeriesP99Ms[ nSeries ] = Summary.nP99 / 1000.0f;
+        gs_Stats.fSeriesMaxMs[ nSeries ] = Summary.nMax / 1000.0f;
+    }
+
+    gs_StatsPublisher.Publish( gs_Stats );
+}
+
+//--------------------------------------------------------------------------------------
+// Run one configuration from a fresh game
+//--------------------------------------------------------------------------------------
+static HeadlessResult RunConfiguration( const HeadlessOptions& Options,
+                                        const char* szMode,
+                                        bool bSIMD,
+                                        bool bThreaded,
+                                        unsigned int nThreads,
+                                        bool bFirst )
+{
+    g_bUseSIMD = bSIMD;
+    g_bThreaded = bThreaded;
+
+    gTaskMgr.miDemoModeTBBThreadCountOverride = ( INT )nThreads;
+    gTaskMgr.Init();
+    gFrameStats.Init( g_szFrameSeriesNames, FrameSeriesCount, Options.TheScenario.nFrames );
+
+    // The same world and units for every configuration
+    Options.TheScenario.Apply( g_Game );
+    UnitManager* pUnitManager = g_Game.GetUnitManager();
+
+    // main has already checked the snapshot loads
+    bool bSchedule = ( NULL == Options.szSnapshotFile );
+    if( !bSchedule )
+    {
+        unsigned long long nBegin = FrameStats::GetTimeUs();
+        g_Game.LoadSnapshot( Options.szSnapshotFile );
+        unsigned long long nEnd = FrameStats::GetTimeUs();
+        srand( Options.TheScenario.nSeed );
+
+        fprintf( stderr, "Restored %s in %.3f ms\n", Options.szSnapshotFile, ( nEnd - nBegin ) / 1000.0 );
+    }
+
+    HeadlessResult Result;
+    memset( &Result, 0, sizeof( Result ) );
+    Result.szMode = szMode;
+    Result.bThreaded = bThreaded;
+    Result.nThreads = nThreads;
+
+    unsigned int nResetsAtStart = g_Game.GetResetCount();
+    unsigned int nOverflowsAtStart = pUnitManager->GetBinOverflows();
+    unsigned long long nSimulationUs = 0;
+    unsigned long long nUnitFrames = 0;
+    double fPhaseTotal[ FrameSeriesCount ] = { 0.0 };
+    RenderDevice::Stats RenderTotal;
+    memset( &RenderTotal, 0, sizeof( RenderTotal ) );
+    unsigned int nCullTasks = 0;
+
+    // The first configuration's measured frames are recorded, outside the
+    //   frame times
+    bool bRecord = bFirst && NULL != Options.szTrajectoryFile;
+    if( bRecord && !gTrajectoryRecorder.Start( Options.szTrajectoryFile, gs_nMaxUnits, gs_fTrajectoryStep ) )
+    {
+        fprintf( stderr, "Could not create %s\n", Options.szTrajectoryFile );
+        bRecord = false;
+    }
+
+    float fTime = 0.0f;
+    for( unsigned int nFrame = 0; nFrame < Options.nWarmup + Options.TheScenario.nFrames; ++nFrame )
+    {
+        if( bSchedule )
+        {
+            pUnitManager->SetUnitCount( Options.TheScenario.GetUnitCount( nFrame ) / gs_nSIMDWidth );
+        }
+
+        unsigned long long nBegin = FrameStats::GetTimeUs();
+        {
+            FrameStatsScope Stats( FrameSeriesUpdate );
+            g_Game.Update( fTime, Options.fTimeStep );
+        }
+        {
+            FrameStatsScope Stats( FrameSeriesWait );
+            g_Game.GetUnitManager()->StopWork();
+        }
+        unsigned long long nEnd = FrameStats::GetTimeUs();
+
+        if( Options.bRender )
+        {
+            // Draw the frame the units just finished, as Colony would
+            FrameStatsScope Stats( FrameSeriesRender );
+            Render::ResetStats();
+            g_Game.Render();
+        }
+
+        gFrameArena.Reset();
+        gFrameStats.AddTime( FrameSeriesFrame, ( unsigned int )( nEnd - nBegin ) );
+        gFrameStats.EndFrame();
+        fTime += Options.fTimeStep;
+
+        if( gs_StatsPublisher.IsCreated() )
+        {
+            PublishStats( ( nEnd - nBegin ) / 1000.0f );
+        }
+
+        // Warmup frames leave the window as the measured ones fill it
+        if( nFrame >= Options.nWarmup )
+        {
+            nSimulationUs += nEnd - nBegin;
+            nUnitFrames += pUnitManager->GetNumUnits();
+            for( unsigned int nSeries = 0; nSeries < FrameSeriesCount; ++nSeries )
+            {
+                fPhaseTotal[ nSeries ] += gFrameStats.GetLastTime( nSeries );
+            }
+
+            if( Options.bRender )
+            {
+                const RenderDevice::Stats& RenderStats = Render::GetStats();
+                RenderTotal.nDraws += RenderStats.nDraws;
+                for( unsigned int nMesh = 0; nMesh < MESH_COUNT; ++nMesh )
+                {
+                    RenderTotal.pMeshDraws[ nMesh ] += RenderStats.pMeshDraws[ nMesh ];
+                }
+                RenderTotal.nInstances += RenderStats.nInstances;
+                RenderTotal.nStateChanges += RenderStats.nStateChanges;
+                RenderTotal.nShaderChanges += RenderStats.nShaderChanges;
+                RenderTotal.nBytesUploaded += RenderStats.nBytesUploaded;
+                nCullTasks += Render::GetCullTasks();
+            }
+        }
+        else if( nFrame + 1 == Options.nWarmup )
+        {
+            nResetsAtStart = g_Game.GetResetCount();
+            nOverflowsAtStart = pUnitManager->GetBinOverflows();
+        }
+
+        if( bRecord && nFrame >= Options.nWarmup )
+        {
+            // Every frame is recorded; the wait is outside the frame times
+            pUnitManager->RecordTrajectory( gTrajectoryRecorder, true );
+        }
+    }
+
+    for( unsigned int nSeries = 0; nSeries < FrameSeriesCount; ++nSeries )
+    {
+        Result.fPhaseMean[ nSeries ] = fPhaseTotal[ nSeries ] / Options.TheScenario.nFrames / 1000.0;
+        Result.Phases[ nSeries ] = gFrameStats.GetSummary( nSeries );
+    }
+    Result.fFrameMean = Result.fPhaseMean[ FrameSeriesFrame ];
+    Result.Frame = Result.Phases[ FrameSeriesFrame ];
+
+    Result.fDraws = ( double )RenderTotal.nDraws / Options.TheScenario.nFrames;
+    for( unsigned int nMesh = 0; nMesh < MESH_COUNT; ++nMesh )
+    {
+        Result.fMeshDraws[ nMesh ] = ( double )RenderTotal.pMeshDraws[ nMesh ] / Options.TheScenario.nFrames;
+    }
+    Result.fInstances = ( double )RenderTotal.nInstances / Options.TheScenario.nFrames;
+    Result.fStateChanges = ( double )RenderTotal.nStateChanges / Options.TheScenario.nFrames;
+    Result.fShaderChanges = ( double )RenderTotal.nShaderChanges / Options.TheScenario.nFrames;
+    Result.fUploadKB = RenderTotal.nBytesUploaded / 1024.0 / Options.TheScenario.nFrames;
+    Result.fCullTasks = ( double )nCullTasks / Options.TheScenario.nFrames;
+
+    // Games reset on full coverage; runs that hit one say so
+    Result.nResets = g_Game.GetResetCount() - nResetsAtStart;
+    Result.nBinOverflows = pUnitManager->GetBinOverflows() - nOverflowsAtStart;
+    Result.fUnitsPerSecond = nSimulationUs ? ( double )nUnitFrames * 1000000.0 / nSimulationUs : 0.0;
+
+    if( bRecord )
+    {
+        unsigned int nRecorded = gTrajectoryRecorder.GetRecordedFrames();
+        unsigned long long nCaptureUs = gTrajectoryRecorder.GetCaptureTimeUs();
+        unsigned int nDropped = gTrajectoryRecorder.GetDroppedFrames();
+        bool bWritten = gTrajectoryRecorder.Stop();
+
+        fprintf( stderr, "Recorded %u frames to %s, %u dropped, %.3f ms/frame to capture, %.1f bytes/unit-frame%s\n",
+                 nRecorded, Options.szTrajectoryFile, nDropped, nRecorded ? nCaptureUs / 1000.0 / nRecorded : 0.0,
+                 nUnitFrames ? ( double )gTrajectoryRecorder.GetBytesWritten() / nUnitFrames : 0.0,
+                 bWritten ? "" : ", write failed" );
+    }
+
+    if( bFirst && Options.szSaveSnapshotFile && !g_Game.SaveSnapshot( Options.szSaveSnapshotFile ) )
+    {
+        fprintf( stderr, "Could not save %s\n", Options.szSaveSnapshotFile );
+    }
+
+    gFrameStats.Shutdown();
+    gTaskMgr.Shutdown();
+
+    fprintf( stderr, "%-8s %-8s %2u threads  %9.3f ms/frame  %12.0f units/s\n",
+             szMode, bThreaded ? "threaded" : "serial", nThreads, Result.fFrameMean, Result.fUnitsPerSecond );
+
+    return Result;
+}
+
+//--------------------------------------------------------------------------------------
+// JSON output
+//--------------------------------------------------------------------------------------
+static void WriteSummary( FILE* pFile,
+                          double fMean,
+                          const FrameStats::Summary& Summary )
+{
+    fprintf( pFile, "{\"mean\":%.4f,\"p50\":%.4f,\"p90\":%.4f,\"p99\":%.4f,\"max\":%.4f}",
+             fMean, Summary.nP50 / 1000.0, Summary.nP90 / 1000.0, Summary.nP99 / 1000.0, Summary.nMax / 1000.0 );
+}
+
+static void WriteResults( FILE* pFile,
+                          const HeadlessOptions& Options,
+                          const std::vector<HeadlessResult>& Results )
+{
+    const Scenario& TheScenario = Options.TheScenario;
+
+    fprintf( pFile, "{\n" );
+    fprintf( pFile, "  \"scenario\": \"%s\",\n", TheScenario.szName );
+    fprintf( pFile, "  \"units\": %u,\n", TheScenario.nUnits );
+    fprintf( pFile, "  \"frames\": %u,\n", TheScenario.nFrames );
+    fprintf( pFile, "  \"warmup\": %u,\n", Options.nWarmup );
+    fprintf( pFile, "  \"dt_ms\": %.4f,\n", Options.fTimeStep * 1000.0f );
+    fprintf( pFile, "  \"seed\": %u,\n", TheScenario.nSeed );
+    if( Options.szSnapshotFile )
+    {
+        fprintf( pFile, "  \"snapshot\": \"%s\",\n", Options.szSnapshotFile );
+    }
+    fprintf( pFile, "  \"hardware_threads\": %u,\n", GetHardwareThreadCount() );
+    fprintf( pFile, "  \"runs\": [\n" );
+
+    for( size_t i = 0; i < Results.size(); ++i )
+    {
+        const HeadlessResult& Result = Results[i];
+
+        fprintf( pFile, "    {\"mode\":\"%s\",\"threaded\":%s,\"threads\":%u,\"resets\":%u,\"bin_overflows\":%u,",
+                 Result.szMode, Result.bThreaded ? "true" : "false", Result.nThreads, Result.nResets, Result.nBinOverflows );
+        fprintf( pFile, "\"units_per_second\":%.0f,\"speedup\":%.4f,\"efficiency\":%.4f,\n",
+                 Result.fUnitsPerSecond, Result.fSpeedup, Result.fEfficiency );
+
+        fprintf( pFile, "     \"frame_ms\":" );
+        WriteSummary( pFile, Result.fFrameMean, Result.Frame );
+        fprintf( pFile, ",\n     \"phases_ms\":{" );
+
+        // The frame itself is reported above
+        for( unsigned int nSeries = FrameSeriesFrame + 1; nSeries < FrameSeriesCount; ++nSeries )
+        {
+            if( FrameSeriesRender == nSeries && !Options.bRender )
+            {
+                continue;
+            }
+
+            fprintf( pFile, "%s\"%s\":", nSeries == FrameSeriesFrame + 1 ? "" : ",", g_szFrameSeriesNames[ nSeries ] );
+            WriteSummary( pFile, Result.fPhaseMean[ nSeries ], Result.Phases[ nSeries ] );
+        }
+
+        fprintf( pFile, "}" );
+
+        if( Options.bRender )
+        {
+            fprintf( pFile, ",\n     \"render\":{\"draws\":%.1f,\"instances\":%.0f,\"state_changes\":%.1f,"
+                     "\"shader_changes\":%.1f,\"upload_kb\":%.1f,\"cull_tasks\":%.1f,\"mesh_draws\":{",
+                     Result.fDraws, Result.fInstances, Result.fStateChanges, Result.fShaderChanges, Result.fUploadKB,
+                     Result.fCullTasks );
+            for( unsigned int nMesh = 0; nMesh < MESH_COUNT; ++nMesh )
+            {
+                fprintf( pFile, "%s\"%s\":%.1f", nMesh ? "," : "", gs_szMeshNames[ nMesh ], Result.fMeshDraws[ nMesh ] );
+            }
+            fprintf( pFile, "}}" );
+        }
+
+        fprintf( pFile, "}%s\n", i + 1 < Results.size() ? "," : "" );
+    }
+
+    fprintf( pFile, "  ],\n" );
+
+    // Scaling curves, one per update kind, from the threaded runs
+    fprintf( pFile, "  \"scaling\": {" );
+    const char* szModes[] = { "simd", "scalar" };
+    bool bFirstMode = true;
+    for( unsigned int m = 0; m < 2; ++m )
+    {
+        bool bFirstPoint = true;
+        for( size_t i = 0; i < Results.size(); ++i )
+        {
+            const HeadlessResult& Result = Results[i];
+            if( !Result.bThreaded || strcmp( Result.szMode, szModes[m] ) )
+            {
+                continue;
+            }
+
+            if( bFirstPoint )
+            {
+                fprintf( pFile, "%s\n    \"%s\": [", bFirstMode ? "" : ",", szModes[m] );
+                bFirstMode = false;
+            }
+
+            fprintf( pFile, "%s{\"threads\":%u,\"speedup\":%.4f,\"efficiency\":%.4f}",
+                     bFirstPoint ? "" : ",", Result.nThreads, Result.fSpeedup, Result.fEfficiency );
+            bFirstPoint = false;
+        }
+
+        if( !bFirstPoint )
+        {
+            fprintf( pFile, "]" );
+        }
+    }
+    fprintf( pFile, "\n  }\n}\n" );
+}
+
+//--------------------------------------------------------------------------------------
+// Entry point
+//--------------------------------------------------------------------------------------
+int main( int argc,
+          char* argv[] )
+{
+    HeadlessOptions Options;
+    Options.nWarmup = 30;
+    Options.fTimeStep = 1.0f / gs_nTargetFPS;
+    Options.bSIMD = true;
+    Options.bScalar = true;
+    Options.szSnapshotFile = NULL;
+    Options.szSaveSnapshotFile = NULL;
+    Options.szTrajectoryFile = NULL;
+    Options.szStatsName = NULL;
+    Options.bRender = false;
+
+    const char* szOutFile = NULL;
+
+    for( int i = 1; i < argc; ++i )
+    {
+        if( !strcmp( argv[i], "-scenario" ) && i + 1 < argc )
+        {
+            if( !Options.TheScenario.Load( argv[++i] ) )
+            {
+                return 1;
+            }
+        }
+        else if( !strcmp( argv[i], "-units" ) && i + 1 < argc )
+        {
+            // Replaces the scenario's whole schedule
+            Options.TheScenario.nUnits = ( unsigned int )atoi( argv[++i] );
+            Options.TheScenario.Schedule.clear();
+        }
+        else if( !strcmp( argv[i], "-frames" ) && i + 1 < argc )
+        {
+            Options.TheScenario.nFrames = ( unsigned int )atoi( argv[++i] );
+        }
+        else if( !strcmp( argv[i], "-warmup" ) && i + 1 < argc )
+        {
+            Options.nWarmup = ( unsigned int )atoi( argv[++i] );
+        }
+        else if( !strcmp( argv[i], "-dt" ) && i + 1 < argc )
+        {
+            Options.fTimeStep = ( float )atof( argv[++i] ) / 1000.0f;
+        }
+        else if( !strcmp( argv[i], "-seed" ) && i + 1 < argc )
+        {
+            Options.TheScenario.nSeed = ( unsigned int )atoi( argv[++i] );
+        }
+        else if( !strcmp( argv[i], "-threads" ) && i + 1 < argc )
+        {
+            ParseThreadCounts( argv[++i], Options.ThreadCounts );
+        }
+        else if( !strcmp( argv[i], "-modes" ) && i + 1 < argc )
+        {
+            ++i;
+            Options.bSIMD = ( strstr( argv[i], "simd" ) != NULL );
+            Options.bScalar = ( strstr( argv[i], "scalar" ) != NULL );
+        }
+        else if( !strcmp( argv[i], "-snapshot" ) && i + 1 < argc )
+        {
+            Options.szSnapshotFile = argv[++i];
+        }
+        else if( !strcmp( argv[i], "-savesnapshot" ) && i + 1 < argc )
+        {
+            Options.szSaveSnapshotFile = argv[++i];
+        }
+        else if( !strcmp( argv[i], "-trajectory" ) && i + 1 < argc )
+        {
+            Options.szTrajectoryFile = argv[++i];
+        }
+        else if( !strcmp( argv[i], "-stats" ) && i + 1 < argc )
+        {
+            Options.szStatsName = argv[++i];
+        }
+        else if( !strcmp( argv[i], "-render" ) )
+        {
+            Options.bRender = true;
+        }
+        else if( !strcmp( argv[i], "-pinworkers" ) )
+        {
+            gTaskMgr.mbPinWorkerThreads = TRUE;
+        }
+        else if( !strcmp( argv[i], "-out" ) && i + 1 < argc )
+        {
+            szOutFile = argv[++i];
+        }
+        else
+        {
+            fprintf( stderr, "Unknown option: %s\n", argv[i] );
+            return 1;
+        }
+    }
+
+    // Whole SIMD groups, at least one
+    Options.TheScenario.nUnits = min( max( Options.TheScenario.nUnits, gs_nSIMDWidth ), gs_nMaxUnits );
+    Options.TheScenario.nUnits -= Options.TheScenario.nUnits % gs_nSIMDWidth;
+    Options.TheScenario.nFrames = max( Options.TheScenario.nFrames, 1u );
+
+    // Powers of two up to the hardware, and the hardware itself
+    if( Options.ThreadCounts.empty() )
+    {
+        unsigned int nHardware = GetHardwareThreadCount();
+        for( unsigned int nThreads = 1; nThreads < nHardware; nThreads *= 2 )
+        {
+            Options.ThreadCounts.push_back( nThreads );
+        }
+        Options.ThreadCounts.push_back( nHardware );
+    }
+
+    FILE* pOutFile = stdout;
+    if( szOutFile && NULL == ( pOutFile = fopen( szOutFile, "w" ) ) )
+    {
+        fprintf( stderr, "Could not create %s\n", szOutFile );
+        return 1;
+    }
+
+    // The game is initialized once; each configuration resets it
+    gTaskMgr.Init();
+    gFrameArena.Init( gs_nMaxThreadCount, gs_nArenaContextSize );
+    srand( Options.TheScenario.nSeed );
+    g_Game.Initialize();
+    bool bSnapshotOk = ( NULL == Options.szSnapshotFile || g_Game.LoadSnapshot( Options.szSnapshotFile ) );
+    gTaskMgr.Shutdown();
+
+    if( !bSnapshotOk )
+    {
+        fprintf( stderr, "Could not restore %s; not a snapshot from this build\n", Options.szSnapshotFile );
+        return 1;
+    }
+
+    if( Options.bRender )
+    {
+        if( FAILED( Render::Init( NULL_RENDER_BACKEND ) ) )
+        {
+            fprintf( stderr, "Could not create the null render device\n" );
+            return 1;
+        }
+
+        // Everything Colony draws by default, the trees included
+        g_bRenderTrees = true;
+
+        // Colony's starting camera and projection, looking over the middle
+        //   of the world
+        XMMATRIX mView = XMMatrixLookAtLH( XMVectorSet( gs_fWorldSize / 2, 1.0f, gs_fWorldSize / 2 - 3.0f, 1.0f ),
+                                           XMVectorSet( gs_fWorldSize / 2, 0.0f, gs_fWorldSize / 2, 1.0f ),
+                                           XMVectorSet( 0.0f, 1.0f, 0.0f, 0.0f ) );
+        XMMATRIX mProj = XMMatrixPerspectiveFovLH( XM_PIDIV4, 1024.0f / 768.0f, 0.01f, 2000.0f );
+        Render::SetCamera( mView * mProj );
+    }
+
+    if( Options.szStatsName )
+    {
+        if( !gs_StatsPublisher.Create( Options.szStatsName ) )
+        {
+            fprintf( stderr, "Could not create the stats segment %s\n", Options.szStatsName );
+            return 1;
+        }
+
+        // Every configuration's FrameStats has the same series
+        memset( &gs_Stats, 0, sizeof( gs_Stats ) );
+        gs_Stats.nSeries = FrameSeriesCount;
+        for( unsigned int nSeries = 0; nSeries < FrameSeriesCount; ++nSeries )
+        {
+            strncpy( gs_Stats.szSeriesNames[ nSeries ], g_szFrameSeriesNames[ nSeries ], StatsBlock::SeriesNameLength - 1 );
+        }
+    }
+
+    std::vector<HeadlessResult> Results;
+
+    const char* szModes[] = { "simd", "scalar" };
+    const bool bModes[] = { Options.bSIMD, Options.bScalar };
+    for( unsigned int m = 0; m < 2; ++m )
+    {
+        if( !bModes[m] )
+        {
+            continue;
+        }
+
+        bool bSIMD = ( 0 == m );
+        HeadlessResult Serial = RunConfiguration( Options, szModes[m], bSIMD, false, 1, Results.empty() );
+        Serial.fSpeedup = 1.0;
+        Serial.fEfficiency = 1.0;
+        Results.push_back( Serial );
+
+        for( size_t t = 0; t < Options.ThreadCounts.size(); ++t )
+        {
+            unsigned int nThreads = Options.ThreadCounts[t];
+            HeadlessResult Threaded = RunConfiguration( Options, szModes[m], bSIMD, true, nThreads, false );
+
+            Threaded.fSpeedup = Serial.fUnitsPerSecond > 0.0 ? Threaded.fUnitsPerSecond / Serial.fUnitsPerSecond : 0.0;
+            Threaded.fEfficiency = Threaded.fSpeedup / nThreads;
+            Results.push_back( Threaded );
+        }
+    }
+
+    WriteResults( pOutFile, Options, Results );
+
+    if( pOutFile != stdout )
+    {
+        fclose( pOutFile );
+    }
+
+    gFrameArena.Shutdown();
+    gs_StatsPublisher.Destroy();
+    Render::Destroy();
+
+    return 0;
+}
@@ -0,0 +1,264 @@
+// Copyright 2010 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+#include "Scenario.h"
+#include "Game.h"
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Whole SIMD groups, at least one
+static unsigned int ClampUnits( unsigned int nUnits )
+{
+    nUnits = min( max( nUnits, gs_nSIMDWidth ), gs_nMaxUnits );
+    return nUnits - nUnits % gs_nSIMDWidth;
+}
+
+static float ScenarioRand( void )
+{
+    return rand() / ( RAND_MAX + 1.0f );
+}
+
+static bool SortByFrame( const Scenario::UnitStep& A,
+                         const Scenario::UnitStep& B )
+{
+    return A.nFrame < B.nFrame;
+}
+
+Scenario::Scenario( void ) : nSeed( 1 ),
+                             nFrames( 300 ),
+                             nUnits( gs_nMaxUnits ),
+                             nFactories( 0 ),
+                             eSpawn( SpawnUniform ),
+                             fClusterX( 0.0f ),
+                             fClusterY( 0.0f ),
+                             fClusterRadius( 0.0f ),
+                             fCoverage( 0.0f ),
+                             fResetCoverage( 0.9f )
+{
+    strcpy( szName, "random" );
+}
+
+bool Scenario::Load( const char* szFileName )
+{
+    FILE* pFile = fopen( szFileName, "r" );
+    if( NULL == pFile )
+    {
+        fprintf( stderr, "Could not open scenario %s\n", szFileName );
+        return false;
+    }
+
+    // Named after the file unless it says otherwise
+    const char* szBaseName = szFileName;
+    for( const char* p = szFileName; *p; ++p )
+    {
+        if( '/' == *p || '\\' == *p )
+        {
+            szBaseName = p + 1;
+        }
+    }
+    strncpy( szName, szBaseName, sizeof( szName ) - 1 );
+    szName[ sizeof( szName ) - 1 ] = 0;
+    char* pExtension = strrchr( szName, '.' );
+    if( pExtension )
+    {
+        *pExtension = 0;
+    }
+
+    // A file lists its own factories and schedule
+    nFactories = 0;
+    Schedule.clear();
+
+    char szLine[256];
+    unsigned int nLine = 0;
+    bool bOk = true;
+    while( bOk && fgets( szLine, sizeof( szLine ), pFile ) )
+    {
+        ++nLine;
+
+        char* pComment = strchr( szLine, '#' );
+        if( pComment )
+        {
+            *pComment = 0;
+        }
+
+        char szKey[32];
+        if( sscanf( szLine, "%31s", szKey ) != 1 )
+        {
+            continue;
+        }
+
+        const char* szArgs = strstr( szLine, szKey ) + strlen( szKey );
+        unsigned int nX, nY;
+        char szSpawn[32];
+
+        if( !strcmp( szKey, "name" ) )
+        {
+            bOk = sscanf( szArgs, "%63s", szName ) == 1;
+        }
+        else if( !strcmp( szKey, "seed" ) )
+        {
+            bOk = sscanf( szArgs, "%u", &nSeed ) == 1;
+        }
+        else if( !strcmp( szKey, "frames" ) )
+        {
+            bOk = sscanf( szArgs, "%u", &nFrames ) == 1 && nFrames > 0;
+        }
+        else if( !strcmp( szKey, "units" ) )
+        {
+            bOk = sscanf( szArgs, "%u", &nUnits ) == 1;
+            nUnits = ClampUnits( nUnits );
+        }
+        else if( !strcmp( szKey, "schedule" ) )
+        {
+            UnitStep Step;
+            bOk = sscanf( szArgs, "%u %u", &Step.nFrame, &Step.nUnits ) == 2;
+            Step.nUnits = ClampUnits( Step.nUnits );
+            Schedule.push_back( Step );
+        }
+        else if( !strcmp( szKey, "factory" ) )
+        {
+            bOk = sscanf( szArgs, "%u %u", &nX, &nY ) == 2 &&
+                  nX < gs_nWorldSize && nY < gs_nWorldSize && nFactories < gs_nMaxFactories;
+            if( bOk )
+            {
+                pFactoryTiles[ nFactories++ ] = nX * gs_nWorldSize + nY;
+            }
+        }
+        else if( !strcmp( szKey, "spawn" ) && sscanf( szArgs, "%31s", szSpawn ) == 1 )
+        {
+            if( !strcmp( szSpawn, "uniform" ) )
+            {
+                eSpawn = SpawnUniform;
+            }
+            else if( !strcmp( szSpawn, "cluster" ) )
+            {
+                eSpawn = SpawnCluster;
+                bOk = sscanf( strstr( szArgs, szSpawn ) + strlen( szSpawn ), "%f %f %f",
+                              &fClusterX, &fClusterY, &fClusterRadius ) == 3;
+            }
+            else if( !strcmp( szSpawn, "factories" ) )
+            {
+                eSpawn = SpawnFactories;
+            }
+            else
+            {
+                bOk = false;
+            }
+        }
+        else if( !strcmp( szKey, "coverage" ) )
+        {
+            bOk = sscanf( szArgs, "%f", &fCoverage ) == 1 && fCoverage >= 0.0f && fCoverage < 1.0f;
+        }
+        else if( !strcmp( szKey, "resetcoverage" ) )
+        {
+            bOk = sscanf( szArgs, "%f", &fResetCoverage ) == 1;
+        }
+        else
+        {
+            bOk = false;
+        }
+
+        if( !bOk )
+        {
+            fprintf( stderr, "%s(%u): bad or unknown setting: %s\n", szFileName, nLine, szKey );
+        }
+    }
+
+    fclose( pFile );
+
+    std::stable_sort( Schedule.begin(), Schedule.end(), SortByFrame );
+    return bOk;
+}
+
+unsigned int Scenario::GetUnitCount( unsigned int nFrame ) const
+{
+    unsigned int nCount = nUnits;
+    for( size_t i = 0; i < Schedule.size() && Schedule[i].nFrame <= nFrame; ++i )
+    {
+        nCount = Schedule[i].nUnits;
+    }
+    return nCount;
+}
+
+void Scenario::Apply( Game& TheGame ) const
+{
+    UnitManager* pUnitManager = TheGame.GetUnitManager();
+
+    srand( nSeed );
+    TheGame.Reset();
+
+    // Factories, then the units' goals that point at them
+    if( nFactories > 0 )
+    {
+        for( unsigned int i = 0; i < gs_nMaxFactories; ++i )
+        {
+            TheGame.SetFactory( i, pFactoryTiles[ i % nFactories ] );
+        }
+        pUnitManager->Reset();
+    }
+
+    if( fCoverage > 0.0f )
+    {
+        TheGame.PaveRandomTiles( fCoverage );
+    }
+    TheGame.SetCoverageThreshold( fResetCoverage );
+
+    // Every unit is placed, so units the schedule adds later start in the
+    //   scenario too
+    const Tile* pTiles = TheGame.GetTiles();
+    const unsigned int* pFactories = TheGame.GetFactories();
+    for( unsigned int nUnit = 0; nUnit < gs_nMaxUnits; ++nUnit )
+    {
+        float fX, fY;
+        if( SpawnUniform == eSpawn )
+        {
+            fX = ScenarioRand() * gs_fWorldSize;
+            fY = ScenarioRand() * gs_fWorldSize;
+        }
+        else
+        {
+            // Uniform over a disc around the centre
+            float fCentreX, fCentreY, fRadius;
+            if( SpawnCluster == eSpawn )
+            {
+                fCentreX = ( fClusterX + 0.5f ) * gs_fTileSize;
+                fCentreY = ( fClusterY + 0.5f ) * gs_fTileSize;
+                fRadius = fClusterRadius * gs_fTileSize;
+            }
+            else
+            {
+                // The factory UnitManager::Reset gives the unit's group
+                unsigned int nGroup = nUnit / gs_nSIMDWidth;
+                const Tile& Factory = pTiles[ pFactories[ nGroup * gs_nMaxFactories / gs_nUnitTaskCount ] ];
+                fCentreX = Factory.fX;
+                fCentreY = Factory.fY;
+                fRadius = 2.0f * gs_fTileSize;
+            }
+
+            float fDistance = fRadius * sqrtf( ScenarioRand() );
+            float fAngle = ScenarioRand() * XM_2PI;
+            fX = fCentreX + fDistance * cosf( fAngle );
+            fY = fCentreY + fDistance * sinf( fAngle );
+        }
+
+        // Inside the world, which ends just before gs_fWorldSize
+        fX = min( max( fX, 0.0f ), gs_fWorldSize * 0.9999f );
+        fY = min( max( fY, 0.0f ), gs_fWorldSize * 0.9999f );
+        pUnitManager->SetUnitPosition( nUnit, fX, fY );
+    }
+
+    pUnitManager->SetUnitCount( GetUnitCount( 0 ) / gs_nSIMDWidth );
+}
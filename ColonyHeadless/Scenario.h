@@ -0,0 +1,92 @@
+// Copyright 2010 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+#pragma once
+#ifndef _SCENARIO_H_
+#define _SCENARIO_H_
+
+#include "Colony.h"
+#include <vector>
+
+class Game;
+
+//--------------------------------------------------------------------------------------
+// A scenario fixes everything a run of the simulation depends on, so runs on
+// different machines and builds simulate the same frames.  Scenario files are
+// text, one setting per line; # starts a comment.
+//
+//   name converge              Name reported with the results
+//   seed 7                     Seed for the world, trees and anything random
+//   frames 600                 Measured frames
+//   units 8192                 Units at the start
+//   schedule 300 2048          Unit count from a frame on, counted from the
+//                              first frame of the run, warmup included
+//   factory 256 256            Factory tile x y.  Listed factories repeat to
+//                              fill all gs_nMaxFactories; with none the seed
+//                              places them
+//   spawn uniform              Units start anywhere in the world,
+//   spawn cluster 256 256 32   within a radius of tiles around a tile,
+//   spawn factories            or next to the factory they work for
+//   coverage 0.85              Fraction of the world paved at the start
+//   resetcoverage 0.99         Coverage that resets the game.  A reset
+//                              places a new random world, so scenarios keep
+//                              this above what the run reaches
+//
+// The library in ColonyHeadless/Scenarios covers the stress cases.
+//--------------------------------------------------------------------------------------
+struct Scenario
+{
+    enum Spawn
+    {
+        SpawnUniform = 0,
+        SpawnCluster,
+        SpawnFactories,
+    };
+
+    struct UnitStep
+    {
+        unsigned int nFrame;
+        unsigned int nUnits;
+    };
+
+    char szName[64];
+    unsigned int nSeed;
+    unsigned int nFrames;
+    unsigned int nUnits;
+    std::vector<UnitStep> Schedule;
+
+    unsigned int nFactories;
+    unsigned int pFactoryTiles[ gs_nMaxFactories ];
+
+    Spawn eSpawn;
+    float fClusterX;            // In tiles
+    float fClusterY;
+    float fClusterRadius;
+
+    float fCoverage;
+    float fResetCoverage;
+
+    // The default: a random world from seed 1 with every unit spread over it
+    Scenario( void );
+
+    // Reads a scenario file over the current settings.  Errors go to stderr.
+    bool Load( const char* szFileName );
+
+    // Units the run simulates at a frame
+    unsigned int GetUnitCount( unsigned int nFrame ) const;
+
+    // Start the game over in the scenario's first frame.  Seeds rand().
+    void Apply( Game& TheGame ) const;
+};
+
+#endif // #ifndef _SCENARIO_H_
@@ -0,0 +1,196 @@
+// Copyright 2010 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+//--------------------------------------------------------------------------------------
+// ColonyStats polls the stats segment a running Colony or ColonyHeadless
+// publishes with -stats, and prints a line per poll: the frame, units,
+// coverage, frame time, the p99 of each FrameStats series, and the average
+// and busiest CPU.  It only maps the segment read only, so polling, however
+// fast, costs the simulation nothing.
+//
+// Usage:
+// ColonyStats [-name ColonyStats] [-interval ms] [-count N] [-json]
+//
+// -interval defaults to 1000 ms; -count 0, the default, polls until the
+// publisher goes away.  -json prints each poll as a JSON object on its own
+// line, for a sidecar to forward.
+//
+// Windows: build ColonyStats.vcxproj.
+// Linux, from this directory:
+//   g++ -O2 -I../SampleComponents ColonyStats.cpp
+//       ../SampleComponents/StatsSegment.cpp ../SampleComponents/FrameStats.cpp
+//       -pthread -lrt -o ColonyStats
+//--------------------------------------------------------------------------------------
+
+#include "StatsSegment.h"
+#include "FrameStats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+static void SleepMs( unsigned int nMs )
+{
+#ifdef _WIN32
+    Sleep( nMs );
+#else
+    usleep( nMs * 1000 );
+#endif
+}
+
+static void PrintText( const StatsBlock& Stats,
+                       double fAgeMs,
+                       double fFps,
+                       double fCpuMean,
+                       double fCpuMax )
+{
+    printf( "frame %llu  units %u  coverage %5.1f%%  frame %6.2f ms  %5.1f fps  age %6.1f ms  resets %u",
+            Stats.nFrame, Stats.nUnits, Stats.fCoverage * 100.0f, Stats.fFrameMs, fFps, fAgeMs, Stats.nResets );
+
+    for( unsigned int i = 0; i < Stats.nSeries; ++i )
+    {
+        printf( "  %s p99 %.2f", Stats.szSeriesNames[i], Stats.fSeriesP99Ms[i] );
+    }
+
+    if( Stats.nCpus > 0 )
+    {
+        printf( "  cpu %.0f%% (max %.0f%%)", fCpuMean, fCpuMax );
+    }
+    printf( "\n" );
+}
+
+static void PrintJson( const StatsBlock& Stats,
+                       double fAgeMs,
+                       double fFps )
+{
+    printf( "{\"pid\":%u,\"frame\":%llu,\"time_us\":%llu,\"age_ms\":%.1f,\"fps\":%.2f,",
+            Stats.nProcessId, Stats.nFrame, Stats.nTimeUs, fAgeMs, fFps );
+    printf( "\"units\":%u,\"coverage\":%.4f,\"resets\":%u,\"frame_ms\":%.3f,",
+            Stats.nUnits, Stats.fCoverage, Stats.nResets, Stats.fFrameMs );
+    printf( "\"simd\":%s,\"threaded\":%s,\"paused\":%s,\"series\":{",
+            ( Stats.nFlags & StatsBlock::FlagSIMD ) ? "true" : "false",
+            ( Stats.nFlags & StatsBlock::FlagThreaded ) ? "true" : "false",
+            ( Stats.nFlags & StatsBlock::FlagPaused ) ? "true" : "false" );
+
+    for( unsigned int i = 0; i < Stats.nSeries; ++i )
+    {
+        printf( "%s\"%s\":{\"ms\":%.3f,\"p50\":%.3f,\"p99\":%.3f,\"max\":%.3f}", i ? "," : "",
+                Stats.szSeriesNames[i], Stats.fSeriesMs[i], Stats.fSeriesP50Ms[i], Stats.fSeriesP99Ms[i],
+                Stats.fSeriesMaxMs[i] );
+    }
+
+    printf( "},\"cpu\":[" );
+    for( unsigned int i = 0; i < Stats.nCpus; ++i )
+    {
+        printf( "%s%.1f", i ? "," : "", Stats.fCpuPercent[i] );
+    }
+    printf( "]}\n" );
+}
+
+int main( int argc,
+          char* argv[] )
+{
+    const char* szName = "ColonyStats";
+    unsigned int nIntervalMs = 1000;
+    unsigned int nCount = 0;
+    bool bJson = false;
+
+    for( int i = 1; i < argc; ++i )
+    {
+        if( !strcmp( argv[i], "-name" ) && i + 1 < argc )
+        {
+            szName = argv[++i];
+        }
+        else if( !strcmp( argv[i], "-interval" ) && i + 1 < argc )
+        {
+            nIntervalMs = ( unsigned int )atoi( argv[++i] );
+        }
+        else if( !strcmp( argv[i], "-count" ) && i + 1 < argc )
+        {
+            nCount = ( unsigned int )atoi( argv[++i] );
+        }
+        else if( !strcmp( argv[i], "-json" ) )
+        {
+            bJson = true;
+        }
+        else
+        {
+            fprintf( stderr, "Unknown option: %s\n", argv[i] );
+            return 1;
+        }
+    }
+
+    StatsReader Reader;
+    if( !Reader.Open( szName ) )
+    {
+        fprintf( stderr, "No stats segment %s; start Colony with -stats\n", szName );
+        return 1;
+    }
+
+    StatsBlock Previous;
+    bool bHavePrevious = false;
+
+    for( unsigned int nPoll = 0; 0 == nCount || nPoll < nCount; ++nPoll )
+    {
+        if( nPoll > 0 )
+        {
+            SleepMs( nIntervalMs );
+        }
+
+        StatsBlock Stats;
+        if( !Reader.Read( Stats ) )
+        {
+            fprintf( stderr, "The stats segment %s stopped updating\n", szName );
+            return 1;
+        }
+
+        // The publisher stamps the block with the same system wide clock
+        unsigned long long nNowUs = FrameStats::GetTimeUs();
+        double fAgeMs = nNowUs > Stats.nTimeUs ? ( nNowUs - Stats.nTimeUs ) / 1000.0 : 0.0;
+
+        double fFps = 0.0;
+        if( bHavePrevious && Stats.nTimeUs > Previous.nTimeUs && Stats.nFrame >= Previous.nFrame )
+        {
+            fFps = ( Stats.nFrame - Previous.nFrame ) * 1000000.0 / ( Stats.nTimeUs - Previous.nTimeUs );
+        }
+
+        double fCpuMean = 0.0;
+        double fCpuMax = 0.0;
+        for( unsigned int i = 0; i < Stats.nCpus; ++i )
+        {
+            fCpuMean += Stats.fCpuPercent[i];
+            fCpuMax = Stats.fCpuPercent[i] > fCpuMax ? Stats.fCpuPercent[i] : fCpuMax;
+        }
+        fCpuMean = Stats.nCpus ? fCpuMean / Stats.nCpus : 0.0;
+
+        if( bJson )
+        {
+            PrintJson( Stats, fAgeMs, fFps );
+        }
+        else
+        {
+            PrintText( Stats, fAgeMs, fFps, fCpuMean, fCpuMax );
+        }
+        fflush( stdout );
+
+        Previous = Stats;
+        bHavePrevious = true;
+    }
+
+    return 0;
+}
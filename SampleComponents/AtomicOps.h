@@ -0,0 +1,85 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+//---------------------------------------------------------------------------------------
+
+#ifndef __ATOMICOPS_H
+#define __ATOMICOPS_H
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Acquire loads, release stores and a full fence for data shared between
+// threads, or processes through a mapping, without locks.  MSVC gives
+// volatile accesses acquire and release semantics on x86 and x64; the
+// compiler barriers keep it from moving plain accesses across them.
+
+template< typename T >
+static inline T LoadAcquire( const volatile T* p )
+{
+#ifdef _MSC_VER
+    T Value = *p;
+    _ReadWriteBarrier();
+    return Value;
+#else
+    return __atomic_load_n( p, __ATOMIC_ACQUIRE );
+#endif
+}
+
+template< typename T >
+static inline void StoreRelease( volatile T* p,
+                                 T Value )
+{
+#ifdef _MSC_VER
+    _ReadWriteBarrier();
+    *p = Value;
+#else
+    __atomic_store_n( p, Value, __ATOMIC_RELEASE );
+#endif
+}
+
+// Plain 64 bit accesses can tear on 32 bit x86, so there they go through
+// cmpxchg8b.  GCC's builtins already do.
+#if defined( _MSC_VER ) && defined( _M_IX86 )
+static inline unsigned long long LoadAcquire( const volatile unsigned long long* p )
+{
+    return ( unsigned long long )_InterlockedCompareExchange64( ( volatile __int64* )p, 0, 0 );
+}
+
+static inline void StoreRelease( volatile unsigned long long* p,
+                                 unsigned long long Value )
+{
+    __int64 Old = *( volatile __int64* )p;
+    __int64 Seen;
+    while( ( Seen = _InterlockedCompareExchange64( ( volatile __int64* )p, ( __int64 )Value, Old ) ) != Old )
+    {
+        Old = Seen;
+    }
+}
+#endif
+
+// Ordinary loads and stores on either side must not pass each other
+static inline void FullFence( void )
+{
+#ifdef _MSC_VER
+    _ReadWriteBarrier();
+    _mm_mfence();
+#else
+    __atomic_thread_fence( __ATOMIC_SEQ_CST );
+#endif
+}
+
+#endif // __ATOMICOPS_H
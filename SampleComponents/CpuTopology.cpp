@@ -0,0 +1,309 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+
+#include "CpuTopology.h"
+
+#ifdef __linux__
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#else
+#include <windows.h>
+#include <malloc.h>
+#endif
+
+#ifdef __linux__
+
+// Read a single unsigned integer from a /sys file.
+static bool ReadSysValue( const char* szPath, unsigned int* pValue )
+{
+    FILE* pFile = fopen( szPath, "r" );
+    if( pFile == NULL )
+    {
+        return false;
+    }
+
+    bool bRead = ( fscanf( pFile, "%u", pValue ) == 1 );
+    fclose( pFile );
+    return bRead;
+}
+
+// Read a /sys cpu list such as "0-3,8-11" and mark each cpu in it.
+static bool ReadSysCpuList( const char* szPath, bool* pCpus, unsigned int nMax )
+{
+    FILE* pFile = fopen( szPath, "r" );
+    if( pFile == NULL )
+    {
+        return false;
+    }
+
+    unsigned int nFirst;
+    while( fscanf( pFile, "%u", &nFirst ) == 1 )
+    {
+        unsigned int nLast = nFirst;
+        int c = fgetc( pFile );
+        if( c == '-' )
+        {
+            if( fscanf( pFile, "%u", &nLast ) != 1 )
+            {
+                break;
+            }
+            c = fgetc( pFile );
+        }
+
+        for( unsigned int i = nFirst; i <= nLast && i < nMax; ++i )
+        {
+            pCpus[i] = true;
+        }
+
+        if( c != ',' )
+        {
+            break;
+        }
+    }
+
+    fclose( pFile );
+    return true;
+}
+
+#endif
+
+CpuTopology::CpuTopology( void ) : m_LogicalCount( 1 ),
+                                   m_CoreCount( 1 ),
+                                   m_NodeCount( 1 )
+{
+    for( unsigned int i = 0; i < MaxLogical; ++i )
+    {
+        m_Present[i] = ( i == 0 );
+        m_Core[i] = i;
+        m_Node[i] = 0;
+        m_SiblingRank[i] = 0;
+        m_Placement[i] = i;
+    }
+}
+
+bool CpuTopology::Query( void )
+{
+#ifdef __linux__
+    char szPath[128];
+    unsigned int nPackage[ MaxLogical ];
+    unsigned int nCoreId[ MaxLogical ];
+
+    bool bOnline[ MaxLogical ] = { false };
+
+    // Offline processors leave gaps in the cpuN numbering
+    if( !ReadSysCpuList( "/sys/devices/system/cpu/online", bOnline, MaxLogical ) &&
+        !ReadSysCpuList( "/sys/devices/system/cpu/present", bOnline, MaxLogical ) )
+    {
+        return false;
+    }
+
+    m_LogicalCount = 0;
+    m_CoreCount = 0;
+    m_NodeCount = 1;
+
+    // Each online cpuN with a topology is one logical processor
+    for( unsigned int i = 0; i < MaxLogical; ++i )
+    {
+        m_Present[i] = false;
+        if( !bOnline[i] )
+        {
+            continue;
+        }
+
+        snprintf( szPath, sizeof( szPath ), "/sys/devices/system/cpu/cpu%u/topology/physical_package_id", i );
+        if( !ReadSysValue( szPath, &nPackage[i] ) )
+        {
+            continue;
+        }
+
+        snprintf( szPath, sizeof( szPath ), "/sys/devices/system/cpu/cpu%u/topology/core_id", i );
+        if( !ReadSysValue( szPath, &nCoreId[i] ) )
+        {
+            continue;
+        }
+
+        // Logical processors with the same package and core id are SMT siblings
+        m_SiblingRank[i] = 0;
+        m_Core[i] = m_CoreCount;
+        for( unsigned int j = 0; j < i; ++j )
+        {
+            if( m_Present[j] && nPackage[j] == nPackage[i] && nCoreId[j] == nCoreId[i] )
+            {
+                if( m_SiblingRank[j] == 0 )
+                {
+                    m_Core[i] = m_Core[j];
+                }
+                ++m_SiblingRank[i];
+            }
+        }
+
+        if( m_SiblingRank[i] == 0 )
+        {
+            ++m_CoreCount;
+        }
+
+        m_Node[i] = 0;
+        m_Present[i] = true;
+        ++m_LogicalCount;
+    }
+
+    if( m_LogicalCount == 0 )
+    {
+        m_Present[0] = true;
+        m_LogicalCount = 1;
+        m_CoreCount = 1;
+        return false;
+    }
+
+    // Machines without NUMA support have no node directories at all
+    for( unsigned int nNode = 0; nNode < MaxLogical; ++nNode )
+    {
+        bool bCpus[ MaxLogical ] = { false };
+
+        snprintf( szPath, sizeof( szPath ), "/sys/devices/system/node/node%u/cpulist", nNode );
+        if( !ReadSysCpuList( szPath, bCpus, MaxLogical ) )
+        {
+            break;
+        }
+
+        for( unsigned int i = 0; i < MaxLogical; ++i )
+        {
+            if( bCpus[i] )
+            {
+                m_Node[i] = nNode;
+            }
+        }
+
+        m_NodeCount = nNode + 1;
+    }
+#else
+    DWORD dwLength = 0;
+    GetLogicalProcessorInformation( NULL, &dwLength );
+    if( GetLastError() != ERROR_INSUFFICIENT_BUFFER )
+    {
+        return false;
+    }
+
+    SYSTEM_LOGICAL_PROCESSOR_INFORMATION* pInfo = ( SYSTEM_LOGICAL_PROCESSOR_INFORMATION* )_alloca( dwLength );
+    if( !GetLogicalProcessorInformation( pInfo, &dwLength ) )
+    {
+        return false;
+    }
+
+    unsigned int nEntries = dwLength / sizeof( SYSTEM_LOGICAL_PROCESSOR_INFORMATION );
+
+    m_LogicalCount = 0;
+    m_CoreCount = 0;
+    m_NodeCount = 1;
+
+    // Masks are pointer sized, 32 bits on Win32
+    const unsigned int nMaskBits = min( ( unsigned int )MaxLogical, ( unsigned int )sizeof( ULONG_PTR ) * 8 );
+    for( unsigned int i = 0; i < MaxLogical; ++i )
+    {
+        m_Present[i] = false;
+    }
+
+    for( unsigned int n = 0; n < nEntries; ++n )
+    {
+        ULONG_PTR uMask = pInfo[n].ProcessorMask;
+
+        if( pInfo[n].Relationship == RelationProcessorCore )
+        {
+            // Every set bit of a core's mask is one of its SMT siblings
+            unsigned int nRank = 0;
+            for( unsigned int i = 0; i < nMaskBits; ++i )
+            {
+                if( uMask & ( ( ULONG_PTR )1 << i ) )
+                {
+                    m_Present[i] = true;
+                    m_Core[i] = m_CoreCount;
+                    m_SiblingRank[i] = nRank++;
+                    ++m_LogicalCount;
+                }
+            }
+            ++m_CoreCount;
+        }
+        else if( pInfo[n].Relationship == RelationNumaNode )
+        {
+            unsigned int nNode = pInfo[n].NumaNode.NodeNumber;
+            for( unsigned int i = 0; i < nMaskBits; ++i )
+            {
+                if( uMask & ( ( ULONG_PTR )1 << i ) )
+                {
+                    m_Node[i] = nNode;
+                }
+            }
+            m_NodeCount = max( m_NodeCount, nNode + 1 );
+        }
+    }
+
+    if( m_LogicalCount == 0 )
+    {
+        m_Present[0] = true;
+        m_LogicalCount = 1;
+        m_CoreCount = 1;
+        return false;
+    }
+#endif
+
+    BuildPlacement();
+    return true;
+}
+
+void CpuTopology::BuildPlacement( void )
+{
+    // First thread of every core, node by node, then the second thread of
+    //   every core and so on.  Threads placed next to each other share a node.
+    unsigned int nPlaced = 0;
+    for( unsigned int nRank = 0; nPlaced < m_LogicalCount && nRank < MaxLogical; ++nRank )
+    {
+        for( unsigned int nNode = 0; nNode < m_NodeCount; ++nNode )
+        {
+            for( unsigned int i = 0; i < MaxLogical; ++i )
+            {
+                if( m_Present[i] && m_SiblingRank[i] == nRank && m_Node[i] == nNode )
+                {
+                    m_Placement[ nPlaced++ ] = i;
+                }
+            }
+        }
+    }
+}
+
+bool CpuTopology::PinCurrentThread( unsigned int nCpu )
+{
+    if( nCpu >= MaxLogical )
+    {
+        return false;
+    }
+
+#ifdef __linux__
+    cpu_set_t CpuSet;
+    CPU_ZERO( &CpuSet );
+    CPU_SET( nCpu, &CpuSet );
+
+    // A pid of 0 means the calling thread
+    return sched_setaffinity( 0, sizeof( CpuSet ), &CpuSet ) == 0;
+#else
+    if( nCpu >= sizeof( DWORD_PTR ) * 8 )
+    {
+        return false;
+    }
+
+    return SetThreadAffinityMask( GetCurrentThread(), ( DWORD_PTR )1 << nCpu ) != 0;
+#endif
+}
@@ -0,0 +1,86 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+//---------------------------------------------------------------------------------------
+
+#ifndef __CPUTOPOLOGY_H
+#define __CPUTOPOLOGY_H
+
+// CpuTopology reads the processor layout of the machine and produces an
+// order in which to place worker threads: one logical processor of every
+// physical core first, grouped by NUMA node, then the remaining SMT
+// siblings.  Windows uses GetLogicalProcessorInformation, Linux reads
+// /sys/devices/system/cpu and /sys/devices/system/node.
+class CpuTopology
+{
+public:
+    CpuTopology( void );
+
+    // Fill in the topology.  Returns false if it could not be read, in
+    // which case the placement order is simply 0 to n-1.
+    bool Query( void );
+
+    // Logical processors the process can run on.  Their numbers need not
+    // be contiguous; offline processors are left out.
+    unsigned int getLogicalCount() const
+    {
+        return m_LogicalCount;
+    }
+    unsigned int getCoreCount() const
+    {
+        return m_CoreCount;
+    }
+    unsigned int getNodeCount() const
+    {
+        return m_NodeCount;
+    }
+
+    // Logical processor to use for the nth thread placed.  Wraps once
+    // every logical processor has been handed out.
+    unsigned int getPlacement( unsigned int nThread ) const
+    {
+        return m_Placement[ nThread % m_LogicalCount ];
+    }
+
+    // NUMA node of a logical processor.
+    unsigned int getNode( unsigned int nCpu ) const
+    {
+        return nCpu < MaxLogical && m_Present[ nCpu ] ? m_Node[ nCpu ] : 0;
+    }
+
+    // Restrict the calling thread to a single logical processor.
+    static bool PinCurrentThread( unsigned int nCpu );
+
+    static const unsigned int MaxLogical = 64;
+
+private:
+    void BuildPlacement( void );
+
+    unsigned int m_LogicalCount;
+    unsigned int m_CoreCount;
+    unsigned int m_NodeCount;
+
+    // Per logical processor number: whether it is online, physical core
+    // index, NUMA node and rank among the SMT siblings of its core (0 for
+    // the first thread of a core).
+    bool m_Present[ MaxLogical ];
+    unsigned int m_Core[ MaxLogical ];
+    unsigned int m_Node[ MaxLogical ];
+    unsigned int m_SiblingRank[ MaxLogical ];
+
+    unsigned int m_Placement[ MaxLogical ];
+};
+
+#endif
@@ -0,0 +1,253 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+//---------------------------------------------------------------------------------------
+
+#include "FrameArena.h"
+#include <assert.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <stdlib.h>
+#endif
+
+FrameArena gFrameArena;
+
+// Resized contexts get this much room over their peak, rounded up to a
+// whole number of granules.
+static const size_t gs_nGrowthGranule = 64 * 1024;
+
+static size_t AlignUp( size_t n,
+                       size_t nAlign )
+{
+    return ( n + nAlign - 1 ) & ~( nAlign - 1 );
+}
+
+FrameArena::FrameArena( void )
+    : m_pArenas( NULL )
+    , m_nContexts( 0 )
+    , m_nHeapAllocations( 0 )
+    , m_nHeapAllocationsAtReset( 0 )
+    , m_nFrameHeapAllocations( 0 )
+    , m_nFramePeakBytes( 0 )
+{
+}
+
+FrameArena::~FrameArena( void )
+{
+    Shutdown();
+}
+
+bool FrameArena::Init( unsigned int nContexts,
+                       size_t nBytesPerContext )
+{
+    Shutdown();
+
+    m_pArenas = ( SubArena* )HeapAllocate( nContexts * sizeof( SubArena ) );
+    if( NULL == m_pArenas )
+    {
+        return false;
+    }
+
+    memset( m_pArenas, 0, nContexts * sizeof( SubArena ) );
+    m_nContexts = nContexts;
+
+    nBytesPerContext = AlignUp( nBytesPerContext, Alignment );
+    for( unsigned int i = 0; i < nContexts; ++i )
+    {
+        m_pArenas[i].pBase = ( char* )HeapAllocate( nBytesPerContext );
+        if( NULL == m_pArenas[i].pBase )
+        {
+            Shutdown();
+            return false;
+        }
+        m_pArenas[i].nCapacity = nBytesPerContext;
+    }
+
+    // Only count what happens once the app is running
+    m_nHeapAllocations = 0;
+    m_nHeapAllocationsAtReset = 0;
+    m_nFrameHeapAllocations = 0;
+    m_nFramePeakBytes = 0;
+
+    return true;
+}
+
+void FrameArena::Shutdown( void )
+{
+    if( NULL == m_pArenas )
+    {
+        return;
+    }
+
+    for( unsigned int i = 0; i < m_nContexts; ++i )
+    {
+        Marker Empty = { 0, 0, NULL };
+        Rewind( ( int )i, Empty );
+        HeapFree( m_pArenas[i].pBase );
+    }
+
+    HeapFree( m_pArenas );
+    m_pArenas = NULL;
+    m_nContexts = 0;
+}
+
+void* FrameArena::Allocate( int nContext,
+                            size_t nBytes )
+{
+    assert( nContext >= 0 && ( unsigned int )nContext < m_nContexts );
+
+    SubArena& Arena = m_pArenas[ nContext ];
+
+    nBytes = AlignUp( nBytes, Alignment );
+
+    if( Arena.nOffset + nBytes > Arena.nCapacity )
+    {
+        return AllocateOverflow( Arena, nBytes );
+    }
+
+    void* p = Arena.pBase + Arena.nOffset;
+    Arena.nOffset += nBytes;
+
+    size_t nInUse = Arena.nOffset + Arena.nOverflowBytes;
+    if( nInUse > Arena.nPeak )
+    {
+        Arena.nPeak = nInUse;
+    }
+
+    return p;
+}
+
+void* FrameArena::AllocateOverflow( SubArena& Arena,
+                                    size_t nBytes )
+{
+    // The first line of the block links it to the previous overflow block
+    char* pBlock = ( char* )HeapAllocate( Alignment + nBytes );
+    if( NULL == pBlock )
+    {
+        return NULL;
+    }
+
+    CountHeapAllocation();
+
+    *( void** )pBlock = Arena.pOverflow;
+    Arena.pOverflow = pBlock;
+    Arena.nOverflowBytes += nBytes;
+
+    size_t nInUse = Arena.nOffset + Arena.nOverflowBytes;
+    if( nInUse > Arena.nPeak )
+    {
+        Arena.nPeak = nInUse;
+    }
+
+    return pBlock + Alignment;
+}
+
+FrameArena::Marker FrameArena::GetMarker( int nContext ) const
+{
+    assert( nContext >= 0 && ( unsigned int )nContext < m_nContexts );
+
+    const SubArena& Arena = m_pArenas[ nContext ];
+    Marker Mark = { Arena.nOffset, Arena.nOverflowBytes, Arena.pOverflow };
+    return Mark;
+}
+
+void FrameArena::Rewind( int nContext,
+                         const Marker& Mark )
+{
+    assert( nContext >= 0 && ( unsigned int )nContext < m_nContexts );
+
+    SubArena& Arena = m_pArenas[ nContext ];
+
+    while( Arena.pOverflow != Mark.pOverflow )
+    {
+        void* pNext = *( void** )Arena.pOverflow;
+        HeapFree( Arena.pOverflow );
+        Arena.pOverflow = pNext;
+    }
+
+    Arena.nOffset = Mark.nOffset;
+    Arena.nOverflowBytes = Mark.nOverflowBytes;
+}
+
+void FrameArena::Reset( void )
+{
+    m_nFramePeakBytes = 0;
+
+    for( unsigned int i = 0; i < m_nContexts; ++i )
+    {
+        SubArena& Arena = m_pArenas[i];
+
+        Marker Empty = { 0, 0, NULL };
+        Rewind( ( int )i, Empty );
+
+        if( Arena.nPeak > m_nFramePeakBytes )
+        {
+            m_nFramePeakBytes = Arena.nPeak;
+        }
+
+        // Grow a context that spilled to the heap so next frame fits
+        if( Arena.nPeak > Arena.nCapacity )
+        {
+            size_t nCapacity = AlignUp( Arena.nPeak + Arena.nPeak / 4, gs_nGrowthGranule );
+            char* pBase = ( char* )HeapAllocate( nCapacity );
+            if( NULL != pBase )
+            {
+                CountHeapAllocation();
+
+                HeapFree( Arena.pBase );
+                Arena.pBase = pBase;
+                Arena.nCapacity = nCapacity;
+            }
+        }
+
+        Arena.nPeak = 0;
+    }
+
+    m_nFrameHeapAllocations = ( unsigned int )( m_nHeapAllocations - m_nHeapAllocationsAtReset );
+    m_nHeapAllocationsAtReset = m_nHeapAllocations;
+}
+
+// Overflow can happen on any context at once
+void FrameArena::CountHeapAllocation( void )
+{
+#ifdef _WIN32
+    _InterlockedIncrement( &m_nHeapAllocations );
+#else
+    __sync_add_and_fetch( &m_nHeapAllocations, 1 );
+#endif
+}
+
+void* FrameArena::HeapAllocate( size_t nBytes )
+{
+#ifdef _WIN32
+    return _aligned_malloc( nBytes, Alignment );
+#else
+    void* p = NULL;
+    return posix_memalign( &p, Alignment, nBytes ) == 0 ? p : NULL;
+#endif
+}
+
+void FrameArena::HeapFree( void* p )
+{
+#ifdef _WIN32
+    _aligned_free( p );
+#else
+    free( p );
+#endif
+}
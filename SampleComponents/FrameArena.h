@@ -0,0 +1,159 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+//---------------------------------------------------------------------------------------
+
+#ifndef __FRAMEARENA_H
+#define __FRAMEARENA_H
+
+#include <stddef.h>
+
+// FrameArena hands out transient memory that lives for at most one frame.
+// It holds one bump allocator per task context, indexed by the nContext a
+// task callback receives, so tasks allocate without locks or sharing cache
+// lines.  Every allocation is rounded to a 64 byte boundary.
+//
+// Memory is released in bulk by Reset at the end of the frame, or earlier
+// by rewinding to a marker; FrameArenaScope does that for a block of code.
+// A context that runs out of space falls back to the heap for the rest of
+// the frame, and Reset grows it to the peak it reached, so after a few
+// frames a steady workload makes no heap allocations at all.
+// GetFrameHeapAllocations reports how many the last frame made.
+//
+// Allocate and Rewind for a context must only be called by the thread
+// running that context.  Reset must be called when no task that allocates
+// is in flight.  Like gTaskMgr, the app uses the gFrameArena instance.
+class FrameArena
+{
+public:
+    FrameArena( void );
+    ~FrameArena( void );
+
+    // Create nContexts sub-arenas of nBytesPerContext each.  nContexts must
+    // cover every nContext the task manager hands out.
+    bool Init( unsigned int nContexts,
+               size_t nBytesPerContext );
+    void Shutdown( void );
+
+    // 64 byte aligned memory valid until the next Reset, or until the
+    // context is rewound past it.
+    void* Allocate( int nContext,
+                    size_t nBytes );
+
+    template< typename T >
+    T* AllocateArray( int nContext,
+                      size_t nCount )
+    {
+        return ( T* )Allocate( nContext, nCount * sizeof( T ) );
+    }
+
+    // Position of a context's bump pointer, to rewind to later.
+    struct Marker
+    {
+        size_t nOffset;
+        size_t nOverflowBytes;
+        void* pOverflow;
+    };
+
+    Marker GetMarker( int nContext ) const;
+    void Rewind( int nContext,
+                 const Marker& Mark );
+
+    // Release everything allocated this frame.  Contexts that overflowed
+    // are resized here, which is the only heap allocation Reset makes.
+    void Reset( void );
+
+    // Heap allocations made since Init, and during the last frame.
+    unsigned int GetHeapAllocations( void ) const
+    {
+        return ( unsigned int )m_nHeapAllocations;
+    }
+    unsigned int GetFrameHeapAllocations( void ) const
+    {
+        return m_nFrameHeapAllocations;
+    }
+
+    // Highest number of bytes in use by any one context during the last frame.
+    size_t GetFramePeakBytes( void ) const
+    {
+        return m_nFramePeakBytes;
+    }
+
+    // Context of the main thread, which renders.  The thread that calls
+    // gTaskMgr.Init is context 0 in both task manager backends.
+    static const int MainContext = 0;
+
+    static const size_t Alignment = 64;
+
+private:
+    struct SubArena
+    {
+        char* pBase;
+        size_t nCapacity;
+        size_t nOffset;
+        size_t nPeak;
+
+        // Heap blocks used once the base is full, newest first.
+        void* pOverflow;
+        size_t nOverflowBytes;
+
+        // Keep each context on its own cache lines
+        char Padding[ 64 - 6 * sizeof( size_t ) ];
+    };
+
+    void* AllocateOverflow( SubArena& Arena,
+                            size_t nBytes );
+    void CountHeapAllocation( void );
+    void* HeapAllocate( size_t nBytes );
+    static void HeapFree( void* p );
+
+    SubArena* m_pArenas;
+    unsigned int m_nContexts;
+
+    volatile long m_nHeapAllocations;
+    long m_nHeapAllocationsAtReset;
+    unsigned int m_nFrameHeapAllocations;
+    size_t m_nFramePeakBytes;
+};
+
+// Rewinds a context to where it was when the scope was entered.
+class FrameArenaScope
+{
+public:
+    FrameArenaScope( FrameArena& Arena,
+                     int nContext )
+        : m_Arena( Arena )
+        , m_nContext( nContext )
+        , m_Mark( Arena.GetMarker( nContext ) )
+    {
+    }
+
+    ~FrameArenaScope( void )
+    {
+        m_Arena.Rewind( m_nContext, m_Mark );
+    }
+
+private:
+    FrameArenaScope( const FrameArenaScope& );
+    FrameArenaScope& operator=( const FrameArenaScope& );
+
+    FrameArena& m_Arena;
+    int m_nContext;
+    FrameArena::Marker m_Mark;
+};
+
+extern FrameArena gFrameArena;
+
+#endif // __FRAMEARENA_H
@@ -0,0 +1,439 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+//---------------------------------------------------------------------------------------
+
+#include "FrameStats.h"
+#include "AtomicOps.h"
+#include <assert.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <intrin.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#endif
+
+FrameStats gFrameStats;
+
+// How often the writer thread drains the log ring
+static const unsigned int gs_nWriteIntervalMs = 50;
+
+static void SleepMs( unsigned int nMs )
+{
+#ifdef _WIN32
+    Sleep( nMs );
+#else
+    usleep( nMs * 1000 );
+#endif
+}
+
+FrameStats::FrameStats( void )
+    : m_pszSeriesNames( NULL )
+    , m_nSeries( 0 )
+    , m_pWindow( NULL )
+    , m_pHistograms( NULL )
+    , m_nWindowFrames( 0 )
+    , m_nWindowPos( 0 )
+    , m_nWindowFill( 0 )
+    , m_nFrame( 0 )
+    , m_szFrameEvent( NULL )
+    , m_pLogRing( NULL )
+    , m_nLogHead( 0 )
+    , m_nLogTail( 0 )
+    , m_bStopWriter( 0 )
+    , m_pFile( NULL )
+    , m_bJson( false )
+    , m_bFirstRow( true )
+    , m_nDroppedRows( 0 )
+    , m_nLogStartUs( 0 )
+{
+    for( unsigned int i = 0; i < MaxSeries; ++i )
+    {
+        m_nCurrent[i] = 0;
+        m_nLastTimes[i] = 0;
+    }
+}
+
+FrameStats::~FrameStats( void )
+{
+    Shutdown();
+}
+
+bool FrameStats::Init( const char* const* pszSeriesNames,
+                       unsigned int nSeries,
+                       unsigned int nWindowFrames )
+{
+    Shutdown();
+
+    assert( nSeries <= MaxSeries );
+    assert( nWindowFrames > 0 );
+
+    m_pszSeriesNames = pszSeriesNames;
+    m_nSeries = nSeries;
+    m_nWindowFrames = nWindowFrames;
+    m_nWindowPos = 0;
+    m_nWindowFill = 0;
+    m_nFrame = 0;
+    m_szFrameEvent = NULL;
+
+    m_pWindow = new unsigned int[ nSeries * nWindowFrames ];
+    m_pHistograms = new Histogram[ nSeries ];
+    m_pLogRing = new LogRow[ LogRingSize ];
+
+    memset( m_pHistograms, 0, nSeries * sizeof( Histogram ) );
+    for( unsigned int i = 0; i < MaxSeries; ++i )
+    {
+        m_nCurrent[i] = 0;
+        m_nLastTimes[i] = 0;
+    }
+
+    return true;
+}
+
+void FrameStats::Shutdown( void )
+{
+    StopLog();
+
+    delete[] m_pWindow;
+    delete[] m_pHistograms;
+    delete[] m_pLogRing;
+    m_pWindow = NULL;
+    m_pHistograms = NULL;
+    m_pLogRing = NULL;
+    m_nSeries = 0;
+}
+
+void FrameStats::AddTime( unsigned int nSeries,
+                          unsigned int nMicroseconds )
+{
+    assert( nSeries < m_nSeries );
+
+#ifdef _WIN32
+    _InterlockedExchangeAdd( &m_nCurrent[ nSeries ], ( long )nMicroseconds );
+#else
+    __sync_fetch_and_add( &m_nCurrent[ nSeries ], ( long )nMicroseconds );
+#endif
+}
+
+void FrameStats::EndFrame( void )
+{
+    if( NULL == m_pWindow )
+    {
+        return;
+    }
+
+    unsigned int nTimes[ MaxSeries ];
+    for( unsigned int i = 0; i < m_nSeries; ++i )
+    {
+#ifdef _WIN32
+        nTimes[i] = ( unsigned int )_InterlockedExchange( &m_nCurrent[i], 0 );
+#else
+        nTimes[i] = ( unsigned int )__sync_lock_test_and_set( &m_nCurrent[i], 0 );
+#endif
+    }
+
+    // Replace the oldest frame of the window once it is full
+    for( unsigned int i = 0; i < m_nSeries; ++i )
+    {
+        unsigned int* pSlot = &m_pWindow[ i * m_nWindowFrames + m_nWindowPos ];
+        Histogram& Hist = m_pHistograms[i];
+
+        if( m_nWindowFill == m_nWindowFrames )
+        {
+            --Hist.nCounts[ GetBucket( *pSlot ) ];
+        }
+
+        *pSlot = nTimes[i];
+        ++Hist.nCounts[ GetBucket( nTimes[i] ) ];
+        m_nLastTimes[i] = nTimes[i];
+    }
+
+    m_nWindowPos = ( m_nWindowPos + 1 ) % m_nWindowFrames;
+    if( m_nWindowFill < m_nWindowFrames )
+    {
+        ++m_nWindowFill;
+    }
+
+    if( NULL != m_pFile )
+    {
+        QueueRow( nTimes );
+    }
+
+    m_szFrameEvent = NULL;
+    ++m_nFrame;
+}
+
+FrameStats::Summary FrameStats::GetSummary( unsigned int nSeries ) const
+{
+    Summary Result;
+    Result.nP50 = GetPercentile( nSeries, 50.0 );
+    Result.nP90 = GetPercentile( nSeries, 90.0 );
+    Result.nP99 = GetPercentile( nSeries, 99.0 );
+    Result.nFrames = m_nWindowFill;
+
+    // The worst frame is found exactly, a histogram only knows its bucket
+    Result.nMax = 0;
+    const unsigned int* pWindow = &m_pWindow[ nSeries * m_nWindowFrames ];
+    for( unsigned int i = 0; i < m_nWindowFill; ++i )
+    {
+        if( pWindow[i] > Result.nMax )
+        {
+            Result.nMax = pWindow[i];
+        }
+    }
+
+    // A bucket's highest value can be past the worst frame in it
+    Result.nP50 = Result.nP50 < Result.nMax ? Result.nP50 : Result.nMax;
+    Result.nP90 = Result.nP90 < Result.nMax ? Result.nP90 : Result.nMax;
+    Result.nP99 = Result.nP99 < Result.nMax ? Result.nP99 : Result.nMax;
+
+    return Result;
+}
+
+unsigned int FrameStats::GetPercentile( unsigned int nSeries,
+                                        double fPercentile ) const
+{
+    assert( nSeries < m_nSeries );
+
+    if( 0 == m_nWindowFill )
+    {
+        return 0;
+    }
+
+    // The smallest value at least this many frames are at or below
+    unsigned int nRank = ( unsigned int )( fPercentile / 100.0 * m_nWindowFill + 0.999999 );
+    if( nRank < 1 )
+    {
+        nRank = 1;
+    }
+    if( nRank > m_nWindowFill )
+    {
+        nRank = m_nWindowFill;
+    }
+
+    const Histogram& Hist = m_pHistograms[ nSeries ];
+    unsigned int nCount = 0;
+    for( unsigned int b = 0; b < BucketCount; ++b )
+    {
+        nCount += Hist.nCounts[b];
+        if( nCount >= nRank )
+        {
+            return GetBucketValue( b );
+        }
+    }
+
+    return GetBucketValue( BucketCount - 1 );
+}
+
+// Values below 2 * SubBucketCount have a bucket each.  Above, a value with
+// its top bit at position n lands in one of SubBucketCount buckets selected
+// by the bits below the top one.
+unsigned int FrameStats::GetBucket( unsigned int nValue )
+{
+    if( nValue < 2 * SubBucketCount )
+    {
+        return nValue;
+    }
+
+    unsigned int nShift = 0;
+    while( ( nValue >> nShift ) >= 2 * SubBucketCount )
+    {
+        ++nShift;
+    }
+
+    return ( nShift + 1 ) * SubBucketCount + ( nValue >> nShift ) - SubBucketCount;
+}
+
+// Highest value that falls into a bucket
+unsigned int FrameStats::GetBucketValue( unsigned int nBucket )
+{
+    if( nBucket < 2 * SubBucketCount )
+    {
+        return nBucket;
+    }
+
+    unsigned int nShift = nBucket / SubBucketCount - 1;
+    unsigned long long nTop = ( unsigned long long )( nBucket % SubBucketCount + SubBucketCount + 1 ) << nShift;
+    return ( unsigned int )( nTop - 1 );
+}
+
+bool FrameStats::StartLog( const char* szFileName )
+{
+    if( NULL != m_pFile || NULL == m_pLogRing )
+    {
+        return false;
+    }
+
+    m_pFile = fopen( szFileName, "w" );
+    if( NULL == m_pFile )
+    {
+        return false;
+    }
+
+    size_t nLength = strlen( szFileName );
+    m_bJson = nLength >= 5 && 0 == strcmp( szFileName + nLength - 5, ".json" );
+    m_bFirstRow = true;
+    m_nDroppedRows = 0;
+    m_nLogStartUs = GetTimeUs();
+    m_nLogHead = 0;
+    m_nLogTail = 0;
+
+    // Times are in microseconds
+    if( m_bJson )
+    {
+        fputs( "[\n", m_pFile );
+    }
+    else
+    {
+        fputs( "frame,time_us,event", m_pFile );
+        for( unsigned int i = 0; i < m_nSeries; ++i )
+        {
+            fprintf( m_pFile, ",%s", m_pszSeriesNames[i] );
+        }
+        fputc( '\n', m_pFile );
+    }
+
+    m_bStopWriter = 0;
+#ifdef _WIN32
+    m_hWriterThread = CreateThread( NULL, 0, WriterThread, this, 0, NULL );
+#else
+    pthread_create( &m_WriterThread, NULL, WriterThread, this );
+#endif
+
+    return true;
+}
+
+void FrameStats::StopLog( void )
+{
+    if( NULL == m_pFile )
+    {
+        return;
+    }
+
+    StoreRelease( &m_bStopWriter, 1L );
+
+#ifdef _WIN32
+    WaitForSingleObject( m_hWriterThread, INFINITE );
+    CloseHandle( m_hWriterThread );
+#else
+    pthread_join( m_WriterThread, NULL );
+#endif
+
+    Drain();
+
+    if( m_bJson )
+    {
+        fputs( "\n]\n", m_pFile );
+    }
+
+    fclose( m_pFile );
+    m_pFile = NULL;
+}
+
+void FrameStats::QueueRow( const unsigned int* pTimes )
+{
+    unsigned int nHead = m_nLogHead;
+    if( nHead - LoadAcquire( &m_nLogTail ) >= LogRingSize )
+    {
+        ++m_nDroppedRows;
+        return;
+    }
+
+    LogRow& Row = m_pLogRing[ nHead & ( LogRingSize - 1 ) ];
+    Row.nFrame = m_nFrame;
+    Row.nTimeUs = GetTimeUs() - m_nLogStartUs;
+    Row.szEvent = m_szFrameEvent;
+    memcpy( Row.nTimes, pTimes, m_nSeries * sizeof( unsigned int ) );
+
+    StoreRelease( &m_nLogHead, nHead + 1 );
+}
+
+// Only one thread drains at a time: the writer thread while the log is
+// open, and StopLog once it has finished.
+void FrameStats::Drain( void )
+{
+    unsigned int nHead = LoadAcquire( &m_nLogHead );
+    unsigned int nTail = m_nLogTail;
+
+    for( ; nTail != nHead; ++nTail )
+    {
+        WriteRow( m_pLogRing[ nTail & ( LogRingSize - 1 ) ] );
+    }
+
+    StoreRelease( &m_nLogTail, nHead );
+}
+
+void FrameStats::WriteRow( const LogRow& Row )
+{
+    if( m_bJson )
+    {
+        fprintf( m_pFile, "%s{\"frame\":%llu,\"time_us\":%llu", m_bFirstRow ? "" : ",\n", Row.nFrame, Row.nTimeUs );
+        if( NULL != Row.szEvent )
+        {
+            fprintf( m_pFile, ",\"event\":\"%s\"", Row.szEvent );
+        }
+        for( unsigned int i = 0; i < m_nSeries; ++i )
+        {
+            fprintf( m_pFile, ",\"%s\":%u", m_pszSeriesNames[i], Row.nTimes[i] );
+        }
+        fputc( '}', m_pFile );
+    }
+    else
+    {
+        fprintf( m_pFile, "%llu,%llu,%s", Row.nFrame, Row.nTimeUs, NULL != Row.szEvent ? Row.szEvent : "" );
+        for( unsigned int i = 0; i < m_nSeries; ++i )
+        {
+            fprintf( m_pFile, ",%u", Row.nTimes[i] );
+        }
+        fputc( '\n', m_pFile );
+    }
+
+    m_bFirstRow = false;
+}
+
+unsigned long long FrameStats::GetTimeUs( void )
+{
+#ifdef _WIN32
+    LARGE_INTEGER Frequency;
+    LARGE_INTEGER Counter;
+    QueryPerformanceFrequency( &Frequency );
+    QueryPerformanceCounter( &Counter );
+    return ( unsigned long long )( ( double )Counter.QuadPart * 1e6 / ( double )Frequency.QuadPart );
+#else
+    timespec Now;
+    clock_gettime( CLOCK_MONOTONIC, &Now );
+    return ( unsigned long long )Now.tv_sec * 1000000ull + ( unsigned long long )Now.tv_nsec / 1000ull;
+#endif
+}
+
+#ifdef _WIN32
+unsigned long __stdcall FrameStats::WriterThread( void* pArg )
+#else
+void* FrameStats::WriterThread( void* pArg )
+#endif
+{
+    FrameStats* pStats = ( FrameStats* )pArg;
+
+    while( !LoadAcquire( &pStats->m_bStopWriter ) )
+    {
+        pStats->Drain();
+        SleepMs( gs_nWriteIntervalMs );
+    }
+
+    return 0;
+}
@@ -0,0 +1,230 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+//---------------------------------------------------------------------------------------
+
+#ifndef __FRAMESTATS_H
+#define __FRAMESTATS_H
+
+#include <stdio.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+// FrameStats keeps the distribution of frame times, and of the time spent
+// in each phase of a frame, over a rolling window of recent frames.  An
+// average hides the hitches that players notice, so it reports the 50th,
+// 90th and 99th percentiles and the worst frame of the window.
+//
+// The app names its series at Init.  Times are added to the frame in
+// progress with AddTime or a FrameStatsScope, from any thread; tasks that
+// run the same phase on several workers add up to the phase's busy time.
+// EndFrame closes the frame and moves it into the window.  Each series
+// keeps a histogram with 32 buckets per power of two of microseconds, so a
+// percentile is within about 3% of the exact value, while the worst frame
+// is exact.
+//
+// StartLog also writes every frame to a CSV file, or to a JSON file if the
+// name ends in .json.  EndFrame only copies the frame into a ring buffer
+// and a background thread formats and writes it, so logging never waits
+// on the disk.  Rows that find the ring full are dropped and counted.
+// MarkFrame tags the current frame in the log, for example with a reset,
+// to tell a hitch's cause.
+//
+// Init, EndFrame, MarkFrame and the log calls belong to the main thread.
+// Like gTaskMgr, the app uses the gFrameStats instance.
+class FrameStats
+{
+public:
+    FrameStats( void );
+    ~FrameStats( void );
+
+    // Keep nWindowFrames frames of each series.  The series names are kept
+    // by pointer.
+    bool Init( const char* const* pszSeriesNames,
+               unsigned int nSeries,
+               unsigned int nWindowFrames );
+    void Shutdown( void );
+
+    // Add time to a series of the frame in progress.  Safe from any thread.
+    void AddTime( unsigned int nSeries,
+                  unsigned int nMicroseconds );
+
+    // Tag the frame in progress in the log.  The event is kept by pointer
+    // until the row is written; a later mark in the same frame replaces it.
+    void MarkFrame( const char* szEvent )
+    {
+        m_szFrameEvent = szEvent;
+    }
+
+    // Close the frame in progress and start the next one.
+    void EndFrame( void );
+
+    // Distribution of a series over the window, in microseconds.
+    struct Summary
+    {
+        unsigned int nP50;
+        unsigned int nP90;
+        unsigned int nP99;
+        unsigned int nMax;
+        unsigned int nFrames;
+    };
+
+    Summary GetSummary( unsigned int nSeries ) const;
+
+    // Time of a series in the last closed frame, in microseconds.
+    unsigned int GetLastTime( unsigned int nSeries ) const
+    {
+        return m_nLastTimes[ nSeries ];
+    }
+    unsigned int GetPercentile( unsigned int nSeries,
+                                double fPercentile ) const;
+
+    unsigned int GetSeriesCount( void ) const
+    {
+        return m_nSeries;
+    }
+    const char* GetSeriesName( unsigned int nSeries ) const
+    {
+        return m_pszSeriesNames[ nSeries ];
+    }
+
+    // Begin writing every frame to szFileName.  Fails if a log is already
+    // open or the file cannot be created.
+    bool StartLog( const char* szFileName );
+
+    // Write out the rows still queued and close the file.
+    void StopLog( void );
+
+    bool IsLogging( void ) const
+    {
+        return NULL != m_pFile;
+    }
+
+    // Rows dropped on a full ring since StartLog.
+    unsigned int GetDroppedRows( void ) const
+    {
+        return m_nDroppedRows;
+    }
+
+    // Microseconds of a monotonic clock.
+    static unsigned long long GetTimeUs( void );
+
+    static const unsigned int MaxSeries = 16;
+
+    // Frames the log ring holds, a power of two.
+    static const unsigned int LogRingSize = 1024;
+
+    // Histogram buckets: the values below 64 exactly, then 32 per power of
+    // two up to 2^32.
+    static const unsigned int SubBucketCount = 32;
+    static const unsigned int BucketCount = 28 * SubBucketCount;
+
+private:
+    struct Histogram
+    {
+        unsigned int nCounts[ BucketCount ];
+    };
+
+    struct LogRow
+    {
+        unsigned long long nFrame;
+        unsigned long long nTimeUs;
+        const char* szEvent;
+        unsigned int nTimes[ MaxSeries ];
+    };
+
+    FrameStats( const FrameStats& );
+    FrameStats& operator=( const FrameStats& );
+
+    static unsigned int GetBucket( unsigned int nValue );
+    static unsigned int GetBucketValue( unsigned int nBucket );
+
+    void QueueRow( const unsigned int* pTimes );
+    void Drain( void );
+    void WriteRow( const LogRow& Row );
+
+#ifdef _WIN32
+    static unsigned long __stdcall WriterThread( void* pArg );
+#else
+    static void* WriterThread( void* pArg );
+#endif
+
+    const char* const* m_pszSeriesNames;
+    unsigned int m_nSeries;
+
+    // Time added to the frame in progress, per series
+    volatile long m_nCurrent[ MaxSeries ];
+    unsigned int m_nLastTimes[ MaxSeries ];
+
+    // The last nWindowFrames times of each series, oldest at m_nWindowPos
+    // once the window is full, and their histograms.
+    unsigned int* m_pWindow;
+    Histogram* m_pHistograms;
+    unsigned int m_nWindowFrames;
+    unsigned int m_nWindowPos;
+    unsigned int m_nWindowFill;
+
+    unsigned long long m_nFrame;
+    const char* m_szFrameEvent;
+
+    // Log ring; the main thread writes the head, the writer thread the tail.
+    LogRow* m_pLogRing;
+    volatile unsigned int m_nLogHead;
+    char HeadPadding[ 64 - sizeof( unsigned int ) ];
+    volatile unsigned int m_nLogTail;
+    char TailPadding[ 64 - sizeof( unsigned int ) ];
+
+    volatile long m_bStopWriter;
+    FILE* m_pFile;
+    bool m_bJson;
+    bool m_bFirstRow;
+    unsigned int m_nDroppedRows;
+    unsigned long long m_nLogStartUs;
+
+#ifdef _WIN32
+    void* m_hWriterThread;
+#else
+    pthread_t m_WriterThread;
+#endif
+};
+
+extern FrameStats gFrameStats;
+
+// Adds the time spent in the enclosing block to a series.
+class FrameStatsScope
+{
+public:
+    FrameStatsScope( unsigned int nSeries )
+        : m_nSeries( nSeries )
+        , m_nBegin( FrameStats::GetTimeUs() )
+    {
+    }
+
+    ~FrameStatsScope( void )
+    {
+        gFrameStats.AddTime( m_nSeries, ( unsigned int )( FrameStats::GetTimeUs() - m_nBegin ) );
+    }
+
+private:
+    FrameStatsScope( const FrameStatsScope& );
+    FrameStatsScope& operator=( const FrameStatsScope& );
+
+    unsigned int m_nSeries;
+    unsigned long long m_nBegin;
+};
+
+#endif // __FRAMESTATS_H
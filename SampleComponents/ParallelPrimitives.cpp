@@ -0,0 +1,705 @@
+/*!
+    \file ParallelPrimitives.cpp
+
+    Implementation of the data-parallel primitives in ParallelPrimitives.h.
+    Every primitive follows the same pattern: a first task set works out a
+    per task partial (a sum, a count or a histogram), the main thread
+    combines the partials serially, and a second task set, if needed, uses
+    the combined result to write its range.
+
+    Copyright 2010 Intel Corporation
+    All Rights Reserved
+
+    Permission is granted to use, copy, distribute and prepare derivative works of this
+    software for any purpose and without fee, provided, that the above copyright notice
+    and this statement appear in all copies.  Intel makes no representations about the
+    suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED ""AS IS.""
+    INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+    INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+    INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+    assume any responsibility for any errors which may appear in this software nor any
+    responsibility to update it.
+*/
+#include "ParallelPrimitives.h"
+
+#include <string.h>
+
+#if defined( _M_IX86 ) || defined( _M_X64 ) || defined( __SSE2__ )
+#define PARALLEL_SSE2
+#include <emmintrin.h>
+#endif
+
+extern TaskMgrTbb gTaskMgr;
+
+//
+//  INTERNAL
+//  Ranges are multiples of 16 elements so every task but the last starts
+//  on a whole SIMD register of any element type used here.
+//
+static UINT
+GetTaskCount(
+    UINT                        uCount )
+{
+    UINT uTasks = uCount / PARALLEL_MIN_GRAIN;
+
+    if( uTasks < 1 )
+    {
+        uTasks = 1;
+    }
+    else if( uTasks > PARALLEL_MAX_TASKS )
+    {
+        uTasks = PARALLEL_MAX_TASKS;
+    }
+
+    return uTasks;
+}
+
+static VOID
+GetTaskRange(
+    UINT                        uTask,
+    UINT                        uTaskCount,
+    UINT                        uCount,
+    UINT*                       puStart,
+    UINT*                       puEnd )
+{
+    UINT uChunk = ( ( uCount + uTaskCount - 1 ) / uTaskCount + 15 ) & ~15u;
+
+    *puStart = uChunk * uTask < uCount ? uChunk * uTask : uCount;
+    *puEnd = *puStart + uChunk < uCount ? *puStart + uChunk : uCount;
+}
+
+//
+//  INTERNAL
+//  Run uTaskCount tasks and wait for them.  A single task is run inline
+//  so small inputs never touch the scheduler.
+//
+static VOID
+RunTasks(
+    TASKSETFUNC                 pFunc,
+    VOID*                       pArg,
+    UINT                        uTaskCount,
+    LPCSTR                      szSetName )
+{
+    if( 1 == uTaskCount )
+    {
+        pFunc( pArg, 0, 0, 1 );
+        return;
+    }
+
+    TASKSETHANDLE               hSet;
+
+    gTaskMgr.CreateTaskSet( pFunc, pArg, uTaskCount, NULL, 0, szSetName, &hSet );
+    gTaskMgr.WaitForSet( hSet );
+    gTaskMgr.ReleaseHandle( hSet );
+}
+
+//////////////////////////////////////////////////////////////////////////////////////
+// Scan
+//////////////////////////////////////////////////////////////////////////////////////
+
+struct ScanArgs
+{
+    const UINT*                 pIn;
+    UINT*                       pOut;
+    UINT                        uCount;
+    UINT                        uTotal;
+    UINT                        uPartials[ PARALLEL_MAX_TASKS ];
+};
+
+static UINT
+SumRange(
+    const UINT*                 pIn,
+    UINT                        uStart,
+    UINT                        uEnd )
+{
+    UINT uSum = 0;
+    UINT uIdx = uStart;
+
+#ifdef PARALLEL_SSE2
+    __m128i Sum = _mm_setzero_si128();
+    for( ; uIdx + 4 <= uEnd; uIdx += 4 )
+    {
+        Sum = _mm_add_epi32( Sum, _mm_loadu_si128( ( const __m128i* )( pIn + uIdx ) ) );
+    }
+
+    Sum = _mm_add_epi32( Sum, _mm_srli_si128( Sum, 8 ) );
+    Sum = _mm_add_epi32( Sum, _mm_srli_si128( Sum, 4 ) );
+    uSum = ( UINT )_mm_cvtsi128_si32( Sum );
+#endif
+
+    for( ; uIdx < uEnd; ++uIdx )
+    {
+        uSum += pIn[ uIdx ];
+    }
+
+    return uSum;
+}
+
+static VOID
+ScanSumTask(
+    VOID*                       pvArgs,
+    INT                         iContext,
+    UINT                        uTaskId,
+    UINT                        uTaskCount )
+{
+    ScanArgs*                   pArgs = ( ScanArgs* )pvArgs;
+    UINT                        uStart, uEnd;
+
+    UNREFERENCED_PARAMETER( iContext );
+
+    GetTaskRange( uTaskId, uTaskCount, pArgs->uCount, &uStart, &uEnd );
+    pArgs->uPartials[ uTaskId ] = SumRange( pArgs->pIn, uStart, uEnd );
+}
+
+static VOID
+ScanWriteTask(
+    VOID*                       pvArgs,
+    INT                         iContext,
+    UINT                        uTaskId,
+    UINT                        uTaskCount )
+{
+    ScanArgs*                   pArgs = ( ScanArgs* )pvArgs;
+    const UINT*                 pIn = pArgs->pIn;
+    UINT*                       pOut = pArgs->pOut;
+    UINT                        uStart, uEnd;
+    UINT                        uCarry = pArgs->uPartials[ uTaskId ];
+    UINT                        uIdx;
+
+    UNREFERENCED_PARAMETER( iContext );
+
+    GetTaskRange( uTaskId, uTaskCount, pArgs->uCount, &uStart, &uEnd );
+    uIdx = uStart;
+
+#ifdef PARALLEL_SSE2
+    //
+    //  Inclusive scan inside the register by two shifted adds, then shift
+    //  by one lane to make it exclusive and add the running carry.
+    //
+    __m128i Carry = _mm_set1_epi32( ( int )uCarry );
+    for( ; uIdx + 4 <= uEnd; uIdx += 4 )
+    {
+        __m128i X = _mm_loadu_si128( ( const __m128i* )( pIn + uIdx ) );
+        __m128i Inclusive = _mm_add_epi32( X, _mm_slli_si128( X, 4 ) );
+        Inclusive = _mm_add_epi32( Inclusive, _mm_slli_si128( Inclusive, 8 ) );
+
+        __m128i Exclusive = _mm_add_epi32( _mm_slli_si128( Inclusive, 4 ), Carry );
+        _mm_storeu_si128( ( __m128i* )( pOut + uIdx ), Exclusive );
+
+        Carry = _mm_add_epi32( Carry, _mm_shuffle_epi32( Inclusive, _MM_SHUFFLE( 3, 3, 3, 3 ) ) );
+    }
+    uCarry = ( UINT )_mm_cvtsi128_si32( Carry );
+#endif
+
+    for( ; uIdx < uEnd; ++uIdx )
+    {
+        UINT uValue = pIn[ uIdx ];
+        pOut[ uIdx ] = uCarry;
+        uCarry += uValue;
+    }
+
+    if( uTaskId + 1 == uTaskCount )
+    {
+        pArgs->uTotal = uCarry;
+    }
+}
+
+UINT
+ParallelScan(
+    const UINT*                 pIn,
+    UINT*                       pOut,
+    UINT                        uCount )
+{
+    ScanArgs                    Args;
+    UINT                        uTaskCount = GetTaskCount( uCount );
+    UINT                        uOffset = 0;
+
+    Args.pIn = pIn;
+    Args.pOut = pOut;
+    Args.uCount = uCount;
+
+    if( uTaskCount > 1 )
+    {
+        RunTasks( ScanSumTask, &Args, uTaskCount, "ParallelScan" );
+    }
+
+    //  Turn the range sums into each range's starting offset.  A single
+    //  range starts at zero and needs no sums.
+    for( UINT uTask = 0; uTask < uTaskCount; ++uTask )
+    {
+        UINT uSum = uTaskCount > 1 ? Args.uPartials[ uTask ] : 0;
+        Args.uPartials[ uTask ] = uOffset;
+        uOffset += uSum;
+    }
+
+    RunTasks( ScanWriteTask, &Args, uTaskCount, "ParallelScan" );
+
+    return Args.uTotal;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////
+// Reduce
+//////////////////////////////////////////////////////////////////////////////////////
+
+struct ReduceArgs
+{
+    const FLOAT*                pIn;
+    UINT                        uCount;
+    PARALLELREDUCEOP            eOp;
+    FLOAT                       fPartials[ PARALLEL_MAX_TASKS ];
+};
+
+//
+//  INTERNAL
+//  Operators as types so each reduce loop is compiled without a branch on
+//  the operator.
+//
+struct ReduceSum
+{
+    static FLOAT Apply( FLOAT fA, FLOAT fB ) { return fA + fB; }
+#ifdef PARALLEL_SSE2
+    static __m128 Apply( __m128 A, __m128 B ) { return _mm_add_ps( A, B ); }
+#endif
+};
+
+struct ReduceMin
+{
+    static FLOAT Apply( FLOAT fA, FLOAT fB ) { return fA < fB ? fA : fB; }
+#ifdef PARALLEL_SSE2
+    static __m128 Apply( __m128 A, __m128 B ) { return _mm_min_ps( A, B ); }
+#endif
+};
+
+struct ReduceMax
+{
+    static FLOAT Apply( FLOAT fA, FLOAT fB ) { return fA > fB ? fA : fB; }
+#ifdef PARALLEL_SSE2
+    static __m128 Apply( __m128 A, __m128 B ) { return _mm_max_ps( A, B ); }
+#endif
+};
+
+//  Reduce a non-empty range, starting from fInit.
+template< typename Op >
+static FLOAT
+ReduceRange(
+    const FLOAT*                pIn,
+    UINT                        uStart,
+    UINT                        uEnd,
+    FLOAT                       fInit )
+{
+    FLOAT fResult = fInit;
+    UINT uIdx = uStart;
+
+#ifdef PARALLEL_SSE2
+    if( uIdx + 16 <= uEnd )
+    {
+        //  Four independent accumulators hide the instruction latency.
+        __m128 Acc0 = _mm_set1_ps( fInit );
+        __m128 Acc1 = Acc0;
+        __m128 Acc2 = Acc0;
+        __m128 Acc3 = Acc0;
+
+        for( ; uIdx + 16 <= uEnd; uIdx += 16 )
+        {
+            Acc0 = Op::Apply( Acc0, _mm_loadu_ps( pIn + uIdx ) );
+            Acc1 = Op::Apply( Acc1, _mm_loadu_ps( pIn + uIdx + 4 ) );
+            Acc2 = Op::Apply( Acc2, _mm_loadu_ps( pIn + uIdx + 8 ) );
+            Acc3 = Op::Apply( Acc3, _mm_loadu_ps( pIn + uIdx + 12 ) );
+        }
+
+        FLOAT fLanes[ 4 ];
+        _mm_storeu_ps( fLanes, Op::Apply( Op::Apply( Acc0, Acc1 ), Op::Apply( Acc2, Acc3 ) ) );
+
+        //  Every lane starts from fInit, which is zero for a sum and an
+        //  element of the range for min and max.
+        fResult = Op::Apply( Op::Apply( fLanes[0], fLanes[1] ), Op::Apply( fLanes[2], fLanes[3] ) );
+    }
+#endif
+
+    for( ; uIdx < uEnd; ++uIdx )
+    {
+        fResult = Op::Apply( fResult, pIn[ uIdx ] );
+    }
+
+    return fResult;
+}
+
+static VOID
+ReduceTask(
+    VOID*                       pvArgs,
+    INT                         iContext,
+    UINT                        uTaskId,
+    UINT                        uTaskCount )
+{
+    ReduceArgs*                 pArgs = ( ReduceArgs* )pvArgs;
+    const FLOAT*                pIn = pArgs->pIn;
+    UINT                        uStart, uEnd;
+
+    UNREFERENCED_PARAMETER( iContext );
+
+    GetTaskRange( uTaskId, uTaskCount, pArgs->uCount, &uStart, &uEnd );
+
+    //  Min and max start from an element of the range, or of the array for
+    //  an empty trailing range, which cannot change the result.
+    FLOAT fFirst = pIn[ uStart < uEnd ? uStart : 0 ];
+
+    switch( pArgs->eOp )
+    {
+    case PARALLELREDUCE_MIN:
+        pArgs->fPartials[ uTaskId ] = ReduceRange< ReduceMin >( pIn, uStart, uEnd, fFirst );
+        break;
+    case PARALLELREDUCE_MAX:
+        pArgs->fPartials[ uTaskId ] = ReduceRange< ReduceMax >( pIn, uStart, uEnd, fFirst );
+        break;
+    default:
+        pArgs->fPartials[ uTaskId ] = ReduceRange< ReduceSum >( pIn, uStart, uEnd, 0.0f );
+        break;
+    }
+}
+
+FLOAT
+ParallelReduce(
+    const FLOAT*                pIn,
+    UINT                        uCount,
+    PARALLELREDUCEOP            eOp )
+{
+    ReduceArgs                  Args;
+    UINT                        uTaskCount = GetTaskCount( uCount );
+
+    if( 0 == uCount )
+    {
+        return 0.0f;
+    }
+
+    Args.pIn = pIn;
+    Args.uCount = uCount;
+    Args.eOp = eOp;
+
+    RunTasks( ReduceTask, &Args, uTaskCount, "ParallelReduce" );
+
+    FLOAT fResult = Args.fPartials[0];
+    for( UINT uTask = 1; uTask < uTaskCount; ++uTask )
+    {
+        switch( eOp )
+        {
+        case PARALLELREDUCE_MIN:
+            fResult = ReduceMin::Apply( fResult, Args.fPartials[ uTask ] );
+            break;
+        case PARALLELREDUCE_MAX:
+            fResult = ReduceMax::Apply( fResult, Args.fPartials[ uTask ] );
+            break;
+        default:
+            fResult = ReduceSum::Apply( fResult, Args.fPartials[ uTask ] );
+            break;
+        }
+    }
+
+    return fResult;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////
+// Compact
+//////////////////////////////////////////////////////////////////////////////////////
+
+struct CompactArgs
+{
+    const BYTE*                 pIn;
+    BYTE*                       pOut;
+    UINT                        uElementSize;
+    const BYTE*                 pKeep;
+    UINT                        uCount;
+    UINT                        uOffsets[ PARALLEL_MAX_TASKS ];
+};
+
+static UINT
+CountBits(
+    UINT                        uBits )
+{
+    uBits = uBits - ( ( uBits >> 1 ) & 0x55555555 );
+    uBits = ( uBits & 0x33333333 ) + ( ( uBits >> 2 ) & 0x33333333 );
+    return ( ( ( uBits + ( uBits >> 4 ) ) & 0x0F0F0F0F ) * 0x01010101 ) >> 24;
+}
+
+static VOID
+CompactCountTask(
+    VOID*                       pvArgs,
+    INT                         iContext,
+    UINT                        uTaskId,
+    UINT                        uTaskCount )
+{
+    CompactArgs*                pArgs = ( CompactArgs* )pvArgs;
+    const BYTE*                 pKeep = pArgs->pKeep;
+    UINT                        uStart, uEnd;
+    UINT                        uKept = 0;
+
+    UNREFERENCED_PARAMETER( iContext );
+
+    GetTaskRange( uTaskId, uTaskCount, pArgs->uCount, &uStart, &uEnd );
+    UINT uIdx = uStart;
+
+#ifdef PARALLEL_SSE2
+    //  Sixteen flags per compare; the mask has a bit per flag set to zero.
+    __m128i Zero = _mm_setzero_si128();
+    for( ; uIdx + 16 <= uEnd; uIdx += 16 )
+    {
+        __m128i Flags = _mm_loadu_si128( ( const __m128i* )( pKeep + uIdx ) );
+        UINT uZero = ( UINT )_mm_movemask_epi8( _mm_cmpeq_epi8( Flags, Zero ) );
+        uKept += 16 - CountBits( uZero );
+    }
+#endif
+
+    for( ; uIdx < uEnd; ++uIdx )
+    {
+        uKept += pKeep[ uIdx ] ? 1 : 0;
+    }
+
+    pArgs->uOffsets[ uTaskId ] = uKept;
+}
+
+static VOID
+CompactWriteTask(
+    VOID*                       pvArgs,
+    INT                         iContext,
+    UINT                        uTaskId,
+    UINT                        uTaskCount )
+{
+    CompactArgs*                pArgs = ( CompactArgs* )pvArgs;
+    const BYTE*                 pKeep = pArgs->pKeep;
+    const UINT                  uSize = pArgs->uElementSize;
+    UINT                        uStart, uEnd;
+
+    UNREFERENCED_PARAMETER( iContext );
+
+    GetTaskRange( uTaskId, uTaskCount, pArgs->uCount, &uStart, &uEnd );
+
+    BYTE* pOut = pArgs->pOut + ( size_t )pArgs->uOffsets[ uTaskId ] * uSize;
+    UINT uIdx = uStart;
+
+#ifdef PARALLEL_SSE2
+    //  Runs of sixteen kept or dropped elements are handled in one go.
+    __m128i Zero = _mm_setzero_si128();
+    for( ; uIdx + 16 <= uEnd; uIdx += 16 )
+    {
+        __m128i Flags = _mm_loadu_si128( ( const __m128i* )( pKeep + uIdx ) );
+        UINT uZero = ( UINT )_mm_movemask_epi8( _mm_cmpeq_epi8( Flags, Zero ) );
+
+        if( 0xFFFF == uZero )
+        {
+            continue;
+        }
+
+        if( 0 == uZero )
+        {
+            memcpy( pOut, pArgs->pIn + ( size_t )uIdx * uSize, 16 * uSize );
+            pOut += 16 * uSize;
+            continue;
+        }
+
+        for( UINT uBit = 0; uBit < 16; ++uBit )
+        {
+            if( 0 == ( uZero & ( 1u << uBit ) ) )
+            {
+                memcpy( pOut, pArgs->pIn + ( size_t )( uIdx + uBit ) * uSize, uSize );
+                pOut += uSize;
+            }
+        }
+    }
+#endif
+
+    for( ; uIdx < uEnd; ++uIdx )
+    {
+        if( pKeep[ uIdx ] )
+        {
+            memcpy( pOut, pArgs->pIn + ( size_t )uIdx * uSize, uSize );
+            pOut += uSize;
+        }
+    }
+}
+
+UINT
+ParallelCompact(
+    const VOID*                 pIn,
+    VOID*                       pOut,
+    UINT                        uElementSize,
+    const BYTE*                 pKeep,
+    UINT                        uCount )
+{
+    CompactArgs                 Args;
+    UINT                        uTaskCount = GetTaskCount( uCount );
+    UINT                        uTotal = 0;
+
+    Args.pIn = ( const BYTE* )pIn;
+    Args.pOut = ( BYTE* )pOut;
+    Args.uElementSize = uElementSize;
+    Args.pKeep = pKeep;
+    Args.uCount = uCount;
+
+    RunTasks( CompactCountTask, &Args, uTaskCount, "ParallelCompact" );
+
+    for( UINT uTask = 0; uTask < uTaskCount; ++uTask )
+    {
+        UINT uKept = Args.uOffsets[ uTask ];
+        Args.uOffsets[ uTask ] = uTotal;
+        uTotal += uKept;
+    }
+
+    RunTasks( CompactWriteTask, &Args, uTaskCount, "ParallelCompact" );
+
+    return uTotal;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////
+// Radix sort
+//////////////////////////////////////////////////////////////////////////////////////
+
+#define RADIX_BITS      8
+#define RADIX_BUCKETS   ( 1 << RADIX_BITS )
+#define RADIX_PASSES    ( 32 / RADIX_BITS )
+
+struct RadixArgs
+{
+    const UINT*                 pKeysIn;
+    const UINT*                 pValuesIn;
+    UINT*                       pKeysOut;
+    UINT*                       pValuesOut;
+    UINT                        uCount;
+    UINT                        uShift;
+
+    //  Bucket counts per task, turned into each task's first slot per
+    //  bucket before the scatter.
+    UINT                        uHistograms[ PARALLEL_MAX_TASKS ][ RADIX_BUCKETS ];
+};
+
+static VOID
+RadixHistogramTask(
+    VOID*                       pvArgs,
+    INT                         iContext,
+    UINT                        uTaskId,
+    UINT                        uTaskCount )
+{
+    RadixArgs*                  pArgs = ( RadixArgs* )pvArgs;
+    const UINT*                 pKeys = pArgs->pKeysIn;
+    const UINT                  uShift = pArgs->uShift;
+    UINT*                       puHistogram = pArgs->uHistograms[ uTaskId ];
+    UINT                        uStart, uEnd;
+
+    UNREFERENCED_PARAMETER( iContext );
+
+    GetTaskRange( uTaskId, uTaskCount, pArgs->uCount, &uStart, &uEnd );
+
+    memset( puHistogram, 0, RADIX_BUCKETS * sizeof( UINT ) );
+    for( UINT uIdx = uStart; uIdx < uEnd; ++uIdx )
+    {
+        ++puHistogram[ ( pKeys[ uIdx ] >> uShift ) & ( RADIX_BUCKETS - 1 ) ];
+    }
+}
+
+static VOID
+RadixScatterTask(
+    VOID*                       pvArgs,
+    INT                         iContext,
+    UINT                        uTaskId,
+    UINT                        uTaskCount )
+{
+    RadixArgs*                  pArgs = ( RadixArgs* )pvArgs;
+    const UINT*                 pKeys = pArgs->pKeysIn;
+    const UINT*                 pValues = pArgs->pValuesIn;
+    const UINT                  uShift = pArgs->uShift;
+    UINT*                       puOffsets = pArgs->uHistograms[ uTaskId ];
+    UINT                        uStart, uEnd;
+
+    UNREFERENCED_PARAMETER( iContext );
+
+    GetTaskRange( uTaskId, uTaskCount, pArgs->uCount, &uStart, &uEnd );
+
+    for( UINT uIdx = uStart; uIdx < uEnd; ++uIdx )
+    {
+        UINT uKey = pKeys[ uIdx ];
+        UINT uSlot = puOffsets[ ( uKey >> uShift ) & ( RADIX_BUCKETS - 1 ) ]++;
+
+        pArgs->pKeysOut[ uSlot ] = uKey;
+        if( NULL != pValues )
+        {
+            pArgs->pValuesOut[ uSlot ] = pValues[ uIdx ];
+        }
+    }
+}
+
+VOID
+ParallelRadixSort(
+    UINT*                       pKeys,
+    UINT*                       pValues,
+    UINT*                       pTempKeys,
+    UINT*                       pTempValues,
+    UINT                        uCount )
+{
+    //  The per task histograms, 64 KB, live on the main thread's stack.
+    RadixArgs                   Args;
+    UINT                        uTaskCount = GetTaskCount( uCount );
+
+    Args.pKeysIn = pKeys;
+    Args.pValuesIn = pValues;
+    Args.pKeysOut = pTempKeys;
+    Args.pValuesOut = pTempValues;
+    Args.uCount = uCount;
+
+    for( UINT uPass = 0; uPass < RADIX_PASSES; ++uPass )
+    {
+        Args.uShift = uPass * RADIX_BITS;
+
+        RunTasks( RadixHistogramTask, &Args, uTaskCount, "ParallelRadixSort" );
+
+        //
+        //  Bucket-major, task-minor offsets keep equal digits in input
+        //  order, which makes each pass stable.  A digit shared by every
+        //  key does not reorder anything and the pass is skipped.
+        //
+        UINT uTotal = 0;
+        BOOL bSkip = FALSE;
+
+        for( UINT uBucket = 0; uBucket < RADIX_BUCKETS && !bSkip; ++uBucket )
+        {
+            UINT uBucketTotal = 0;
+            for( UINT uTask = 0; uTask < uTaskCount; ++uTask )
+            {
+                uBucketTotal += Args.uHistograms[ uTask ][ uBucket ];
+            }
+            bSkip = uBucketTotal == uCount;
+        }
+
+        if( bSkip )
+        {
+            continue;
+        }
+
+        for( UINT uBucket = 0; uBucket < RADIX_BUCKETS; ++uBucket )
+        {
+            for( UINT uTask = 0; uTask < uTaskCount; ++uTask )
+            {
+                UINT uBucketCount = Args.uHistograms[ uTask ][ uBucket ];
+                Args.uHistograms[ uTask ][ uBucket ] = uTotal;
+                uTotal += uBucketCount;
+            }
+        }
+
+        RunTasks( RadixScatterTask, &Args, uTaskCount, "ParallelRadixSort" );
+
+        //  Ping-pong between the caller's arrays and the scratch arrays.
+        const UINT* pKeysIn = Args.pKeysIn;
+        const UINT* pValuesIn = Args.pValuesIn;
+        Args.pKeysIn = Args.pKeysOut;
+        Args.pValuesIn = NULL != pValues ? Args.pValuesOut : NULL;
+        Args.pKeysOut = ( UINT* )pKeysIn;
+        Args.pValuesOut = ( UINT* )pValuesIn;
+    }
+
+    //  An odd number of passes leaves the result in the scratch arrays.
+    if( Args.pKeysIn != pKeys )
+    {
+        memcpy( pKeys, Args.pKeysIn, uCount * sizeof( UINT ) );
+        if( NULL != pValues )
+        {
+            memcpy( pValues, Args.pValuesIn, uCount * sizeof( UINT ) );
+        }
+    }
+}
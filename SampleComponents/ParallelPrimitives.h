@@ -0,0 +1,87 @@
+/*!
+    \file ParallelPrimitives.h
+
+    Data-parallel building blocks that run on the gTaskMgr workers.  Each
+    call splits its input into contiguous ranges, one task per range, and
+    returns once the work is done.  Scan, reduce and compact use SSE2 for
+    their inner loops when it is available.
+
+    Like WaitForSet these must be called from the main thread, not from
+    inside a task.  Inputs below PARALLEL_MIN_GRAIN elements per task use
+    fewer tasks, down to running serially on the calling thread.
+
+    Copyright 2010 Intel Corporation
+    All Rights Reserved
+
+    Permission is granted to use, copy, distribute and prepare derivative works of this
+    software for any purpose and without fee, provided, that the above copyright notice
+    and this statement appear in all copies.  Intel makes no representations about the
+    suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED ""AS IS.""
+    INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+    INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+    INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+    assume any responsibility for any errors which may appear in this software nor any
+    responsibility to update it.
+*/
+#pragma once
+
+#include "TaskMgrTBB.h"
+
+//
+//  PARALLEL_MAX_TASKS bounds the tasks one call creates, and the per task
+//  scratch kept on the caller's stack.  PARALLEL_MIN_GRAIN is the fewest
+//  elements worth handing to a task.
+//
+#define PARALLEL_MAX_TASKS              64
+#define PARALLEL_MIN_GRAIN              8192
+
+//  Operator of ParallelReduce.
+typedef enum _PARALLELREDUCEOP
+{
+    PARALLELREDUCE_SUM = 0,
+    PARALLELREDUCE_MIN,
+    PARALLELREDUCE_MAX,
+} PARALLELREDUCEOP;
+
+//  Exclusive prefix sum of pIn into pOut: pOut[i] is the sum of pIn[0] to
+//  pIn[i-1].  Returns the sum of all elements.  pIn and pOut may be the
+//  same array.
+UINT
+ParallelScan(
+    const UINT*                 pIn,
+    UINT*                       pOut,
+    UINT                        uCount );
+
+//  Sum, minimum or maximum of uCount floats.  Returns 0 for an empty array.
+//  Sums are accumulated in a different order than a serial loop, so they
+//  can differ from it in the last bits.
+FLOAT
+ParallelReduce(
+    const FLOAT*                pIn,
+    UINT                        uCount,
+    PARALLELREDUCEOP            eOp );
+
+//  Copies the elements of pIn whose pKeep byte is non-zero to pOut, in
+//  order, and returns how many were kept.  pOut must have room for
+//  uCount elements and must not overlap pIn.
+UINT
+ParallelCompact(
+    const VOID*                 pIn,
+    VOID*                       pOut,
+    UINT                        uElementSize,
+    const BYTE*                 pKeep,
+    UINT                        uCount );
+
+//  Stable LSD radix sort of 32 bit keys, carrying an optional value per
+//  key.  pTempKeys, and pTempValues when pValues is not NULL, are scratch
+//  arrays of uCount elements.  The sorted result is left in pKeys and
+//  pValues.  Digits that are the same in every key are skipped, so small
+//  key ranges sort in fewer passes.
+VOID
+ParallelRadixSort(
+    UINT*                       pKeys,
+    UINT*                       pValues,
+    UINT*                       pTempKeys,
+    UINT*                       pTempValues,
+    UINT                        uCount );
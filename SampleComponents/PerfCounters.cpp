@@ -0,0 +1,312 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+//---------------------------------------------------------------------------------------
+
+#include "PerfCounters.h"
+#include <assert.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined( __linux__ )
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define PERFCOUNTERS_PERF_EVENT
+#endif
+
+PerfCounters gPerfCounters;
+
+double PerfCounters::Sample::GetIPC( void ) const
+{
+    return nCounts[ Cycles ] ? ( double )nCounts[ Instructions ] / ( double )nCounts[ Cycles ] : 0.0;
+}
+
+double PerfCounters::Sample::GetPerUnit( Counter eCounter ) const
+{
+    return nUnits ? ( double )nCounts[ eCounter ] / ( double )nUnits : 0.0;
+}
+
+double PerfCounters::Sample::GetBytesPerUnit( void ) const
+{
+    return GetPerUnit( LLCMisses ) * LineSize;
+}
+
+PerfCounters::PerfCounters( void )
+    : m_pContexts( NULL )
+    , m_pAccumulated( NULL )
+    , m_pFrame( NULL )
+    , m_nContexts( 0 )
+    , m_pszPhaseNames( NULL )
+    , m_nPhases( 0 )
+    , m_nAvailable( 0 )
+    , m_bEnabled( false )
+{
+    memset( m_pFrameTotals, 0, sizeof( m_pFrameTotals ) );
+}
+
+PerfCounters::~PerfCounters( void )
+{
+    Shutdown();
+}
+
+bool PerfCounters::Init( unsigned int nContexts,
+                         const char* const* pszPhaseNames,
+                         unsigned int nPhases )
+{
+    Shutdown();
+
+    assert( nPhases <= MaxPhases );
+
+    m_nContexts = nContexts;
+    m_pszPhaseNames = pszPhaseNames;
+    m_nPhases = nPhases;
+
+    m_pContexts = new ContextCounters[ nContexts ];
+    m_pAccumulated = new Sample[ nContexts * MaxPhases ];
+    m_pFrame = new Sample[ nContexts * MaxPhases ];
+
+    memset( m_pAccumulated, 0, nContexts * MaxPhases * sizeof( Sample ) );
+    memset( m_pFrame, 0, nContexts * MaxPhases * sizeof( Sample ) );
+    memset( m_pFrameTotals, 0, sizeof( m_pFrameTotals ) );
+
+    for( unsigned int i = 0; i < nContexts; ++i )
+    {
+        m_pContexts[i].bOpened = false;
+        m_pContexts[i].nOpen = 0;
+        for( unsigned int c = 0; c < CounterCount; ++c )
+        {
+            m_pContexts[i].nFds[c] = -1;
+        }
+    }
+
+    // The calling thread is context 0 in both TaskMgr backends.  What it
+    //   can open is what every thread can.
+    m_nAvailable = ~0u;
+    Open( m_pContexts[0] );
+
+    m_nAvailable = 0;
+    for( unsigned int c = 0; c < m_pContexts[0].nOpen; ++c )
+    {
+        m_nAvailable |= 1u << m_pContexts[0].nReadOrder[c];
+    }
+
+    return m_nAvailable != 0;
+}
+
+void PerfCounters::Shutdown( void )
+{
+    if( NULL == m_pContexts )
+    {
+        return;
+    }
+
+    // Counters belong to their threads but the descriptors can be closed
+    //   from any thread
+    for( unsigned int i = 0; i < m_nContexts; ++i )
+    {
+        Close( m_pContexts[i] );
+    }
+
+    delete[] m_pContexts;
+    delete[] m_pAccumulated;
+    delete[] m_pFrame;
+    m_pContexts = NULL;
+    m_pAccumulated = NULL;
+    m_pFrame = NULL;
+    m_nContexts = 0;
+    m_nAvailable = 0;
+    m_bEnabled = false;
+}
+
+#ifdef PERFCOUNTERS_PERF_EVENT
+
+static int OpenPerfEvent( unsigned int nType,
+                          unsigned long long nConfig,
+                          int nGroupFd )
+{
+    perf_event_attr Attr;
+    memset( &Attr, 0, sizeof( Attr ) );
+    Attr.size = sizeof( Attr );
+    Attr.type = nType;
+    Attr.config = nConfig;
+    Attr.read_format = PERF_FORMAT_GROUP;
+    Attr.exclude_kernel = 1;
+    Attr.exclude_hv = 1;
+
+    // This thread, on any CPU
+    return ( int )syscall( __NR_perf_event_open, &Attr, 0, -1, nGroupFd, 0 );
+}
+
+#endif
+
+void PerfCounters::Open( ContextCounters& Context )
+{
+    Context.bOpened = true;
+    Context.nOpen = 0;
+
+#ifdef PERFCOUNTERS_PERF_EVENT
+    static const unsigned int s_nTypes[ CounterCount ] =
+    {
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_HW_CACHE,
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_HARDWARE,
+    };
+    static const unsigned long long s_nConfigs[ CounterCount ] =
+    {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_L1D | ( PERF_COUNT_HW_CACHE_OP_READ << 8 ) | ( PERF_COUNT_HW_CACHE_RESULT_MISS << 16 ),
+        PERF_COUNT_HW_CACHE_REFERENCES,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES,
+    };
+
+    // Cycles lead the group so all counters start and stop together; without
+    //   it nothing is opened
+    int nLeader = -1;
+    for( unsigned int c = 0; c < CounterCount; ++c )
+    {
+        if( 0 == ( m_nAvailable & ( 1u << c ) ) )
+        {
+            continue;
+        }
+
+        int nFd = OpenPerfEvent( s_nTypes[c], s_nConfigs[c], nLeader );
+        if( nFd < 0 )
+        {
+            if( Cycles == c )
+            {
+                return;
+            }
+            continue;
+        }
+
+        if( Cycles == c )
+        {
+            nLeader = nFd;
+        }
+
+        Context.nFds[c] = nFd;
+        Context.nReadOrder[ Context.nOpen++ ] = c;
+    }
+#elif defined( _WIN32 )
+    Context.nReadOrder[ Context.nOpen++ ] = Cycles;
+#endif
+}
+
+void PerfCounters::Close( ContextCounters& Context )
+{
+#ifdef PERFCOUNTERS_PERF_EVENT
+    // Members before the leader
+    for( int c = CounterCount - 1; c >= 0; --c )
+    {
+        if( Context.nFds[c] >= 0 )
+        {
+            close( Context.nFds[c] );
+        }
+    }
+#endif
+
+    for( unsigned int c = 0; c < CounterCount; ++c )
+    {
+        Context.nFds[c] = -1;
+    }
+    Context.bOpened = false;
+    Context.nOpen = 0;
+}
+
+void PerfCounters::Read( int nContext,
+                         unsigned long long* pCounts )
+{
+    assert( nContext >= 0 && ( unsigned int )nContext < m_nContexts );
+
+    ContextCounters& Context = m_pContexts[ nContext ];
+    if( !Context.bOpened )
+    {
+        Open( Context );
+    }
+
+    memset( pCounts, 0, CounterCount * sizeof( unsigned long long ) );
+
+#ifdef PERFCOUNTERS_PERF_EVENT
+    if( 0 == Context.nOpen )
+    {
+        return;
+    }
+
+    // A group read returns the count of values, then the values in the
+    //   order the counters were opened
+    unsigned long long nValues[ 1 + CounterCount ];
+    ssize_t nBytes = read( Context.nFds[ Cycles ], nValues, sizeof( nValues ) );
+    if( nBytes < ( ssize_t )( ( 1 + Context.nOpen ) * sizeof( unsigned long long ) ) )
+    {
+        return;
+    }
+
+    for( unsigned int c = 0; c < Context.nOpen; ++c )
+    {
+        pCounts[ Context.nReadOrder[c] ] = nValues[ 1 + c ];
+    }
+#elif defined( _WIN32 )
+    ULONG64 nCycles = 0;
+    QueryThreadCycleTime( GetCurrentThread(), &nCycles );
+    pCounts[ Cycles ] = nCycles;
+#endif
+}
+
+void PerfCounters::Accumulate( unsigned int nPhase,
+                               int nContext,
+                               const unsigned long long* pBegin,
+                               const unsigned long long* pEnd,
+                               unsigned int nUnits )
+{
+    assert( nPhase < m_nPhases );
+    assert( nContext >= 0 && ( unsigned int )nContext < m_nContexts );
+
+    Sample& Accumulated = m_pAccumulated[ nContext * MaxPhases + nPhase ];
+    for( unsigned int c = 0; c < CounterCount; ++c )
+    {
+        Accumulated.nCounts[c] += pEnd[c] - pBegin[c];
+    }
+    Accumulated.nUnits += nUnits;
+    ++Accumulated.nScopes;
+}
+
+void PerfCounters::EndFrame( void )
+{
+    memset( m_pFrameTotals, 0, sizeof( m_pFrameTotals ) );
+
+    for( unsigned int i = 0; i < m_nContexts * MaxPhases; ++i )
+    {
+        Sample& Total = m_pFrameTotals[ i % MaxPhases ];
+        const Sample& Accumulated = m_pAccumulated[i];
+
+        for( unsigned int c = 0; c < CounterCount; ++c )
+        {
+            Total.nCounts[c] += Accumulated.nCounts[c];
+        }
+        Total.nUnits += Accumulated.nUnits;
+        Total.nScopes += Accumulated.nScopes;
+    }
+
+    memcpy( m_pFrame, m_pAccumulated, m_nContexts * MaxPhases * sizeof( Sample ) );
+    memset( m_pAccumulated, 0, m_nContexts * MaxPhases * sizeof( Sample ) );
+}
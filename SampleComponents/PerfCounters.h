@@ -0,0 +1,213 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+//---------------------------------------------------------------------------------------
+
+#ifndef __PERFCOUNTERS_H
+#define __PERFCOUNTERS_H
+
+// PerfCounters collects hardware performance counters per phase of the
+// frame and per task context, to tell whether a phase is bound by compute,
+// by memory or by something like atomics.  The app names its phases at
+// Init and wraps the work of each phase in a PerfScope, which also counts
+// the units the work processed so results can be given per unit.
+//
+// On Linux the counters are read with perf_event_open: cycles,
+// instructions, L1 data cache read misses, last level cache references and
+// misses, and branch mispredicts, counted in user mode for the calling
+// thread.  A last level cache reference is a request the core's own caches
+// missed, so on most x86 parts it counts L2 misses.  Each
+// task context opens its counters on its own thread the first time it
+// enters a scope, as contexts map one to one to threads in both TaskMgr
+// backends.  On Windows only cycles are available, from
+// QueryThreadCycleTime.  Counters the CPU, kernel or hypervisor do not
+// provide read as zero; HasCounter tells which ones are real.
+//
+// Reading the counters is a system call, so scopes should wrap a task's
+// whole loop, not single units, and collection is off until SetEnabled.
+// EndFrame publishes what the finished frame collected; like
+// FrameArena::Reset it must be called when no scope is in flight.  Like
+// gTaskMgr, the app uses the gPerfCounters instance.
+class PerfCounters
+{
+public:
+    enum Counter
+    {
+        Cycles = 0,
+        Instructions,
+        L1DMisses,
+        LLCReferences,
+        LLCMisses,
+        BranchMisses,
+        CounterCount
+    };
+
+    // Counts for one phase over a frame
+    struct Sample
+    {
+        unsigned long long nCounts[ CounterCount ];
+        unsigned long long nUnits;
+        unsigned long long nScopes;
+
+        double GetIPC( void ) const;
+        double GetPerUnit( Counter eCounter ) const;
+
+        // Last level cache misses times the line size, per unit; an
+        // estimate of the memory traffic each unit costs.
+        double GetBytesPerUnit( void ) const;
+    };
+
+    PerfCounters( void );
+    ~PerfCounters( void );
+
+    // nContexts must cover every nContext the task manager hands out.
+    // The phase names are kept by pointer.  Returns false if the
+    // platform provides no counters; scopes are then free.
+    bool Init( unsigned int nContexts,
+               const char* const* pszPhaseNames,
+               unsigned int nPhases );
+    void Shutdown( void );
+
+    void SetEnabled( bool bEnabled )
+    {
+        m_bEnabled = bEnabled && m_nAvailable != 0;
+    }
+    bool IsEnabled( void ) const
+    {
+        return m_bEnabled;
+    }
+
+    bool HasCounter( Counter eCounter ) const
+    {
+        return ( m_nAvailable & ( 1u << eCounter ) ) != 0;
+    }
+
+    // Current counts of the calling thread, which must run nContext.
+    void Read( int nContext,
+               unsigned long long* pCounts );
+
+    // Add the difference of two reads to a phase of nContext.
+    void Accumulate( unsigned int nPhase,
+                     int nContext,
+                     const unsigned long long* pBegin,
+                     const unsigned long long* pEnd,
+                     unsigned int nUnits );
+
+    // Publish this frame's counts and start the next frame.
+    void EndFrame( void );
+
+    // Last frame's counts for a phase, over all contexts or for one.
+    const Sample& GetFrameSample( unsigned int nPhase ) const
+    {
+        return m_pFrameTotals[ nPhase ];
+    }
+    const Sample& GetFrameSample( unsigned int nPhase,
+                                  int nContext ) const
+    {
+        return m_pFrame[ nContext * MaxPhases + nPhase ];
+    }
+
+    unsigned int GetPhaseCount( void ) const
+    {
+        return m_nPhases;
+    }
+    const char* GetPhaseName( unsigned int nPhase ) const
+    {
+        return m_pszPhaseNames[ nPhase ];
+    }
+    unsigned int GetContextCount( void ) const
+    {
+        return m_nContexts;
+    }
+
+    static const unsigned int MaxPhases = 8;
+
+    // Bytes one last level cache miss is assumed to move
+    static const unsigned int LineSize = 64;
+
+private:
+    struct ContextCounters
+    {
+        bool bOpened;
+
+        // Group leader and member descriptors, -1 when not open, and which
+        // counter each value of a group read belongs to.
+        int nFds[ CounterCount ];
+        unsigned int nReadOrder[ CounterCount ];
+        unsigned int nOpen;
+    };
+
+    PerfCounters( const PerfCounters& );
+    PerfCounters& operator=( const PerfCounters& );
+
+    void Open( ContextCounters& Context );
+    void Close( ContextCounters& Context );
+
+    ContextCounters* m_pContexts;
+    Sample* m_pAccumulated;
+    Sample* m_pFrame;
+    Sample m_pFrameTotals[ MaxPhases ];
+    unsigned int m_nContexts;
+
+    const char* const* m_pszPhaseNames;
+    unsigned int m_nPhases;
+
+    unsigned int m_nAvailable;
+    volatile bool m_bEnabled;
+};
+
+extern PerfCounters gPerfCounters;
+
+// Counts the enclosing block as nUnits units of work of a phase, while
+// collection is enabled.
+class PerfScope
+{
+public:
+    PerfScope( unsigned int nPhase,
+               int nContext,
+               unsigned int nUnits )
+        : m_nPhase( nPhase )
+        , m_nContext( nContext )
+        , m_nUnits( nUnits )
+        , m_bEnabled( gPerfCounters.IsEnabled() )
+    {
+        if( m_bEnabled )
+        {
+            gPerfCounters.Read( m_nContext, m_nBegin );
+        }
+    }
+
+    ~PerfScope( void )
+    {
+        if( m_bEnabled )
+        {
+            unsigned long long nEnd[ PerfCounters::CounterCount ];
+            gPerfCounters.Read( m_nContext, nEnd );
+            gPerfCounters.Accumulate( m_nPhase, m_nContext, m_nBegin, nEnd, m_nUnits );
+        }
+    }
+
+private:
+    PerfScope( const PerfScope& );
+    PerfScope& operator=( const PerfScope& );
+
+    unsigned int m_nPhase;
+    int m_nContext;
+    unsigned int m_nUnits;
+    bool m_bEnabled;
+    unsigned long long m_nBegin[ PerfCounters::CounterCount ];
+};
+
+#endif // __PERFCOUNTERS_H
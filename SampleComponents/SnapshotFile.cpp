@@ -0,0 +1,321 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+//---------------------------------------------------------------------------------------
+
+#include "SnapshotFile.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char gs_szSnapshotMagic[8] = { 'S', 'N', 'A', 'P', 'S', 'H', 'O', 'T' };
+
+struct SnapshotHeader
+{
+    char szMagic[8];
+    unsigned int nFormat;
+    unsigned int nVersion;
+    unsigned int nSections;
+    unsigned int nReserved;
+    unsigned long long nFileSize;
+    unsigned char Padding[32];
+};
+
+struct SnapshotSection
+{
+    unsigned int nId;
+    unsigned int nReserved;
+    unsigned long long nOffset;
+    unsigned long long nSize;
+    unsigned long long nPadding;
+};
+
+static unsigned long long AlignUp( unsigned long long nOffset )
+{
+    return ( nOffset + SnapshotReader::Alignment - 1 ) & ~( unsigned long long )( SnapshotReader::Alignment - 1 );
+}
+
+SnapshotWriter::SnapshotWriter( unsigned int nFormat,
+                                unsigned int nVersion )
+    : m_nFormat( nFormat )
+    , m_nVersion( nVersion )
+{
+}
+
+void SnapshotWriter::AddSection( unsigned int nId,
+                                 const void* pData,
+                                 size_t nSize )
+{
+    Section NewSection;
+    NewSection.nId = nId;
+    NewSection.pData = pData;
+    NewSection.nSize = nSize;
+    NewSection.nCopy = -1;
+    m_Sections.push_back( NewSection );
+}
+
+void SnapshotWriter::AddSectionCopy( unsigned int nId,
+                                     const void* pData,
+                                     size_t nSize )
+{
+    const unsigned char* pBytes = ( const unsigned char* )pData;
+    m_Copies.push_back( std::vector<unsigned char>( pBytes, pBytes + nSize ) );
+
+    Section NewSection;
+    NewSection.nId = nId;
+    NewSection.pData = NULL;
+    NewSection.nSize = nSize;
+    NewSection.nCopy = ( int )m_Copies.size() - 1;
+    m_Sections.push_back( NewSection );
+}
+
+bool SnapshotWriter::Write( const char* szFileName ) const
+{
+    unsigned int nSections = ( unsigned int )m_Sections.size();
+
+    // Lay out the sections after the header and table
+    std::vector<SnapshotSection> Table( nSections );
+    unsigned long long nOffset = AlignUp( sizeof( SnapshotHeader ) + nSections * sizeof( SnapshotSection ) );
+    for( unsigned int i = 0; i < nSections; ++i )
+    {
+        memset( &Table[i], 0, sizeof( SnapshotSection ) );
+        Table[i].nId = m_Sections[i].nId;
+        Table[i].nOffset = nOffset;
+        Table[i].nSize = m_Sections[i].nSize;
+        nOffset = AlignUp( nOffset + m_Sections[i].nSize );
+    }
+
+    SnapshotHeader Header;
+    memset( &Header, 0, sizeof( Header ) );
+    memcpy( Header.szMagic, gs_szSnapshotMagic, sizeof( Header.szMagic ) );
+    Header.nFormat = m_nFormat;
+    Header.nVersion = m_nVersion;
+    Header.nSections = nSections;
+    Header.nFileSize = nOffset;
+
+    FILE* pFile = fopen( szFileName, "wb" );
+    if( NULL == pFile )
+    {
+        return false;
+    }
+
+    static const unsigned char s_Zeros[ SnapshotReader::Alignment ] = { 0 };
+    unsigned long long nWritten = 0;
+    bool bOk = fwrite( &Header, sizeof( Header ), 1, pFile ) == 1;
+    nWritten += sizeof( Header );
+
+    if( bOk && nSections > 0 )
+    {
+        bOk = fwrite( &Table[0], sizeof( SnapshotSection ), nSections, pFile ) == nSections;
+        nWritten += nSections * sizeof( SnapshotSection );
+    }
+
+    for( unsigned int i = 0; bOk && i < nSections; ++i )
+    {
+        const Section& Data = m_Sections[i];
+        const void* pData = Data.nCopy >= 0 ? &m_Copies[ Data.nCopy ][0] : Data.pData;
+
+        size_t nPadding = ( size_t )( Table[i].nOffset - nWritten );
+        bOk = ( 0 == nPadding || fwrite( s_Zeros, nPadding, 1, pFile ) == 1 ) &&
+              ( 0 == Data.nSize || fwrite( pData, Data.nSize, 1, pFile ) == 1 );
+        nWritten = Table[i].nOffset + m_Sections[i].nSize;
+    }
+
+    // The file ends on the alignment too
+    if( bOk && nWritten < Header.nFileSize )
+    {
+        bOk = fwrite( s_Zeros, ( size_t )( Header.nFileSize - nWritten ), 1, pFile ) == 1;
+    }
+
+    bOk = ( 0 == fclose( pFile ) ) && bOk;
+    if( !bOk )
+    {
+        remove( szFileName );
+    }
+    return bOk;
+}
+
+SnapshotReader::SnapshotReader( void )
+    : m_pView( NULL )
+    , m_nViewSize( 0 )
+    , m_nSections( 0 )
+#ifdef _WIN32
+    , m_hFile( INVALID_HANDLE_VALUE )
+    , m_hMapping( NULL )
+#endif
+{
+}
+
+SnapshotReader::~SnapshotReader( void )
+{
+    Close();
+}
+
+bool SnapshotReader::Open( const char* szFileName,
+                           unsigned int nFormat,
+                           unsigned int nVersion )
+{
+    Close();
+
+#ifdef _WIN32
+    m_hFile = CreateFileA( szFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL, NULL );
+    if( INVALID_HANDLE_VALUE == m_hFile )
+    {
+        return false;
+    }
+
+    LARGE_INTEGER FileSize;
+    if( !GetFileSizeEx( m_hFile, &FileSize ) || FileSize.QuadPart < ( LONGLONG )sizeof( SnapshotHeader ) )
+    {
+        Close();
+        return false;
+    }
+
+    m_hMapping = CreateFileMappingA( m_hFile, NULL, PAGE_READONLY, 0, 0, NULL );
+    if( NULL == m_hMapping )
+    {
+        Close();
+        return false;
+    }
+
+    m_pView = ( const unsigned char* )MapViewOfFile( m_hMapping, FILE_MAP_READ, 0, 0, 0 );
+    m_nViewSize = ( unsigned long long )FileSize.QuadPart;
+#else
+    int nFile = open( szFileName, O_RDONLY );
+    if( nFile < 0 )
+    {
+        return false;
+    }
+
+    struct stat Stat;
+    if( fstat( nFile, &Stat ) != 0 || Stat.st_size < ( off_t )sizeof( SnapshotHeader ) )
+    {
+        close( nFile );
+        return false;
+    }
+
+    // The mapping keeps the file open
+    void* pView = mmap( NULL, ( size_t )Stat.st_size, PROT_READ, MAP_PRIVATE, nFile, 0 );
+    close( nFile );
+
+    m_pView = ( MAP_FAILED == pView ) ? NULL : ( const unsigned char* )pView;
+    m_nViewSize = ( unsigned long long )Stat.st_size;
+#endif
+
+    if( NULL == m_pView )
+    {
+        Close();
+        return false;
+    }
+
+    const SnapshotHeader* pHeader = ( const SnapshotHeader* )m_pView;
+    if( memcmp( pHeader->szMagic, gs_szSnapshotMagic, sizeof( pHeader->szMagic ) ) != 0 ||
+        pHeader->nFormat != nFormat ||
+        pHeader->nVersion != nVersion ||
+        pHeader->nFileSize != m_nViewSize ||
+        sizeof( SnapshotHeader ) + ( unsigned long long )pHeader->nSections * sizeof( SnapshotSection ) > m_nViewSize )
+    {
+        Close();
+        return false;
+    }
+
+    // Every section must lie in the file, aligned, so GetSection can trust them
+    const SnapshotSection* pTable = ( const SnapshotSection* )( m_pView + sizeof( SnapshotHeader ) );
+    for( unsigned int i = 0; i < pHeader->nSections; ++i )
+    {
+        if( pTable[i].nOffset % Alignment != 0 ||
+            pTable[i].nOffset > m_nViewSize ||
+            pTable[i].nSize > m_nViewSize - pTable[i].nOffset )
+        {
+            Close();
+            return false;
+        }
+    }
+
+    m_nSections = pHeader->nSections;
+    return true;
+}
+
+void SnapshotReader::Close( void )
+{
+#ifdef _WIN32
+    if( NULL != m_pView )
+    {
+        UnmapViewOfFile( m_pView );
+    }
+    if( NULL != m_hMapping )
+    {
+        CloseHandle( m_hMapping );
+    }
+    if( INVALID_HANDLE_VALUE != m_hFile )
+    {
+        CloseHandle( m_hFile );
+    }
+    m_hMapping = NULL;
+    m_hFile = INVALID_HANDLE_VALUE;
+#else
+    if( NULL != m_pView )
+    {
+        munmap( ( void* )m_pView, ( size_t )m_nViewSize );
+    }
+#endif
+
+    m_pView = NULL;
+    m_nViewSize = 0;
+    m_nSections = 0;
+}
+
+const void* SnapshotReader::GetSection( unsigned int nId,
+                                        size_t nSize ) const
+{
+    if( NULL == m_pView )
+    {
+        return NULL;
+    }
+
+    const SnapshotSection* pTable = ( const SnapshotSection* )( m_pView + sizeof( SnapshotHeader ) );
+    for( unsigned int i = 0; i < m_nSections; ++i )
+    {
+        if( pTable[i].nId == nId )
+        {
+            return pTable[i].nSize == nSize ? m_pView + pTable[i].nOffset : NULL;
+        }
+    }
+
+    return NULL;
+}
+
+bool SnapshotReader::ReadSection( unsigned int nId,
+                                  void* pDest,
+                                  size_t nSize ) const
+{
+    const void* pSection = GetSection( nId, nSize );
+    if( NULL == pSection )
+    {
+        return false;
+    }
+
+    memcpy( pDest, pSection, nSize );
+    return true;
+}
@@ -0,0 +1,119 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+//---------------------------------------------------------------------------------------
+
+#ifndef __SNAPSHOTFILE_H
+#define __SNAPSHOTFILE_H
+
+#include <stddef.h>
+#include <vector>
+
+// Snapshot files hold raw memory images of an app's state in tagged
+// sections, so it can be saved in one write and restored without parsing.
+//
+// A file starts with a 64 byte header: the magic "SNAPSHOT", the app's
+// format tag and version, the section count and the file size.  The
+// section table follows, then the sections, each starting on a 64 byte
+// boundary so they can be read with aligned and streaming loads.  Sections
+// are stored in the writer's byte order and struct layout; the app bumps
+// its version whenever a section's layout changes, and a reader rejects
+// any other version.
+//
+// SnapshotReader maps the file read only rather than reading it, and
+// GetSection resolves a section's offset to a pointer into the mapping, so
+// opening a snapshot costs the same however large it is.  Pages are read
+// from disk or the file cache as the app touches them.
+class SnapshotWriter
+{
+public:
+    SnapshotWriter( unsigned int nFormat,
+                    unsigned int nVersion );
+
+    // The data is kept by pointer and must stay valid until Write returns.
+    void AddSection( unsigned int nId,
+                     const void* pData,
+                     size_t nSize );
+
+    // As AddSection, but the data is copied, for small state gathered into
+    // a local struct.
+    void AddSectionCopy( unsigned int nId,
+                         const void* pData,
+                         size_t nSize );
+
+    bool Write( const char* szFileName ) const;
+
+private:
+    struct Section
+    {
+        unsigned int nId;
+        const void* pData;
+        size_t nSize;
+        int nCopy;              // Index in m_Copies, or -1
+    };
+
+    unsigned int m_nFormat;
+    unsigned int m_nVersion;
+    std::vector<Section> m_Sections;
+    std::vector< std::vector<unsigned char> > m_Copies;
+};
+
+class SnapshotReader
+{
+public:
+    SnapshotReader( void );
+    ~SnapshotReader( void );
+
+    // Maps the file and checks its header and section table.  Fails if the
+    // file is not a snapshot of this format and version.
+    bool Open( const char* szFileName,
+               unsigned int nFormat,
+               unsigned int nVersion );
+    void Close( void );
+
+    // A section's data in the mapping, valid until Close.  NULL if the file
+    // has no such section or it is not nSize bytes long.
+    const void* GetSection( unsigned int nId,
+                            size_t nSize ) const;
+
+    // Copies a section over the app's copy of it.  False, leaving pDest
+    // alone, where GetSection would return NULL.
+    bool ReadSection( unsigned int nId,
+                      void* pDest,
+                      size_t nSize ) const;
+
+    // Section data starts on multiples of this
+    static const unsigned int Alignment = 64;
+
+private:
+    SnapshotReader( const SnapshotReader& );
+    SnapshotReader& operator=( const SnapshotReader& );
+
+    const unsigned char* m_pView;
+    unsigned long long m_nViewSize;
+    unsigned int m_nSections;
+
+#ifdef _WIN32
+    void* m_hFile;
+    void* m_hMapping;
+#endif
+};
+
+// Section and format tags made of four characters, as in
+// SNAPSHOT_TAG( 'U', 'N', 'I', 'T' )
+#define SNAPSHOT_TAG( a, b, c, d ) \
+    ( ( unsigned int )( a ) | ( ( unsigned int )( b ) << 8 ) | ( ( unsigned int )( c ) << 16 ) | ( ( unsigned int )( d ) << 24 ) )
+
+#endif // __SNAPSHOTFILE_H
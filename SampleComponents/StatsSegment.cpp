@@ -0,0 +1,263 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+//---------------------------------------------------------------------------------------
+
+#include "StatsSegment.h"
+#include "AtomicOps.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <intrin.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Reads of a block the publisher keeps changing give up after this many tries
+static const unsigned int gs_nReadTries = 1000;
+
+// The published fields start after the sequence
+static const size_t gs_nPayloadOffset = offsetof( StatsBlock, nFlags );
+
+static void GetSegmentName( const char* szName,
+                            char* szOut,
+                            size_t nOutSize )
+{
+#ifdef _WIN32
+    _snprintf_s( szOut, nOutSize, _TRUNCATE, "Local\\%s", szName );
+#else
+    snprintf( szOut, nOutSize, "/%s", szName );
+#endif
+}
+
+StatsPublisher::StatsPublisher( void )
+    : m_pBlock( NULL )
+#ifdef _WIN32
+    , m_hMapping( NULL )
+#endif
+{
+    m_szName[0] = 0;
+}
+
+StatsPublisher::~StatsPublisher( void )
+{
+    Destroy();
+}
+
+bool StatsPublisher::Create( const char* szName )
+{
+    if( NULL != m_pBlock )
+    {
+        return false;
+    }
+
+    GetSegmentName( szName, m_szName, sizeof( m_szName ) );
+
+#ifdef _WIN32
+    m_hMapping = CreateFileMappingA( INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof( StatsBlock ), m_szName );
+    if( NULL == m_hMapping )
+    {
+        return false;
+    }
+    m_pBlock = ( StatsBlock* )MapViewOfFile( m_hMapping, FILE_MAP_WRITE, 0, 0, sizeof( StatsBlock ) );
+    if( NULL == m_pBlock )
+    {
+        CloseHandle( m_hMapping );
+        m_hMapping = NULL;
+        return false;
+    }
+#else
+    int nFile = shm_open( m_szName, O_CREAT | O_RDWR, 0644 );
+    if( nFile < 0 )
+    {
+        return false;
+    }
+
+    void* pView = MAP_FAILED;
+    if( 0 == ftruncate( nFile, sizeof( StatsBlock ) ) )
+    {
+        pView = mmap( NULL, sizeof( StatsBlock ), PROT_READ | PROT_WRITE, MAP_SHARED, nFile, 0 );
+    }
+    close( nFile );
+
+    if( MAP_FAILED == pView )
+    {
+        shm_unlink( m_szName );
+        return false;
+    }
+    m_pBlock = ( StatsBlock* )pView;
+#endif
+
+    // Readers that find the old magic or an odd sequence wait for this
+    StoreRelease( &m_pBlock->nSequence, 1u );
+    FullFence();
+    memset( ( char* )m_pBlock + gs_nPayloadOffset, 0, sizeof( StatsBlock ) - gs_nPayloadOffset );
+    m_pBlock->nMagic = StatsBlock::Magic;
+    m_pBlock->nVersion = StatsBlock::Version;
+    m_pBlock->nSize = sizeof( StatsBlock );
+#ifdef _WIN32
+    m_pBlock->nProcessId = GetCurrentProcessId();
+#else
+    m_pBlock->nProcessId = ( unsigned int )getpid();
+#endif
+    StoreRelease( &m_pBlock->nSequence, 2u );
+
+    return true;
+}
+
+void StatsPublisher::Destroy( void )
+{
+    if( NULL == m_pBlock )
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile( m_pBlock );
+    CloseHandle( m_hMapping );
+    m_hMapping = NULL;
+#else
+    munmap( m_pBlock, sizeof( StatsBlock ) );
+    shm_unlink( m_szName );
+#endif
+
+    m_pBlock = NULL;
+}
+
+void StatsPublisher::Publish( const StatsBlock& Stats )
+{
+    if( NULL == m_pBlock )
+    {
+        return;
+    }
+
+    unsigned int nSequence = m_pBlock->nSequence;
+    StoreRelease( &m_pBlock->nSequence, nSequence + 1u );
+    FullFence();
+    memcpy( ( char* )m_pBlock + gs_nPayloadOffset, ( const char* )&Stats + gs_nPayloadOffset,
+            sizeof( StatsBlock ) - gs_nPayloadOffset );
+    StoreRelease( &m_pBlock->nSequence, nSequence + 2u );
+}
+
+StatsReader::StatsReader( void )
+    : m_pBlock( NULL )
+#ifdef _WIN32
+    , m_hMapping( NULL )
+#endif
+{
+}
+
+StatsReader::~StatsReader( void )
+{
+    Close();
+}
+
+bool StatsReader::Open( const char* szName )
+{
+    Close();
+
+    char szSegment[ 64 ];
+    GetSegmentName( szName, szSegment, sizeof( szSegment ) );
+
+#ifdef _WIN32
+    m_hMapping = OpenFileMappingA( FILE_MAP_READ, FALSE, szSegment );
+    if( NULL == m_hMapping )
+    {
+        return false;
+    }
+    m_pBlock = ( const StatsBlock* )MapViewOfFile( m_hMapping, FILE_MAP_READ, 0, 0, sizeof( StatsBlock ) );
+#else
+    int nFile = shm_open( szSegment, O_RDONLY, 0 );
+    if( nFile < 0 )
+    {
+        return false;
+    }
+
+    struct stat Stat;
+    void* pView = MAP_FAILED;
+    if( 0 == fstat( nFile, &Stat ) && Stat.st_size >= ( off_t )sizeof( StatsBlock ) )
+    {
+        pView = mmap( NULL, sizeof( StatsBlock ), PROT_READ, MAP_SHARED, nFile, 0 );
+    }
+    close( nFile );
+
+    m_pBlock = ( MAP_FAILED == pView ) ? NULL : ( const StatsBlock* )pView;
+#endif
+
+    StatsBlock Stats;
+    if( NULL == m_pBlock || !Read( Stats ) )
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void StatsReader::Close( void )
+{
+#ifdef _WIN32
+    if( NULL != m_pBlock )
+    {
+        UnmapViewOfFile( m_pBlock );
+    }
+    if( NULL != m_hMapping )
+    {
+        CloseHandle( m_hMapping );
+        m_hMapping = NULL;
+    }
+#else
+    if( NULL != m_pBlock )
+    {
+        munmap( ( void* )m_pBlock, sizeof( StatsBlock ) );
+    }
+#endif
+
+    m_pBlock = NULL;
+}
+
+bool StatsReader::Read( StatsBlock& Stats ) const
+{
+    if( NULL == m_pBlock )
+    {
+        return false;
+    }
+
+    for( unsigned int nTry = 0; nTry < gs_nReadTries; ++nTry )
+    {
+        unsigned int nBefore = LoadAcquire( &m_pBlock->nSequence );
+        if( nBefore & 1 )
+        {
+            continue;
+        }
+
+        memcpy( &Stats, ( const void* )m_pBlock, sizeof( StatsBlock ) );
+        FullFence();
+
+        if( LoadAcquire( &m_pBlock->nSequence ) == nBefore )
+        {
+            return StatsBlock::Magic == Stats.nMagic &&
+                   StatsBlock::Version == Stats.nVersion &&
+                   sizeof( StatsBlock ) == Stats.nSize;
+        }
+    }
+
+    return false;
+}
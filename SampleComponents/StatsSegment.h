@@ -0,0 +1,140 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+//---------------------------------------------------------------------------------------
+
+#ifndef __STATSSEGMENT_H
+#define __STATSSEGMENT_H
+
+#include <stddef.h>
+
+// A stats segment is a block of live stats in named shared memory, so tools
+// outside the process can watch it without asking it for anything.
+// StatsPublisher creates the segment and copies a StatsBlock into it once a
+// frame; StatsReader maps it read only from another process.
+//
+// The block is guarded by a sequence lock.  Publish makes the sequence odd,
+// writes the fields and makes it even again; a reader copies the block and
+// keeps the copy only if the sequence was even and unchanged across it.  The
+// publisher never waits on readers, so they can poll as often as they like
+// without touching the frame.
+//
+// The segment is a POSIX shared memory object, /name, or on Windows a named
+// file mapping, Local\name.  The layout is fixed: only 4 and 8 byte fields in
+// an order with no padding, so 32 and 64 bit builds of either side agree.
+// Bump StatsBlock::Version on any change to it.
+struct StatsBlock
+{
+    static const unsigned int Magic = 0x54415453;     // "STAT"
+    static const unsigned int Version = 1;
+    static const unsigned int MaxSeries = 16;
+    static const unsigned int SeriesNameLength = 24;
+    static const unsigned int MaxCpus = 64;
+
+    // Flags
+    static const unsigned int FlagSIMD = 1;
+    static const unsigned int FlagThreaded = 2;
+    static const unsigned int FlagPaused = 4;
+
+    // Set by StatsPublisher::Create
+    unsigned int nMagic;
+    unsigned int nVersion;
+    unsigned int nSize;
+    unsigned int nProcessId;
+
+    // Odd while the fields below are being written
+    volatile unsigned int nSequence;
+    unsigned int nFlags;
+
+    unsigned long long nFrame;
+    unsigned long long nTimeUs;             // FrameStats::GetTimeUs at Publish
+
+    unsigned int nUnits;
+    unsigned int nResets;
+    float fCoverage;                        // 0 to 1
+    float fFrameMs;
+
+    // FrameStats series: the last frame, and the percentiles of its window
+    unsigned int nSeries;
+    unsigned int nCpus;
+    char szSeriesNames[ MaxSeries ][ SeriesNameLength ];
+    float fSeriesMs[ MaxSeries ];
+    float fSeriesP50Ms[ MaxSeries ];
+    float fSeriesP99Ms[ MaxSeries ];
+    float fSeriesMaxMs[ MaxSeries ];
+
+    // CPUUsage, per logical processor
+    float fCpuPercent[ MaxCpus ];
+};
+
+class StatsPublisher
+{
+public:
+    StatsPublisher( void );
+    ~StatsPublisher( void );
+
+    // Create, or take over, the segment szName.  Fails if the shared memory
+    // cannot be created.
+    bool Create( const char* szName );
+
+    // Unmap the segment, and on POSIX remove its name.
+    void Destroy( void );
+
+    bool IsCreated( void ) const
+    {
+        return NULL != m_pBlock;
+    }
+
+    // Copy Stats into the segment, from nFlags on.  The header and the
+    // sequence of Stats are ignored.  One thread publishes.
+    void Publish( const StatsBlock& Stats );
+
+private:
+    StatsPublisher( const StatsPublisher& );
+    StatsPublisher& operator=( const StatsPublisher& );
+
+    StatsBlock* m_pBlock;
+    char m_szName[ 64 ];
+#ifdef _WIN32
+    void* m_hMapping;
+#endif
+};
+
+class StatsReader
+{
+public:
+    StatsReader( void );
+    ~StatsReader( void );
+
+    // Map the segment szName read only.  Fails if no process has created it
+    // or it is not a StatsBlock of this version.
+    bool Open( const char* szName );
+    void Close( void );
+
+    // Copy a consistent block into Stats.  False if the publisher was
+    // writing on every try, which means it stopped halfway.
+    bool Read( StatsBlock& Stats ) const;
+
+private:
+    StatsReader( const StatsReader& );
+    StatsReader& operator=( const StatsReader& );
+
+    const StatsBlock* m_pBlock;
+#ifdef _WIN32
+    void* m_hMapping;
+#endif
+};
+
+#endif // __STATSSEGMENT_H
@@ -0,0 +1,247 @@
+/*!
+    \file TaskMgrCoro.h
+
+    Coroutine tasks on top of gTaskMgr.  A function returning TaskCoroutine
+    runs as a chain of one-task tasksets.  The coroutine starts on a worker.
+    co_await AwaitTaskSet( hSet ) suspends it without blocking a thread.  The
+    rest of the body is queued as a new taskset that depends on hSet, so it
+    resumes on whichever worker runs that taskset.
+
+        TaskCoroutine RegenerateWorld( World* pWorld )
+        {
+            TASKSETHANDLE hTerrain;
+            gTaskMgr.CreateTaskSet( TerrainTask, pWorld, 64, NULL, 0,
+                                    "Terrain", &hTerrain );
+            co_await AwaitTaskSet( hTerrain );
+            gTaskMgr.ReleaseHandle( hTerrain );
+
+            PrepareUpload( pWorld );
+        }
+
+    Each resume taskset joins the first taskset of the coroutine through
+    hJoinParent.  GetHandle() is therefore a normal TASKSETHANDLE that
+    completes when the body returns.  Other tasksets can depend on it, and
+    WaitForSet, TryWaitForSet and CancelSet accept it.
+
+    A coroutine cancelled with CancelSet stops at its next co_await.
+    Awaiting a set that is cancelled has the same effect, because
+    cancellation flows to the resume taskset.  The frame stays at its
+    suspension point until Release, which destroys it and runs the
+    destructors of its locals.
+
+    Awaiting a set that already has MAX_SUCCESSORS successors fails the
+    same way CreateTaskSet does.  The coroutine never resumes and its set
+    never completes, so MAX_SUCCESSORS must cover the awaits too.
+
+    The coroutine frame is owned by the TaskCoroutine object.  Release, or
+    destroying the object, must only happen after the set has completed.
+    TaskCoroutine is only defined when the compiler supports C++20
+    coroutines.  The rest of TaskMgr does not depend on it.
+
+    Copyright 2010 Intel Corporation
+    All Rights Reserved
+
+    Permission is granted to use, copy, distribute and prepare derivative works of this
+    software for any purpose and without fee, provided, that the above copyright notice
+    and this statement appear in all copies.  Intel makes no representations about the
+    suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED ""AS IS.""
+    INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+    INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+    INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+    assume any responsibility for any errors which may appear in this software nor any
+    responsibility to update it.
+*/
+#pragma once
+
+#include "TaskMgrTBB.h"
+
+#if defined( __cpp_impl_coroutine ) && __cpp_impl_coroutine >= 201902L
+#define TASKMGR_COROUTINES
+#endif
+
+#ifdef TASKMGR_COROUTINES
+#include <coroutine>
+#include <exception>
+
+extern TaskMgrTbb gTaskMgr;
+
+//  Taskset callback that resumes the coroutine frame passed as the arg.
+inline VOID
+ResumeCoroutineTask(
+    VOID*                       pvInfo,
+    INT                         iContext,
+    UINT                        uTaskId,
+    UINT                        uTaskCount )
+{
+    UNREFERENCED_PARAMETER( iContext );
+    UNREFERENCED_PARAMETER( uTaskId );
+    UNREFERENCED_PARAMETER( uTaskCount );
+
+    std::coroutine_handle<>::from_address( pvInfo ).resume();
+}
+
+/*! Return type of a coroutine that runs on gTaskMgr.  Move only.
+*/
+class TaskCoroutine
+{
+public:
+    struct promise_type;
+    typedef std::coroutine_handle<promise_type> FrameHandle;
+
+    struct promise_type
+    {
+        //  First taskset of the coroutine; every resume joins it.
+        TASKSETHANDLE           mhSet;
+
+        promise_type()
+            : mhSet( TASKSETHANDLE_INVALID )
+        {
+        }
+
+        //  The first taskset can only be created once the frame has
+        //  suspended, otherwise a worker could resume it first.
+        struct StartAwaiter
+        {
+            bool await_ready() const noexcept { return false; }
+
+            VOID await_suspend( FrameHandle hFrame ) noexcept
+            {
+                //  CreateTaskSet writes the handle before the set can
+                //  start, so the body always sees a valid mhSet.
+                gTaskMgr.CreateTaskSet(
+                    ResumeCoroutineTask,
+                    hFrame.address(),
+                    1,
+                    NULL,
+                    0,
+                    "TaskCoroutine",
+                    &hFrame.promise().mhSet );
+            }
+
+            VOID await_resume() const noexcept {}
+        };
+
+        TaskCoroutine get_return_object()
+        {
+            return TaskCoroutine( FrameHandle::from_promise( *this ) );
+        }
+
+        StartAwaiter initial_suspend() noexcept { return StartAwaiter(); }
+
+        //  Keep the frame until Release.  A cancelled coroutine is left
+        //  suspended at a co_await, and the owner destroys both kinds the
+        //  same way once the set has completed.
+        std::suspend_always final_suspend() noexcept { return std::suspend_always(); }
+
+        VOID return_void() {}
+
+        //  Tasks have no way to report errors to the creator.
+        VOID unhandled_exception() { std::terminate(); }
+    };
+
+    TaskCoroutine()
+        : mhFrame( nullptr )
+    {
+    }
+
+    TaskCoroutine( TaskCoroutine&& Other ) noexcept
+        : mhFrame( Other.mhFrame )
+    {
+        Other.mhFrame = nullptr;
+    }
+
+    TaskCoroutine& operator=( TaskCoroutine&& Other ) noexcept
+    {
+        if( this != &Other )
+        {
+            Release();
+            mhFrame = Other.mhFrame;
+            Other.mhFrame = nullptr;
+        }
+        return *this;
+    }
+
+    ~TaskCoroutine()
+    {
+        Release();
+    }
+
+    //  Taskset that completes when the coroutine body returns, or when it
+    //  stops at a co_await after being cancelled.
+    TASKSETHANDLE
+        GetHandle() const
+    {
+        return mhFrame ? mhFrame.promise().mhSet : TASKSETHANDLE_INVALID;
+    }
+
+    //  Destroys the frame and releases the handle.  The set must have
+    //  completed.
+    VOID
+        Release()
+    {
+        if( mhFrame )
+        {
+            TASKSETHANDLE   hSet = mhFrame.promise().mhSet;
+
+            mhFrame.destroy();
+            mhFrame = nullptr;
+
+            gTaskMgr.ReleaseHandle( hSet );
+        }
+    }
+
+private:
+    explicit TaskCoroutine( FrameHandle hFrame )
+        : mhFrame( hFrame )
+    {
+    }
+
+    FrameHandle mhFrame;
+};
+
+/*! co_await AwaitTaskSet( hSet ) suspends a TaskCoroutine until hSet
+    completes.  The caller must hold a reference to hSet until co_await
+    returns.
+*/
+class AwaitTaskSet
+{
+public:
+    explicit AwaitTaskSet( TASKSETHANDLE hSet )
+        : mhSet( hSet )
+    {
+    }
+
+    bool await_ready() const
+    {
+        return TRUE == gTaskMgr.IsSetComplete( mhSet );
+    }
+
+    VOID await_suspend( TaskCoroutine::FrameHandle hFrame )
+    {
+        TASKSETHANDLE       hResume;
+
+        //  Once the resume set exists the frame may already be running on
+        //  another thread, so this awaiter, which lives in the frame, is 
+        //  not touched after the call.
+        if( gTaskMgr.CreateTaskSet(
+                ResumeCoroutineTask,
+                hFrame.address(),
+                1,
+                &mhSet,
+                1,
+                "TaskCoroutine",
+                &hResume,
+                hFrame.promise().mhSet ) )
+        {
+            gTaskMgr.ReleaseHandle( hResume );
+        }
+    }
+
+    VOID await_resume() const {}
+
+private:
+    TASKSETHANDLE   mhSet;
+};
+
+#endif // TASKMGR_COROUTINES
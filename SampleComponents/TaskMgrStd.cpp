@@ -0,0 +1,1087 @@
+/*!
+    \file TaskMgrStd.cpp
+
+    TaskMgrStd.cpp implements the TaskMgrTbb interface on top of std::thread
+    instead of TBB.  It is compiled in place of TaskMgrTbb.cpp when
+    TASKMGR_STDTHREAD is defined, which is the default on platforms other
+    than Windows.  The handle, dependency, join and cancellation rules are
+    the same as the TBB backend; see TaskMgrTbb.h.
+
+    Every thread that runs tasks owns a Chase-Lev work-stealing deque.  A
+    thread pushes and pops tasks at the bottom of its own deque and steals
+    from the top of the others when it runs dry.  Tasks pushed by threads
+    the scheduler does not know about, and LOW priority tasks, go to shared
+    locked queues that are only checked once the deques are empty.  Idle
+    workers spin briefly and then sleep until new work is pushed.
+
+    Internal classes used to implement the backend are defined here.  They
+    are commented to illustrate their functionality, but are not for use by
+    the applicaton.  All the application needs to use is the TaskMgrTbb
+    interface.
+
+    Copyright 2010 Intel Corporation
+    All Rights Reserved
+
+    Permission is granted to use, copy, distribute and prepare derivative works of this
+    software for any purpose and without fee, provided, that the above copyright notice
+    and this statement appear in all copies.  Intel makes no representations about the
+    suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED ""AS IS.""
+    INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+    INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+    INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+    assume any responsibility for any errors which may appear in this software nor any
+    responsibility to update it.
+
+*/
+#include "TaskMgrTBB.h"
+
+#ifdef TASKMGR_STDTHREAD
+
+#include "CpuTopology.h"
+#include "TraceRecorder.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+
+
+//
+//  Global Domain for GPA CPU tracing
+//
+#ifdef PROFILEGPA
+
+__itt_domain* g_ProfileDomain = __itt_domain_create( TEXT( "TaskMgr.ProfileDomain" ) );
+
+#endif
+
+//
+//  Global task mananger instance
+//
+TaskMgrTbb                      gTaskMgr;
+
+//
+//  Index of the calling thread in the scheduler.  0 is the thread that
+//  called Init, 1 to n-1 are the workers and -1 is any other thread.  The
+//  index doubles as the task context id.
+//
+static thread_local INT         tlsThreadIndex = -1;
+
+//
+//  INTERNAL
+//  The SpinLock class implements a simple spinlock.  The lock is primarly
+//  used by the successor list for quick locking at the cost of spinning in
+//  the cases of contention.
+//
+class SpinLock
+{
+public:
+    SpinLock()
+        : mbLock( false )
+    {}
+
+    VOID
+    Lock()
+    {
+        while( mbLock.exchange( true, std::memory_order_acquire ) )
+        {}
+    }
+
+    VOID
+    Unlock()
+    {
+        mbLock.store( false, std::memory_order_release );
+    }
+
+private:
+
+    std::atomic<bool>           mbLock;
+};
+
+//
+//  INTERNAL
+//  WorkStealingDeque is a fixed size Chase-Lev deque of task items, using
+//  the C11 memory orderings from Le et al., "Correct and Efficient
+//  Work-Stealing for Weak Memory Models".  Only the owning thread may Push
+//  and Pop; any thread may Steal.  A task item packs the taskset handle in
+//  the high 32 bits and the task index in the low 32 bits.
+//
+class WorkStealingDeque
+{
+public:
+    static const int64_t        Capacity = 4096;
+
+    WorkStealingDeque()
+        : mllTop( 0 )
+        , mllBottom( 0 )
+    {}
+
+    //  Returns false if the deque is full.
+    bool
+    Push( uint64_t uItem )
+    {
+        int64_t llBottom = mllBottom.load( std::memory_order_relaxed );
+        int64_t llTop = mllTop.load( std::memory_order_acquire );
+
+        if( llBottom - llTop >= Capacity )
+        {
+            return false;
+        }
+
+        mItems[ llBottom & ( Capacity - 1 ) ].store( uItem, std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_release );
+        mllBottom.store( llBottom + 1, std::memory_order_relaxed );
+
+        return true;
+    }
+
+    bool
+    Pop( uint64_t* puItem )
+    {
+        int64_t llBottom = mllBottom.load( std::memory_order_relaxed ) - 1;
+        mllBottom.store( llBottom, std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        int64_t llTop = mllTop.load( std::memory_order_relaxed );
+
+        if( llTop > llBottom )
+        {
+            //  Empty.
+            mllBottom.store( llBottom + 1, std::memory_order_relaxed );
+            return false;
+        }
+
+        *puItem = mItems[ llBottom & ( Capacity - 1 ) ].load( std::memory_order_relaxed );
+
+        if( llTop == llBottom )
+        {
+            //  Last item, race the thieves for it.
+            bool bWon = mllTop.compare_exchange_strong(
+                llTop,
+                llTop + 1,
+                std::memory_order_seq_cst,
+                std::memory_order_relaxed );
+
+            mllBottom.store( llBottom + 1, std::memory_order_relaxed );
+            return bWon;
+        }
+
+        return true;
+    }
+
+    //  Returns false if the deque is empty or another thread won the item.
+    bool
+    Steal( uint64_t* puItem )
+    {
+        int64_t llTop = mllTop.load( std::memory_order_acquire );
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        int64_t llBottom = mllBottom.load( std::memory_order_acquire );
+
+        if( llTop >= llBottom )
+        {
+            return false;
+        }
+
+        uint64_t uItem = mItems[ llTop & ( Capacity - 1 ) ].load( std::memory_order_relaxed );
+
+        if( !mllTop.compare_exchange_strong(
+                llTop,
+                llTop + 1,
+                std::memory_order_seq_cst,
+                std::memory_order_relaxed ) )
+        {
+            return false;
+        }
+
+        *puItem = uItem;
+        return true;
+    }
+
+private:
+
+    //  Thieves and the owner write different ends, keep them on separate
+    //  cache lines.
+    std::atomic<int64_t>        mllTop;
+    CHAR                        mPadTop[ 64 - sizeof( std::atomic<int64_t> ) ];
+    std::atomic<int64_t>        mllBottom;
+    CHAR                        mPadBottom[ 64 - sizeof( std::atomic<int64_t> ) ];
+    std::atomic<uint64_t>       mItems[ Capacity ];
+};
+
+//
+//  INTERNAL
+//  Mailbox holds the tasks sent to one thread by an affinity hint.  Any
+//  thread may Push and Take.  The owner takes from it before stealing, and
+//  other threads only once they find nothing else, like the mailboxes tbb
+//  delivers affinitized tasks through.
+//
+class Mailbox
+{
+public:
+    Mailbox()
+        : muCount( 0 )
+    {}
+
+    VOID
+    Push( uint64_t uItem )
+    {
+        std::lock_guard<std::mutex> Lock( mLock );
+
+        mItems.push_back( uItem );
+        muCount.fetch_add( 1 );
+    }
+
+    //  Returns false if the mailbox is empty.
+    bool
+    Take( uint64_t* puItem )
+    {
+        if( 0 == muCount.load() )
+        {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> Lock( mLock );
+
+        if( mItems.empty() )
+        {
+            return false;
+        }
+
+        *puItem = mItems.front();
+        mItems.pop_front();
+        muCount.fetch_sub( 1 );
+        return true;
+    }
+
+private:
+
+    std::mutex                  mLock;
+    std::deque<uint64_t>        mItems;
+    std::atomic<UINT>           muCount;
+};
+
+//
+//  INTERNAL
+//  TaskSetStd tracks one taskset.  It owns the completion count and the
+//  successor array, the same way TaskSetTbb does for the TBB backend.
+//
+class TaskSetStd
+{
+public:
+    TaskSetStd()
+    : mhTaskset( TASKSETHANDLE_INVALID )
+    , mhJoinParent( TASKSETHANDLE_INVALID )
+    , mbHasBeenWaitedOn( FALSE )
+    , mbCompleted( FALSE )
+    , mbCancelled( FALSE )
+    , mePriority( TASKSETPRIORITY_NORMAL )
+    , muAffinityKey( TASKSETAFFINITY_NONE )
+    , mpFunc( NULL )
+    , mpvArg( NULL )
+    , muStartCount( 0 )
+    , muCompletionCount( 0 )
+    , muRefCount( 1 )
+    , muJoinRefs( 0 )
+    , muSize( 0 )
+    , mpszSetName( NULL )
+    {
+        memset( Successors, 0, sizeof( Successors ) ) ;
+    };
+
+    TaskSetStd*             Successors[ MAX_SUCCESSORS ];
+    TASKSETHANDLE           mhTaskset;
+
+    //  Set whose completion also waits for this set, or
+    //  TASKSETHANDLE_INVALID.  Cleared once the parent is signaled.
+    std::atomic<TASKSETHANDLE> mhJoinParent;
+    BOOL                    mbHasBeenWaitedOn;
+
+    //  TRUE once the completion count first reaches zero.
+    std::atomic<BOOL>       mbCompleted;
+
+    //  Cooperative cancellation flag, see TaskMgrTbb::CancelSet.
+    std::atomic<BOOL>       mbCancelled;
+
+    TASKSETPRIORITY         mePriority;
+    UINT                    muAffinityKey;
+
+    TASKSETFUNC             mpFunc;
+    void*                   mpvArg;
+
+    std::atomic<UINT>       muStartCount;
+    std::atomic<UINT>       muCompletionCount;
+    std::atomic<UINT>       muRefCount;
+
+    //  Joined sets that still have to signal this set.  The slot cannot be
+    //  recycled until it drops to zero.
+    std::atomic<UINT>       muJoinRefs;
+
+    UINT                    muSize;
+    SpinLock                mSuccessorsLock;
+
+    //  Name passed to CreateTaskSet, kept by pointer for profiling.
+    LPCSTR                  mpszSetName;
+};
+
+//
+//  INTERNAL
+//  TaskSchedulerStd owns the worker threads, one deque per thread and the
+//  shared queues.  Thread 0 is the thread that called Init; it only runs
+//  tasks while it waits on a set.
+//
+class TaskSchedulerStd
+{
+public:
+    TaskSchedulerStd(
+        UINT                uThreadCount,
+        BOOL                bPinWorkers )
+    : muThreadCount( uThreadCount )
+    , mpDeques( new WorkStealingDeque[ uThreadCount ] )
+    , mpMailboxes( new Mailbox[ uThreadCount ] )
+    , muShared( 0 )
+    , muSleepers( 0 )
+    , muEpoch( 0 )
+    , mbQuit( false )
+    , mbPinWorkers( bPinWorkers )
+    {
+        if( mbPinWorkers )
+        {
+            mTopology.Query();
+        }
+
+        for( UINT uThread = 1; uThread < muThreadCount; ++uThread )
+        {
+            mWorkers.push_back( std::thread( &TaskSchedulerStd::WorkerMain, this, uThread ) );
+        }
+    }
+
+    ~TaskSchedulerStd()
+    {
+        {
+            std::lock_guard<std::mutex> Lock( mSleepLock );
+            mbQuit = true;
+        }
+        mWakeUp.notify_all();
+
+        for( size_t uWorker = 0; uWorker < mWorkers.size(); ++uWorker )
+        {
+            mWorkers[ uWorker ].join();
+        }
+
+        delete [] mpDeques;
+        delete [] mpMailboxes;
+    }
+
+    //  Queue a task.  Call Wake once a batch has been pushed.  A task with
+    //  an affinity thread other than the calling one goes to its mailbox.
+    VOID
+    Push(
+        uint64_t            uItem,
+        TASKSETPRIORITY     ePriority,
+        INT                 iAffinity = -1 )
+    {
+        INT                 iThread = tlsThreadIndex;
+
+        if( TASKSETPRIORITY_LOW != ePriority &&
+            iAffinity >= 0 &&
+            iAffinity != iThread &&
+            (UINT)iAffinity < muThreadCount )
+        {
+            mpMailboxes[ iAffinity ].Push( uItem );
+            return;
+        }
+
+        if( TASKSETPRIORITY_LOW != ePriority &&
+            iThread >= 0 &&
+            mpDeques[ iThread ].Push( uItem ) )
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> Lock( mQueueLock );
+
+        if( TASKSETPRIORITY_LOW == ePriority )
+        {
+            mLowPriority.push_back( uItem );
+        }
+        else
+        {
+            mInjected.push_back( uItem );
+        }
+
+        muShared.fetch_add( 1 );
+    }
+
+    //  Wake sleeping workers after work was pushed.
+    VOID
+    Wake()
+    {
+        muEpoch.fetch_add( 1 );
+
+        if( muSleepers.load() > 0 )
+        {
+            //  Taking the lock orders this with a worker that is about to
+            //  sleep, so the notification cannot be lost.
+            std::lock_guard<std::mutex> Lock( mSleepLock );
+            mWakeUp.notify_all();
+        }
+    }
+
+    //  Run one queued task on the calling thread.  Returns FALSE if there
+    //  was nothing to run or the thread is not known to the scheduler.
+    BOOL
+    Help()
+    {
+        INT                 iThread = tlsThreadIndex;
+        uint64_t            uItem;
+
+        if( iThread < 0 || !FindTask( iThread, &uItem ) )
+        {
+            return FALSE;
+        }
+
+        Run( uItem );
+        return TRUE;
+    }
+
+private:
+
+    static const UINT       IdleSpins = 64;
+
+    VOID
+    WorkerMain( UINT uThread )
+    {
+        UINT                uIdle = 0;
+
+        tlsThreadIndex = uThread;
+
+        if( mbPinWorkers )
+        {
+            CpuTopology::PinCurrentThread( mTopology.getPlacement( uThread ) );
+        }
+
+        while( !mbQuit.load() )
+        {
+            uint64_t        uEpoch = muEpoch.load();
+            uint64_t        uItem;
+
+            if( FindTask( uThread, &uItem ) )
+            {
+                Run( uItem );
+                uIdle = 0;
+                continue;
+            }
+
+            if( ++uIdle < IdleSpins )
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            //
+            //  Nothing found for a while.  Sleep until something is pushed;
+            //  anything pushed since the search started bumped the epoch.
+            //
+            std::unique_lock<std::mutex> Lock( mSleepLock );
+            muSleepers.fetch_add( 1 );
+
+            while( !mbQuit.load() && uEpoch == muEpoch.load() )
+            {
+                mWakeUp.wait( Lock );
+            }
+
+            muSleepers.fetch_sub( 1 );
+            uIdle = 0;
+        }
+    }
+
+    BOOL
+    FindTask(
+        UINT                uThread,
+        uint64_t*           puItem )
+    {
+        if( mpDeques[ uThread ].Pop( puItem ) ||
+            mpMailboxes[ uThread ].Take( puItem ) )
+        {
+            return TRUE;
+        }
+
+        for( UINT uVictim = 1; uVictim < muThreadCount; ++uVictim )
+        {
+            if( mpDeques[ ( uThread + uVictim ) % muThreadCount ].Steal( puItem ) )
+            {
+                return TRUE;
+            }
+        }
+
+        if( 0 != muShared.load() )
+        {
+            std::lock_guard<std::mutex> Lock( mQueueLock );
+
+            std::deque<uint64_t>* pQueue = !mInjected.empty() ? &mInjected : &mLowPriority;
+
+            if( !pQueue->empty() )
+            {
+                *puItem = pQueue->front();
+                pQueue->pop_front();
+                muShared.fetch_sub( 1 );
+                return TRUE;
+            }
+        }
+
+        //  Nothing else to do; take what was sent to a busy thread.
+        for( UINT uVictim = 1; uVictim < muThreadCount; ++uVictim )
+        {
+            if( mpMailboxes[ ( uThread + uVictim ) % muThreadCount ].Take( puItem ) )
+            {
+                return TRUE;
+            }
+        }
+
+        return FALSE;
+    }
+
+    VOID
+    Run( uint64_t uItem )
+    {
+        gTaskMgr.ExecuteTask(
+            (TASKSETHANDLE)( uItem >> 32 ),
+            (UINT)( uItem & 0xFFFFFFFF ) );
+    }
+
+    UINT                    muThreadCount;
+    WorkStealingDeque*      mpDeques;
+    Mailbox*                mpMailboxes;
+    std::vector<std::thread> mWorkers;
+
+    //  Tasks from unknown threads and LOW priority tasks, and their count.
+    std::mutex              mQueueLock;
+    std::deque<uint64_t>    mInjected;
+    std::deque<uint64_t>    mLowPriority;
+    std::atomic<UINT>       muShared;
+
+    //  Sleeping workers wait for muEpoch to change.
+    std::mutex              mSleepLock;
+    std::condition_variable mWakeUp;
+    std::atomic<UINT>       muSleepers;
+    std::atomic<uint64_t>   muEpoch;
+    std::atomic<bool>       mbQuit;
+
+    BOOL                    mbPinWorkers;
+    CpuTopology             mTopology;
+};
+
+TaskMgrTbb::TaskMgrTbb()
+    : miDemoModeTBBThreadCountOverride( -1 )
+    , mbPinWorkerThreads( FALSE )
+    , muNextFreeSet( 0 )
+    , mpAllocLock( new SpinLock() )
+    , mpScheduler( NULL )
+{
+    memset(
+        mSets,
+        0x0,
+        sizeof( mSets ) );
+}
+
+TaskMgrTbb::~TaskMgrTbb()
+{
+    delete mpAllocLock;
+}
+
+BOOL
+TaskMgrTbb::Init()
+{
+    UINT                    uThreadCount;
+
+    //  Same meaning as the tbb thread count: workers plus the main thread.
+    if( miDemoModeTBBThreadCountOverride > 0 )
+    {
+        uThreadCount = miDemoModeTBBThreadCountOverride;
+    }
+    else
+    {
+        uThreadCount = std::thread::hardware_concurrency();
+    }
+
+    if( 0 == uThreadCount )
+    {
+        uThreadCount = 1;
+    }
+
+    tlsThreadIndex = 0;
+
+    //  Threads of the last Init are gone, forget where tasks ran.
+    memset(
+        mAffinity,
+        0x0,
+        sizeof( mAffinity ) );
+
+    mpScheduler = new TaskSchedulerStd( uThreadCount, mbPinWorkerThreads );
+
+    //  Reset thread override demo variable.
+    miDemoModeTBBThreadCountOverride = -1;
+
+    return TRUE;
+}
+
+VOID
+TaskMgrTbb::Shutdown()
+{
+    //
+    //  Wait for any left-over tasksets
+    for( UINT uSet = 0; uSet < MAX_TASKSETS; ++uSet )
+    {
+        if( mSets[ uSet ] )
+        {
+            WaitForSet( uSet );
+        }
+    }
+
+    //
+    //  A worker can still be finishing a completed set, releasing its
+    //  handle or signalling its join parent.  Join the workers before the
+    //  sets are freed.
+    //
+    delete mpScheduler;
+    mpScheduler = NULL;
+
+    for( UINT uSet = 0; uSet < MAX_TASKSETS; ++uSet )
+    {
+        delete mSets[ uSet ];
+        mSets[ uSet ] = NULL;
+    }
+}
+
+BOOL
+TaskMgrTbb::CreateTaskSet(
+    TASKSETFUNC             pFunc,
+    VOID*                   pArg,
+    UINT                    uTaskCount,
+    TASKSETHANDLE*          pInDepends,
+    UINT                    uInDepends,
+    OPTIONAL LPCSTR         szSetName,
+    TASKSETHANDLE*          pOutHandle,
+    OPTIONAL TASKSETHANDLE  hJoinParent,
+    OPTIONAL TASKSETPRIORITY ePriority,
+    OPTIONAL UINT           uAffinityKey )
+{
+    TASKSETHANDLE           hSet;
+    TASKSETHANDLE           hSetParent = TASKSETHANDLE_INVALID;
+    TASKSETHANDLE*          pDepends = pInDepends;
+    UINT                    uDepends = uInDepends;
+
+    //  Validate incomming parameters
+    if( 0 == uTaskCount || NULL == pFunc )
+    {
+        return FALSE;
+    }
+
+    //
+    //  Tasksets are started when their parents complete.  If no parent for a
+    //  taskset is specified we need to create a fake one.
+    //
+    if( 0 == uDepends )
+    {
+        hSetParent = AllocateTaskSet();
+        mSets[ hSetParent ]->muCompletionCount = 0;
+        mSets[ hSetParent ]->muRefCount = 1;
+        mSets[ hSetParent ]->mbCompleted = TRUE;
+        mSets[ hSetParent ]->mbHasBeenWaitedOn = TRUE;
+
+        uDepends = 1;
+        pDepends = &hSetParent;
+    }
+
+    //
+    //  Allocate and setup the internal taskset
+    //
+    hSet = AllocateTaskSet();
+
+    mSets[ hSet ]->muStartCount   = uDepends;
+
+    //  NOTE: one refcount is owned by the tasking system the other
+    //  by the caller.
+    mSets[ hSet ]->muRefCount     = 2;
+
+    mSets[ hSet ]->mpFunc         = pFunc;
+    mSets[ hSet ]->mpvArg         = pArg;
+    mSets[ hSet ]->muSize         = uTaskCount;
+    mSets[ hSet ]->muCompletionCount = uTaskCount;
+    mSets[ hSet ]->mhTaskset      = hSet;
+    mSets[ hSet ]->mbCompleted    = FALSE;
+    mSets[ hSet ]->mbCancelled    = FALSE;
+    mSets[ hSet ]->mePriority     = ePriority;
+    mSets[ hSet ]->muAffinityKey  = uAffinityKey;
+
+    //  The name is interned so the caller's string need not outlive the
+    //  set, or the trace the set's tasks are recorded in.
+    mSets[ hSet ]->mpszSetName    = gTraceRecorder.InternName( szSetName ? szSetName : "Unnamed Task" );
+
+    //
+    //  A joined set holds one completion count on its parent, and one join
+    //  reference so the parent slot is not recycled before the joined set
+    //  has signaled it.  This must be done before the dependencies are
+    //  wired since that can start the set.
+    //
+    if( TASKSETHANDLE_INVALID != hJoinParent )
+    {
+        TaskSetStd*         pParent = mSets[ hJoinParent ];
+
+        pParent->muCompletionCount.fetch_add( 1 );
+        pParent->muJoinRefs.fetch_add( 1 );
+
+        mSets[ hSet ]->mhJoinParent = hJoinParent;
+
+        //  Work forked from a cancelled set starts out cancelled.
+        mSets[ hSet ]->mbCancelled = pParent->mbCancelled.load();
+    }
+
+    //  Set output taskset handle.  Wiring the dependencies can start the
+    //  set, so it is written first for tasks that read their own handle.
+    *pOutHandle = hSet;
+
+    //
+    //  Iterate over the dependency list and setup the successor
+    //  pointers in each parent to point to this taskset.
+    //
+    for( UINT uDepend = 0; uDepend < uDepends; ++uDepend )
+    {
+        TASKSETHANDLE       hDependsOn = pDepends[ uDepend ];
+        TaskSetStd*         pDependsOn = mSets[ hDependsOn ];
+        UINT                uPrevCompletion;
+
+        //
+        //  A taskset with a new successor is consider incomplete even if it
+        //  already has completed.  See TaskMgrTbb.cpp for details.
+        //
+        uPrevCompletion = pDependsOn->muCompletionCount.fetch_add( 1 );
+
+        if( 0 == uPrevCompletion && hSetParent != hDependsOn )
+        {
+            pDependsOn->muRefCount.fetch_add( 1 );
+        }
+
+        pDependsOn->mSuccessorsLock.Lock();
+
+        UINT uSuccessor;
+        for( uSuccessor = 0; uSuccessor < MAX_SUCCESSORS; ++uSuccessor )
+        {
+            if( NULL == pDependsOn->Successors[ uSuccessor ] )
+            {
+                pDependsOn->Successors[ uSuccessor ] = mSets[ hSet ];
+                break;
+            }
+        }
+
+        pDependsOn->mSuccessorsLock.Unlock();
+
+        //
+        //  The list also fills when several threads add successors to a set
+        //  that has already completed faster than their completions drain
+        //  it.  That dependency is already satisfied, so signal this set
+        //  here instead.  Otherwise we have a problem.  The app needs to 
+        //  give us more space by increasing MAX_SUCCESSORS
+        //
+        if( uSuccessor == MAX_SUCCESSORS )
+        {
+            if( !pDependsOn->mbCompleted )
+            {
+                printf( "Too many successors for this task set.\nIncrease MAX_SUCCESSORS\n" );
+                return FALSE;
+            }
+
+            if( pDependsOn->mbCancelled )
+            {
+                mSets[ hSet ]->mbCancelled = TRUE;
+            }
+
+            if( 1 == mSets[ hSet ]->muStartCount.fetch_sub( 1 ) )
+            {
+                StartTaskSet( hSet );
+            }
+        }
+
+        //
+        //  Mark the set as completed for the successor adding operation.
+        //
+        CompleteTaskSet( hDependsOn );
+    }
+
+    return TRUE;
+}
+
+VOID
+TaskMgrTbb::ReleaseHandle(
+    TASKSETHANDLE           hSet )
+{
+    //
+    //  Destruction is deferred until the slot is needed again, since
+    //  another thread may still be finishing the completion of the set.
+    //
+    mSets[ hSet ]->muRefCount.fetch_sub( 1 );
+}
+
+VOID
+TaskMgrTbb::ReleaseHandles(
+    TASKSETHANDLE*              phSet,
+    UINT                        uSet )
+{
+    for( UINT uIdx = 0; uIdx < uSet; ++uIdx )
+    {
+        ReleaseHandle( phSet[ uIdx ] );
+    }
+}
+
+VOID
+TaskMgrTbb::WaitForSet(
+    TASKSETHANDLE               hSet )
+{
+    TaskSetStd*                 pSet = mSets[ hSet ];
+
+    //
+    //  Run tasks of any set until this one completes.
+    //
+    while( !pSet->mbCompleted )
+    {
+        if( !mpScheduler->Help() )
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    pSet->mbHasBeenWaitedOn = TRUE;
+}
+
+BOOL
+TaskMgrTbb::TryWaitForSet(
+    TASKSETHANDLE               hSet,
+    DWORD                       dwBudgetUs )
+{
+    TaskSetStd*                 pSet = mSets[ hSet ];
+
+    std::chrono::steady_clock::time_point Deadline =
+        std::chrono::steady_clock::now() + std::chrono::microseconds( dwBudgetUs );
+
+    //
+    //  Run tasks of any set until this one completes or a task finishes
+    //  past the deadline.
+    //
+    while( !pSet->mbCompleted )
+    {
+        if( std::chrono::steady_clock::now() >= Deadline )
+        {
+            return FALSE;
+        }
+
+        if( !mpScheduler->Help() )
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    pSet->mbHasBeenWaitedOn = TRUE;
+
+    return TRUE;
+}
+
+BOOL
+TaskMgrTbb::IsSetComplete(
+    TASKSETHANDLE               hSet )
+{
+    return mSets[ hSet ]->mbCompleted;
+}
+
+VOID
+TaskMgrTbb::CancelSet(
+    TASKSETHANDLE               hSet )
+{
+    mSets[ hSet ]->mbCancelled = TRUE;
+}
+
+BOOL
+TaskMgrTbb::IsSetCancelled(
+    TASKSETHANDLE               hSet )
+{
+    return mSets[ hSet ]->mbCancelled;
+}
+
+VOID
+TaskMgrTbb::CancelAndWaitForSet(
+    TASKSETHANDLE               hSet )
+{
+    CancelSet( hSet );
+    WaitForSet( hSet );
+}
+
+TASKSETHANDLE
+TaskMgrTbb::AllocateTaskSet()
+{
+    //  New sets start with one reference so no other thread can claim the
+    //  slot before CreateTaskSet has filled it in.
+    TaskSetStd*         pSet = new TaskSetStd();
+    TaskSetStd*         pOldSet = NULL;
+    UINT                uSet;
+
+    //
+    //  NOTE: if we have too many tasks pending we will spin on the slot.  If
+    //  spinning occures, see TaskMgrTbb.h and increase MAX_TASKSETS
+    //
+    mpAllocLock->Lock();
+
+    uSet = muNextFreeSet;
+    while( NULL != mSets[ uSet ] &&
+           ( 0 != mSets[ uSet ]->muRefCount ||
+             0 != mSets[ uSet ]->muJoinRefs ) )
+    {
+        uSet = ( uSet + 1 ) % MAX_TASKSETS;
+    }
+
+    pOldSet = mSets[ uSet ];
+
+    mSets[ uSet ] = pSet;
+    muNextFreeSet = ( uSet + 1 ) % MAX_TASKSETS;
+
+    mpAllocLock->Unlock();
+
+    delete pOldSet;
+
+    return (TASKSETHANDLE)uSet;
+}
+
+VOID
+TaskMgrTbb::StartTaskSet(
+    TASKSETHANDLE           hSet )
+{
+    TaskSetStd*             pSet = mSets[ hSet ];
+
+    for( UINT uIdx = 0; uIdx < pSet->muSize; ++uIdx )
+    {
+        INT                 iAffinity = -1;
+
+        //  Send the task to the thread that last ran its index.
+        if( pSet->muAffinityKey < MAX_AFFINITYKEYS && uIdx < MAX_AFFINITYTASKS )
+        {
+            iAffinity = (INT)mAffinity[ pSet->muAffinityKey ][ uIdx ] - 1;
+        }
+
+        mpScheduler->Push( ( (uint64_t)hSet << 32 ) | uIdx, pSet->mePriority, iAffinity );
+    }
+
+    mpScheduler->Wake();
+}
+
+VOID
+TaskMgrTbb::ExecuteTask(
+    TASKSETHANDLE           hSet,
+    UINT                    uIdx )
+{
+    TaskSetStd*             pSet = mSets[ hSet ];
+    INT                     iContext = tlsThreadIndex < 0 ? 0 : tlsThreadIndex;
+
+    //  Remember where the index ran, including when it was stolen, so the
+    //  next set with this key sends it back here.
+    if( pSet->muAffinityKey < MAX_AFFINITYKEYS &&
+        uIdx < MAX_AFFINITYTASKS &&
+        tlsThreadIndex >= 0 &&
+        mAffinity[ pSet->muAffinityKey ][ uIdx ] != tlsThreadIndex + 1 )
+    {
+        mAffinity[ pSet->muAffinityKey ][ uIdx ] = (unsigned short)( tlsThreadIndex + 1 );
+    }
+
+    {
+        TraceScope          Trace( pSet->mpszSetName, iContext );
+
+        ProfileBeginTask( pSet->mpszSetName );
+
+        //  Cancelled sets are drained without calling back into the app.
+        if( !pSet->mbCancelled )
+        {
+            pSet->mpFunc( pSet->mpvArg, iContext, uIdx, pSet->muSize );
+        }
+
+        ProfileEndTask();
+    }
+
+    //  Notify the taskmgr that this set completed one of its tasks.
+    CompleteTaskSet( hSet );
+}
+
+VOID
+TaskMgrTbb::CompleteTaskSet(
+    TASKSETHANDLE           hSet )
+{
+    TaskSetStd*             pSet = mSets[ hSet ];
+
+    UINT uCount = pSet->muCompletionCount.fetch_sub( 1 ) - 1;
+
+    if( 0 == uCount )
+    {
+        //
+        //  The task set has completed.  We need to look at the successors
+        //  and signal them that this dependency of theirs has completed.
+        //
+        pSet->mSuccessorsLock.Lock();
+
+        for( UINT uSuccessor = 0; uSuccessor < MAX_SUCCESSORS; ++uSuccessor )
+        {
+            TaskSetStd* pSuccessor = pSet->Successors[ uSuccessor ];
+
+            //
+            //  A signaled successor must be removed from the Successors list
+            //  before the mSuccessorsLock can be released.
+            //
+            pSet->Successors[ uSuccessor ] = NULL;
+
+            if( NULL != pSuccessor )
+            {
+                //  Cancellation flows down the dependency chain.
+                if( pSet->mbCancelled )
+                {
+                    pSuccessor->mbCancelled = TRUE;
+                }
+
+                //
+                //  If the start count is 0 the successor has had all its
+                //  dependencies satisified and can be scheduled.
+                //
+                if( 1 == pSuccessor->muStartCount.fetch_sub( 1 ) )
+                {
+                    StartTaskSet( pSuccessor->mhTaskset );
+                }
+            }
+        }
+
+        pSet->mSuccessorsLock.Unlock();
+
+        pSet->mbCompleted = TRUE;
+
+        //
+        //  Signal the set this one joined exactly once.  The completion
+        //  count can return to zero again when successors are added to a
+        //  completed set.
+        //
+        TASKSETHANDLE hJoinParent = pSet->mhJoinParent.exchange( TASKSETHANDLE_INVALID );
+
+        ReleaseHandle( hSet );
+
+        if( TASKSETHANDLE_INVALID != hJoinParent )
+        {
+            TaskSetStd* pParent = mSets[ hJoinParent ];
+
+            CompleteTaskSet( hJoinParent );
+
+            //  Drop the join reference last; the parent slot cannot be
+            //  recycled until it reaches zero.
+            pParent->muJoinRefs.fetch_sub( 1 );
+        }
+    }
+}
+
+#endif // TASKMGR_STDTHREAD
@@ -27,6 +27,11 @@
 */
 #include "TaskMgrTBB.h"
 
+#ifndef TASKMGR_STDTHREAD
+
+#include "CpuTopology.h"
+#include "TraceRecorder.h"
+
 //  TBB includes
 #include <tbb_stddef.h>
 #include <task.h>
@@ -34,8 +39,6 @@
 #include <task_scheduler_init.h>
 #include <task_scheduler_observer.h>
 
-#include <strsafe.h>
-
 #pragma warning ( push )
 #pragma warning ( disable : 4995 ) // skip deprecated warning on intrinsics.
 #include <intrin.h>
@@ -113,21 +116,59 @@ enumerable_thread_specific<INT> gContextId;
 //  be used by tasks in the tasking system to access thread-local data
 //  in an efficient mannor.
 //
+//  When pinning is enabled, each worker is also pinned to the next 
+//  logical processor in the CpuTopology placement order.
+//
 class TbbContextId : public task_scheduler_observer
 {
     void 
-    on_scheduler_entry( bool /*bIsWorker*/ )  
+    on_scheduler_entry( bool bIsWorker )  
     {
         INT iContext = gContextIdCount.fetch_and_increment();
         gContextId.local() = iContext;
+
+        if( bIsWorker && mbPinWorkers )
+        {
+            //  Placement slot 0 is left for the main thread.
+            UINT uSlot = mPinCount.fetch_and_increment() + 1;
+            CpuTopology::PinCurrentThread( mTopology.getPlacement( uSlot ) );
+        }
     }
 
 public:
-    TbbContextId()
+    TbbContextId( BOOL bPinWorkers )
+    : mbPinWorkers( bPinWorkers )
     {
         gContextIdCount = 0;
+        mPinCount = 0;
+
+        if( mbPinWorkers )
+        {
+            mTopology.Query();
+        }
+
         observe( true );
     }
+
+private:
+    BOOL                    mbPinWorkers;
+    atomic<UINT>            mPinCount;
+    CpuTopology             mTopology;
+};
+
+//
+//  INTERNAL
+//  WaitTaskTbb is the root the main thread waits on in TryWaitForSet.
+//  It never runs; waiting on it lets the main thread run tasks of any set
+//  until its reference count is dropped by SignalWaiter.
+//
+class WaitTaskTbb : public task
+{
+public:
+    task* execute()
+    {
+        return NULL;
+    }
 };
 
 //
@@ -149,6 +190,9 @@ public:
     , muSize( 0 )
     , mpszSetName( NULL )
     , mhTaskSet( TASKSETHANDLE_INVALID )
+    , mePriority( TASKSETPRIORITY_NORMAL )
+    , muAffinityKey( TASKSETAFFINITY_NONE )
+    , mpNextParked( NULL )
     {
     };
 
@@ -157,42 +201,119 @@ public:
         void*               pvArg,
         UINT                uIdx,
         UINT                uSize,
-        CHAR*               pszSetName,
-        TASKSETHANDLE       hSet ) 
+        LPCSTR              pszSetName,
+        TASKSETHANDLE       hSet,
+        TASKSETPRIORITY     ePriority,
+        UINT                uAffinityKey ) 
     : mpFunc( pFunc )
     , mpvArg( pvArg )
     , muIdx( uIdx )
     , muSize( uSize )
     , mpszSetName( pszSetName )
     , mhTaskSet( hSet )
+    , mePriority( ePriority )
+    , muAffinityKey( uAffinityKey )
+    , mpNextParked( NULL )
     {
+        //  Route this task index to the worker that ran it last time.
+        if( HasAffinitySlot() )
+        {
+            set_affinity( gTaskMgr.mAffinity[ muAffinityKey ][ muIdx ] );
+        }
     };
 
+    //  tbb calls note_affinity when the task runs on a thread other than 
+    //  its affinity, including when it is stolen.  Remember that thread so
+    //  the next set with this key follows it.
+    void 
+    note_affinity( affinity_id id )
+    {
+        if( HasAffinitySlot() )
+        {
+            gTaskMgr.mAffinity[ muAffinityKey ][ muIdx ] = id;
+        }
+    }
+
     //  execute will call the app-defined task callback with the 
     //  proper parameters
     task* execute()
     {
-        ProfileBeginTask( mpszSetName );
+        //  Background work yields to frame-critical work that is in flight.
+        if( TASKSETPRIORITY_LOW == mePriority &&
+            gTaskMgr.ParkIfHighPriorityPending( this ) )
+        {
+            return NULL;
+        }
 
-        mpFunc( mpvArg, gContextId.local(), muIdx, muSize );
+        {
+            INT             iContext = gContextId.local();
+            TraceScope      Trace( mpszSetName, iContext );
 
-        ProfileEndTask();
+            ProfileBeginTask( mpszSetName );
+
+            //  Cancelled sets are drained without calling back into the app.
+            if( !gTaskMgr.IsSetCancelled( mhTaskSet ) )
+            {
+                mpFunc( mpvArg, iContext, muIdx, muSize );
+            }
+
+            ProfileEndTask();
+        }
 
         //  Notify the taskmgr that this set completed one of its tasks.
         gTaskMgr.CompleteTaskSet( mhTaskSet );
 
+        if( TASKSETPRIORITY_HIGH == mePriority &&
+            0 == _InterlockedDecrement( &gTaskMgr.mlHighPriorityTasks ) )
+        {
+            gTaskMgr.ResumeParkedTasks();
+        }
+
+        //  A timed wait on the main thread only ends between tasks.
+        if( gTaskMgr.mlWaitState & 1 )
+        {
+            gTaskMgr.CheckWaitBudget();
+        }
+
         return NULL;
     }
 
+    //  Allocate a copy of this task that stays a child of the same set, so
+    //  it can be parked while this instance returns to tbb.
+    GenericTask*
+    CloneForParking()
+    {
+        return new( allocate_additional_child_of( *parent() ) ) GenericTask(
+            mpFunc,
+            mpvArg,
+            muIdx,
+            muSize,
+            mpszSetName,
+            mhTaskSet,
+            mePriority,
+            muAffinityKey );
+    }
+
+    //  Link in TaskMgrTbb's parked task list.
+    GenericTask*            mpNextParked;
+
 private:
 
     TASKSETFUNC             mpFunc;
     void*                   mpvArg;
     UINT                    muIdx;
     UINT                    muSize;
-    CHAR*                   mpszSetName;
+    LPCSTR                  mpszSetName;
 
     TASKSETHANDLE           mhTaskSet;
+    TASKSETPRIORITY         mePriority;
+    UINT                    muAffinityKey;
+
+    BOOL
+    HasAffinitySlot() const
+    {
+        return muAffinityKey < MAX_AFFINITYKEYS && muIdx < MAX_AFFINITYTASKS;
+    }
 };
 
 //
@@ -210,9 +331,15 @@ public:
     , mpvArg( 0 )
     , muSize( 0 )
     , mhTaskset( TASKSETHANDLE_INVALID )
+    , mhJoinParent( TASKSETHANDLE_INVALID )
     , mbHasBeenWaitedOn( FALSE )
+    , mbCompleted( FALSE )
+    , mbCancelled( FALSE )
+    , mePriority( TASKSETPRIORITY_NORMAL )
+    , muAffinityKey( TASKSETAFFINITY_NONE )
+    , mdwOwnerThreadId( GetCurrentThreadId() )
+    , mpszSetName( NULL )
     {
-        mszSetName[ 0 ] = 0;
         memset( Successors, 0, sizeof( Successors ) ) ;
     };
 
@@ -222,6 +349,11 @@ public:
         //  one plus the task set count
         set_ref_count( muSize + 1 );
 
+        if( TASKSETPRIORITY_HIGH == mePriority )
+        {
+            _InterlockedExchangeAdd( &gTaskMgr.mlHighPriorityTasks, (LONG)muSize );
+        }
+
         ProfileBeginTask("Taskset Spawn Tasks");
 
         //  Iterate for each task in the set and spawn a GenericTask
@@ -232,8 +364,10 @@ public:
                 mpvArg,
                 uIdx, 
                 muSize,
-                mszSetName,
-                mhTaskset ) );
+                mpszSetName,
+                mhTaskset,
+                mePriority,
+                muAffinityKey ) );
         }
 
         ProfileEndTask();
@@ -244,8 +378,24 @@ public:
     
     TaskSetTbb*             Successors[ MAX_SUCCESSORS ];
     TASKSETHANDLE           mhTaskset;
+
+    //  Set whose completion also waits for this set, or 
+    //  TASKSETHANDLE_INVALID.  Cleared once the parent is signaled.
+    volatile TASKSETHANDLE  mhJoinParent;
     BOOL                    mbHasBeenWaitedOn;
 
+    //  TRUE once the completion count first reaches zero.
+    volatile BOOL           mbCompleted;
+
+    //  Cooperative cancellation flag, see TaskMgrTbb::CancelSet.
+    volatile BOOL           mbCancelled;
+
+    TASKSETPRIORITY         mePriority;
+    UINT                    muAffinityKey;
+
+    //  The tbb root can only be waited on by the thread that allocated it.
+    DWORD                   mdwOwnerThreadId;
+
     TASKSETFUNC             mpFunc;
     void*                   mpvArg;
 
@@ -256,7 +406,8 @@ public:
     UINT                    muSize;    
     SpinLock                mSuccessorsLock;
 
-    CHAR                    mszSetName[ MAX_TASKSETNAMELENGTH ];
+    //  Name passed to CreateTaskSet, kept by pointer for profiling.
+    LPCSTR                  mpszSetName;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -268,28 +419,53 @@ public:
 TaskMgrTbb::TaskMgrTbb()
     : mpTbbContextId( NULL )
     , mpTbbInit( NULL )
+    , muNextFreeSet( 0 )
+    , mpAllocLock( new SpinLock() )
+    , mlHighPriorityTasks( 0 )
+    , mpParkedTasks( NULL )
+    , mpParkLock( new SpinLock() )
     , miDemoModeTBBThreadCountOverride( task_scheduler_init::automatic )
+    , mbPinWorkerThreads( FALSE )
+    , mpWaiter( NULL )
+    , mlWaitState( 0 )
+    , mhWaitSet( TASKSETHANDLE_INVALID )
+    , mllWaitDeadline( 0 )
+    , mllTicksPerSecond( 1 )
 {
     memset(
         mSets,
         0x0,
         sizeof( mSets ) );
+
+    memset(
+        mAffinity,
+        0x0,
+        sizeof( mAffinity ) );
 }
 
 TaskMgrTbb::~TaskMgrTbb()
 {
+    delete mpAllocLock;
+    delete mpParkLock;
 }
 
 BOOL
 TaskMgrTbb::Init()
 {
-    mpTbbContextId = new TbbContextId();
+    mpTbbContextId = new TbbContextId( mbPinWorkerThreads );
 
     mpTbbInit = new task_scheduler_init( miDemoModeTBBThreadCountOverride );
 
     //  Reset thread override demo variable.
     miDemoModeTBBThreadCountOverride = -1;
 
+    //  Roots can only be waited on by the thread that allocated them.
+    mpWaiter = new( task::allocate_root() ) WaitTaskTbb();
+
+    LARGE_INTEGER liFrequency;
+    QueryPerformanceFrequency( &liFrequency );
+    mllTicksPerSecond = liFrequency.QuadPart;
+
     return TRUE;
 }
 
@@ -309,6 +485,13 @@ TaskMgrTbb::Shutdown()
             mSets[ uSet ] = NULL;
         }
     }
+
+    if( mpWaiter )
+    {
+        mpWaiter->set_ref_count( 0 );
+        mpWaiter->destroy( *mpWaiter );
+        mpWaiter = NULL;
+    }
     
     delete mpTbbInit;
     delete mpTbbContextId;
@@ -322,7 +505,10 @@ TaskMgrTbb::CreateTaskSet(
     TASKSETHANDLE*          pInDepends,
     UINT                    uInDepends,
     OPTIONAL LPCSTR         szSetName,
-    TASKSETHANDLE*          pOutHandle )
+    TASKSETHANDLE*          pOutHandle,
+    OPTIONAL TASKSETHANDLE  hJoinParent,
+    OPTIONAL TASKSETPRIORITY ePriority,
+    OPTIONAL UINT           uAffinityKey )
 {
     TASKSETHANDLE           hSet;
     TASKSETHANDLE           hSetParent = TASKSETHANDLE_INVALID;
@@ -345,6 +531,7 @@ TaskMgrTbb::CreateTaskSet(
         hSetParent = AllocateTaskSet();
         mSets[ hSetParent ]->muCompletionCount = 0;
         mSets[ hSetParent ]->muRefCount = 1;
+        mSets[ hSetParent ]->mbCompleted = TRUE;
 
         //  Implicit starting task never needs to be waited on for TBB since
         //  it is not a real tbb task.
@@ -370,27 +557,37 @@ TaskMgrTbb::CreateTaskSet(
     mSets[ hSet ]->muSize         = uTaskCount;
     mSets[ hSet ]->muCompletionCount = uTaskCount;
     mSets[ hSet ]->mhTaskset      = hSet;
+    mSets[ hSet ]->mbCompleted    = FALSE;
+    mSets[ hSet ]->mbCancelled    = FALSE;
+    mSets[ hSet ]->mePriority     = ePriority;
+    mSets[ hSet ]->muAffinityKey  = uAffinityKey;
+
+    //  The name is interned so the caller's string need not outlive the
+    //  set, or the trace the set's tasks are recorded in.
+    mSets[ hSet ]->mpszSetName    = gTraceRecorder.InternName( szSetName ? szSetName : "Unnamed Task" );
 
-#ifdef PROFILEGPA
     //
-    //  Track task name if profiling is enabled
-    if( szSetName )
-    {
-        StringCbCopyA(
-            mSets[ hSet ]->mszSetName,
-            sizeof( mSets[ hSet ]->mszSetName ),
-            szSetName );
-    }
-    else
+    //  A joined set holds one completion count on its parent, and one
+    //  tbb reference on the parent root so that WaitForSet on the parent
+    //  keeps helping until the joined set has run.  This must be done 
+    //  before the dependencies are wired since that can start the set.
+    //
+    if( TASKSETHANDLE_INVALID != hJoinParent )
     {
-        StringCbCopyA(
-            mSets[ hSet ]->mszSetName,
-            sizeof( mSets[ hSet ]->mszSetName ),
-            "Unnamed Task" );
+        TaskSetTbb*         pParent = mSets[ hJoinParent ];
+
+        _InterlockedIncrement( (LONG*)&pParent->muCompletionCount );
+        pParent->increment_ref_count();
+
+        mSets[ hSet ]->mhJoinParent = hJoinParent;
+
+        //  Work forked from a cancelled set starts out cancelled.
+        mSets[ hSet ]->mbCancelled = pParent->mbCancelled;
     }
-#else
-    UNREFERENCED_PARAMETER( szSetName );
-#endif // PROFILEGPA
+
+    //  Set output taskset handle.  Wiring the dependencies can start the
+    //  set, so it is written first for tasks that read their own handle.
+    *pOutHandle = hSet;
 
     //
     //  Iterate over the dependency list and setup the successor
@@ -433,18 +630,33 @@ TaskMgrTbb::CreateTaskSet(
             }
         }
 
+        pDependsOn->mSuccessorsLock.Unlock();
+
         //
-        //  If the successor list is full we have a problem.  The app
-        //  needs to give us more space by increasing MAX_SUCCESSORS
+        //  The list also fills when several threads add successors to a set
+        //  that has already completed faster than their completions drain
+        //  it.  That dependency is already satisfied, so signal this set
+        //  here instead.  Otherwise we have a problem.  The app needs to 
+        //  give us more space by increasing MAX_SUCCESSORS
         //
         if( uSuccessor == MAX_SUCCESSORS )
         {
-            printf( "Too many successors for this task set.\nIncrease MAX_SUCCESSORS\n" );
-            pDependsOn->mSuccessorsLock.Unlock();
-            goto Cleanup;
-        }
+            if( !pDependsOn->mbCompleted )
+            {
+                printf( "Too many successors for this task set.\nIncrease MAX_SUCCESSORS\n" );
+                goto Cleanup;
+            }
 
-        pDependsOn->mSuccessorsLock.Unlock();
+            if( pDependsOn->mbCancelled )
+            {
+                mSets[ hSet ]->mbCancelled = TRUE;
+            }
+
+            if( 0 == _InterlockedDecrement( (LONG*)&mSets[ hSet ]->muStartCount ) )
+            {
+                mSets[ hSet ]->execute();
+            }
+        }
 
         //  
         //  Mark the set as completed for the successor adding operation.
@@ -452,9 +664,6 @@ TaskMgrTbb::CreateTaskSet(
         CompleteTaskSet( hDependsOn );
     }
 
-    //  Set output taskset handle
-    *pOutHandle = hSet;
-
     bResult = TRUE;
 
 Cleanup:
@@ -490,23 +699,167 @@ VOID
 TaskMgrTbb::WaitForSet(
     TASKSETHANDLE               hSet )
 {
+    TaskSetTbb*                 pSet = mSets[ hSet ];
+
     //
     //  Yield the main thread to TBB to get our taskset done faster!
     //  NOTE: tasks can only be waited on once.  After that they will
     //  deadlock if waited on again.
-    if( !mSets[ hSet ]->mbHasBeenWaitedOn )
+    if( !pSet->mbHasBeenWaitedOn )
+    {
+        if( GetCurrentThreadId() == pSet->mdwOwnerThreadId )
+        {
+            pSet->wait_for_all();
+        }
+        else
+        {
+            //
+            //  The set was created from inside a task, so its root belongs
+            //  to a worker's scheduler and cannot be waited on here.
+            //
+            while( !pSet->mbCompleted || pSet->ref_count() > 1 )
+            {
+                SwitchToThread();
+            }
+        }
+
+        pSet->mbHasBeenWaitedOn = TRUE;
+    }
+
+}
+
+BOOL
+TaskMgrTbb::TryWaitForSet(
+    TASKSETHANDLE               hSet,
+    DWORD                       dwBudgetUs )
+{
+    TaskSetTbb*                 pSet = mSets[ hSet ];
+
+    if( pSet->mbHasBeenWaitedOn )
+    {
+        return TRUE;
+    }
+
+    if( !pSet->mbCompleted && dwBudgetUs > 0 )
     {
-        mSets[ hSet ]->wait_for_all();
-        mSets[ hSet ]->mbHasBeenWaitedOn = TRUE;
+        LARGE_INTEGER liNow;
+        QueryPerformanceCounter( &liNow );
+
+        mllWaitDeadline = liNow.QuadPart + 
+            ( mllTicksPerSecond * dwBudgetUs ) / 1000000;
+        mhWaitSet = hSet;
+        mpWaiter->set_ref_count( 2 );
+
+        //  Arm the wait.  The set may have completed before it was armed,
+        //  so check again afterwards.
+        _InterlockedIncrement( &mlWaitState );
+
+        if( pSet->mbCompleted )
+        {
+            SignalWaiter( hSet );
+        }
+
+        //
+        //  Run tasks of any set until the awaited set completes or a task 
+        //  finishes past the deadline.
+        //
+        mpWaiter->wait_for_all();
     }
 
+    if( !pSet->mbCompleted )
+    {
+        return FALSE;
+    }
+
+    //  The last task is still returning to tbb.
+    while( pSet->ref_count() > 1 )
+    {
+        SwitchToThread();
+    }
+
+    pSet->mbHasBeenWaitedOn = TRUE;
+
+    return TRUE;
+}
+
+VOID
+TaskMgrTbb::SignalWaiter(
+    TASKSETHANDLE               hSet )
+{
+    //  The interlocked read orders it after the caller's store to mbCompleted.
+    LONG lState = _InterlockedCompareExchange( &mlWaitState, 0, 0 );
+
+    if( ( lState & 1 ) && hSet == mhWaitSet )
+    {
+        //  Only one signal per armed wait drops the reference.
+        if( lState == _InterlockedCompareExchange( 
+            &mlWaitState, 
+            lState + 1, 
+            lState ) )
+        {
+            mpWaiter->decrement_ref_count();
+        }
+    }
+}
+
+VOID
+TaskMgrTbb::CheckWaitBudget()
+{
+    //  Read the state before the deadline; the deadline is written before
+    //  a wait is armed, so it belongs to this wait or a later one.
+    LONG lState = mlWaitState;
+
+    if( lState & 1 )
+    {
+        LARGE_INTEGER liNow;
+        QueryPerformanceCounter( &liNow );
+
+        if( liNow.QuadPart >= mllWaitDeadline &&
+            lState == _InterlockedCompareExchange( 
+                &mlWaitState, 
+                lState + 1, 
+                lState ) )
+        {
+            mpWaiter->decrement_ref_count();
+        }
+    }
+}
+
+BOOL
+TaskMgrTbb::IsSetComplete(
+    TASKSETHANDLE               hSet )
+{
+    return mSets[ hSet ]->mbCompleted;
+}
+
+VOID
+TaskMgrTbb::CancelSet(
+    TASKSETHANDLE               hSet )
+{
+    mSets[ hSet ]->mbCancelled = TRUE;
+}
+
+BOOL
+TaskMgrTbb::IsSetCancelled(
+    TASKSETHANDLE               hSet )
+{
+    return mSets[ hSet ]->mbCancelled;
+}
+
+VOID
+TaskMgrTbb::CancelAndWaitForSet(
+    TASKSETHANDLE               hSet )
+{
+    CancelSet( hSet );
+    WaitForSet( hSet );
 }
 
 TASKSETHANDLE
 TaskMgrTbb::AllocateTaskSet()
 {
     TaskSetTbb*         pSet = new( task::allocate_root() ) TaskSetTbb();
-    UINT                uSet = muNextFreeSet;
+    TaskSetTbb*         pOldSet = NULL;
+    UINT                uSet;
 
     //
     //  Create a new task set and find a slot in the TaskMgrTbb to put it in.
@@ -517,38 +870,102 @@ TaskMgrTbb::AllocateTaskSet()
     pSet->set_ref_count( 2 );
 
     //
-    //  NOTE: Allocating tasksets is not thread-safe due to allocation of the
-    //  slot for the task pointer.  This can be easily made threadsafe with 
-    //  an interlocked op on the muNextFreeSet variable and a spin on the slot.  
-    //  It will cost a small amount of performance.
+    //  Tasksets can be created from worker threads so the slot search is
+    //  done under a lock.  A slot is free when no one references the set 
+    //  and tbb has retired all of its child tasks.  Checking the tbb 
+    //  reference count instead of waiting allows any thread to recycle a 
+    //  slot, not just the thread that allocated the root.
     //
-    while( NULL != mSets[ uSet ] && 0 != mSets[ uSet ]->muRefCount )
+    mpAllocLock->Lock();
+
+    uSet = muNextFreeSet;
+    while( NULL != mSets[ uSet ] && 
+           ( 0 != mSets[ uSet ]->muRefCount ||
+             ( !mSets[ uSet ]->mbHasBeenWaitedOn && mSets[ uSet ]->ref_count() > 1 ) ) )
     { 
         uSet = ( uSet + 1 ) % MAX_TASKSETS;
     }
-    
-    if( NULL != mSets[ uSet ] )
-    {
-        //  We know the refcount is done, but TBB has an assert that requires
-        //  a task be waited on before being deleted.
-        WaitForSet( uSet );
 
+    pOldSet = mSets[ uSet ];
+
+    mSets[ uSet ] = pSet;
+    muNextFreeSet = ( uSet + 1 ) % MAX_TASKSETS;
+
+    mpAllocLock->Unlock();
+
+    if( NULL != pOldSet )
+    {
         //
         //  Once TaskMgrTbb is done with a tbb object we need to forcibly destroy it.
         //  There are some refcount issues with tasks in tbb 3.0 which can be 
         //  inconsistent if a task has never been waited for.  TaskMgrTbb knows the
         //  correct refcount.
-        mSets[ uSet ]->set_ref_count( 0 );
-        mSets[ uSet ]->destroy( *mSets[ uSet ] );
-        mSets[ uSet ] = NULL;
+        pOldSet->set_ref_count( 0 );
+        pOldSet->destroy( *pOldSet );
     }
 
-    mSets[ uSet ] = pSet;
-    muNextFreeSet = ( uSet + 1 ) % MAX_TASKSETS;
-
     return (TASKSETHANDLE)uSet;
 }
 
+BOOL
+TaskMgrTbb::ParkIfHighPriorityPending(
+    GenericTask*            pTask )
+{
+    if( 0 == mlHighPriorityTasks )
+    {
+        return FALSE;
+    }
+
+    //
+    //  The clone is an additional child of the set so the set cannot
+    //  complete while it is parked.  The running instance just returns.
+    //
+    GenericTask*            pParked = pTask->CloneForParking();
+
+    mpParkLock->Lock();
+    pParked->mpNextParked = mpParkedTasks;
+    mpParkedTasks = pParked;
+    mpParkLock->Unlock();
+
+    //
+    //  The HIGH work may have drained while we were parking, in which case
+    //  nobody else will resume us.
+    //
+    if( 0 == mlHighPriorityTasks )
+    {
+        ResumeParkedTasks();
+    }
+
+    return TRUE;
+}
+
+VOID
+TaskMgrTbb::ResumeParkedTasks()
+{
+    GenericTask*            pTask;
+
+    mpParkLock->Lock();
+    pTask = mpParkedTasks;
+    mpParkedTasks = NULL;
+    mpParkLock->Unlock();
+
+    //
+    //  The clones were allocated by the threads that parked them, and spawn
+    //  would push them onto this thread's deque.  enqueue puts them on the
+    //  arena's shared queue, which any thread may feed and which also
+    //  guarantees they run if this thread goes on to block.
+    //
+    while( NULL != pTask )
+    {
+        GenericTask*        pNext = pTask->mpNextParked;
+
+        pTask->mpNextParked = NULL;
+        task::enqueue( *pTask );
+
+        pTask = pNext;
+    }
+}
+
 VOID
 TaskMgrTbb::CompleteTaskSet(
     TASKSETHANDLE           hSet )
@@ -579,6 +996,12 @@ TaskMgrTbb::CompleteTaskSet(
             {
                 UINT uStart;
 
+                //  Cancellation flows down the dependency chain.
+                if( pSet->mbCancelled )
+                {
+                    pSuccessor->mbCancelled = TRUE;
+                }
+
                 uStart = _InterlockedDecrement( (LONG*)&pSuccessor->muStartCount );
 
                 //
@@ -594,6 +1017,32 @@ TaskMgrTbb::CompleteTaskSet(
 
         pSet->mSuccessorsLock.Unlock();
 
+        pSet->mbCompleted = TRUE;
+
+        SignalWaiter( hSet );
+
+        //
+        //  Signal the set this one joined exactly once.  The completion 
+        //  count can return to zero again when successors are added to a
+        //  completed set.
+        //
+        TASKSETHANDLE hJoinParent = (TASKSETHANDLE)_InterlockedExchange( 
+            (LONG*)&pSet->mhJoinParent, 
+            TASKSETHANDLE_INVALID );
+
         ReleaseHandle( hSet );
+
+        if( TASKSETHANDLE_INVALID != hJoinParent )
+        {
+            TaskSetTbb* pParent = mSets[ hJoinParent ];
+
+            CompleteTaskSet( hJoinParent );
+
+            //  Drop the tbb reference last; the parent slot cannot be 
+            //  recycled until it reaches one.
+            pParent->decrement_ref_count();
+        }
     }
 }
+
+#endif // !TASKMGR_STDTHREAD
@@ -6,9 +6,11 @@
     cores.
 
     TaskMgrTbb is a singleton object and is already instantiated for the app as
-    gTaskMgr.  The TaskMgrTbb is single threaded, meaning that tasksets can only
-    be created from one thread.  With minor changes and some performance loss,
-    multiple thread can create task sets (see AllocateTaskSet in TaskMgrTbb.cpp. 
+    gTaskMgr.  Tasksets can be created, released and queried for completion
+    from any thread, including from inside a running task.  This allows a task
+    to fork more work (nested parallelism) and optionally have the new taskset
+    join the completion of the taskset that created it.  Init, Shutdown,
+    WaitForSet and TryWaitForSet must still be called from the main thread.
     The app can control two knobs in the TaskMgrTbb class through MAX_SUCCESSORS 
     and MAX_TASKSETS defined below.
 
@@ -19,6 +21,16 @@
     of successors so the value should be set to something reasonably close to 
     the maximum the app will use. The default value is 5.
 
+    Two backends implement the interface.  By default it runs on top of TBB.
+    Defining TASKMGR_STDTHREAD selects TaskMgrStd.cpp instead, which is built
+    only on std::thread and per-thread work-stealing deques and compiles on
+    platforms other than Windows.  The std::thread backend is the only one
+    available off Windows.  It hands out the same nContext ids, 0 for the 
+    thread that called Init and 1 to n-1 for the workers.  It sends a task
+    with an affinity hint to a mailbox of the thread that last ran its 
+    index, which that thread takes from before stealing, and runs LOW 
+    priority tasks only when no other task is queued.
+
     MAX_TASKSETS is the max number of tasksets that can be live at one  time. 
     A taskset is live if it has a non-zero reference count.  Increasing the 
     number of tasksets that can be live increases the memory footprint of the 
@@ -40,7 +52,36 @@
 */
 #pragma once
 
+#if !defined( _WIN32 ) && !defined( TASKMGR_STDTHREAD )
+#define TASKMGR_STDTHREAD
+#endif
+
+#ifdef _WIN32
 #include <wtypes.h>
+#else
+//
+//  The subset of the Windows types used by the interface.
+//
+#include <stdint.h>
+
+typedef int                 INT;
+typedef unsigned int        UINT;
+typedef int                 BOOL;
+typedef char                CHAR;
+typedef unsigned char       BYTE;
+typedef float               FLOAT;
+typedef const char*         LPCSTR;
+typedef int32_t             LONG;
+typedef uint32_t            DWORD;
+typedef int64_t             LONGLONG;
+
+#define VOID                void
+#define TRUE                1
+#define FALSE               0
+#define OPTIONAL
+#define OUT
+#define UNREFERENCED_PARAMETER( P ) ( void )( P )
+#endif
 
 /*! Intel Graphics Performance Analyizer (GPA) allows for CPU tracing of tasks
     in a frame.  Define PROFILEGPA to send task notifications to GPA.  
@@ -78,23 +119,57 @@ typedef UINT        TASKSETHANDLE;
 //  Value of a TASKSETHANDLE that indicates an invalid handle
 #define TASKSETHANDLE_INVALID 0xFFFFFFFF
 
+//  Scheduling class of a task set.  HIGH is for frame-critical work that
+//  gates the current frame.  LOW is for background work (next frame 
+//  simulation, world regeneration, stats) and yields to HIGH sets: a LOW
+//  task that is about to start while HIGH tasks are outstanding is parked
+//  and resumed once the HIGH work drains.  Tasks already running are not
+//  preempted.  NORMAL sets never yield.
+typedef enum _TASKSETPRIORITY
+{
+    TASKSETPRIORITY_HIGH = 0,
+    TASKSETPRIORITY_NORMAL,
+    TASKSETPRIORITY_LOW,
+} TASKSETPRIORITY;
+
+//  Value of an affinity key that indicates no affinity hint.
+#define TASKSETAFFINITY_NONE  0xFFFFFFFF
+
 //
 //  Variables to control the memory size and performance of the TaskMgrTbb 
 //  class.  See header comment for details.
 //
 #define MAX_SUCCESSORS                  5
 #define MAX_TASKSETS                    255
-#define MAX_TASKSETNAMELENGTH           512
 
+//
+//  Affinity hints.  Tasksets created with the same affinity key remember
+//  which worker ran each task index and send that index back to the same
+//  worker next time, so a task keeps working on a warm cache.  Idle workers
+//  still steal.  MAX_AFFINITYKEYS is the number of distinct keys and 
+//  MAX_AFFINITYTASKS the number of task indices tracked per key; tasks
+//  past that limit are scheduled without a hint.
+//
+#define MAX_AFFINITYKEYS                8
+#define MAX_AFFINITYTASKS               256
+
+class SpinLock;
+#ifdef TASKMGR_STDTHREAD
+class TaskSetStd;
+class TaskSchedulerStd;
+#else
 class TaskSetTbb;
 class GenericTask;
 class TbbContextId;
+class WaitTaskTbb;
+#endif
 
 /*! The TaskMgrTbb allows the user to schedule tasksets that run on top of
-    TBB.  All TaskMgrTbb functions are NOT threadsafe.  TaskMgrTbb is 
-    designed to be called only from the main thread.  Multi-threading is 
-    achieved by creating TaskSets that execte on threads created internally
-    by TBB.
+    TBB.  CreateTaskSet, ReleaseHandle(s) and IsSetComplete are threadsafe
+    and may be called from within tasks.  Init, Shutdown, WaitForSet and
+    TryWaitForSet are NOT threadsafe and are designed to be called only from the main thread.
+    Multi-threading is achieved by creating TaskSets that execte on threads 
+    created internally by TBB.
 */
 class TaskMgrTbb
 {
@@ -141,8 +216,29 @@ public:
 
         OPTIONAL LPCSTR             szSetName,  //  [Optional] name of the taskset
         //  the name is used for profiling
-
-        OUT TASKSETHANDLE*          pOutHandle  //  [Out] Handle to the new taskset
+        //  and tracing.  It is copied, so
+        //  any string will do.
+
+        OUT TASKSETHANDLE*          pOutHandle, //  [Out] Handle to the new taskset
+        //  written before the set can start.
+
+        OPTIONAL TASKSETHANDLE      hJoinParent = TASKSETHANDLE_INVALID,
+        //  [Optional] taskset whose completion
+        //  will also wait for this taskset.
+        //  Used when a running task forks 
+        //  more work; pass the handle of the
+        //  set the calling task belongs to.
+        //  The parent must not have completed.
+
+        OPTIONAL TASKSETPRIORITY    ePriority = TASKSETPRIORITY_NORMAL,
+        //  [Optional] scheduling class of
+        //  the taskset.
+
+        OPTIONAL UINT               uAffinityKey = TASKSETAFFINITY_NONE
+        //  [Optional] affinity key below
+        //  MAX_AFFINITYKEYS.  Sets sharing
+        //  a key run task i on the worker
+        //  that last ran task i of the key.
  );
 
     //  All TASKSETHANDLE must be released when no longer referenced.  
@@ -162,11 +258,54 @@ public:
                         );
 
     //  WaitForSet will yeild the main thread to the tasking system and return
-    //  only when the taskset specified has completed execution.
+    //  only when the taskset specified has completed execution.  This 
+    //  includes any tasksets that joined it through hJoinParent.  While it
+    //  waits the main thread runs tasks of any set.
     VOID
         WaitForSet( TASKSETHANDLE hSet        // Taskset to wait for completion
                     );
 
+    //  TryWaitForSet yields the main thread to the tasking system like 
+    //  WaitForSet, but gives up once the budget has passed so the frame 
+    //  loop can do other work and try again.  Returns TRUE if the set has
+    //  completed, after which it counts as waited on.  The budget is checked
+    //  whenever a task finishes, so it can overrun by the longest running 
+    //  task.  A budget of 0 only polls.
+    BOOL
+        TryWaitForSet( TASKSETHANDLE hSet,    // Taskset to wait for completion
+                       DWORD dwBudgetUs       // Budget in microseconds
+                       );
+
+    //  IsSetComplete returns TRUE once every task in the set, and every 
+    //  taskset that joined it, has run.  It never blocks and can be called
+    //  from any thread while the caller holds a reference to the handle.
+    BOOL
+        IsSetComplete( TASKSETHANDLE hSet     // Taskset to query
+                       );
+
+    //  CancelSet requests cooperative cancellation of a taskset.  Tasks of
+    //  the set that have not started yet are skipped, and successors of a
+    //  cancelled set are cancelled when it completes.  Tasks that are 
+    //  already running finish unless they poll IsSetCancelled.  The set
+    //  still completes normally so handles and dependencies stay valid.
+    //  Threadsafe.
+    VOID
+        CancelSet( TASKSETHANDLE hSet         // Taskset to cancel
+                   );
+
+    //  IsSetCancelled returns TRUE if cancellation was requested for the 
+    //  set.  Long running tasks should poll it at chunk boundaries and 
+    //  return early.  Threadsafe.
+    BOOL
+        IsSetCancelled( TASKSETHANDLE hSet    // Taskset to query
+                        );
+
+    //  CancelAndWaitForSet cancels the set and drains it: it returns once
+    //  the running tasks have reached a cancellation point.
+    VOID
+        CancelAndWaitForSet( TASKSETHANDLE hSet   // Taskset to cancel
+                             );
+
 
     //  DEMO ONLY: set variable before calling init to the
     //  number of threads tbb should create.  Changing this value will
@@ -177,20 +316,88 @@ public:
     //  systems occupy a set of cores, tbb thread count should be reduced by
     //  the number of fully utilized cores.
     INT miDemoModeTBBThreadCountOverride;
+
+    //  Set before calling Init to pin each tbb worker thread to its own 
+    //  logical processor.  Workers take one thread of every physical core
+    //  first, grouped by NUMA node, before using SMT siblings.  The first
+    //  core is left to the main thread, which is not pinned.  Combined with
+    //  affinity keys this keeps a task index on one core and one node.
+    BOOL mbPinWorkerThreads;
 private:
 
+#ifdef TASKMGR_STDTHREAD
+    friend class TaskSchedulerStd;
+
+    //  INTERNAL:
+    //  Allocate a free slot in the mSets list
+    TASKSETHANDLE
+        AllocateTaskSet();
+
+    //  INTERNAL:
+    //  Queue every task of a set whose dependencies have completed.
+    VOID
+        StartTaskSet( TASKSETHANDLE hSet );
+
+    //  INTERNAL:
+    //  Run one task of a set.
+    VOID
+        ExecuteTask( TASKSETHANDLE hSet,
+                     UINT uIdx );
+
+    //  INTERNAL:
+    //  Called by the tasking system when a task in a set completes.
+    VOID
+        CompleteTaskSet( TASKSETHANDLE hSet );
+
+    //  Array containing the task sets.
+    TaskSetStd* mSets[ MAX_TASKSETS ];
+
+    //  Helper array index of next free task slot.
+    UINT muNextFreeSet;
+
+    //  Lock protecting slot allocation in mSets, since tasksets can be 
+    //  created from worker threads.
+    SpinLock* mpAllocLock;
+
+    //  Worker threads, their deques and the shared queues.
+    TaskSchedulerStd* mpScheduler;
+
+    //  Thread each task index of an affinity key last ran on, plus one.
+    //  Zero means no affinity.
+    unsigned short mAffinity[ MAX_AFFINITYKEYS ][ MAX_AFFINITYTASKS ];
+#else
     friend class GenericTask;
+    friend class TaskSetTbb;
 
     //  INTERNAL:
     //  Allocate a free slot in the mSets list
     TASKSETHANDLE
         AllocateTaskSet();
 
+    //  INTERNAL:
+    //  Called by LOW priority tasks before they run.  Returns TRUE if the
+    //  task was parked because HIGH priority tasks are outstanding.
+    BOOL
+        ParkIfHighPriorityPending( GenericTask* pTask );
+
+    //  INTERNAL:
+    //  Enqueue all parked LOW priority tasks.
+    VOID
+        ResumeParkedTasks();
+
     //  INTERNAL:
     //  Called by the tasking system when a task in a set completes.
     VOID
         CompleteTaskSet( TASKSETHANDLE hSet );
 
+    //  INTERNAL:
+    //  Release the main thread from TryWaitForSet, when the awaited set
+    //  completes or when a finished task finds the budget has passed.
+    VOID
+        SignalWaiter( TASKSETHANDLE hSet );
+    VOID
+        CheckWaitBudget();
+
 
     //  Array containing the tbb task parents.
     TaskSetTbb* mSets[ MAX_TASKSETS ];
@@ -198,11 +405,37 @@ private:
     //  Helper array index of next free task slot.
     UINT muNextFreeSet;
 
+    //  Lock protecting slot allocation in mSets, since tasksets can be 
+    //  created from worker threads.
+    SpinLock* mpAllocLock;
+
+    //  Number of HIGH priority tasks spawned but not yet completed.
+    volatile LONG mlHighPriorityTasks;
+
+    //  Intrusive list of parked LOW priority tasks and its lock.
+    GenericTask* mpParkedTasks;
+    SpinLock* mpParkLock;
+
+    //  Last tbb affinity id each task index of an affinity key ran on.
+    //  Zero means no affinity.
+    unsigned short mAffinity[ MAX_AFFINITYKEYS ][ MAX_AFFINITYTASKS ];
+
+    //  TryWaitForSet state.  The main thread waits on mpWaiter, a root 
+    //  allocated by Init.  mlWaitState is odd while a wait is armed and 
+    //  each wait advances it by two, so a late signal from an earlier wait
+    //  cannot release a later one.
+    WaitTaskTbb* mpWaiter;
+    volatile LONG mlWaitState;
+    volatile TASKSETHANDLE mhWaitSet;
+    volatile LONGLONG mllWaitDeadline;
+    LONGLONG mllTicksPerSecond;
+
     //  Pointer to the observer class that assigned context ids.
     TbbContextId* mpTbbContextId;
 
     //  Pointer to the tbb structure to start tbb.
     void* mpTbbInit;
+#endif
 
 };
 
@@ -0,0 +1,503 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+//---------------------------------------------------------------------------------------
+
+#include "TraceRecorder.h"
+#include "AtomicOps.h"
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#define TRACE_THREAD_LOCAL __declspec( thread )
+#else
+#include <time.h>
+#include <unistd.h>
+#define TRACE_THREAD_LOCAL __thread
+#endif
+
+TraceRecorder gTraceRecorder;
+
+// The calling thread's ring, NULL until its first event.  Threads that
+// find every ring taken get gs_pNoRing, and only try to register again
+// once a ring is freed.
+static TRACE_THREAD_LOCAL void* tls_pRing = NULL;
+static char gs_NoRing;
+static void* const gs_pNoRing = &gs_NoRing;
+
+// How often the flush thread drains the rings
+static const unsigned int gs_nFlushIntervalMs = 5;
+
+static inline long AtomicAdd( volatile long* p,
+                              long nValue )
+{
+#ifdef _WIN32
+    return _InterlockedExchangeAdd( p, nValue ) + nValue;
+#else
+    return __sync_add_and_fetch( p, nValue );
+#endif
+}
+
+static inline bool AtomicClaim( volatile long* p )
+{
+#ifdef _WIN32
+    return 0 == _InterlockedCompareExchange( p, 1, 0 );
+#else
+    return __sync_bool_compare_and_swap( p, 0L, 1L );
+#endif
+}
+
+static inline bool AtomicClaimPointer( char* volatile* p,
+                                       char* pValue )
+{
+#ifdef _WIN32
+    return NULL == _InterlockedCompareExchangePointer( ( void* volatile* )p, pValue, NULL );
+#else
+    return __sync_bool_compare_and_swap( p, ( char* )NULL, pValue );
+#endif
+}
+
+static void SleepMs( unsigned int nMs )
+{
+#ifdef _WIN32
+    Sleep( nMs );
+#else
+    usleep( nMs * 1000 );
+#endif
+}
+
+TraceRecorder::TraceRecorder( void )
+    : m_nRings( 0 )
+    , m_nFreeRings( 0 )
+    , m_nUnregisteredDropped( 0 )
+    , m_bRecording( 0 )
+    , m_bStopFlush( 0 )
+    , m_pFile( NULL )
+    , m_bFirstEvent( true )
+    , m_nWrittenEvents( 0 )
+    , m_nDroppedAtStart( 0 )
+    , m_nStartTicks( 0 )
+    , m_fTicksPerUs( 1.0 )
+{
+    for( unsigned int i = 0; i < MaxThreads; ++i )
+    {
+        m_pRings[i] = NULL;
+        m_nThreadContext[i] = -1;
+    }
+    for( unsigned int i = 0; i < MaxNames; ++i )
+    {
+        m_pNames[i] = NULL;
+    }
+
+#ifdef _WIN32
+    m_nThreadExitKey = FlsAlloc( ThreadExit );
+#else
+    pthread_key_create( &m_ThreadExitKey, ThreadExit );
+#endif
+}
+
+TraceRecorder::~TraceRecorder( void )
+{
+    Stop();
+
+#ifdef _WIN32
+    FlsFree( m_nThreadExitKey );
+#else
+    pthread_key_delete( m_ThreadExitKey );
+#endif
+
+    for( unsigned int i = 0; i < MaxThreads; ++i )
+    {
+        delete m_pRings[i];
+    }
+    for( unsigned int i = 0; i < MaxNames; ++i )
+    {
+        delete [] m_pNames[i];
+    }
+}
+
+bool TraceRecorder::Start( const char* szFileName )
+{
+    if( NULL != m_pFile )
+    {
+        return false;
+    }
+
+    m_pFile = fopen( szFileName, "w" );
+    if( NULL == m_pFile )
+    {
+        return false;
+    }
+
+    setvbuf( m_pFile, NULL, _IOFBF, 1024 * 1024 );
+    fputs( "{\"traceEvents\":[\n", m_pFile );
+
+    // Measure the tick rate against the OS clock
+    unsigned long long nClock0 = GetClockNs();
+    unsigned long long nTicks0 = GetTimestamp();
+    SleepMs( 20 );
+    unsigned long long nClock1 = GetClockNs();
+    unsigned long long nTicks1 = GetTimestamp();
+
+    m_nStartTicks = nTicks0;
+    m_fTicksPerUs = ( double )( nTicks1 - nTicks0 ) * 1000.0 / ( double )( nClock1 - nClock0 );
+
+    // Forget whatever the last trace left in the rings
+    Drain( true );
+
+    m_bFirstEvent = true;
+    m_nWrittenEvents = 0;
+    m_nDroppedAtStart = 0;
+    m_nDroppedAtStart = GetDroppedEvents();
+    for( unsigned int i = 0; i < MaxThreads; ++i )
+    {
+        m_nThreadContext[i] = -1;
+    }
+
+    m_bStopFlush = 0;
+#ifdef _WIN32
+    m_hFlushThread = CreateThread( NULL, 0, FlushThread, this, 0, NULL );
+#else
+    pthread_create( &m_FlushThread, NULL, FlushThread, this );
+#endif
+
+    StoreRelease( &m_bRecording, 1L );
+    return true;
+}
+
+void TraceRecorder::Stop( void )
+{
+    if( NULL == m_pFile )
+    {
+        return;
+    }
+
+    StoreRelease( &m_bRecording, 0L );
+    StoreRelease( &m_bStopFlush, 1L );
+
+#ifdef _WIN32
+    WaitForSingleObject( m_hFlushThread, INFINITE );
+    CloseHandle( m_hFlushThread );
+#else
+    pthread_join( m_FlushThread, NULL );
+#endif
+
+    Drain( false );
+
+    // Name the rows after the task context each thread ran
+    unsigned int nRings = ( unsigned int )m_nRings;
+    for( unsigned int i = 0; i < nRings && i < MaxThreads; ++i )
+    {
+        char szThreadName[32];
+        if( 0 == m_nThreadContext[i] )
+        {
+            strcpy( szThreadName, "Main thread" );
+        }
+        else if( m_nThreadContext[i] > 0 )
+        {
+            sprintf( szThreadName, "Worker %d", m_nThreadContext[i] );
+        }
+        else
+        {
+            sprintf( szThreadName, "Thread %u", i );
+        }
+
+        fprintf( m_pFile, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                 m_bFirstEvent ? "" : ",\n", i, szThreadName );
+        m_bFirstEvent = false;
+    }
+
+    fputs( "\n],\"displayTimeUnit\":\"ns\"}\n", m_pFile );
+    fclose( m_pFile );
+    m_pFile = NULL;
+}
+
+void TraceRecorder::Record( const char* szName,
+                            int nContext,
+                            unsigned long long nBegin,
+                            unsigned long long nEnd )
+{
+    ThreadRing* pRing = ( ThreadRing* )tls_pRing;
+    if( NULL == pRing || ( gs_pNoRing == pRing && 0 != LoadAcquire( &m_nFreeRings ) ) )
+    {
+        pRing = RegisterThread();
+    }
+
+    // A scope that began before Stop can end after it
+    if( !m_bRecording )
+    {
+        return;
+    }
+
+    if( gs_pNoRing == pRing )
+    {
+        AtomicAdd( &m_nUnregisteredDropped, 1 );
+        return;
+    }
+
+    unsigned int nHead = pRing->nHead;
+    if( nHead - pRing->nCachedTail >= RingSize )
+    {
+        pRing->nCachedTail = LoadAcquire( &pRing->nTail );
+        if( nHead - pRing->nCachedTail >= RingSize )
+        {
+            StoreRelease( &pRing->nDropped, pRing->nDropped + 1 );
+            return;
+        }
+    }
+
+    Event& Ev = pRing->Events[ nHead & ( RingSize - 1 ) ];
+    Ev.nBegin = nBegin;
+    Ev.nEnd = nEnd;
+    Ev.szName = szName;
+    Ev.nContext = nContext;
+
+    StoreRelease( &pRing->nHead, nHead + 1 );
+}
+
+const char* TraceRecorder::InternName( const char* szName )
+{
+    // FNV-1a
+    unsigned int nHash = 2166136261u;
+    for( const char* p = szName; *p; ++p )
+    {
+        nHash = ( nHash ^ ( unsigned char )*p ) * 16777619u;
+    }
+
+    char* szCopy = NULL;
+    for( unsigned int i = 0; i < MaxNames; ++i )
+    {
+        char* volatile* ppSlot = &m_pNames[ ( nHash + i ) & ( MaxNames - 1 ) ];
+        char* szInterned = LoadAcquire( ppSlot );
+
+        if( NULL == szInterned )
+        {
+            if( NULL == szCopy )
+            {
+                size_t nLength = strlen( szName ) + 1;
+                szCopy = new char[ nLength ];
+                memcpy( szCopy, szName, nLength );
+            }
+
+            if( AtomicClaimPointer( ppSlot, szCopy ) )
+            {
+                return szCopy;
+            }
+
+            // Another thread filled the slot first; it may hold this name
+            szInterned = LoadAcquire( ppSlot );
+        }
+
+        if( 0 == strcmp( szInterned, szName ) )
+        {
+            delete [] szCopy;
+            return szInterned;
+        }
+    }
+
+    delete [] szCopy;
+    return "Other";
+}
+
+unsigned int TraceRecorder::GetDroppedEvents( void ) const
+{
+    unsigned int nDropped = ( unsigned int )LoadAcquire( &m_nUnregisteredDropped );
+    unsigned int nRings = ( unsigned int )LoadAcquire( &m_nRings );
+
+    for( unsigned int i = 0; i < nRings && i < MaxThreads; ++i )
+    {
+        ThreadRing* pRing = LoadAcquire( &m_pRings[i] );
+        if( NULL != pRing )
+        {
+            nDropped += LoadAcquire( &pRing->nDropped );
+        }
+    }
+
+    return nDropped - m_nDroppedAtStart;
+}
+
+TraceRecorder::ThreadRing* TraceRecorder::RegisterThread( void )
+{
+    ThreadRing* pRing = NULL;
+
+    // Take over the ring of a thread that exited.  Its events not yet
+    // drained stay in the ring and are written under the same row.
+    if( 0 != LoadAcquire( &m_nFreeRings ) )
+    {
+        unsigned int nRings = ( unsigned int )LoadAcquire( &m_nRings );
+
+        for( unsigned int i = 0; i < nRings && i < MaxThreads; ++i )
+        {
+            ThreadRing* pFree = LoadAcquire( &m_pRings[i] );
+            if( NULL != pFree && AtomicClaim( &pFree->bInUse ) )
+            {
+                AtomicAdd( &m_nFreeRings, -1 );
+                pRing = pFree;
+                break;
+            }
+        }
+    }
+
+    if( NULL == pRing )
+    {
+        long nIndex = AtomicAdd( &m_nRings, 1 ) - 1;
+
+        if( nIndex >= ( long )MaxThreads )
+        {
+            tls_pRing = gs_pNoRing;
+            return ( ThreadRing* )gs_pNoRing;
+        }
+
+        // Owned before it is published, so no other thread can claim it
+        pRing = new ThreadRing;
+        pRing->nHead = 0;
+        pRing->nDropped = 0;
+        pRing->nCachedTail = 0;
+        pRing->nTail = 0;
+        pRing->bInUse = 1;
+        pRing->pRecorder = this;
+
+        StoreRelease( &m_pRings[ nIndex ], pRing );
+    }
+
+#ifdef _WIN32
+    FlsSetValue( m_nThreadExitKey, pRing );
+#else
+    pthread_setspecific( m_ThreadExitKey, pRing );
+#endif
+
+    tls_pRing = pRing;
+    return pRing;
+}
+
+// Called on the owning thread as it exits.  The release orders its last
+// events before the next owner's.
+void TraceRecorder::ReleaseRing( ThreadRing* pRing )
+{
+    StoreRelease( &pRing->bInUse, 0L );
+    AtomicAdd( &m_nFreeRings, 1 );
+}
+
+#ifdef _WIN32
+void __stdcall TraceRecorder::ThreadExit( void* pRing )
+#else
+void TraceRecorder::ThreadExit( void* pRing )
+#endif
+{
+    if( NULL != pRing )
+    {
+        ( ( ThreadRing* )pRing )->pRecorder->ReleaseRing( ( ThreadRing* )pRing );
+    }
+}
+
+// Only one thread drains at a time: Start and Stop while the flush thread
+// is not running, and the flush thread in between.
+void TraceRecorder::Drain( bool bDiscard )
+{
+    unsigned int nRings = ( unsigned int )LoadAcquire( &m_nRings );
+
+    for( unsigned int i = 0; i < nRings && i < MaxThreads; ++i )
+    {
+        ThreadRing* pRing = LoadAcquire( &m_pRings[i] );
+        if( NULL == pRing )
+        {
+            continue;
+        }
+
+        unsigned int nHead = LoadAcquire( &pRing->nHead );
+        unsigned int nTail = pRing->nTail;
+
+        if( !bDiscard )
+        {
+            for( ; nTail != nHead; ++nTail )
+            {
+                WriteEvent( i, pRing->Events[ nTail & ( RingSize - 1 ) ] );
+            }
+        }
+
+        StoreRelease( &pRing->nTail, nHead );
+    }
+}
+
+void TraceRecorder::WriteEvent( unsigned int nThread,
+                                const Event& Ev )
+{
+    double fBeginUs = ( double )( long long )( Ev.nBegin - m_nStartTicks ) / m_fTicksPerUs;
+    double fDurationUs = ( double )( Ev.nEnd - Ev.nBegin ) / m_fTicksPerUs;
+
+    fputs( m_bFirstEvent ? "{\"name\":\"" : ",\n{\"name\":\"", m_pFile );
+    WriteString( Ev.szName );
+    fprintf( m_pFile, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f", nThread, fBeginUs, fDurationUs );
+
+    if( Ev.nContext >= 0 )
+    {
+        fprintf( m_pFile, ",\"args\":{\"context\":%d}", Ev.nContext );
+        m_nThreadContext[ nThread ] = Ev.nContext;
+    }
+
+    fputc( '}', m_pFile );
+
+    m_bFirstEvent = false;
+    ++m_nWrittenEvents;
+}
+
+// Writes a name as a JSON string body
+void TraceRecorder::WriteString( const char* szString )
+{
+    for( const char* p = szString; *p; ++p )
+    {
+        if( '"' == *p || '\\' == *p )
+        {
+            fputc( '\\', m_pFile );
+            fputc( *p, m_pFile );
+        }
+        else if( ( unsigned char )*p >= 0x20 )
+        {
+            fputc( *p, m_pFile );
+        }
+    }
+}
+
+unsigned long long TraceRecorder::GetClockNs( void )
+{
+#ifdef _WIN32
+    LARGE_INTEGER Frequency;
+    LARGE_INTEGER Counter;
+    QueryPerformanceFrequency( &Frequency );
+    QueryPerformanceCounter( &Counter );
+    return ( unsigned long long )( ( double )Counter.QuadPart * 1e9 / ( double )Frequency.QuadPart );
+#else
+    timespec Now;
+    clock_gettime( CLOCK_MONOTONIC, &Now );
+    return ( unsigned long long )Now.tv_sec * 1000000000ull + ( unsigned long long )Now.tv_nsec;
+#endif
+}
+
+#ifdef _WIN32
+unsigned long __stdcall TraceRecorder::FlushThread( void* pArg )
+#else
+void* TraceRecorder::FlushThread( void* pArg )
+#endif
+{
+    TraceRecorder* pRecorder = ( TraceRecorder* )pArg;
+
+    while( !LoadAcquire( &pRecorder->m_bStopFlush ) )
+    {
+        pRecorder->Drain( false );
+        SleepMs( gs_nFlushIntervalMs );
+    }
+
+    return 0;
+}
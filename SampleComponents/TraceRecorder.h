@@ -0,0 +1,232 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+//---------------------------------------------------------------------------------------
+
+#ifndef __TRACERECORDER_H
+#define __TRACERECORDER_H
+
+#include <stdio.h>
+
+#if defined( _M_IX86 ) || defined( _M_X64 )
+#include <intrin.h>
+#define TRACE_USE_RDTSC
+#elif defined( __i386__ ) || defined( __x86_64__ )
+#include <x86intrin.h>
+#define TRACE_USE_RDTSC
+#endif
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+// TraceRecorder records a timeline of named scopes on every thread and
+// writes it as Chrome trace event JSON, which chrome://tracing and the
+// Perfetto UI open directly.  It works on every platform and build, unlike
+// the GPA notifications, and costs one load and branch per scope while no
+// trace is running.
+//
+// Each thread writes its scopes into its own ring buffer, so recording
+// takes no locks.  A scope becomes one event when it ends, holding its
+// begin and end timestamps, its name and the task context it ran on.  A
+// background thread drains the rings to the file while the trace runs.
+// A ring that fills faster than it is drained drops events; the count is
+// reported by GetDroppedEvents.  A thread's ring is freed when the thread
+// exits and handed to the next thread that records, so the worker threads
+// of a re-initialised TaskMgr reuse the rings of the ones they replace.
+//
+// Names are stored by pointer and must stay valid until Stop returns.
+// String literals and __FUNCTION__ do.  Any other name goes through
+// InternName first, as the TaskMgr does for task set names.  Like gTaskMgr,
+// the app uses the gTraceRecorder instance.
+class TraceRecorder
+{
+public:
+    TraceRecorder( void );
+    ~TraceRecorder( void );
+
+    // Begin recording to szFileName.  Fails if a trace is already running
+    // or the file cannot be created.
+    bool Start( const char* szFileName );
+
+    // Stop recording, write out what is left and close the file.
+    void Stop( void );
+
+    bool IsRecording( void ) const
+    {
+        return m_bRecording != 0;
+    }
+
+    // Record a scope of the calling thread.  nContext is the task context
+    // the scope ran on, or -1 if it is not known.
+    void Record( const char* szName,
+                 int nContext,
+                 unsigned long long nBegin,
+                 unsigned long long nEnd );
+
+    // A copy of szName that stays valid until the recorder is destroyed.
+    // Equal names share one copy, so interning the same name again is a
+    // lookup.  Once MaxNames different names have been interned, further
+    // names come back as "Other".  Safe to call from any thread.
+    const char* InternName( const char* szName );
+
+    // Timestamp in the recorder's ticks.  These are CPU timestamp counter
+    // cycles where the CPU has one, and nanoseconds otherwise.
+    static unsigned long long GetTimestamp( void )
+    {
+#ifdef TRACE_USE_RDTSC
+        return __rdtsc();
+#else
+        return GetClockNs();
+#endif
+    }
+
+    // Events written to the file and dropped on full rings since Start.
+    unsigned int GetWrittenEvents( void ) const
+    {
+        return m_nWrittenEvents;
+    }
+    unsigned int GetDroppedEvents( void ) const;
+
+    // Threads that can record at once.  Scopes on any further thread are
+    // dropped, and counted by GetDroppedEvents.
+    static const unsigned int MaxThreads = 64;
+
+    // Events each thread's ring holds, a power of two.
+    static const unsigned int RingSize = 16 * 1024;
+
+    // Different names InternName keeps, a power of two.
+    static const unsigned int MaxNames = 1024;
+
+private:
+    struct Event
+    {
+        unsigned long long nBegin;
+        unsigned long long nEnd;
+        const char* szName;
+        int nContext;
+    };
+
+    struct ThreadRing
+    {
+        Event Events[ RingSize ];
+
+        // The owning thread writes the head, the flush thread the tail.
+        // They sit on separate cache lines.  The owner keeps the last tail
+        // it read, and only reads the tail again when the ring looks full.
+        volatile unsigned int nHead;
+        volatile unsigned int nDropped;
+        unsigned int nCachedTail;
+        char HeadPadding[ 64 - 3 * sizeof( unsigned int ) ];
+        volatile unsigned int nTail;
+        char TailPadding[ 64 - sizeof( unsigned int ) ];
+
+        // Set while a thread owns the ring
+        volatile long bInUse;
+        TraceRecorder* pRecorder;
+    };
+
+    TraceRecorder( const TraceRecorder& );
+    TraceRecorder& operator=( const TraceRecorder& );
+
+    ThreadRing* RegisterThread( void );
+    void ReleaseRing( ThreadRing* pRing );
+    void Drain( bool bDiscard );
+    void WriteEvent( unsigned int nThread,
+                     const Event& Ev );
+    void WriteString( const char* szString );
+
+    static unsigned long long GetClockNs( void );
+
+#ifdef _WIN32
+    static unsigned long __stdcall FlushThread( void* pArg );
+    static void __stdcall ThreadExit( void* pRing );
+#else
+    static void* FlushThread( void* pArg );
+    static void ThreadExit( void* pRing );
+#endif
+
+    ThreadRing* volatile m_pRings[ MaxThreads ];
+    volatile long m_nRings;
+
+    // Interned names, open addressed by hash.  Slots are only ever filled.
+    char* volatile m_pNames[ MaxNames ];
+
+    // Rings released by threads that exited, and scopes of threads that
+    // found no ring
+    volatile long m_nFreeRings;
+    volatile long m_nUnregisteredDropped;
+
+    // Calls ThreadExit when a thread that registered exits
+#ifdef _WIN32
+    unsigned long m_nThreadExitKey;
+#else
+    pthread_key_t m_ThreadExitKey;
+#endif
+
+    volatile long m_bRecording;
+    volatile long m_bStopFlush;
+
+    FILE* m_pFile;
+    bool m_bFirstEvent;
+    unsigned int m_nWrittenEvents;
+    unsigned int m_nDroppedAtStart;
+
+    // Last task context seen per thread, used to name the thread rows.
+    int m_nThreadContext[ MaxThreads ];
+
+    // Ticks at Start, and ticks per microsecond measured there.
+    unsigned long long m_nStartTicks;
+    double m_fTicksPerUs;
+
+#ifdef _WIN32
+    void* m_hFlushThread;
+#else
+    pthread_t m_FlushThread;
+#endif
+};
+
+extern TraceRecorder gTraceRecorder;
+
+// Records the enclosing block as one event while a trace is running.
+class TraceScope
+{
+public:
+    TraceScope( const char* szName,
+                int nContext = -1 )
+        : m_szName( szName )
+        , m_nContext( nContext )
+        , m_nBegin( gTraceRecorder.IsRecording() ? TraceRecorder::GetTimestamp() : 0 )
+    {
+    }
+
+    ~TraceScope( void )
+    {
+        if( m_nBegin != 0 )
+        {
+            gTraceRecorder.Record( m_szName, m_nContext, m_nBegin, TraceRecorder::GetTimestamp() );
+        }
+    }
+
+private:
+    TraceScope( const TraceScope& );
+    TraceScope& operator=( const TraceScope& );
+
+    const char* m_szName;
+    int m_nContext;
+    unsigned long long m_nBegin;
+};
+
+#endif // __TRACERECORDER_H
@@ -0,0 +1,790 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+//---------------------------------------------------------------------------------------
+
+// 64 bit off_t for fseeko and ftello on 32 bit POSIX builds
+#ifndef _WIN32
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include "TrajectoryRecorder.h"
+#include "FrameStats.h"
+#include "AtomicOps.h"
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+TrajectoryRecorder gTrajectoryRecorder;
+
+// How often the encoder thread looks for queued frames
+static const unsigned int gs_nEncodeIntervalMs = 1;
+
+// Fields of a unit in the order the encoder writes them
+static const unsigned int gs_nFieldCount = 5;
+static const float gs_fDirectionScale = 32767.0f;
+
+// File layout.  The chunks follow the header; the index and then the
+// footer follow the last chunk.
+static const char gs_szTrajectoryMagic[4] = { 'T', 'R', 'A', 'J' };
+static const unsigned int gs_nTrajectoryVersion = 1;
+static const unsigned int gs_nChunkMagic = 0x4b4e4843;      // "CHNK"
+static const unsigned int gs_nIndexMagic = 0x58444954;      // "TIDX"
+
+struct TrajectoryHeader
+{
+    char szMagic[4];
+    unsigned int nVersion;
+    unsigned int nMaxUnits;
+    unsigned int nChunkFrames;
+    float fPositionStep;
+    unsigned int nReserved[3];
+};
+
+struct TrajectoryChunkHeader
+{
+    unsigned int nMagic;
+    unsigned int nFirstFrame;
+    unsigned int nFrames;
+    unsigned int nBytes;
+};
+
+// Each frame in a chunk: this, then the fields' encoded differences
+struct TrajectoryFrameHeader
+{
+    unsigned int nFrame;
+    unsigned int nUnits;
+    unsigned int nBytes;
+};
+
+struct TrajectoryIndexEntry
+{
+    unsigned int nFirstFrame;
+    unsigned int nFrames;
+    unsigned long long nOffset;
+};
+
+struct TrajectoryFooter
+{
+    unsigned long long nIndexOffset;
+    unsigned int nChunks;
+    unsigned int nMagic;
+};
+
+static void SleepMs( unsigned int nMs )
+{
+#ifdef _WIN32
+    Sleep( nMs );
+#else
+    usleep( nMs * 1000 );
+#endif
+}
+
+// Seek and tell with 64 bit offsets; captures can pass 2 GB, where the
+// long offsets of fseek and ftell stop on Windows and 32 bit builds
+static inline bool FileSeek( FILE* pFile,
+                             long long nOffset,
+                             int nOrigin )
+{
+#ifdef _WIN32
+    return 0 == _fseeki64( pFile, nOffset, nOrigin );
+#else
+    return 0 == fseeko( pFile, ( off_t )nOffset, nOrigin );
+#endif
+}
+
+static inline long long FileTell( FILE* pFile )
+{
+#ifdef _WIN32
+    return _ftelli64( pFile );
+#else
+    return ( long long )ftello( pFile );
+#endif
+}
+
+// Small differences, of either sign, become small unsigned values
+static inline unsigned int ZigZag( int nValue )
+{
+    return ( ( unsigned int )nValue << 1 ) ^ ( unsigned int )( nValue >> 31 );
+}
+
+static inline int UnZigZag( unsigned int nValue )
+{
+    return ( int )( nValue >> 1 ) ^ -( int )( nValue & 1 );
+}
+
+static inline void PutVarint( std::vector<unsigned char>& Out,
+                              unsigned int nValue )
+{
+    while( nValue >= 0x80 )
+    {
+        Out.push_back( ( unsigned char )( nValue | 0x80 ) );
+        nValue >>= 7;
+    }
+    Out.push_back( ( unsigned char )nValue );
+}
+
+static inline bool GetVarint( const unsigned char*& p,
+                              const unsigned char* pEnd,
+                              unsigned int& nValue )
+{
+    nValue = 0;
+    for( unsigned int nShift = 0; nShift < 35 && p < pEnd; nShift += 7 )
+    {
+        unsigned char nByte = *p++;
+        nValue |= ( unsigned int )( nByte & 0x7f ) << nShift;
+        if( !( nByte & 0x80 ) )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// A zero byte starts a run of zeros, followed by the run's length less one.
+// Other values are never zero once zigzagged, so they go as they are.
+static void PutDeltas( std::vector<unsigned char>& Out,
+                       const unsigned int* pDeltas,
+                       unsigned int nCount )
+{
+    for( unsigned int i = 0; i < nCount; )
+    {
+        if( 0 == pDeltas[i] )
+        {
+            unsigned int nRun = 1;
+            while( i + nRun < nCount && 0 == pDeltas[ i + nRun ] )
+            {
+                ++nRun;
+            }
+            Out.push_back( 0 );
+            PutVarint( Out, nRun - 1 );
+            i += nRun;
+        }
+        else
+        {
+            PutVarint( Out, pDeltas[i++] );
+        }
+    }
+}
+
+static bool GetDeltas( const unsigned char*& p,
+                       const unsigned char* pEnd,
+                       unsigned int* pDeltas,
+                       unsigned int nCount )
+{
+    for( unsigned int i = 0; i < nCount; )
+    {
+        unsigned int nValue;
+        if( !GetVarint( p, pEnd, nValue ) )
+        {
+            return false;
+        }
+
+        if( 0 == nValue )
+        {
+            unsigned int nRun;
+            if( !GetVarint( p, pEnd, nRun ) || nRun >= nCount - i )
+            {
+                return false;
+            }
+            memset( &pDeltas[i], 0, ( nRun + 1 ) * sizeof( unsigned int ) );
+            i += nRun + 1;
+        }
+        else
+        {
+            pDeltas[i++] = nValue;
+        }
+    }
+    return true;
+}
+
+static inline int QuantizeDirection( float fValue )
+{
+    fValue = fValue < -1.0f ? -1.0f : ( fValue > 1.0f ? 1.0f : fValue );
+    return ( int )floorf( fValue * gs_fDirectionScale + 0.5f );
+}
+
+TrajectoryRecorder::TrajectoryRecorder( void )
+    : m_pFile( NULL )
+    , m_nMaxUnits( 0 )
+    , m_fPositionStep( 1.0f )
+    , m_nBeginUs( 0 )
+    , m_bFrameOpen( false )
+    , m_nFrame( 0 )
+    , m_nDroppedFrames( 0 )
+    , m_nRecordedFrames( 0 )
+    , m_nCaptureUs( 0 )
+    , m_nHead( 0 )
+    , m_nTail( 0 )
+    , m_pPrevious( NULL )
+    , m_nChunkFirstFrame( 0 )
+    , m_nChunkFrames( 0 )
+    , m_nBytesWritten( 0 )
+    , m_bWriteFailed( false )
+    , m_bStopEncoder( 0 )
+{
+    memset( m_Slots, 0, sizeof( m_Slots ) );
+}
+
+TrajectoryRecorder::~TrajectoryRecorder( void )
+{
+    Stop();
+}
+
+bool TrajectoryRecorder::Start( const char* szFileName,
+                                unsigned int nMaxUnits,
+                                float fPositionStep )
+{
+    if( NULL != m_pFile || 0 == nMaxUnits || !( fPositionStep > 0.0f ) )
+    {
+        return false;
+    }
+
+    m_pFile = fopen( szFileName, "wb" );
+    if( NULL == m_pFile )
+    {
+        return false;
+    }
+
+    m_nMaxUnits = nMaxUnits;
+    m_fPositionStep = fPositionStep;
+
+    for( unsigned int i = 0; i < FrameSlots; ++i )
+    {
+        Frame& Data = m_Slots[i].Data;
+        Data.nUnits = 0;
+        Data.pPositionX = new float[ nMaxUnits ];
+        Data.pPositionY = new float[ nMaxUnits ];
+        Data.pDirectionX = new float[ nMaxUnits ];
+        Data.pDirectionY = new float[ nMaxUnits ];
+        Data.pState = new unsigned char[ nMaxUnits ];
+
+        // Touch the pages now rather than in the first frames recorded
+        memset( Data.pPositionX, 0, nMaxUnits * sizeof( float ) );
+        memset( Data.pPositionY, 0, nMaxUnits * sizeof( float ) );
+        memset( Data.pDirectionX, 0, nMaxUnits * sizeof( float ) );
+        memset( Data.pDirectionY, 0, nMaxUnits * sizeof( float ) );
+        memset( Data.pState, 0, nMaxUnits );
+    }
+    m_pPrevious = new int[ gs_nFieldCount * nMaxUnits ];
+    m_Deltas.resize( nMaxUnits );
+    m_Chunk.clear();
+    m_Index.clear();
+
+    m_bFrameOpen = false;
+    m_nFrame = 0;
+    m_nDroppedFrames = 0;
+    m_nRecordedFrames = 0;
+    m_nCaptureUs = 0;
+    m_nHead = 0;
+    m_nTail = 0;
+    m_nChunkFrames = 0;
+    m_bWriteFailed = false;
+
+    TrajectoryHeader Header;
+    memset( &Header, 0, sizeof( Header ) );
+    memcpy( Header.szMagic, gs_szTrajectoryMagic, sizeof( Header.szMagic ) );
+    Header.nVersion = gs_nTrajectoryVersion;
+    Header.nMaxUnits = nMaxUnits;
+    Header.nChunkFrames = ChunkFrames;
+    Header.fPositionStep = fPositionStep;
+    m_bWriteFailed = fwrite( &Header, sizeof( Header ), 1, m_pFile ) != 1;
+    StoreRelease( &m_nBytesWritten, ( unsigned long long )sizeof( Header ) );
+
+    m_bStopEncoder = 0;
+#ifdef _WIN32
+    m_hEncoderThread = CreateThread( NULL, 0, EncoderThread, this, 0, NULL );
+#else
+    pthread_create( &m_EncoderThread, NULL, EncoderThread, this );
+#endif
+
+    return true;
+}
+
+bool TrajectoryRecorder::Stop( void )
+{
+    if( NULL == m_pFile )
+    {
+        return false;
+    }
+
+    StoreRelease( &m_bStopEncoder, 1L );
+
+#ifdef _WIN32
+    WaitForSingleObject( m_hEncoderThread, INFINITE );
+    CloseHandle( m_hEncoderThread );
+#else
+    pthread_join( m_EncoderThread, NULL );
+#endif
+
+    // A frame begun and not ended is dropped
+    m_bFrameOpen = false;
+
+    Drain();
+    FlushChunk();
+
+    long long nIndexOffset = FileTell( m_pFile );
+    m_bWriteFailed |= nIndexOffset < 0;
+
+    TrajectoryFooter Footer;
+    Footer.nIndexOffset = ( unsigned long long )nIndexOffset;
+    Footer.nChunks = ( unsigned int )m_Index.size();
+    Footer.nMagic = gs_nIndexMagic;
+
+    for( size_t i = 0; i < m_Index.size(); ++i )
+    {
+        TrajectoryIndexEntry Entry;
+        Entry.nFirstFrame = m_Index[i].nFirstFrame;
+        Entry.nFrames = m_Index[i].nFrames;
+        Entry.nOffset = m_Index[i].nOffset;
+        m_bWriteFailed |= fwrite( &Entry, sizeof( Entry ), 1, m_pFile ) != 1;
+    }
+    m_bWriteFailed |= fwrite( &Footer, sizeof( Footer ), 1, m_pFile ) != 1;
+
+    m_bWriteFailed |= fclose( m_pFile ) != 0;
+    m_pFile = NULL;
+
+    FreeBuffers();
+    return !m_bWriteFailed;
+}
+
+void TrajectoryRecorder::FreeBuffers( void )
+{
+    for( unsigned int i = 0; i < FrameSlots; ++i )
+    {
+        Frame& Data = m_Slots[i].Data;
+        delete [] Data.pPositionX;
+        delete [] Data.pPositionY;
+        delete [] Data.pDirectionX;
+        delete [] Data.pDirectionY;
+        delete [] Data.pState;
+    }
+    memset( m_Slots, 0, sizeof( m_Slots ) );
+
+    delete [] m_pPrevious;
+    m_pPrevious = NULL;
+}
+
+TrajectoryRecorder::Frame* TrajectoryRecorder::BeginFrame( unsigned int nUnits,
+                                                           bool bWait )
+{
+    assert( !m_bFrameOpen );
+    if( NULL == m_pFile )
+    {
+        return NULL;
+    }
+
+    // Dropped frames keep their number, so the file shows the gap
+    unsigned int nHead = m_nHead;
+    while( bWait && nHead - LoadAcquire( &m_nTail ) >= FrameSlots )
+    {
+        SleepMs( gs_nEncodeIntervalMs );
+    }
+    if( nHead - LoadAcquire( &m_nTail ) >= FrameSlots )
+    {
+        ++m_nDroppedFrames;
+        ++m_nFrame;
+        return NULL;
+    }
+
+    m_nBeginUs = FrameStats::GetTimeUs();
+    m_bFrameOpen = true;
+
+    FrameSlot& Slot = m_Slots[ nHead & ( FrameSlots - 1 ) ];
+    Slot.Data.nUnits = nUnits < m_nMaxUnits ? nUnits : m_nMaxUnits;
+    Slot.nFrame = m_nFrame;
+    return &Slot.Data;
+}
+
+void TrajectoryRecorder::EndFrame( void )
+{
+    if( !m_bFrameOpen )
+    {
+        return;
+    }
+
+    m_bFrameOpen = false;
+    ++m_nFrame;
+    ++m_nRecordedFrames;
+    StoreRelease( &m_nHead, m_nHead + 1 );
+
+    m_nCaptureUs += FrameStats::GetTimeUs() - m_nBeginUs;
+}
+
+// Only one thread encodes at a time: the encoder thread while recording,
+// and Stop once it has finished.
+void TrajectoryRecorder::Drain( void )
+{
+    unsigned int nHead = LoadAcquire( &m_nHead );
+    unsigned int nTail = m_nTail;
+
+    for( ; nTail != nHead; ++nTail )
+    {
+        EncodeFrame( m_Slots[ nTail & ( FrameSlots - 1 ) ] );
+
+        // Hand the slot back as soon as it is encoded
+        StoreRelease( &m_nTail, nTail + 1 );
+    }
+}
+
+void TrajectoryRecorder::EncodeFrame( const FrameSlot& Slot )
+{
+    const Frame& Data = Slot.Data;
+
+    // A chunk starts on a keyframe, encoded against zero
+    if( 0 == m_nChunkFrames )
+    {
+        memset( m_pPrevious, 0, gs_nFieldCount * m_nMaxUnits * sizeof( int ) );
+        m_nChunkFirstFrame = Slot.nFrame;
+    }
+
+    size_t nFrameStart = m_Chunk.size();
+    m_Chunk.resize( nFrameStart + sizeof( TrajectoryFrameHeader ) );
+
+    float fRecipStep = 1.0f / m_fPositionStep;
+    unsigned int* pDeltas = &m_Deltas[0];
+    for( unsigned int nField = 0; nField < gs_nFieldCount; ++nField )
+    {
+        int* pPrevious = &m_pPrevious[ nField * m_nMaxUnits ];
+        for( unsigned int i = 0; i < Data.nUnits; ++i )
+        {
+            int nValue;
+            switch( nField )
+            {
+            case 0:  nValue = ( int )floorf( Data.pPositionX[i] * fRecipStep + 0.5f ); break;
+            case 1:  nValue = ( int )floorf( Data.pPositionY[i] * fRecipStep + 0.5f ); break;
+            case 2:  nValue = QuantizeDirection( Data.pDirectionX[i] ); break;
+            case 3:  nValue = QuantizeDirection( Data.pDirectionY[i] ); break;
+            default: nValue = Data.pState[i]; break;
+            }
+
+            pDeltas[i] = ZigZag( nValue - pPrevious[i] );
+            pPrevious[i] = nValue;
+        }
+
+        PutDeltas( m_Chunk, pDeltas, Data.nUnits );
+    }
+
+    TrajectoryFrameHeader FrameHeader;
+    FrameHeader.nFrame = Slot.nFrame;
+    FrameHeader.nUnits = Data.nUnits;
+    FrameHeader.nBytes = ( unsigned int )( m_Chunk.size() - nFrameStart - sizeof( FrameHeader ) );
+    memcpy( &m_Chunk[ nFrameStart ], &FrameHeader, sizeof( FrameHeader ) );
+
+    if( ++m_nChunkFrames == ChunkFrames )
+    {
+        FlushChunk();
+    }
+}
+
+void TrajectoryRecorder::FlushChunk( void )
+{
+    if( 0 == m_nChunkFrames )
+    {
+        return;
+    }
+
+    long long nOffset = FileTell( m_pFile );
+    m_bWriteFailed |= nOffset < 0;
+
+    ChunkEntry Entry;
+    Entry.nFirstFrame = m_nChunkFirstFrame;
+    Entry.nFrames = m_nChunkFrames;
+    Entry.nOffset = ( unsigned long long )nOffset;
+    m_Index.push_back( Entry );
+
+    TrajectoryChunkHeader Header;
+    Header.nMagic = gs_nChunkMagic;
+    Header.nFirstFrame = m_nChunkFirstFrame;
+    Header.nFrames = m_nChunkFrames;
+    Header.nBytes = ( unsigned int )m_Chunk.size();
+
+    m_bWriteFailed |= fwrite( &Header, sizeof( Header ), 1, m_pFile ) != 1;
+    m_bWriteFailed |= fwrite( &m_Chunk[0], m_Chunk.size(), 1, m_pFile ) != 1;
+    StoreRelease( &m_nBytesWritten, m_nBytesWritten + sizeof( Header ) + m_Chunk.size() );
+
+    m_Chunk.clear();
+    m_nChunkFrames = 0;
+}
+
+#ifdef _WIN32
+unsigned long __stdcall TrajectoryRecorder::EncoderThread( void* pArg )
+#else
+void* TrajectoryRecorder::EncoderThread( void* pArg )
+#endif
+{
+    TrajectoryRecorder* pRecorder = ( TrajectoryRecorder* )pArg;
+
+    while( !LoadAcquire( &pRecorder->m_bStopEncoder ) )
+    {
+        pRecorder->Drain();
+        SleepMs( gs_nEncodeIntervalMs );
+    }
+
+    return 0;
+}
+
+TrajectoryReader::TrajectoryReader( void )
+    : m_pFile( NULL )
+    , m_nMaxUnits( 0 )
+    , m_fPositionStep( 1.0f )
+    , m_nChunkPos( 0 )
+    , m_nChunk( 0 )
+    , m_nChunkFrame( 0 )
+{
+}
+
+TrajectoryReader::~TrajectoryReader( void )
+{
+    Close();
+}
+
+bool TrajectoryReader::Open( const char* szFileName )
+{
+    Close();
+
+    m_pFile = fopen( szFileName, "rb" );
+    if( NULL == m_pFile )
+    {
+        return false;
+    }
+
+    TrajectoryHeader Header;
+    TrajectoryFooter Footer;
+    bool bOk = fread( &Header, sizeof( Header ), 1, m_pFile ) == 1 &&
+               0 == memcmp( Header.szMagic, gs_szTrajectoryMagic, sizeof( Header.szMagic ) ) &&
+               gs_nTrajectoryVersion == Header.nVersion &&
+               Header.nMaxUnits > 0 &&
+               Header.fPositionStep > 0.0f &&
+               FileSeek( m_pFile, -( long long )sizeof( Footer ), SEEK_END ) &&
+               fread( &Footer, sizeof( Footer ), 1, m_pFile ) == 1 &&
+               gs_nIndexMagic == Footer.nMagic &&
+               FileSeek( m_pFile, ( long long )Footer.nIndexOffset, SEEK_SET );
+
+    for( unsigned int i = 0; bOk && i < Footer.nChunks; ++i )
+    {
+        TrajectoryIndexEntry Entry;
+        bOk = fread( &Entry, sizeof( Entry ), 1, m_pFile ) == 1 && Entry.nFrames > 0;
+        if( bOk )
+        {
+            ChunkEntry Chunk;
+            Chunk.nFirstFrame = Entry.nFirstFrame;
+            Chunk.nFrames = Entry.nFrames;
+            Chunk.nOffset = Entry.nOffset;
+            m_Index.push_back( Chunk );
+        }
+    }
+
+    if( !bOk )
+    {
+        Close();
+        return false;
+    }
+
+    m_nMaxUnits = Header.nMaxUnits;
+    m_fPositionStep = Header.fPositionStep;
+    m_Previous.resize( gs_nFieldCount * m_nMaxUnits );
+    m_Deltas.resize( m_nMaxUnits );
+    m_Fields.resize( 4 * m_nMaxUnits );
+    m_State.resize( m_nMaxUnits );
+
+    // Past the end until the first chunk loads
+    m_nChunk = ( unsigned int )m_Index.size();
+    return m_Index.empty() || LoadChunk( 0 );
+}
+
+void TrajectoryReader::Close( void )
+{
+    if( NULL != m_pFile )
+    {
+        fclose( m_pFile );
+        m_pFile = NULL;
+    }
+
+    m_Index.clear();
+    m_Chunk.clear();
+    m_nChunkPos = 0;
+    m_nChunk = 0;
+    m_nChunkFrame = 0;
+}
+
+unsigned int TrajectoryReader::GetFrameCount( void ) const
+{
+    unsigned int nFrames = 0;
+    for( size_t i = 0; i < m_Index.size(); ++i )
+    {
+        nFrames += m_Index[i].nFrames;
+    }
+    return nFrames;
+}
+
+bool TrajectoryReader::LoadChunk( unsigned int nChunk )
+{
+    TrajectoryChunkHeader Header;
+    if( !FileSeek( m_pFile, ( long long )m_Index[ nChunk ].nOffset, SEEK_SET ) ||
+        fread( &Header, sizeof( Header ), 1, m_pFile ) != 1 ||
+        gs_nChunkMagic != Header.nMagic ||
+        Header.nFrames != m_Index[ nChunk ].nFrames )
+    {
+        return false;
+    }
+
+    m_Chunk.resize( Header.nBytes );
+    if( Header.nBytes > 0 && fread( &m_Chunk[0], Header.nBytes, 1, m_pFile ) != 1 )
+    {
+        return false;
+    }
+
+    m_nChunk = nChunk;
+    m_nChunkPos = 0;
+    m_nChunkFrame = 0;
+    memset( &m_Previous[0], 0, m_Previous.size() * sizeof( int ) );
+    return true;
+}
+
+bool TrajectoryReader::Seek( unsigned int nFrame )
+{
+    if( m_Index.empty() )
+    {
+        return false;
+    }
+
+    // The last chunk that starts at or before the frame
+    unsigned int nChunk = 0;
+    while( nChunk + 1 < m_Index.size() && m_Index[ nChunk + 1 ].nFirstFrame <= nFrame )
+    {
+        ++nChunk;
+    }
+    if( !LoadChunk( nChunk ) )
+    {
+        return false;
+    }
+
+    // Decode up to the frame; a dropped frame leaves the reader on the next
+    while( m_nChunkFrame < m_Index[ m_nChunk ].nFrames &&
+           m_nChunkPos + sizeof( TrajectoryFrameHeader ) <= m_Chunk.size() )
+    {
+        TrajectoryFrameHeader FrameHeader;
+        memcpy( &FrameHeader, &m_Chunk[ m_nChunkPos ], sizeof( FrameHeader ) );
+        if( FrameHeader.nFrame >= nFrame )
+        {
+            break;
+        }
+
+        TrajectoryRecorder::Frame Data;
+        unsigned int nDecoded;
+        if( !DecodeFrame( Data, nDecoded ) )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TrajectoryReader::ReadFrame( TrajectoryRecorder::Frame& Data,
+                                  unsigned int& nFrame )
+{
+    if( m_nChunk >= m_Index.size() )
+    {
+        return false;
+    }
+
+    if( m_nChunkFrame == m_Index[ m_nChunk ].nFrames )
+    {
+        if( m_nChunk + 1 >= m_Index.size() || !LoadChunk( m_nChunk + 1 ) )
+        {
+            return false;
+        }
+    }
+
+    return DecodeFrame( Data, nFrame );
+}
+
+bool TrajectoryReader::DecodeFrame( TrajectoryRecorder::Frame& Data,
+                                    unsigned int& nFrame )
+{
+    TrajectoryFrameHeader FrameHeader;
+    if( m_nChunkPos + sizeof( FrameHeader ) > m_Chunk.size() )
+    {
+        return false;
+    }
+    memcpy( &FrameHeader, &m_Chunk[ m_nChunkPos ], sizeof( FrameHeader ) );
+
+    const unsigned char* p = &m_Chunk[0] + m_nChunkPos + sizeof( FrameHeader );
+    const unsigned char* pEnd = p + FrameHeader.nBytes;
+    if( FrameHeader.nUnits > m_nMaxUnits ||
+        FrameHeader.nBytes > m_Chunk.size() - m_nChunkPos - sizeof( FrameHeader ) )
+    {
+        return false;
+    }
+
+    unsigned int nUnits = FrameHeader.nUnits;
+    Data.nUnits = nUnits;
+    Data.pPositionX = &m_Fields[0];
+    Data.pPositionY = &m_Fields[ m_nMaxUnits ];
+    Data.pDirectionX = &m_Fields[ 2 * m_nMaxUnits ];
+    Data.pDirectionY = &m_Fields[ 3 * m_nMaxUnits ];
+    Data.pState = &m_State[0];
+
+    unsigned int* pDeltas = &m_Deltas[0];
+    for( unsigned int nField = 0; nField < gs_nFieldCount; ++nField )
+    {
+        if( nUnits > 0 && !GetDeltas( p, pEnd, pDeltas, nUnits ) )
+        {
+            return false;
+        }
+
+        int* pPrevious = &m_Previous[ nField * m_nMaxUnits ];
+        for( unsigned int i = 0; i < nUnits; ++i )
+        {
+            pPrevious[i] += UnZigZag( pDeltas[i] );
+        }
+
+        if( nField < 2 )
+        {
+            float* pOut = &m_Fields[ nField * m_nMaxUnits ];
+            for( unsigned int i = 0; i < nUnits; ++i )
+            {
+                pOut[i] = pPrevious[i] * m_fPositionStep;
+            }
+        }
+        else if( nField < 4 )
+        {
+            float* pOut = &m_Fields[ nField * m_nMaxUnits ];
+            for( unsigned int i = 0; i < nUnits; ++i )
+            {
+                pOut[i] = pPrevious[i] / gs_fDirectionScale;
+            }
+        }
+        else
+        {
+            for( unsigned int i = 0; i < nUnits; ++i )
+            {
+                m_State[i] = ( unsigned char )pPrevious[i];
+            }
+        }
+    }
+
+    m_nChunkPos += sizeof( FrameHeader ) + FrameHeader.nBytes;
+    ++m_nChunkFrame;
+    nFrame = FrameHeader.nFrame;
+    return true;
+}
@@ -0,0 +1,247 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+//---------------------------------------------------------------------------------------
+
+#ifndef __TRAJECTORYRECORDER_H
+#define __TRAJECTORYRECORDER_H
+
+#include "AtomicOps.h"
+#include <stdio.h>
+#include <vector>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+// TrajectoryRecorder streams every unit's position, direction and state to
+// a file each frame, for offline analysis of how units move.
+//
+// The main thread only copies the frame: BeginFrame hands out one of two
+// frame buffers, the app fills its arrays, and EndFrame passes it to a
+// background thread.  A frame that finds both buffers still queued is
+// dropped and counted.  The encoder quantizes positions to a fixed step
+// and directions to 16 bits, takes each value's difference from the same
+// unit in the previous frame, and writes the differences as zigzag
+// varints with runs of zeros collapsed, one field after another.  Units
+// that move in a straight line at a steady speed cost a byte or two per
+// field.
+//
+// Frames are grouped in chunks of ChunkFrames.  The first frame of a chunk
+// is a keyframe, encoded against zero, so decoding can start at any chunk.
+// Stop writes an index of the chunks' file offsets after the last chunk.
+// TrajectoryReader reads the files back.
+//
+// All calls belong to one thread, the main thread in Colony.  Like
+// gTaskMgr, the app uses the gTrajectoryRecorder instance.
+class TrajectoryRecorder
+{
+public:
+    // A frame of units, one array per field
+    struct Frame
+    {
+        unsigned int nUnits;
+        float* pPositionX;
+        float* pPositionY;
+        float* pDirectionX;             // -1 to 1
+        float* pDirectionY;
+        unsigned char* pState;
+    };
+
+    TrajectoryRecorder( void );
+    ~TrajectoryRecorder( void );
+
+    // Begin recording up to nMaxUnits units a frame, with positions kept to
+    // multiples of fPositionStep.  Fails if already recording or the file
+    // cannot be created.
+    bool Start( const char* szFileName,
+                unsigned int nMaxUnits,
+                float fPositionStep );
+
+    // Encode the frames still queued, write the index and close the file.
+    //   False if any write failed.
+    bool Stop( void );
+
+    bool IsRecording( void ) const
+    {
+        return NULL != m_pFile;
+    }
+
+    // A buffer for nUnits units, or NULL if the frame is dropped.  The
+    // arrays stay the app's until EndFrame.  With bWait it waits for the
+    // encoder rather than drop the frame, for offline runs that must record
+    // every frame.
+    Frame* BeginFrame( unsigned int nUnits,
+                       bool bWait = false );
+    void EndFrame( void );
+
+    // Frames dropped on full buffers since Start
+    unsigned int GetDroppedFrames( void ) const
+    {
+        return m_nDroppedFrames;
+    }
+
+    // Frames recorded, and the main thread time they took from BeginFrame
+    // to EndFrame, since Start
+    unsigned int GetRecordedFrames( void ) const
+    {
+        return m_nRecordedFrames;
+    }
+    unsigned long long GetCaptureTimeUs( void ) const
+    {
+        return m_nCaptureUs;
+    }
+
+    // File bytes written by the encoder so far
+    unsigned long long GetBytesWritten( void ) const
+    {
+        return LoadAcquire( &m_nBytesWritten );
+    }
+
+    // Frames per chunk; the first of each is a keyframe
+    static const unsigned int ChunkFrames = 32;
+
+    // Frames queued for the encoder, a power of two
+    static const unsigned int FrameSlots = 2;
+
+private:
+    struct FrameSlot
+    {
+        Frame Data;
+        unsigned int nFrame;
+    };
+
+    struct ChunkEntry
+    {
+        unsigned int nFirstFrame;
+        unsigned int nFrames;
+        unsigned long long nOffset;
+    };
+
+    TrajectoryRecorder( const TrajectoryRecorder& );
+    TrajectoryRecorder& operator=( const TrajectoryRecorder& );
+
+    void FreeBuffers( void );
+    void Drain( void );
+    void EncodeFrame( const FrameSlot& Slot );
+    void FlushChunk( void );
+
+#ifdef _WIN32
+    static unsigned long __stdcall EncoderThread( void* pArg );
+#else
+    static void* EncoderThread( void* pArg );
+#endif
+
+    FILE* m_pFile;
+    unsigned int m_nMaxUnits;
+    float m_fPositionStep;
+
+    FrameSlot m_Slots[ FrameSlots ];
+    unsigned long long m_nBeginUs;
+    bool m_bFrameOpen;
+    unsigned int m_nFrame;
+    unsigned int m_nDroppedFrames;
+    unsigned int m_nRecordedFrames;
+    unsigned long long m_nCaptureUs;
+
+    // The main thread writes the head, the encoder thread the tail
+    volatile unsigned int m_nHead;
+    char HeadPadding[ 64 - sizeof( unsigned int ) ];
+    volatile unsigned int m_nTail;
+    char TailPadding[ 64 - sizeof( unsigned int ) ];
+
+    // Encoder state: the previous frame, quantized, and the chunk being built
+    int* m_pPrevious;
+    std::vector<unsigned int> m_Deltas;
+    std::vector<unsigned char> m_Chunk;
+    std::vector<ChunkEntry> m_Index;
+    unsigned int m_nChunkFirstFrame;
+    unsigned int m_nChunkFrames;
+    volatile unsigned long long m_nBytesWritten;
+    bool m_bWriteFailed;
+
+    volatile long m_bStopEncoder;
+#ifdef _WIN32
+    void* m_hEncoderThread;
+#else
+    pthread_t m_EncoderThread;
+#endif
+};
+
+extern TrajectoryRecorder gTrajectoryRecorder;
+
+// Reads a file TrajectoryRecorder wrote, a frame at a time.
+class TrajectoryReader
+{
+public:
+    TrajectoryReader( void );
+    ~TrajectoryReader( void );
+
+    // Opens the file and reads its index.  Fails on a file Stop did not
+    // finish.
+    bool Open( const char* szFileName );
+    void Close( void );
+
+    unsigned int GetMaxUnits( void ) const
+    {
+        return m_nMaxUnits;
+    }
+
+    // Frames in the file.  Frames are numbered from Start, dropped ones
+    // included, so the last frame's number can be higher.
+    unsigned int GetFrameCount( void ) const;
+
+    // Position the reader so the next ReadFrame returns nFrame, or the
+    // frame after it if it was dropped.  Decoding starts at the keyframe of
+    // nFrame's chunk.
+    bool Seek( unsigned int nFrame );
+
+    // Decode the next frame into the reader's arrays, valid until the next
+    // call.  False at the end of the file or on a damaged frame.
+    bool ReadFrame( TrajectoryRecorder::Frame& Data,
+                    unsigned int& nFrame );
+
+private:
+    struct ChunkEntry
+    {
+        unsigned int nFirstFrame;
+        unsigned int nFrames;
+        unsigned long long nOffset;
+    };
+
+    TrajectoryReader( const TrajectoryReader& );
+    TrajectoryReader& operator=( const TrajectoryReader& );
+
+    bool LoadChunk( unsigned int nChunk );
+    bool DecodeFrame( TrajectoryRecorder::Frame& Data,
+                      unsigned int& nFrame );
+
+    FILE* m_pFile;
+    unsigned int m_nMaxUnits;
+    float m_fPositionStep;
+    std::vector<ChunkEntry> m_Index;
+
+    std::vector<unsigned char> m_Chunk;
+    size_t m_nChunkPos;
+    unsigned int m_nChunk;
+    unsigned int m_nChunkFrame;
+
+    std::vector<int> m_Previous;
+    std::vector<unsigned int> m_Deltas;
+    std::vector<float> m_Fields;
+    std::vector<unsigned char> m_State;
+};
+
+#endif // __TRAJECTORYRECORDER_H